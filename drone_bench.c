@@ -0,0 +1,443 @@
+// Microbenchmarks de Drone Wars 2: mide las primitivas calientes del motor con carga
+// controlada sobre una flota de verdad (creada como en una misión) y muestra percentiles
+// por muestra en una tabla y, con --json, en un archivo para comparar versiones.
+// El motor se compila aquí entero, sin su main.
+#define DRONE_WARS2_LIBRARY
+#include "drone_wars2.c"
+
+#define BENCH_SAMPLES 200 // Muestras por medición (por defecto)
+#define BENCH_DRONES 10000 // Flota de las mediciones por drone (por defecto)
+#define BENCH_MAX_RESULTS 64
+#define BENCH_MAX_PRODUCERS 64
+#define BENCH_EVENTS_PER_PRODUCER 4096 // Eventos de cada productor por muestra
+#define BENCH_LOG_LINES 1024 // Líneas de log por muestra
+#define BENCH_DRAW_CALLS 4096 // Sorteos sueltos por muestra
+
+// Resultado de una medición: percentiles del costo por operación entre las muestras
+typedef struct {
+    char name[32];
+    char param[32];
+    int samples;
+    long ops; // Operaciones por muestra
+    double p50, p90, p99, max, mean; // ns por operación
+    double ops_per_sec;
+} BenchResult;
+
+// Opciones y resultados de la corrida
+typedef struct {
+    int samples;
+    int drones;
+    int producers; // Máximo de productores de eventos (0 = uno por núcleo)
+    const char* only; // Prefijo de las mediciones a correr (NULL = todas)
+    const char* json_path;
+    BenchResult results[BENCH_MAX_RESULTS];
+    int result_count;
+    double* sample_ns; // Costo por operación de cada muestra
+    Position* saved_positions; // Posiciones de la flota al crearla (se reponen antes de cada muestra)
+} BenchSuite;
+
+// Productores de eventos: esperan la largada, mandan sus eventos y avisan
+typedef struct {
+    pthread_barrier_t start;
+    atomic_int done;
+    atomic_int stop;
+    int producers; // Productores que mandan en la muestra actual
+    pthread_t threads[BENCH_MAX_PRODUCERS];
+} BenchProducers;
+
+BenchSuite bench = {.samples = BENCH_SAMPLES, .drones = BENCH_DRONES};
+BenchProducers producers;
+volatile double bench_sink; // Evita que el compilador descarte lo medido
+
+// Función para mostrar el uso
+void print_usage(const char* program) {
+    fprintf(stderr,
+            "Uso: %s [opciones] [config.txt]\n"
+            "  --samples N      muestras por medición (por defecto %d)\n"
+            "  --drones N       drones de la flota (por defecto %d)\n"
+            "  --producers N    máximo de productores de eventos (por defecto uno por núcleo)\n"
+            "  --only nombre    solo las mediciones cuyo nombre empieza así\n"
+            "  --json archivo   resultados en JSON\n",
+            program, BENCH_SAMPLES, BENCH_DRONES);
+}
+
+// Función para saber si una medición está seleccionada
+int bench_selected(const char* name) {
+    return !bench.only || strncmp(name, bench.only, strlen(bench.only)) == 0;
+}
+
+int bench_compare_double(const void* a, const void* b) {
+    double left = *(const double*)a, right = *(const double*)b;
+    return left < right ? -1 : left > right;
+}
+
+// Función para guardar una medición a partir del costo por operación de sus muestras
+BenchResult* bench_record(const char* name, const char* param, int samples, long ops) {
+    if (bench.result_count == BENCH_MAX_RESULTS) {
+        return NULL;
+    }
+    BenchResult* result = &bench.results[bench.result_count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    snprintf(result->param, sizeof(result->param), "%s", param);
+    result->samples = samples;
+    result->ops = ops;
+
+    double* values = bench.sample_ns;
+    qsort(values, samples, sizeof(double), bench_compare_double);
+    double sum = 0.0;
+    for (int i = 0; i < samples; i++) {
+        sum += values[i];
+    }
+    result->p50 = values[(int)(0.50 * (samples - 1))];
+    result->p90 = values[(int)(0.90 * (samples - 1))];
+    result->p99 = values[(int)(0.99 * (samples - 1))];
+    result->max = values[samples - 1];
+    result->mean = sum / samples;
+    result->ops_per_sec = result->mean > 0 ? 1e9 / result->mean : 0.0;
+    return result;
+}
+
+// Función para devolver la flota a donde estaba al crearla
+void bench_reset_positions() {
+    for (int id = 0; id < system_state.drone_count; id++) {
+        drone_set_position(&system_state.drones[id], bench.saved_positions[id]);
+    }
+}
+
+// Función para medir calculate_distance sobre las posiciones de la flota
+void bench_distance() {
+    int n = system_state.drone_count;
+    for (int s = -1; s < bench.samples; s++) {
+        Position target = system_state.targets[(s + 1) % system_state.target_count].pos;
+        uint64_t start = monotonic_ns();
+        double sum = 0.0;
+        for (int id = 0; id < n; id++) {
+            sum += calculate_distance(drone_position(&system_state.drones[id]), target);
+        }
+        uint64_t elapsed = monotonic_ns() - start;
+        bench_sink = sum;
+        if (s >= 0) bench.sample_ns[s] = (double)elapsed / n;
+    }
+    bench_record("calculate_distance", "flota", bench.samples, n);
+}
+
+// Función para medir move_drone_towards (un drone a la vez) y el kernel de cinemática
+// activo (la flota entera), con la flota volando hacia el objetivo más lejano
+void bench_move() {
+    int n = system_state.drone_count;
+    Position far = {system_state.map_width * 4, system_state.map_height * 4};
+    for (int s = -1; s < bench.samples; s++) {
+        bench_reset_positions();
+        uint64_t start = monotonic_ns();
+        for (int id = 0; id < n; id++) {
+            move_drone_towards(&system_state.drones[id], far);
+        }
+        uint64_t elapsed = monotonic_ns() - start;
+        if (s >= 0) bench.sample_ns[s] = (double)elapsed / n;
+    }
+    bench_record("move_drone_towards", "flota", bench.samples, n);
+
+    DroneStore* store = &system_state.store;
+    for (int id = 0; id < n; id++) {
+        drone_set_target(&system_state.drones[id], far);
+    }
+    for (int s = -1; s < bench.samples; s++) {
+        bench_reset_positions();
+        uint64_t start = monotonic_ns();
+        kinematics_kernel(store, 0, n, system_state.speed);
+        uint64_t elapsed = monotonic_ns() - start;
+        if (s >= 0) bench.sample_ns[s] = (double)elapsed / n;
+    }
+    bench_record("kinematics", kinematics_kernel_name, bench.samples, n);
+    bench_reset_positions();
+}
+
+// Función para medir los sorteos: uno suelto (rng_uniform, lo que era check_probability)
+// y los de un tick para toda la flota (kernel de sorteos activo)
+void bench_draws() {
+    for (int s = -1; s < bench.samples; s++) {
+        uint32_t sum = 0;
+        uint64_t start = monotonic_ns();
+        for (int i = 0; i < BENCH_DRAW_CALLS; i++) {
+            sum += rng_uniform(RNG_STREAM_TICK, (uint32_t)i, 100);
+        }
+        uint64_t elapsed = monotonic_ns() - start;
+        bench_sink = sum;
+        if (s >= 0) bench.sample_ns[s] = (double)elapsed / BENCH_DRAW_CALLS;
+    }
+    bench_record("rng_uniform", "1 sorteo", bench.samples, BENCH_DRAW_CALLS);
+
+    int n = system_state.drone_count;
+    for (int s = -1; s < bench.samples; s++) {
+        uint64_t start = monotonic_ns();
+        draws_kernel(&system_state.store, 0, n, s + 1);
+        uint64_t elapsed = monotonic_ns() - start;
+        if (s >= 0) bench.sample_ns[s] = (double)elapsed / n;
+    }
+    bench_record("draws", kinematics_kernel_name, bench.samples, n);
+}
+
+// Función para medir un paso de patrulla circular por drone
+void bench_fly_in_circles() {
+    int n = system_state.drone_count;
+    for (int s = -1; s < bench.samples; s++) {
+        uint64_t start = monotonic_ns();
+        for (int id = 0; id < n; id++) {
+            fly_in_circles(&system_state.drones[id]);
+        }
+        uint64_t elapsed = monotonic_ns() - start;
+        if (s >= 0) bench.sample_ns[s] = (double)elapsed / n;
+    }
+    bench_record("fly_in_circles", "flota", bench.samples, n);
+    bench_reset_positions();
+}
+
+// Hilo productor de eventos: en cada largada manda sus eventos si le toca
+void* bench_producer_thread(void* arg) {
+    int index = (int)(intptr_t)arg;
+    while (1) {
+        pthread_barrier_wait(&producers.start);
+        if (atomic_load(&producers.stop)) {
+            return NULL;
+        }
+        if (index < producers.producers) {
+            int drone_id = index % system_state.drone_count;
+            for (int i = 0; i < BENCH_EVENTS_PER_PRODUCER; i++) {
+                send_event(EVT_READY, drone_id, system_state.drones[drone_id].swarm_id, index, "BENCH");
+            }
+            atomic_fetch_add(&producers.done, 1);
+        }
+    }
+}
+
+// Función para medir send_event + process_events con 1..N productores: cada muestra va
+// de la largada hasta que el centro vació la cola (el log está filtrado: mide la cola)
+void bench_events() {
+    int max = bench.producers;
+    if (max <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        max = cores > 1 ? (int)cores - 1 : 1; // Un núcleo para el centro
+    }
+    if (max > BENCH_MAX_PRODUCERS) max = BENCH_MAX_PRODUCERS;
+
+    pthread_barrier_init(&producers.start, NULL, max + 1);
+    for (int p = 0; p < max; p++) {
+        pthread_create(&producers.threads[p], NULL, bench_producer_thread, (void*)(intptr_t)p);
+    }
+
+    int count = 1;
+    while (1) {
+        producers.producers = count;
+        long total = (long)count * BENCH_EVENTS_PER_PRODUCER;
+        for (int s = -1; s < bench.samples; s++) {
+            atomic_store(&producers.done, 0);
+            uint64_t start = monotonic_ns();
+            pthread_barrier_wait(&producers.start);
+            while (atomic_load(&producers.done) < count) {
+                process_events();
+            }
+            process_events();
+            uint64_t elapsed = monotonic_ns() - start;
+            if (s >= 0) bench.sample_ns[s] = (double)elapsed / total;
+        }
+        char param[32];
+        snprintf(param, sizeof(param), "%d productores", count);
+        bench_record("events", param, bench.samples, total);
+        if (count == max) break;
+        count = count * 2 < max ? count * 2 : max;
+    }
+
+    atomic_store(&producers.stop, 1);
+    pthread_barrier_wait(&producers.start);
+    for (int p = 0; p < max; p++) {
+        pthread_join(producers.threads[p], NULL);
+    }
+    pthread_barrier_destroy(&producers.start);
+}
+
+// Función para medir log_message con la salida a /dev/null. Los percentiles son el costo
+// para quien escribe; las líneas por segundo incluyen vaciar todo al final.
+void bench_log() {
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd == -1) {
+        return;
+    }
+    fflush(stdout);
+    int saved_fd = dup(STDOUT_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    int level = logger.level;
+    logger.level = LOG_INFO;
+    logger.drop_when_full = 0;
+    start_logger();
+    uint64_t begin = monotonic_ns();
+    for (int s = -1; s < bench.samples; s++) {
+        uint64_t start = monotonic_ns();
+        for (int i = 0; i < BENCH_LOG_LINES; i++) {
+            log_message("Drone %d en (%d,%d) con %d de combustible", i, s, i, s + i);
+        }
+        uint64_t elapsed = monotonic_ns() - start;
+        if (s >= 0) bench.sample_ns[s] = (double)elapsed / BENCH_LOG_LINES;
+    }
+    stop_logger();
+    uint64_t total = monotonic_ns() - begin;
+    logger.level = level;
+
+    fflush(stdout);
+    dup2(saved_fd, STDOUT_FILENO);
+    close(saved_fd);
+
+    BenchResult* result = bench_record("log_message", "a /dev/null", bench.samples, BENCH_LOG_LINES);
+    if (result) {
+        result->ops_per_sec = (double)(bench.samples + 1) * BENCH_LOG_LINES / (total / 1e9);
+    }
+}
+
+// Función para medir el re-ensamblaje: emparejar "units" drones sobrantes con otros tantos
+// huecos repartidos por el mapa (óptimo hasta REASSEMBLY_OPTIMAL_MAX, voraz por encima)
+void bench_reassembly(int units) {
+    ReassemblyUnit* supply = malloc(sizeof(ReassemblyUnit) * units);
+    ReassemblyUnit* demand = malloc(sizeof(ReassemblyUnit) * units);
+    int* match = malloc(sizeof(int) * units);
+    for (int i = 0; i < units; i++) {
+        supply[i] = (ReassemblyUnit){i, i, {(int)rng_uniform(RNG_STREAM_BATCH, 4 * i, system_state.map_width),
+                                            (int)rng_uniform(RNG_STREAM_BATCH, 4 * i + 1, system_state.map_height)}};
+        demand[i] = (ReassemblyUnit){i, -1, {(int)rng_uniform(RNG_STREAM_BATCH, 4 * i + 2, system_state.map_width),
+                                             (int)rng_uniform(RNG_STREAM_BATCH, 4 * i + 3, system_state.map_height)}};
+    }
+
+    // La asignación óptima es cúbica: menos muestras cuanto más grande
+    int samples = bench.samples;
+    if (units > 64 && samples > 20) samples = 20;
+    int optimal = 0;
+    for (int s = -1; s < samples; s++) {
+        uint64_t start = monotonic_ns();
+        optimal = reassembly_match(supply, units, demand, units, match);
+        uint64_t elapsed = monotonic_ns() - start;
+        if (s >= 0) bench.sample_ns[s] = (double)elapsed;
+    }
+    char param[32];
+    snprintf(param, sizeof(param), "%d x %d %s", units, units, optimal ? "exacto" : "voraz");
+    bench_record("reassembly_match", param, samples, 1);
+    free(supply);
+    free(demand);
+    free(match);
+}
+
+// Función para mostrar la tabla de resultados
+void bench_print() {
+    printf("\nmedición             parámetro        muestras     p50 ns     p90 ns     p99 ns     máx ns          ops/s\n");
+    for (int i = 0; i < bench.result_count; i++) {
+        const BenchResult* r = &bench.results[i];
+        printf("%-20s %-16s %8d %10.1f %10.1f %10.1f %10.1f %14.0f\n",
+               r->name, r->param, r->samples, r->p50, r->p90, r->p99, r->max, r->ops_per_sec);
+    }
+}
+
+// Función para escribir los resultados en JSON (uno por medición, en ns por operación)
+int bench_write_json(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    fprintf(file, "{\n  \"version\": 1,\n  \"kernel\": \"%s\",\n  \"cpus\": %ld,\n  \"drones\": %d,\n"
+                  "  \"seed\": %llu,\n  \"results\": [\n",
+            kinematics_kernel_name, sysconf(_SC_NPROCESSORS_ONLN), system_state.drone_count,
+            (unsigned long long)system_state.seed);
+    for (int i = 0; i < bench.result_count; i++) {
+        const BenchResult* r = &bench.results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"param\": \"%s\", \"samples\": %d, \"ops_per_sample\": %ld, "
+                      "\"p50_ns\": %.2f, \"p90_ns\": %.2f, \"p99_ns\": %.2f, \"max_ns\": %.2f, "
+                      "\"mean_ns\": %.2f, \"ops_per_sec\": %.0f}%s\n",
+                r->name, r->param, r->samples, r->ops, r->p50, r->p90, r->p99, r->max, r->mean,
+                r->ops_per_sec, i + 1 < bench.result_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+int main(int argc, char* argv[]) {
+    const char* config_path = "config.txt";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            bench.samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--drones") == 0 && i + 1 < argc) {
+            bench.drones = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--producers") == 0 && i + 1 < argc) {
+            bench.producers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            bench.only = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            bench.json_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            config_path = argv[i];
+        }
+    }
+    if (bench.samples < 1 || bench.drones < 1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // La flota sale de config.txt (velocidad, probabilidades, mapa) con la cantidad de
+    // enjambres que pide --drones; sin canal, traza ni intérprete, y solo con avisos en el log
+    system_state.start_time = time(NULL);
+    logger.level = LOG_WARN;
+    logger.hide_phases = 1;
+    load_configuration(config_path);
+    int per_swarm = system_state.attack_per_swarm + system_state.camera_per_swarm;
+    system_state.swarms_requested = (bench.drones + per_swarm - 1) / per_swarm;
+    system_state.seed = 1;
+    system_state.seed_set = 1;
+    system_state.virtual_time = 1;
+    trace.path[0] = '\0';
+    scenario.path[0] = '\0';
+    checkpoint.path[0] = '\0';
+    checkpoint.restore_path[0] = '\0';
+    replay.path[0] = '\0';
+    channel.mode = CHANNEL_NONE;
+    select_kinematics_kernel();
+    initialize_system();
+    create_swarms();
+
+    bench.sample_ns = malloc(sizeof(double) * bench.samples);
+    bench.saved_positions = malloc(sizeof(Position) * system_state.drone_count);
+    for (int id = 0; id < system_state.drone_count; id++) {
+        bench.saved_positions[id] = drone_position(&system_state.drones[id]);
+    }
+    printf("Drone Wars 2 bench: %d drones en %d enjambres, kernel %s, %ld núcleos, %d muestras\n",
+           system_state.drone_count, system_state.swarm_count, kinematics_kernel_name,
+           sysconf(_SC_NPROCESSORS_ONLN), bench.samples);
+
+    if (bench_selected("calculate_distance")) bench_distance();
+    if (bench_selected("move_drone_towards") || bench_selected("kinematics")) bench_move();
+    if (bench_selected("rng_uniform") || bench_selected("draws")) bench_draws();
+    if (bench_selected("fly_in_circles")) bench_fly_in_circles();
+    if (bench_selected("events")) bench_events();
+    if (bench_selected("log_message")) bench_log();
+    if (bench_selected("reassembly_match")) {
+        const int units[] = {16, 64, 256, REASSEMBLY_OPTIMAL_MAX, 4 * REASSEMBLY_OPTIMAL_MAX};
+        for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+            bench_reassembly(units[i]);
+        }
+    }
+
+    bench_print();
+    int status = EXIT_SUCCESS;
+    if (bench.json_path) {
+        if (bench_write_json(bench.json_path) == 0) {
+            printf("Resultados en %s\n", bench.json_path);
+        } else {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    cleanup_system();
+    free(bench.sample_ns);
+    free(bench.saved_positions);
+    return status;
+}
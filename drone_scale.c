@@ -0,0 +1,338 @@
+// Banco de escala de Drone Wars 2: arma escenarios sintéticos a partir de la disposición
+// de initialize_system (camiones, objetivos, enjambres y defensas multiplicados por un
+// mismo factor, con el lado del mapa multiplicado por su raíz para que la densidad no
+// cambie) y corre cada uno completo, sin salida y en tiempo virtual, en un proceso propio. Informa ticks por segundo, percentiles de la duración de
+// un tick, hilos, memoria máxima, cambios de contexto y descartes de eventos, como tabla
+// y como CSV para graficar las curvas de escala.
+// El motor se compila aquí entero, sin su main.
+#define DRONE_WARS2_LIBRARY
+#include "drone_wars2.c"
+
+#include <sys/resource.h>
+
+#define SCALE_MAX_SIZES 32
+#define SCALE_MAX_TICKS (1 << 20) // Ticks anotados por misión
+#define SCALE_POLL_MS 5 // Cada cuánto se cuentan los hilos del hijo
+
+// Disposición de initialize_system que se multiplica (por factor de escala)
+#define SCALE_BASE_TRUCKS 3
+#define SCALE_BASE_TARGETS 3
+#define SCALE_BASE_SWARMS 3
+#define SCALE_BASE_DEFENSES 2
+
+// Resultado de un escenario: la primera parte la llena el hijo (en memoria compartida),
+// el resto el padre al esperarlo
+typedef struct {
+    int factor;
+    int map_side; // Lado del mapa (MAP_WIDTH * raíz del factor, hasta SCENARIO_MAX_MAP)
+    int fuel; // Combustible inicial, escalado como el lado del mapa
+    int trucks, targets, swarms, defenses;
+    int drones;
+    int workers;
+    int completed; // 1 = el hijo terminó la misión y anotó sus números
+    long ticks;
+    double mission_s; // Tiempo de pared del centro de comando
+    double tick_p50_us, tick_p99_us, tick_max_us, tick_mean_us;
+    long ticks_over_budget; // Ticks más largos que TICK_MS (en tiempo real se atrasaría)
+    unsigned long events_enqueued;
+    unsigned long events_dropped;
+    unsigned long log_dropped;
+
+    int threads; // Máximo visto en /proc/<pid>/status
+    long peak_rss_kb;
+    long voluntary_switches;
+    long involuntary_switches;
+    double cpu_s; // Usuario + sistema
+    int exit_status;
+} ScaleResult;
+
+// Opciones de la corrida
+typedef struct {
+    const char* config_path;
+    const char* csv_path;
+    int sizes[SCALE_MAX_SIZES]; // Drones pedidos por escenario
+    int size_count;
+    int workers; // -1 = los de config.txt
+    uint64_t seed;
+} ScaleOptions;
+
+ScaleOptions scale = {.config_path = "config.txt", .workers = -1, .seed = 1};
+
+// Función para mostrar el uso
+void print_usage(const char* program) {
+    fprintf(stderr,
+            "Uso: %s [opciones] [config.txt]\n"
+            "  --sizes N,N,...  drones por escenario (por defecto 15,150,1500,15000,150000)\n"
+            "  --workers N      hilos del pool (por defecto los de config.txt)\n"
+            "  --seed N         semilla de todas las misiones (por defecto 1)\n"
+            "  --csv archivo    resultados en CSV\n",
+            program);
+}
+
+// Función para leer la lista de tamaños
+int scale_parse_sizes(const char* text) {
+    scale.size_count = 0;
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer), "%s", text);
+    char* save = NULL;
+    for (char* item = strtok_r(buffer, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        int drones = atoi(item);
+        if (drones < 1 || scale.size_count == SCALE_MAX_SIZES) {
+            return -1;
+        }
+        scale.sizes[scale.size_count++] = drones;
+    }
+    return scale.size_count > 0 ? 0 : -1;
+}
+
+int scale_compare_u64(const void* a, const void* b) {
+    uint64_t left = *(const uint64_t*)a, right = *(const uint64_t*)b;
+    return left < right ? -1 : left > right;
+}
+
+// Función para correr la misión de un escenario en el proceso hijo y anotar sus números
+void scale_child(ScaleResult* result) {
+    // Sin salida: el informe final y el log van a /dev/null (solo quedan los errores)
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd != -1) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    logger.level = LOG_ERROR;
+    logger.hide_phases = 1;
+    start_logger();
+
+    // Mapa cuadrado con las zonas de siempre escaladas a su altura (como un escenario con
+    // solo "map"), y combustible para recorrerlo
+    system_state.map_width = result->map_side;
+    system_state.map_height = result->map_side;
+    system_state.assembly_y = ASSEMBLY_POINT_Y * result->map_side / MAP_HEIGHT;
+    system_state.defense_zone_start = DEFENSE_ZONE_START * result->map_side / MAP_HEIGHT;
+    system_state.defense_zone_end = DEFENSE_ZONE_END * result->map_side / MAP_HEIGHT;
+    system_state.reassembly_y = REASSEMBLY_POINT_Y * result->map_side / MAP_HEIGHT;
+    system_state.initial_fuel = result->fuel;
+    system_state.truck_count = result->trucks;
+    system_state.target_count = result->targets;
+    system_state.swarms_requested = result->swarms;
+    system_state.defense_count = result->defenses;
+    if (scale.workers >= 0) {
+        system_state.workers = scale.workers;
+    }
+    system_state.seed = scale.seed;
+    system_state.seed_set = 1;
+    system_state.virtual_time = 1;
+    interpreter.read_stdin = 0;
+    trace.path[0] = '\0';
+    scenario.path[0] = '\0';
+    checkpoint.path[0] = '\0';
+    checkpoint.restore_path[0] = '\0';
+    replay.path[0] = '\0';
+    channel.mode = CHANNEL_NONE;
+
+    scheduler.tick_ns = malloc(sizeof(uint64_t) * SCALE_MAX_TICKS);
+    scheduler.tick_ns_capacity = scheduler.tick_ns ? SCALE_MAX_TICKS : 0;
+
+    uint64_t start = monotonic_ns();
+    mission_init();
+    command_center();
+    result->mission_s = (monotonic_ns() - start) / 1e9;
+
+    result->drones = system_state.drone_count;
+    result->workers = scheduler.worker_count;
+    result->events_enqueued = atomic_load(&system_state.events.enqueued);
+    result->events_dropped = atomic_load(&system_state.events.dropped);
+
+    // Los ticks se leen con el hilo de ticks ya unido (cleanup_system detiene el planificador)
+    cleanup_system();
+    long ticks = scheduler.tick_ns_count;
+    result->ticks = ticks;
+    if (ticks > 0) {
+        uint64_t* durations = scheduler.tick_ns;
+        uint64_t sum = 0;
+        for (long i = 0; i < ticks; i++) {
+            sum += durations[i];
+            if (durations[i] > (uint64_t)TICK_MS * 1000000) result->ticks_over_budget++;
+        }
+        qsort(durations, ticks, sizeof(uint64_t), scale_compare_u64);
+        result->tick_p50_us = durations[(long)(0.50 * (ticks - 1))] / 1e3;
+        result->tick_p99_us = durations[(long)(0.99 * (ticks - 1))] / 1e3;
+        result->tick_max_us = durations[ticks - 1] / 1e3;
+        result->tick_mean_us = (double)sum / ticks / 1e3;
+    }
+
+    stop_logger();
+    result->log_dropped = atomic_load(&logger.dropped);
+    result->completed = 1;
+    free(scheduler.tick_ns);
+}
+
+// Función para leer la cantidad de hilos de un proceso (-1 si ya no está)
+int scale_thread_count(pid_t pid) {
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    int threads = -1;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "Threads:", 8) == 0) {
+            threads = atoi(line + 8);
+            break;
+        }
+    }
+    fclose(file);
+    return threads;
+}
+
+// Función para correr un escenario en un proceso propio: el hijo corre la misión y el
+// padre lo espera contando sus hilos; la memoria y los cambios de contexto salen de wait4
+int scale_run(ScaleResult* result) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        scale_child(result);
+        _exit(result->completed ? 0 : EXIT_FAILURE);
+    }
+
+    struct rusage usage;
+    int status = 0;
+    while (1) {
+        pid_t done = wait4(pid, &status, WNOHANG, &usage);
+        if (done == pid) break;
+        if (done == -1) {
+            perror("wait4");
+            return -1;
+        }
+        int threads = scale_thread_count(pid);
+        if (threads > result->threads) {
+            result->threads = threads;
+        }
+        struct timespec pause = {0, SCALE_POLL_MS * 1000000L};
+        nanosleep(&pause, NULL);
+    }
+
+    result->peak_rss_kb = usage.ru_maxrss;
+    result->voluntary_switches = usage.ru_nvcsw;
+    result->involuntary_switches = usage.ru_nivcsw;
+    result->cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    result->exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return result->completed && result->exit_status == 0 ? 0 : -1;
+}
+
+// Función para mostrar la fila de un escenario
+void scale_print(const ScaleResult* r) {
+    double ticks_per_sec = r->mission_s > 0 ? r->ticks / r->mission_s : 0.0;
+    if (!r->completed) {
+        printf("%8d %6d %9d %10d %9d  falló (estado %d)\n", r->drones, r->map_side, r->trucks, r->swarms,
+               r->defenses, r->exit_status);
+        return;
+    }
+    printf("%8d %6d %9d %10d %9d %7ld %10.1f %10.1f %10.1f %11.1f %8ld %6d %9.1f %11ld %12ld %10lu\n",
+           r->drones, r->map_side, r->trucks, r->swarms, r->defenses, r->ticks, ticks_per_sec,
+           r->tick_p50_us, r->tick_p99_us, r->tick_max_us, r->ticks_over_budget, r->threads,
+           r->peak_rss_kb / 1024.0, r->voluntary_switches, r->involuntary_switches, r->events_dropped);
+}
+
+// Función para escribir los resultados en CSV (una fila por escenario)
+int scale_write_csv(const char* path, const ScaleResult* results, int count) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    fprintf(file, "drones,map_side,fuel,trucks,targets,swarms,defenses,workers,threads,ticks,mission_s,ticks_per_sec,"
+                  "tick_p50_us,tick_p99_us,tick_max_us,tick_mean_us,ticks_over_budget,peak_rss_kb,voluntary_switches,"
+                  "involuntary_switches,cpu_s,events_enqueued,events_dropped,log_dropped,completed\n");
+    for (int i = 0; i < count; i++) {
+        const ScaleResult* r = &results[i];
+        fprintf(file, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%ld,%.4f,%.1f,%.2f,%.2f,%.2f,%.2f,%ld,%ld,%ld,%ld,%.3f,%lu,%lu,%lu,%d\n",
+                r->drones, r->map_side, r->fuel, r->trucks, r->targets, r->swarms, r->defenses, r->workers, r->threads, r->ticks,
+                r->mission_s, r->mission_s > 0 ? r->ticks / r->mission_s : 0.0, r->tick_p50_us,
+                r->tick_p99_us, r->tick_max_us, r->tick_mean_us, r->ticks_over_budget, r->peak_rss_kb, r->voluntary_switches,
+                r->involuntary_switches, r->cpu_s, r->events_enqueued, r->events_dropped, r->log_dropped,
+                r->completed);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+int main(int argc, char* argv[]) {
+    scale_parse_sizes("15,150,1500,15000,150000");
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            if (scale_parse_sizes(argv[++i]) != 0) {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            scale.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            scale.seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            scale.csv_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            scale.config_path = argv[i];
+        }
+    }
+
+    // Los parámetros de la misión (W, Q, Z, velocidad, rutas...) salen de config.txt; el
+    // tamaño de la flota, el del mapa y el combustible los pone cada escenario
+    system_state.start_time = time(NULL);
+    logger.level = LOG_WARN;
+    logger.hide_phases = 1;
+    load_configuration(scale.config_path);
+    select_kinematics_kernel();
+    int per_swarm = system_state.attack_per_swarm + system_state.camera_per_swarm;
+    int base_drones = SCALE_BASE_SWARMS * per_swarm;
+
+    // Los resultados viven en memoria compartida: cada hijo llena el suyo
+    ScaleResult* results = mmap(NULL, sizeof(ScaleResult) * scale.size_count, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    printf("Drone Wars 2 escala: %d escenarios, kernel %s, %ld núcleos, semilla %llu\n",
+           scale.size_count, kinematics_kernel_name, sysconf(_SC_NPROCESSORS_ONLN),
+           (unsigned long long)scale.seed);
+    printf("\n  drones   mapa  camiones  enjambres  defensas   ticks    ticks/s     p50 µs     p99 µs      máx µs  > %d ms  hilos   RSS MiB  cc volunt.  cc involunt.  descartes\n",
+           TICK_MS);
+
+    int status = EXIT_SUCCESS;
+    for (int i = 0; i < scale.size_count; i++) {
+        ScaleResult* r = &results[i];
+        memset(r, 0, sizeof(*r));
+        r->factor = (scale.sizes[i] + base_drones - 1) / base_drones;
+        r->trucks = SCALE_BASE_TRUCKS * r->factor;
+        r->targets = SCALE_BASE_TARGETS * r->factor;
+        r->swarms = SCALE_BASE_SWARMS * r->factor;
+        r->defenses = SCALE_BASE_DEFENSES * r->factor;
+        r->drones = r->swarms * per_swarm;
+        r->map_side = (int)lround(MAP_WIDTH * sqrt((double)r->factor));
+        if (r->map_side > SCENARIO_MAX_MAP) r->map_side = SCENARIO_MAX_MAP;
+        r->fuel = (int)((long)system_state.initial_fuel * r->map_side / MAP_WIDTH);
+        if (scale_run(r) != 0) {
+            status = EXIT_FAILURE;
+        }
+        scale_print(r);
+    }
+
+    if (scale.csv_path) {
+        if (scale_write_csv(scale.csv_path, results, scale.size_count) == 0) {
+            printf("\nResultados en %s\n", scale.csv_path);
+        } else {
+            status = EXIT_FAILURE;
+        }
+    }
+    munmap(results, sizeof(ScaleResult) * scale.size_count);
+    return status;
+}
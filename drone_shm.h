@@ -0,0 +1,143 @@
+#ifndef DRONE_SHM_H
+#define DRONE_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "drone_trace.h"
+
+// Región de memoria compartida de Drone Wars 2 (shm_open + mmap), compartida por
+// drone_wars2 y los procesos externos (drone_watch). Región = ShmHeader seguido, en los
+// offsets que indica la cabecera, de un slot de comando por drone, la cola de comandos
+// al centro, los anillos de telemetría (uno por hilo de la simulación) y las fotos del
+// mundo. Los lectores leen directamente de la región, sin copias ni llamadas al sistema.
+
+#define SHM_MAGIC "DWSHM01"
+#define SHM_VERSION 3
+#define SHM_DEFAULT_NAME "/drone_wars2"
+#define SHM_ALIGNMENT 64
+#define SHM_QUEUE_CAPACITY 4096 // Comandos al centro (potencia de 2)
+#define SHM_RING_RECORDS 16384 // Registros por anillo de telemetría (potencia de 2)
+#define SHM_RING_COUNT 80 // Anillos de telemetría (los hilos toman uno al primer registro)
+#define SHM_COMMAND_DATA 48
+#define SHM_SNAPSHOT_BUFFERS 2 // Fotos del mundo (doble buffer)
+#define SHM_SNAPSHOT_STATES 11 // Estados de drone (DRONE_STATE_COUNT de drone_wars2.c)
+#define SHM_CENTER_FIFO "/tmp/drone_wars2/center" // Comandos de texto y timbre de la cola
+
+// Cabecera de la región
+typedef struct {
+    char magic[8]; // SHM_MAGIC (con terminador)
+    uint32_t version;
+    uint32_t header_size; // sizeof(ShmHeader)
+    uint64_t seed; // Semilla de la corrida
+    uint32_t tick_ms; // Duración de un tick
+    uint32_t drone_capacity; // Slots de comando (cota superior de los ids de drone)
+    uint32_t queue_capacity;
+    uint32_t ring_count;
+    uint32_t ring_records;
+    int32_t pid; // Proceso de la simulación
+    uint64_t slots_offset;
+    uint64_t queue_offset;
+    uint64_t rings_offset;
+    uint64_t ring_size; // Bytes entre anillos consecutivos
+    uint64_t snapshots_offset;
+    uint64_t snapshot_size; // Bytes entre fotos consecutivas
+    _Atomic uint64_t tick; // Ticks de simulación completados
+    _Atomic uint32_t rings_used; // Anillos tomados (puede pasar de ring_count: los sobrantes no publican)
+    _Atomic uint32_t running; // 1 mientras corre la misión
+    _Atomic uint64_t snapshots_published; // Fotos publicadas (la última está en (n - 1) % SHM_SNAPSHOT_BUFFERS)
+} ShmHeader;
+
+// Slot de comando de un drone. Lo escribe solo el intérprete de comandos de la simulación
+// (los procesos externos piden "retask_drone D T" por SHM_CENTER_FIFO): espera a que
+// ack == seq, llena type/target_id/arg y publica con seq + 1 (release); el drone aplica el
+// comando en su tick y copia seq en ack.
+typedef struct {
+    _Atomic uint32_t seq;
+    _Atomic uint32_t ack;
+    uint32_t type; // Comando (ver shm_command_names)
+    int32_t target_id;
+    int32_t arg;
+    uint32_t reserved[3];
+} ShmCommandSlot;
+
+// Celda de la cola de comandos al centro. retask: target_id = objetivo nuevo, arg =
+// enjambre; report_ok/report_fail: target_id = objetivo; attack: sin argumentos.
+typedef struct {
+    _Atomic uint64_t sequence; // Turno de la celda: posición libre, o posición + 1 con comando
+    uint32_t type;
+    int32_t target_id;
+    int32_t arg;
+    uint32_t reserved;
+    uint64_t sent_ns; // CLOCK_MONOTONIC al encolar (0 = sin medir), para la latencia de despacho
+    char data[SHM_COMMAND_DATA];
+} ShmCommandCell;
+
+// Cola acotada de comandos al centro: varios productores (reservan con CAS sobre head),
+// un consumidor (el intérprete de comandos). Después de encolar uno o varios comandos el
+// productor escribe "\n" en SHM_CENTER_FIFO para despertar al intérprete; sin timbre la
+// cola igual se revisa cada pocos milisegundos.
+typedef struct {
+    _Alignas(SHM_ALIGNMENT) _Atomic uint64_t head; // Próxima posición a reservar
+    _Alignas(SHM_ALIGNMENT) _Atomic uint64_t tail; // Próxima posición a consumir
+    _Alignas(SHM_ALIGNMENT) ShmCommandCell cells[]; // queue_capacity celdas
+} ShmCommandQueue;
+
+// Anillo de telemetría de un hilo: los mismos registros que la traza binaria. Un
+// escritor que pisa lo viejo y cualquier cantidad de lectores, cada uno con su cursor.
+// El registro de la posición p está en records[p % ring_records] y es válido si, después
+// de leerlo (con un fence acquire), head - p < ring_records.
+typedef struct {
+    _Alignas(SHM_ALIGNMENT) _Atomic uint64_t head; // Registros publicados
+    _Alignas(SHM_ALIGNMENT) TraceRecord records[]; // ring_records registros
+} ShmTelemetryRing;
+
+// Foto del mundo al final de un tick: la escribe el hilo de ticks entre dos ticks, en el
+// buffer que no tiene la última foto, sin esperar a nadie. sequence es un seqlock: impar
+// mientras se escribe; el lector copia lo que necesita y la descarta si sequence cambió.
+// Los arreglos siguen a la parte fija, en los offsets que indica (relativos a la foto).
+typedef struct {
+    _Atomic uint64_t sequence;
+    uint64_t tick; // Ticks completados
+    uint32_t phase; // Fase del centro de comando
+    uint32_t drone_count; // Drones creados (largo válido de los arreglos)
+    uint32_t state_counts[SHM_SNAPSHOT_STATES]; // Drones por estado
+    uint32_t x_offset; // int32_t[drone_capacity]
+    uint32_t y_offset; // int32_t[drone_capacity]
+    uint32_t state_offset; // int32_t[drone_capacity]
+} ShmSnapshot;
+
+// Función para copiar la última foto publicada sin bloquear a la simulación. snapshots es
+// el primer buffer y size la distancia entre buffers; copia la parte fija en out y, si no
+// son NULL, las posiciones y estados de hasta capacity drones. Devuelve los reintentos, o
+// -1 si todavía no hay foto.
+static inline int shm_snapshot_read(char* snapshots, uint64_t size, _Atomic uint64_t* published, ShmSnapshot* out,
+                                    int32_t* x, int32_t* y, int32_t* state, uint32_t capacity) {
+    for (int retries = 0;; retries++) {
+        uint64_t count = atomic_load_explicit(published, memory_order_acquire);
+        if (count == 0) return -1;
+        ShmSnapshot* snapshot = (ShmSnapshot*)(snapshots + ((count - 1) % SHM_SNAPSHOT_BUFFERS) * size);
+        uint64_t before = atomic_load_explicit(&snapshot->sequence, memory_order_acquire);
+        if (before & 1) continue;
+
+        memcpy(&out->tick, &snapshot->tick, sizeof(ShmSnapshot) - offsetof(ShmSnapshot, tick));
+        uint32_t drones = out->drone_count < capacity ? out->drone_count : capacity;
+        if (x) memcpy(x, (char*)snapshot + out->x_offset, sizeof(int32_t) * drones);
+        if (y) memcpy(y, (char*)snapshot + out->y_offset, sizeof(int32_t) * drones);
+        if (state) memcpy(state, (char*)snapshot + out->state_offset, sizeof(int32_t) * drones);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&snapshot->sequence, memory_order_relaxed) == before) {
+            out->drone_count = drones;
+            return retries;
+        }
+    }
+}
+
+// Nombres de los comandos (mismo orden que CommandType de drone_wars2.c)
+static const char* const shm_command_names[] = {
+    "attack", "retask", "report_ok", "report_fail", "defense"
+};
+
+#endif
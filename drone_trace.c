@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "drone_trace.h"
+
+// Decodificador de trazas binarias de Drone Wars 2: filtra registros y los
+// convierte a CSV o muestra un resumen por tipo.
+
+#define READ_BATCH 4096 // Registros leídos por llamada a fread
+
+// Filtros de la línea de comandos (-1 = sin filtro)
+typedef struct {
+    unsigned kind_mask;
+    long drone;
+    long swarm;
+    long from_tick;
+    long to_tick;
+    int summary;
+} TraceFilter;
+
+// Función para mostrar el uso del decodificador
+void print_usage(const char* program) {
+    fprintf(stderr,
+            "Uso: %s [opciones] archivo.trace\n"
+            "  --kind=a,b,...   tipos a mostrar (spawn, state, event, comm_lost, comm_restored,\n"
+            "                   comm_timeout, shot_down, transfer)\n"
+            "  --drone=N        solo el drone N\n"
+            "  --swarm=N        solo registros del enjambre N\n"
+            "  --from=T         desde el tick T\n"
+            "  --to=T           hasta el tick T (incluido)\n"
+            "  --summary        resumen por tipo en lugar de CSV\n",
+            program);
+}
+
+// Función para obtener un nombre de una tabla, o el número si está fuera de rango
+const char* name_or_number(const char* const* names, size_t count, unsigned value, char* buffer, size_t size) {
+    if (value < count) {
+        return names[value];
+    }
+    snprintf(buffer, size, "%u", value);
+    return buffer;
+}
+
+// Función para escribir un registro como línea CSV
+void print_csv(const TraceRecord* record, const TraceHeader* header, uint32_t previous_swarm) {
+    char value_buffer[16], previous_buffer[16];
+    const char* value = "";
+    const char* previous = "";
+    size_t states = sizeof(trace_state_names) / sizeof(trace_state_names[0]);
+    size_t events = sizeof(trace_event_names) / sizeof(trace_event_names[0]);
+
+    switch (record->kind) {
+        case TRACE_SPAWN:
+            value = record->value == 0 ? "ATAQUE" : "CAMARA";
+            snprintf(previous_buffer, sizeof(previous_buffer), "%u", record->aux);
+            previous = previous_buffer; // Camión de origen
+            break;
+        case TRACE_STATE:
+            value = name_or_number(trace_state_names, states, record->value, value_buffer, sizeof(value_buffer));
+            previous = name_or_number(trace_state_names, states, record->aux, previous_buffer, sizeof(previous_buffer));
+            break;
+        case TRACE_EVENT:
+            value = name_or_number(trace_event_names, events, record->value, value_buffer, sizeof(value_buffer));
+            break;
+        case TRACE_COMM_RESTORED:
+        case TRACE_COMM_TIMEOUT:
+        case TRACE_SHOT_DOWN:
+            snprintf(value_buffer, sizeof(value_buffer), "%u", record->aux);
+            value = value_buffer;
+            break;
+        case TRACE_TRANSFER:
+            snprintf(previous_buffer, sizeof(previous_buffer), "%u", previous_swarm);
+            previous = previous_buffer; // Enjambre de origen
+            break;
+        default:
+            break;
+    }
+
+    printf("%u,%.1f,%s,%u,%u,%s,%s\n",
+           record->tick, record->tick * header->tick_ms / 1000.0,
+           record->kind < TRACE_KIND_COUNT ? trace_kind_names[record->kind] : "?",
+           record->drone_id, record->swarm_id, value, previous);
+}
+
+int main(int argc, char* argv[]) {
+    TraceFilter filter = {(1u << TRACE_KIND_COUNT) - 1, -1, -1, -1, -1, 0};
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--kind=", 7) == 0) {
+            filter.kind_mask = parse_kinds(argv[i] + 7);
+        } else if (strncmp(argv[i], "--drone=", 8) == 0) {
+            filter.drone = atol(argv[i] + 8);
+        } else if (strncmp(argv[i], "--swarm=", 8) == 0) {
+            filter.swarm = atol(argv[i] + 8);
+        } else if (strncmp(argv[i], "--from=", 7) == 0) {
+            filter.from_tick = atol(argv[i] + 7);
+        } else if (strncmp(argv[i], "--to=", 5) == 0) {
+            filter.to_tick = atol(argv[i] + 5);
+        } else if (strcmp(argv[i], "--summary") == 0) {
+            filter.summary = 1;
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s: no es una traza de Drone Wars 2\n", path);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+    if (header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s: versión %u con registros de %u bytes no soportada\n",
+                path, header.version, header.record_size);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    // Último enjambre de cada drone, para saber el origen de las transferencias
+    uint32_t* last_swarm = calloc(header.drone_capacity + 1, sizeof(uint32_t));
+    unsigned long long kind_counts[TRACE_KIND_COUNT] = {0};
+    unsigned long long total = 0, shown = 0;
+    uint32_t last_tick = 0;
+
+    if (!filter.summary) {
+        printf("tick,segundos,tipo,drone,enjambre,valor,anterior\n");
+    }
+
+    TraceRecord batch[READ_BATCH];
+    size_t count;
+    while ((count = fread(batch, sizeof(TraceRecord), READ_BATCH, file)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const TraceRecord* record = &batch[i];
+            uint32_t previous_swarm = 0;
+            if (record->drone_id <= header.drone_capacity) {
+                previous_swarm = last_swarm[record->drone_id];
+                last_swarm[record->drone_id] = record->swarm_id;
+            }
+            total++;
+            last_tick = record->tick;
+
+            if (record->kind >= TRACE_KIND_COUNT || !(filter.kind_mask & (1u << record->kind))) continue;
+            if (filter.drone >= 0 && record->drone_id != (uint32_t)filter.drone) continue;
+            if (filter.swarm >= 0 && record->swarm_id != (uint32_t)filter.swarm) continue;
+            if (filter.from_tick >= 0 && record->tick < (uint32_t)filter.from_tick) continue;
+            if (filter.to_tick >= 0 && record->tick > (uint32_t)filter.to_tick) continue;
+
+            shown++;
+            kind_counts[record->kind]++;
+            if (!filter.summary) {
+                print_csv(record, &header, previous_swarm);
+            }
+        }
+    }
+
+    if (filter.summary) {
+        printf("Traza %s: semilla %llu, tick %u ms, %llu registros hasta el tick %u\n",
+               path, (unsigned long long)header.seed, header.tick_ms, total, last_tick);
+        for (int k = 0; k < TRACE_KIND_COUNT; k++) {
+            printf("  %-14s %llu\n", trace_kind_names[k], kind_counts[k]);
+        }
+        printf("  %-14s %llu\n", "filtrados", shown);
+    }
+
+    free(last_swarm);
+    fclose(file);
+    return EXIT_SUCCESS;
+}
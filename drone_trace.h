@@ -0,0 +1,86 @@
+#ifndef DRONE_TRACE_H
+#define DRONE_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Formato binario de la traza de misión (compartido por drone_wars2 y drone_trace).
+// Archivo = TraceHeader seguido de registros TraceRecord de tamaño fijo, en orden
+// no decreciente de tick.
+
+#define TRACE_MAGIC "DWTRACE1"
+#define TRACE_VERSION 1
+
+// Cabecera del archivo de traza
+typedef struct {
+    char magic[8]; // TRACE_MAGIC (sin terminador)
+    uint32_t version;
+    uint32_t record_size; // sizeof(TraceRecord)
+    uint64_t seed; // Semilla de la corrida
+    uint32_t tick_ms; // Duración de un tick
+    uint32_t drone_capacity; // Cota superior de los ids de drone
+} TraceHeader;
+
+// Tipos de registro
+typedef enum {
+    TRACE_SPAWN = 0, // Drone creado: value = tipo, aux = camión de origen
+    TRACE_STATE, // Cambio de estado: value = estado nuevo, aux = estado anterior
+    TRACE_EVENT, // Evento emitido al centro de comando: value = EventType
+    TRACE_COMM_LOST, // Pérdida de comunicación
+    TRACE_COMM_RESTORED, // Comunicación reestablecida: aux = segundos sin comunicación
+    TRACE_COMM_TIMEOUT, // Timeout de comunicación (drone perdido): aux = Z en segundos
+    TRACE_SHOT_DOWN, // Derribo por defensas: aux = posición Y
+    TRACE_TRANSFER, // Re-ensamblaje: swarm_id = enjambre destino (el origen es el anterior)
+    TRACE_KIND_COUNT
+} TraceKind;
+
+// Registro de 16 bytes
+typedef struct {
+    uint32_t tick; // Tick de simulación
+    uint32_t drone_id;
+    uint32_t swarm_id; // Enjambre del drone al registrar
+    uint8_t kind; // TraceKind
+    uint8_t value;
+    uint16_t aux;
+} TraceRecord;
+
+// Nombres para el decodificador (mismo orden que los enum de drone_wars2.c)
+static const char* const trace_kind_names[TRACE_KIND_COUNT] = {
+    "spawn", "state", "event", "comm_lost", "comm_restored", "comm_timeout", "shot_down", "transfer"
+};
+
+// Función para interpretar una lista de tipos separados por coma (--kind= de drone_trace
+// y drone_watch); un nombre desconocido termina el programa
+static inline unsigned parse_kinds(const char* list) {
+    unsigned mask = 0;
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", list);
+
+    for (char* name = strtok(buffer, ","); name; name = strtok(NULL, ",")) {
+        int found = 0;
+        for (int k = 0; k < TRACE_KIND_COUNT; k++) {
+            if (strcmp(name, trace_kind_names[k]) == 0) {
+                mask |= 1u << k;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Tipo desconocido: %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return mask;
+}
+
+static const char* const trace_state_names[] = {
+    "CREATED", "FLYING_TO_ASSEMBLY", "CIRCLING_ASSEMBLY", "READY", "REASSEMBLED",
+    "FLYING_TO_TARGET", "AT_TARGET", "DETONATED", "DESTROYED", "MISSION_COMPLETE", "FUEL_EMPTY"
+};
+
+static const char* const trace_event_names[] = {
+    "READY", "AT_TARGET", "DETONATED", "CAM_REPORT_OK", "CAM_REPORT_FAIL", "DESTROYED", "FUEL_EMPTY"
+};
+
+#endif
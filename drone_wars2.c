@@ -6,12 +6,24 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <time.h>
 #include <math.h>
 #include <signal.h>
 #include <errno.h>
+#include <sched.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "drone_trace.h"
+#include "drone_shm.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DRONE_WARS_X86 1
+#endif
 
 // Constantes del sistema
 #define MAP_WIDTH 100
@@ -20,18 +32,71 @@
 #define DEFENSE_ZONE_START 33
 #define DEFENSE_ZONE_END 66
 #define REASSEMBLY_ZONE_START 66
-#define DRONES_PER_SWARM 5
-#define ATTACK_DRONES_PER_SWARM 4
-#define CAMERA_DRONES_PER_SWARM 1
-#define NUM_TRUCKS 3
-#define NUM_TARGETS 3
-#define NUM_ASSEMBLY_POINTS 3
-#define NUM_REASSEMBLY_POINTS 3
+#define ASSEMBLY_POINT_Y 16
+#define REASSEMBLY_POINT_Y 82
+// Tamaños por defecto de la flota (configurables en config.txt)
+#define DEFAULT_ATTACK_PER_SWARM 4
+#define DEFAULT_CAMERA_PER_SWARM 1
+#define DEFAULT_TRUCKS 3
+#define DEFAULT_TARGETS 3
 #define NUM_ENEMY_DEFENSES 2
-#define MAX_DRONES 100
-#define MAX_EVENTS 1000
+#define DEFAULT_DEFENSE_RANGE 20 // Alcance de una defensa: su probabilidad cae a 0 en esa distancia
+#define THREAT_HAZARD_ONE 65536.0 // Escala de punto fijo del riesgo acumulado del campo de amenaza
+#define THREAT_MAX_PROBABILITY 0.99 // Tope por defensa (riesgo finito)
+#define REASSEMBLY_OPTIMAL_MAX 512 // Unidades por tipo hasta las que el re-ensamblaje es óptimo
+#define THREAT_COST_WEIGHT 1000.0 // Unidades de distancia que vale una unidad de riesgo (asignación y rutas)
+#define ASSIGN_ROUND_PENALTY 1e6 // Costo extra de cada ronda de huecos (primero se cubren todos los objetivos)
+#define ASSIGN_EXACT_MAX 512 // Enjambres hasta los que la asignación optimizada es exacta
+#define ASSIGN_EXACT_CELLS (1L << 21) // Tope de la matriz de costos de la asignación exacta
+#define ASSIGN_PATH_SAMPLES 32 // Puntos máximos por trayecto al estimar la exposición a las defensas
+#define ASSIGN_FUEL_RESERVE 0.8 // Fracción del combustible que puede gastar el vuelo (el resto, esperas)
+#define ASSIGN_FUEL_PENALTY 1000.0 // Costo por segundo de vuelo que no cubre el combustible
+#define FLOW_MAX_CELLS (1 << 16) // Celdas máximas de la grilla de rutas (celdas más grandes en mapas grandes)
+#define FLOW_LOOKAHEAD 8 // Pasos de la grilla que se adelanta el waypoint de un campo de flujo
+#define FLOW_CACHE_MAX_BYTES (256L << 20) // Memoria máxima de los campos de flujo construidos
+#define SCENARIO_MAGIC "DWSCEN1" // Firma del escenario binario (8 bytes con el terminador)
+#define SCENARIO_VERSION 1
+#define SCENARIO_MAX_MAP 4096 // Lado máximo del mapa de un escenario
+#define SCENARIO_MAX_ENTITIES (1 << 20) // Camiones, objetivos, defensas o enjambres por escenario
+#define CHECKPOINT_MAGIC "DWCKPT1" // Firma del punto de control (8 bytes con el terminador)
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_NULL UINT64_MAX // Offset de un puntero nulo en el punto de control
+#define REPLAY_MAGIC "DWREPLAY"
+#define REPLAY_VERSION 2
+#define ARENA_ALIGNMENT 64
+#define DEFAULT_EVENT_QUEUE 1024 // Capacidad por defecto del anillo de eventos
+#define EVENT_BATCH 64 // Eventos por lote al consumir la cola
+#define EVENT_DRAIN_MS 10 // Cada cuánto consume eventos el centro de comando mientras espera
 #define FIFO_PATH "/tmp/drone_wars2"
 #define MAX_MSG_SIZE 256
+#define COMMAND_POLL_MS 10 // Cada cuánto revisa el intérprete la cola compartida sin timbre
+#define COMMAND_LINE_MAX 512 // Largo máximo de una línea de comandos de texto
+#define COMMAND_READ_CHUNK 65536 // Bytes leídos por llamada de una fuente de comandos
+#define COMMAND_LATENCY_BUCKETS 10000 // Histograma de latencia de despacho: baldes de 1 µs
+#define TICK_MS 100 // Duración de un tick de simulación (antes: usleep(100000) en cada hilo)
+#define TICKS_PER_SECOND (1000 / TICK_MS)
+#define DEFENSE_CHECK_TICKS 5 // Verificar defensas cada 5 ticks (500ms)
+#define PHASE_REPORT_SECONDS 5 // Cada cuánto informa una barrera de fase lo que falta
+#define MAX_WORKERS 64
+#define KINEMATICS_CHUNK 4096 // Drones por unidad de trabajo del kernel de cinemática
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0 // Nivel mínimo compilado: -DLOG_MIN_LEVEL=1 elimina los log_debug
+#endif
+#define LOG_RING_SIZE (1 << 20) // Bytes del anillo de log de cada hilo (potencia de 2)
+#define LOG_MAX_RINGS (MAX_WORKERS + 16)
+#define LOG_MAX_RECORD 1024 // Tamaño máximo de un registro de log
+#define LOG_MAX_STRING 256 // Largo máximo de un argumento %s
+#define LOG_OUTPUT_BUFFER 65536 // Salida acumulada antes de escribir
+#define LOG_IDLE_MS 2 // Espera del hilo de log cuando no hay registros
+#define LOG_WRAP 0xFFFFFFFFu // Marca de salto al inicio del anillo
+#define TRACE_MAX_BUFFERS (MAX_WORKERS + 16)
+#define TRACE_BUFFER_RECORDS 4096 // Capacidad inicial del buffer de traza de un hilo
+#define TRACE_FLUSH_BYTES (1 << 20) // Bytes acumulados antes de entregar al escritor
+#define BATCH_Z95 1.959964 // Cuantil normal para intervalos de confianza del 95%
+#define DEFAULT_BATCH_CI 0.05 // Semi-ancho de intervalo para la parada temprana
+#define DEFAULT_BATCH_MIN_RUNS 10 // Corridas mínimas antes de evaluar la parada temprana
+#define SWEEP_MAX_VALUES 256 // Valores por parámetro del barrido
+#define DEFAULT_SWEEP_SAMPLES 20 // Puntos del hipercubo latino por defecto
 
 // Tipos de drone
 typedef enum {
@@ -51,9 +116,15 @@ typedef enum {
     DRONE_STATE_DETONATED,
     DRONE_STATE_DESTROYED,
     DRONE_STATE_MISSION_COMPLETE,  // Para drones cámara que completaron su misión
-    DRONE_STATE_FUEL_EMPTY
+    DRONE_STATE_FUEL_EMPTY,
+    DRONE_STATE_COUNT
 } DroneState;
 
+_Static_assert(DRONE_STATE_COUNT == SHM_SNAPSHOT_STATES, "las fotos del mundo cuentan un estado por DroneState");
+
+#define STATE_BIT(state) (1u << (state))
+#define DRONE_STATES_ALL ((1u << DRONE_STATE_COUNT) - 1)
+
 // Estados del objetivo
 typedef enum {
     TARGET_STATE_INTACT = 0,
@@ -61,6 +132,14 @@ typedef enum {
     TARGET_STATE_DESTROYED = 2
 } TargetState;
 
+// Causas de pérdida de drones (para las estadísticas de la misión)
+typedef enum {
+    LOSS_SHOT_DOWN = 0,
+    LOSS_COMM_LOST,
+    LOSS_FUEL_EMPTY,
+    LOSS_CAUSE_COUNT
+} LossCause;
+
 // Eventos del sistema
 typedef enum {
     EVT_READY,
@@ -77,26 +156,29 @@ typedef enum {
     CMD_GO_ATTACK_GLOBAL,
     CMD_RETASK,
     CMD_REPORT_OK,
-    CMD_REPORT_FAIL
+    CMD_REPORT_FAIL,
+    CMD_SET_DEFENSE
 } CommandType;
 
+// Canal de comandos y telemetría
+typedef enum {
+    CHANNEL_NONE = 0, // Sin canal (modo lote y barrido)
+    CHANNEL_SHM, // Región de memoria compartida (drone_shm.h)
+    CHANNEL_FIFO // Compatibilidad: una FIFO por drone y una del centro en FIFO_PATH
+} ChannelMode;
+
 // Estructura de posición
 typedef struct {
     int x, y;
 } Position;
 
-// Estructura de drone
+// Estructura de drone (datos fríos; los campos calientes viven en DroneStore)
 typedef struct {
     int id;
     int truck_id;
     int swarm_id;
     DroneType type;
-    DroneState state;
-    Position pos;
-    Position target;
-    int fuel;
     int max_fuel;
-    int distance_traveled;
     int shoot_down_probability; // Probabilidad individual de derribo
     
     // Control de comunicación
@@ -104,15 +186,16 @@ typedef struct {
     int communication_timeout; // Contador de timeout en décimas de segundo
     int reestablish_attempts; // Intentos de reestablecimiento
     time_t last_communication_loss; // Timestamp de última pérdida
+    int comm_check_ticks; // Ticks desde la última verificación de comunicación
+    
+    // Estado propio de cada drone (antes eran contadores static compartidos)
+    int patrol_angle; // Ángulo actual de la patrulla circular
+    int payload_logged; // Ya se informó la espera en el objetivo
+    int in_defense_zone; // 1 mientras vuela al objetivo dentro de la zona de defensa
+    int in_swarm; // 1 si es miembro de system_state.swarms[swarm_id] (cuenta en su histograma)
     
-    pthread_mutex_t mutex;
-    pthread_cond_t condition;
     char fifo_name[64];
     int fifo_fd;
-    pthread_t nav_thread;
-    pthread_t fuel_thread;
-    pthread_t comm_thread;
-    pthread_t payload_thread;
     int active;
 } Drone;
 
@@ -120,9 +203,14 @@ typedef struct {
 typedef struct {
     int id;
     int truck_id;
-    Drone* drones[DRONES_PER_SWARM];
+    int* members; // Ids de los drones del enjambre (bloque en la arena)
+    int size; // Drones en el enjambre (incluye destruidos)
+    int capacity; // Capacidad del bloque de miembros
+    int attack_quota; // Composición nominal: drones de ataque
+    int camera_quota; // Composición nominal: drones cámara
     int ready_count;
     int active_count;
+    int state_counts[2][DRONE_STATE_COUNT]; // Miembros por [DroneType][DroneState]
     Position assembly_point;
     Position reassembly_point;
     pthread_mutex_t mutex;
@@ -132,7 +220,7 @@ typedef struct {
 typedef struct {
     int id;
     Position pos;
-    Swarm* swarm;
+    int swarm_count;
     int drone_count;
     int active;
 } Truck;
@@ -150,19 +238,116 @@ typedef struct {
 typedef struct {
     int id;
     Position pos;
-    int shoot_down_probability;
+    int shoot_down_probability; // % por verificación en su posición (W)
+    int range; // Distancia a la que la probabilidad cae a 0 (lineal)
+    int active; // 1 si está sumada al campo de amenaza
+    atomic_int requested; // Pedido del operador: -1 ninguno, 0 apagar, 1 encender (entre ticks)
 } EnemyDefense;
 
+// Campo de amenaza: una celda por unidad de mapa con el riesgo combinado de todas las
+// defensas. El riesgo -ln(1 - p) es aditivo, así que agregar o quitar una defensa solo
+// toca las celdas a su alcance; el umbral de cada celda es 1 - exp(-riesgo).
+typedef struct {
+    int width;
+    int height;
+    uint32_t* hazard; // Riesgo acumulado en punto fijo (THREAT_HAZARD_ONE = 1.0)
+    uint32_t* threshold; // Umbral de derribo por verificación (ver rng_threshold)
+    uint32_t version; // Cambia con cada defensa activada o desactivada
+} ThreatField;
+
+// Campo de flujo hacia un objetivo: para cada celda de la grilla de rutas, la celda que
+// está "lookahead" pasos más adelante en el camino más barato hacia el objetivo
+typedef struct {
+    int32_t* waypoint; // Celda hacia la que volar desde cada celda (NULL = sin construir)
+    uint32_t version; // Versión del campo de amenaza con la que se construyó
+    int goal; // Celda del objetivo
+    int built; // 1 = waypoint vale para "version"
+    atomic_int wanted; // 1 = algún drone vuela siguiendo este campo (se marca desde los trabajadores)
+} FlowField;
+
+// Planificador de rutas compartido: una grilla de costos (riesgo más combustible) sobre
+// el mapa y un campo de flujo por objetivo, construido cuando alguien lo necesita
+typedef struct {
+    int cell; // Lado de una celda de la grilla en unidades de mapa
+    int width;
+    int height;
+    int lookahead; // Pasos del waypoint (cubre al menos dos ticks de vuelo)
+    float* cost; // Costo por unidad de distancia de cada celda (NULL = sin construir)
+    uint32_t cost_version; // Versión del campo de amenaza de la grilla de costos
+    FlowField* fields; // Uno por objetivo (en la arena)
+    int* pending; // Objetivos a construir en la pasada actual (en la arena)
+    size_t cache_bytes; // Memoria de los campos construidos
+    int over_budget; // 1 = algún campo quedó sin construir por falta de memoria
+} FlowPlanner;
+
 // Estructura de evento
 typedef struct {
     EventType type;
     int drone_id;
     int swarm_id;
     int truck_id;
-    char data[128];
+    const char* data; // Texto estático (literal), no se copia
     time_t timestamp;
 } Event;
 
+// Política cuando el anillo de eventos está lleno
+typedef enum {
+    EVENT_OVERFLOW_BLOCK = 0, // El productor espera a que el consumidor libere espacio
+    EVENT_OVERFLOW_DROP, // Se descarta el evento y se cuenta
+    EVENT_OVERFLOW_GROW // Se desborda a una lista enlazada sin límite
+} EventOverflowPolicy;
+
+// Cómo se asignan los objetivos a los enjambres
+typedef enum {
+    ASSIGNMENT_RANDOM = 0, // Permutación aleatoria (para despistar al enemigo)
+    ASSIGNMENT_OPTIMIZED // Distancia, combustible y exposición a las defensas
+} AssignmentMode;
+
+// Cómo vuelan los enjambres a su objetivo
+typedef enum {
+    ROUTING_STRAIGHT = 0, // Línea recta desde el punto de ensamble
+    ROUTING_FLOW // Siguiendo el campo de flujo del objetivo (rodea las defensas)
+} RoutingMode;
+
+// Celda del anillo: la secuencia indica si está libre o lista para el consumidor
+typedef struct {
+    atomic_size_t sequence;
+    Event event;
+} EventCell;
+
+// Nodo de la lista de desborde
+typedef struct EventNode {
+    struct EventNode* _Atomic next;
+    Event event;
+} EventNode;
+
+// Cola de eventos sin bloqueos: muchos productores (trabajadores y centro de comando)
+// y un consumidor (el centro de comando)
+typedef struct {
+    EventCell* cells;
+    size_t mask;
+    EventOverflowPolicy policy;
+    pthread_t consumer;
+    char padding0[64];
+    
+    atomic_size_t enqueue_pos; // Compartida por los productores
+    char padding1[56];
+    atomic_size_t dequeue_pos; // Solo la escribe el consumidor
+    char padding2[56];
+    
+    EventNode* _Atomic overflow_tail; // Compartida por los productores
+    char padding3[56];
+    EventNode* overflow_head; // Solo la usa el consumidor
+    EventNode overflow_stub;
+    
+    // Estadísticas
+    atomic_ulong enqueued;
+    atomic_ulong dropped;
+    atomic_ulong overflowed;
+    atomic_ulong blocked;
+    atomic_size_t high_watermark;
+} EventQueue;
+
 // Estructura de comando
 typedef struct {
     CommandType type;
@@ -170,6 +355,505 @@ typedef struct {
     char data[128];
 } Command;
 
+// Almacén estructura-de-arreglos con los campos calientes de cada drone (indexado por id).
+// El kernel de cinemática recorre estos arreglos de forma contigua y vectorizada.
+typedef struct {
+    int32_t* pos_x;
+    int32_t* pos_y;
+    int32_t* target_x;
+    int32_t* target_y;
+    int32_t* fuel;
+    int32_t* distance_traveled;
+    int32_t* state; // DroneState
+    uint8_t* arrived; // 1 si el drone llegó a su destino en el tick actual
+    uint32_t* vulnerability; // Fracción del riesgo del campo que sufre el drone (escala 2^32)
+    uint32_t* shoot_down_threshold; // Umbral de derribo del tick: campo de amenaza x vulnerabilidad
+    uint8_t* draws; // Sorteos del tick actual (bits DRAW_*)
+    int32_t* route; // Objetivo cuyo campo de flujo sigue el drone (-1 = línea recta)
+} DroneStore;
+
+// Bits de los sorteos por drone y tick
+#define DRAW_SHOOT_DOWN 0x1
+#define DRAW_COMM_LOSS 0x2
+#define DRAW_COMM_RESTORE 0x4
+
+// Rango de trabajo de un trabajador; los demás trabajadores pueden robar de él
+typedef struct {
+    atomic_int next;
+    int end;
+    char padding[56];
+} WorkRange;
+
+// Planificador de ticks: un pool fijo de trabajadores avanza todos los drones en cada tick
+typedef struct {
+    int worker_count; // Incluye al hilo de ticks, que también procesa enjambres
+    pthread_t workers[MAX_WORKERS];
+    WorkRange ranges[MAX_WORKERS];
+    void (*task)(int index, long tick); // Tarea de la fase actual del tick
+    pthread_t tick_thread;
+    int started;
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t start_condition;
+    pthread_cond_t done_condition;
+    unsigned long generation;
+    int pending;
+    int shutdown;
+    
+    long current_tick;
+    
+    // Reloj de simulación: el centro de comando lo retiene mientras trabaja
+    // y lo libera al esperar, así sus órdenes siempre caen entre dos ticks
+    pthread_mutex_t clock_mutex;
+    pthread_cond_t clock_condition; // Despierta al hilo de ticks
+    pthread_cond_t controller_condition; // Despierta al centro de comando
+    atomic_long clock_tick; // Ticks completados
+    long wake_tick; // Tick hasta el que puede avanzar el reloj
+    int controller_waiting;
+    int wake_on_barrier; // 1 = despertar también cuando la barrera de fase llegue a cero
+    
+    // Duración de cada tick en ns (opcional: si tick_ns no es NULL el hilo de ticks anota
+    // hasta tick_ns_capacity ticks; lo usa drone_scale)
+    uint64_t* tick_ns;
+    long tick_ns_capacity;
+    long tick_ns_count;
+} TickScheduler;
+
+// Barrera de fase: cuenta regresiva de los drones que aún bloquean la fase. Se arma
+// con el histograma de estados y la actualiza cada transición de drone; el hilo de
+// ticks despierta al centro de comando al final del tick en que llega a cero.
+typedef struct {
+    uint32_t pending_states; // Estados que bloquean (bit = DroneState)
+    int pending_in_zone; // 1 = bloquean los drones dentro de la zona de defensa
+    atomic_int remaining;
+    int armed;
+} PhaseBarrier;
+
+// Arena de memoria contigua: se reserva una vez y se reparte avanzando un puntero
+typedef struct {
+    char* base;
+    size_t size;
+    size_t used;
+} Arena;
+
+// Niveles de log (los menores a LOG_MIN_LEVEL se eliminan al compilar)
+typedef enum {
+    LOG_DEBUG = 0,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+} LogLevel;
+
+// Categorías de log (filtrables en tiempo de ejecución con log_categories=)
+typedef enum {
+    LOG_CAT_SYSTEM = 0, // Centro de comando, configuración y recursos
+    LOG_CAT_FLEET, // Creación de camiones, enjambres y drones
+    LOG_CAT_DRONE, // Pasos de cada drone (llegadas, derribos, combustible)
+    LOG_CAT_COMM, // Pérdida y reestablecimiento de comunicación
+    LOG_CAT_EVENTS, // Eventos consumidos por el centro de comando
+    LOG_CAT_COUNT
+} LogCategory;
+
+// Forma de la línea (prefijo y marco que añade el formateador)
+typedef enum {
+    LOG_KIND_MESSAGE = 0, // [hora] texto
+    LOG_KIND_EVENT, // │ [hora] [TIPO] texto
+    LOG_KIND_STATUS, // │ texto
+    LOG_KIND_PHASE, // Recuadro de fase
+    LOG_KIND_SUB_PHASE // ┌─ texto
+} LogKind;
+
+// Registro binario en el anillo de un hilo: cabecera más los argumentos capturados.
+// El formato y la etiqueta deben ser literales; los argumentos %s se copian.
+typedef struct {
+    uint32_t size; // Bytes del registro (múltiplo de 8) o LOG_WRAP
+    uint8_t level;
+    uint8_t category;
+    uint8_t kind;
+    uint8_t padding;
+    unsigned long long sequence; // Orden global entre todos los hilos
+    long tick; // Tick de simulación al registrar (para la hora)
+    const char* format;
+    const char* tag; // Tipo de evento de log_event
+} LogRecord;
+
+// Anillo de bytes de un hilo productor; el hilo de log es el único consumidor
+typedef struct {
+    char* buffer;
+    size_t mask;
+    atomic_size_t tail; // Escrito por el productor
+    char padding0[56];
+    atomic_size_t head; // Escrito por el hilo de log
+    char padding1[56];
+    atomic_int retired; // 1 = su hilo terminó: otro hilo nuevo lo puede tomar
+} LogRing;
+
+// Logger asíncrono: los hilos de simulación solo copian registros a su anillo;
+// el hilo de log los ordena, les da formato y los escribe en lotes. Los anillos de los
+// hilos que terminan se reciclan; si igual se acaban, los hilos sin anillo propio
+// comparten el del slot 0 (con shared_mutex).
+typedef struct {
+    LogRing* _Atomic rings[LOG_MAX_RINGS];
+    atomic_int ring_count;
+    pthread_mutex_t shared_mutex;
+    pthread_key_t ring_key; // Libera el anillo de un hilo al terminar
+    pthread_once_t key_once;
+    atomic_ullong sequence; // Siguiente número de secuencia a repartir
+    unsigned long long next_sequence; // Siguiente registro a escribir (hilo de log)
+    
+    pthread_t thread;
+    atomic_int started;
+    atomic_int shutdown;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    
+    // Filtros en tiempo de ejecución
+    int level;
+    unsigned category_mask;
+    int drop_when_full; // 1 = descartar si el anillo está lleno, 0 = esperar
+    int hide_phases; // 1 = aplicar los filtros también a los recuadros de fase
+    atomic_ulong dropped;
+    atomic_ulong waits;
+    
+    // Salida por lotes y hora en caché (solo el hilo de log)
+    char output[LOG_OUTPUT_BUFFER];
+    size_t output_used;
+    time_t cached_second;
+    char cached_time[16];
+} Logger;
+
+// Registros de traza pendientes de un hilo (solo los escribe ese hilo)
+typedef struct {
+    TraceRecord* records;
+    size_t count;
+    size_t capacity;
+} TraceBuffer;
+
+// Grabador de traza binaria: los hilos acumulan registros en su buffer, el hilo de
+// ticks los junta al final de cada tick y un hilo escritor los vuelca al archivo
+typedef struct {
+    int enabled;
+    int fd;
+    char path[256];
+    TraceBuffer* _Atomic buffers[TRACE_MAX_BUFFERS];
+    atomic_int buffer_count;
+    
+    // Doble buffer de salida: uno se llena mientras el escritor vacía el otro
+    char* staging[2];
+    size_t staging_used[2];
+    size_t staging_capacity[2];
+    int active;
+    int pending; // Buffer que está escribiendo el escritor (-1 = ninguno)
+    int shutdown;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    
+    unsigned long long records;
+} TraceRecorder;
+
+// Canal de comandos y telemetría de la misión. Con CHANNEL_SHM todo vive en una región
+// compartida: un slot de comando por drone, la cola de comandos al centro, un anillo de
+// telemetría por hilo y las fotos del mundo; con CHANNEL_FIFO se usan las FIFOs de
+// siempre y las fotos viven en memoria propia (solo para el intérprete).
+typedef struct {
+    ChannelMode mode;
+    char name[64]; // Nombre de la región para shm_open
+    char* base; // Región mapeada (NULL = sin región)
+    size_t size;
+    ShmHeader* header;
+    ShmCommandSlot* slots;
+    ShmCommandQueue* queue;
+    unsigned generation; // Cambia con cada región nueva (los hilos vuelven a tomar anillo)
+    char* snapshots; // Primera foto del mundo (NULL = sin fotos)
+    size_t snapshot_size; // Bytes entre fotos
+    _Atomic uint64_t* snapshots_published; // En la cabecera, o local_published sin región
+    _Atomic uint64_t local_published;
+    char* snapshot_memory; // Fotos en memoria propia (CHANNEL_FIFO)
+} CommandChannel;
+
+// Línea de comandos de texto a medio leer de una fuente
+typedef struct {
+    char data[COMMAND_LINE_MAX];
+    size_t used;
+    int overflowed; // 1 = la línea no cupo: se descarta hasta el próximo separador
+} CommandLineBuffer;
+
+// Intérprete de comandos: un hilo que espera con epoll la FIFO del centro (comandos de
+// texto y timbre de la cola compartida), la entrada del operador y su eventfd de parada,
+// y despacha cada lote de comandos a los enjambres y drones mientras corre la misión
+typedef struct {
+    int read_stdin; // 1 = aceptar comandos del operador por la entrada estándar
+    pthread_t thread;
+    int started;
+    int epoll_fd;
+    int stop_fd; // eventfd que detiene el hilo
+    CommandLineBuffer fifo_line;
+    CommandLineBuffer stdin_line;
+    int32_t* pending_target; // Objetivo por drone cuyo slot estaba ocupado (-1 = nada)
+    int* pending; // Drones con un retask pendiente (se reintentan en cada pasada)
+    int pending_count;
+    unsigned long received;
+    unsigned long applied;
+    unsigned long rejected;
+    int burst_max; // Más comandos despachados en una sola pasada
+    unsigned long latency[COMMAND_LATENCY_BUCKETS]; // El último balde acumula el resto
+    uint64_t latency_max_ns;
+} CommandInterpreter;
+
+// Enjambre candidato a cubrir un objetivo que quedó corto, con su costo de llegar
+typedef struct {
+    double cost;
+    int swarm;
+} RetaskCandidate;
+
+// Motor de re-asignación en vuelo: desde el ataque global hasta el re-ensamblaje lleva los
+// drones de ataque vivos de cada enjambre y de cada objetivo. Cada pérdida (EVT_DESTROYED
+// o EVT_FUEL_EMPTY) descuenta en O(1); solo cuando un objetivo queda por debajo de sus
+// required_attacks se buscan enjambres libres para cubrirlo.
+typedef struct {
+    int enabled; // retasking= de config.txt
+    atomic_int active; // Lo leen sin bloqueos los trabajadores y el intérprete
+    pthread_mutex_t mutex; // Lo comparten el hilo de ticks y el intérprete de comandos
+    int* swarm_attack; // Drones de ataque vivos de cada enjambre (los que salieron al ataque)
+    int* swarm_target; // Objetivo de cada enjambre
+    int* swarm_next; // Lista doble de los enjambres de cada objetivo
+    int* swarm_prev;
+    int* target_attack; // Suma de swarm_attack de los enjambres del objetivo
+    int* target_head; // Primer enjambre del objetivo (-1 = ninguno)
+    int* target_taken; // Ataques ya elegidos de cada objetivo en una búsqueda
+    uint8_t* target_lost; // 1 = no hubo enjambres libres que lo cubran: los suyos quedan libres
+    uint8_t* target_queued; // 1 = en short_targets
+    int* short_targets; // Objetivos que quedaron cortos en el tick
+    uint8_t* counted; // 1 = drone de ataque contado en swarm_attack
+    int* lost; // Drones perdidos (cada drone se pierde una sola vez)
+    atomic_int lost_count;
+    int lost_seen; // Pérdidas ya descontadas
+    RetaskCandidate* candidates;
+    unsigned long losses; // Pérdidas de drones contados
+    unsigned long moves; // Enjambres redirigidos
+    int shortfalls; // Veces que un objetivo quedó corto
+    int abandoned; // Objetivos que no se pudieron cubrir
+    double busy_ms; // Tiempo total del motor
+} RetaskEngine;
+
+// Etapas del centro de comando: una misión restaurada sigue desde la etapa guardada
+typedef enum {
+    STAGE_ASSEMBLY = 0, // Fase 1 (la misión desde el principio)
+    STAGE_ATTACK, // Fase 2: ataque global
+    STAGE_DEFENSE, // Fase 3: cruce de la zona de defensa
+    STAGE_FINAL_ATTACK, // Fase 4: ataque final y llegada al objetivo
+    STAGE_REASSEMBLY, // Fase 4.2: enjambres en el objetivo, antes del re-ensamblaje
+    STAGE_DETONATION, // Fase 5
+    STAGE_COUNT
+} MissionStage;
+
+static const char* const mission_stage_names[STAGE_COUNT] = {
+    "assembly", "attack", "defense", "final", "reassembly", "detonation"
+};
+
+// Escalares de la misión que guarda un punto de control; todo lo demás vive en la arena
+#define CHECKPOINT_VALUES(X) \
+    X(system_state.W) X(system_state.Q) X(system_state.Z) X(system_state.speed) X(system_state.initial_fuel) \
+    X(system_state.seed) X(system_state.start_time) \
+    X(system_state.map_width) X(system_state.map_height) X(system_state.assembly_y) \
+    X(system_state.defense_zone_start) X(system_state.defense_zone_end) X(system_state.reassembly_y) \
+    X(system_state.truck_count) X(system_state.target_count) X(system_state.defense_count) \
+    X(system_state.defense_range) X(system_state.swarms_requested) \
+    X(system_state.attack_per_swarm) X(system_state.camera_per_swarm) \
+    X(system_state.assignment_mode) X(system_state.routing_mode) \
+    X(system_state.swarm_count) X(system_state.swarm_capacity) \
+    X(system_state.drone_count) X(system_state.drone_capacity) X(system_state.state_words) \
+    X(system_state.drones_in_defense_zone) X(system_state.barrier.pending_states) \
+    X(system_state.barrier.pending_in_zone) X(system_state.barrier.remaining) X(system_state.barrier.armed) \
+    X(system_state.global_attack_commanded) X(system_state.all_swarms_ready) X(system_state.phase) \
+    X(system_state.threat.width) X(system_state.threat.height) X(system_state.threat.version) \
+    X(retask.enabled) X(retask.active) X(retask.lost_count) X(retask.lost_seen) \
+    X(retask.losses) X(retask.moves) X(retask.shortfalls) X(retask.abandoned)
+
+// Punteros a la arena: en el punto de control van como offsets desde su base
+#define CHECKPOINT_POINTERS(X) \
+    X(system_state.trucks) X(system_state.targets) X(system_state.defenses) \
+    X(system_state.threat.hazard) X(system_state.threat.threshold) \
+    X(system_state.assembly_points) X(system_state.reassembly_points) X(system_state.target_assignments) \
+    X(system_state.target_outcome) X(system_state.target_confirmed) X(flow.fields) X(flow.pending) \
+    X(system_state.swarms) X(system_state.drones) X(system_state.state_bits) \
+    X(system_state.store.pos_x) X(system_state.store.pos_y) X(system_state.store.target_x) \
+    X(system_state.store.target_y) X(system_state.store.fuel) X(system_state.store.distance_traveled) \
+    X(system_state.store.state) X(system_state.store.arrived) X(system_state.store.vulnerability) \
+    X(system_state.store.shoot_down_threshold) X(system_state.store.draws) X(system_state.store.route) \
+    X(retask.swarm_attack) X(retask.swarm_target) X(retask.swarm_next) X(retask.swarm_prev) \
+    X(retask.target_attack) X(retask.target_head) X(retask.target_taken) X(retask.target_lost) \
+    X(retask.target_queued) X(retask.short_targets) X(retask.counted) X(retask.lost) X(retask.candidates)
+
+#define CHECKPOINT_COUNT(field) + 1
+enum {
+    CHECKPOINT_VALUE_COUNT = 0 CHECKPOINT_VALUES(CHECKPOINT_COUNT),
+    CHECKPOINT_POINTER_COUNT = 0 CHECKPOINT_POINTERS(CHECKPOINT_COUNT)
+};
+
+// Cabecera del punto de control. Archivo = cabecera seguida, en arena_offset (alineado a
+// página), de la imagen de la arena sin punteros: los miembros de cada enjambre guardan
+// su offset en la arena, sin mutex ni campos de flujo construidos. Se restaura mapeando
+// la imagen con MAP_PRIVATE, así varias continuaciones comparten las páginas que no tocan.
+typedef struct {
+    char magic[8]; // CHECKPOINT_MAGIC (con terminador)
+    uint32_t version;
+    uint32_t header_size; // sizeof(CheckpointHeader)
+    uint32_t value_count; // CHECKPOINT_VALUE_COUNT
+    uint32_t pointer_count; // CHECKPOINT_POINTER_COUNT
+    int32_t stage; // MissionStage con la que sigue la misión
+    uint32_t reserved;
+    int64_t tick; // Ticks completados
+    uint64_t arena_offset;
+    uint64_t arena_size; // Tamaño de la arena (el archivo lo cubre entero, con huecos)
+    uint64_t arena_used;
+    int64_t values[CHECKPOINT_VALUE_COUNT];
+    int64_t state_counts[DRONE_STATE_COUNT];
+    int64_t losses[LOSS_CAUSE_COUNT];
+    uint64_t pointers[CHECKPOINT_POINTER_COUNT]; // Offset en la arena (CHECKPOINT_NULL = NULL)
+} CheckpointHeader;
+
+// Puntos de control de la misión (checkpoint= / restore= en config.txt)
+typedef struct {
+    char path[256]; // Archivo a escribir (vacío = sin punto de control)
+    MissionStage at; // Etapa antes de la cual se escribe
+    char restore_path[256]; // Punto de control a restaurar (vacío = misión desde el principio)
+    MissionStage resume; // Etapa desde la que sigue la misión (STAGE_ASSEMBLY = desde el principio)
+    long resume_tick;
+} CheckpointConfig;
+
+// Registro de misión para repetirla (replay= / --record / --replay). Archivo = ReplayHeader,
+// config_size bytes de config.txt, scenario_size bytes del escenario (texto o binario, tal
+// cual) y registros ReplayRecord en orden de tick: los comandos
+// del operador en el tick en que se aplicaron y, por cada tick con eventos, su cuenta y
+// su resumen. Todo lo demás sale de la semilla.
+typedef struct {
+    char magic[8]; // REPLAY_MAGIC (sin terminador)
+    uint32_t version;
+    uint32_t record_size; // sizeof(ReplayRecord)
+    uint64_t seed;
+    int64_t start_time; // Hora de pared del tick 0 (la de los eventos)
+    uint32_t tick_ms;
+    uint32_t config_size;
+    uint32_t scenario_size; // 0 = sin escenario
+    uint32_t reserved;
+    char scenario[256]; // Ruta del escenario de la corrida (solo para los mensajes)
+} ReplayHeader;
+
+// Tipos de registro
+typedef enum {
+    REPLAY_COMMAND = 0, // Comando del operador: value = CommandType, a = objetivo, b = enjambre
+    REPLAY_RETASK_DRONE, // retask_drone del operador: value = CMD_RETASK, a = objetivo, b = drone
+    REPLAY_EVENTS, // Eventos del tick: a = cuenta, digest = suma de sus resúmenes
+    REPLAY_END // Fin de la misión: a = eventos en total, digest = resumen del informe final
+} ReplayKind;
+
+// Registro de 24 bytes
+typedef struct {
+    uint32_t tick;
+    uint8_t kind; // ReplayKind
+    uint8_t value;
+    uint16_t reserved;
+    int32_t a;
+    int32_t b;
+    uint64_t digest;
+} ReplayRecord;
+
+typedef enum {
+    REPLAY_OFF = 0,
+    REPLAY_RECORD,
+    REPLAY_PLAY
+} ReplayMode;
+
+// Registro o repetición en curso. Con registro o repetición los comandos del operador no
+// se aplican al llegar: el intérprete los deja en staged y el hilo de ticks los aplica al
+// final del tick, así caen siempre en el mismo tick.
+typedef struct {
+    ReplayMode mode;
+    char path[256];
+    FILE* file; // Al registrar
+    pthread_mutex_t mutex; // Protege staged (el intérprete agrega, el hilo de ticks vacía)
+    ReplayRecord* staged;
+    int staged_count;
+    int staged_capacity;
+    ReplayRecord* records; // Al repetir: el registro completo
+    long record_count;
+    long cursor; // Próximo registro por comparar o aplicar
+    char* config; // Al repetir: config.txt de la corrida registrada
+    uint32_t config_size;
+    char* scenario; // Al repetir: el escenario de la corrida registrada
+    uint32_t scenario_size;
+    _Atomic uint64_t tick_digest; // Eventos del tick en curso (suma: no importa el orden)
+    atomic_int tick_events;
+    unsigned long long events; // Eventos en total
+    long divergent_ticks; // Al repetir: ticks con eventos distintos
+    long first_divergence; // Primer tick distinto (-1 = ninguno)
+    int end_matched; // Al repetir: 1 = el informe final coincidió
+} ReplayLog;
+
+// Parámetro de config.txt que recorre el barrido (lista de valores a probar)
+typedef struct {
+    const char* name;
+    int* field; // Campo de system_state que fija cada punto
+    int values[SWEEP_MAX_VALUES];
+    int count; // 0 = no se barre (queda el valor de config.txt)
+} SweepParameter;
+
+// Unidad de oferta (un drone excedente) o demanda (un hueco) del re-ensamblaje
+typedef struct {
+    int swarm;
+    int drone; // Id del drone, o -1 en la demanda
+    Position pos; // Donde está el drone, o donde se re-ensambla el enjambre del hueco
+} ReassemblyUnit;
+
+// Registros de un escenario. El formato binario es la cabecera seguida de los arreglos
+// de cada tipo con estos mismos structs, así que cargarlo son cinco fread.
+typedef struct {
+    int32_t x, y;
+    int32_t assembly_x, assembly_y; // -1 = (x, assembly_y del escenario)
+    int32_t reassembly_x, reassembly_y; // -1 = (x, reassembly_y del escenario)
+} ScenarioTruck;
+
+typedef struct {
+    int32_t x, y;
+    int32_t required_attacks; // 0 = attack_per_swarm
+} ScenarioTarget;
+
+typedef struct {
+    int32_t x, y;
+    int32_t probability; // -1 = W de config.txt (así la barre el barrido)
+    int32_t range; // -1 = defense_range de config.txt
+} ScenarioDefense;
+
+typedef struct {
+    int32_t truck;
+    int32_t attack;
+    int32_t camera;
+} ScenarioSwarm;
+
+// Cabecera del escenario binario
+typedef struct {
+    char magic[8]; // SCENARIO_MAGIC
+    uint32_t version;
+    int32_t map_width, map_height;
+    int32_t assembly_y, defense_start, defense_end, reassembly_y;
+    uint32_t truck_count, target_count, defense_count, swarm_count;
+} ScenarioHeader;
+
+// Escenario cargado: lo que no lista (camiones, objetivos, defensas o enjambres) se
+// arma como siempre con los valores de config.txt
+typedef struct {
+    char path[256];
+    int loaded;
+    ScenarioHeader header;
+    ScenarioTruck* trucks;
+    ScenarioTarget* targets;
+    ScenarioDefense* defenses;
+    ScenarioSwarm* swarms;
+    int capacity[4]; // Capacidad de cada arreglo mientras se lee el texto
+} Scenario;
+
 // Variables globales del sistema
 typedef struct {
     // Configuración
@@ -179,29 +863,81 @@ typedef struct {
     int speed; // Velocidad de movimiento
     int initial_fuel; // Combustible inicial
     int ticks; // Número de ticks de simulación
-    
-    // Componentes del sistema
-    Truck trucks[NUM_TRUCKS];
-    Target targets[NUM_TARGETS];
-    EnemyDefense defenses[NUM_ENEMY_DEFENSES];
-    Position assembly_points[NUM_ASSEMBLY_POINTS];
-    Position reassembly_points[NUM_REASSEMBLY_POINTS];
+    int workers; // Hilos del pool (0 = uno por núcleo)
+    int virtual_time; // 1 = avanzar ticks sin esperar al reloj de pared
+    uint64_t seed; // Semilla de la corrida (misma semilla = mismos sorteos)
+    int seed_set; // 1 si la semilla vino de config.txt o de --seed
+    
+    // Modo lote (Monte Carlo)
+    int batch_runs; // Corridas del lote (0 = una misión normal)
+    int batch_jobs; // Procesos en paralelo (0 = uno por núcleo)
+    int batch_min_runs; // Corridas mínimas antes de la parada temprana
+    double batch_ci; // Semi-ancho de IC del 95% que detiene el lote
+    
+    // Barrido de parámetros
+    char sweep_path[256]; // CSV de resultados (vacío = sin barrido)
+    int sweep_lhs; // 1 = hipercubo latino, 0 = rejilla completa
+    int sweep_samples; // Puntos del hipercubo latino
+    int sweep_seeds; // Semillas por punto
+    int reuse_arena; // 1 = cleanup_system conserva la arena para la siguiente misión
+    time_t start_time; // Hora de pared del tick 0
+    
+    // Mapa y zonas (por defecto 100x100; un escenario puede cambiarlos)
+    int map_width;
+    int map_height;
+    int assembly_y;
+    int defense_zone_start;
+    int defense_zone_end;
+    int reassembly_y;
+    
+    // Tamaño de la flota (elegido al arrancar)
+    int truck_count;
+    int target_count;
+    int defense_count;
+    int defense_range;
+    int swarms_requested; // Enjambres a crear (0 = uno por camión)
+    int attack_per_swarm;
+    int camera_per_swarm;
+    AssignmentMode assignment_mode;
+    RoutingMode routing_mode;
+    
+    // Memoria de la flota: todos los componentes viven en una sola arena
+    Arena arena;
+    
+    // Componentes del sistema (una posición de ensamble/re-ensamble por camión)
+    Truck* trucks;
+    Target* targets;
+    EnemyDefense* defenses;
+    ThreatField threat;
+    Position* assembly_points;
+    Position* reassembly_points;
     
     // Estado del sistema
-    Swarm* swarms[MAX_DRONES / DRONES_PER_SWARM];
+    Swarm* swarms;
     int swarm_count;
-    Drone* all_drones[MAX_DRONES];
+    int swarm_capacity;
+    Drone* drones; // Indexados por id de drone
+    DroneStore store; // Campos calientes de los drones
     int drone_count;
-    Event event_queue[MAX_EVENTS];
-    int event_count;
-    int event_head;
-    int event_tail;
+    int drone_capacity;
+    EventQueue events;
+    int event_queue_capacity;
+    EventOverflowPolicy event_overflow;
+    
+    // Histograma de estados de la flota (los huecos sin drone cuentan como CREATED) y un
+    // conjunto de bits por estado sobre los ids: bloque [estado][state_words]
+    atomic_int state_counts[DRONE_STATE_COUNT];
+    _Atomic uint64_t* state_bits;
+    int state_words;
+    atomic_int drones_in_defense_zone;
+    PhaseBarrier barrier;
     
     // Sincronización
     pthread_mutex_t system_mutex;
-    pthread_cond_t system_condition;
     int global_attack_commanded;
     int all_swarms_ready;
+    atomic_int attack_requested; // 1 = el operador adelantó el ataque global
+    atomic_int defense_requested; // 1 = el operador pidió cambiar alguna defensa
     
     // Archivos FIFO
     int center_fifo_fd;
@@ -211,750 +947,5026 @@ typedef struct {
     int simulation_running;
     int phase;
     
-    // Asignación aleatoria de objetivos a enjambres
-    int target_assignments[NUM_TRUCKS];
+    // Asignación de objetivos a enjambres (uno por enjambre; el operador puede cambiarla)
+    _Atomic int* target_assignments;
+    
+    // Resultado de la misión (lo llena command_detonation; lo usa el modo lote)
+    int* target_outcome; // TargetState por objetivo, o -1 si no hubo ataque
+    uint8_t* target_confirmed; // 1 si un drone cámara confirmó el resultado
+    atomic_int losses[LOSS_CAUSE_COUNT];
 } SystemState;
 
 // Variables globales
 SystemState system_state;
-pthread_mutex_t log_mutex;
+TickScheduler scheduler;
+pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER; // Solo para la escritura directa
+Logger logger = {.category_mask = (1u << LOG_CAT_COUNT) - 1, .key_once = PTHREAD_ONCE_INIT};
+TraceRecorder trace;
+Scenario scenario;
+FlowPlanner flow;
+CommandChannel channel = {.mode = CHANNEL_SHM, .name = SHM_DEFAULT_NAME};
+CommandInterpreter interpreter = {.read_stdin = 1};
+RetaskEngine retask = {.enabled = 1, .mutex = PTHREAD_MUTEX_INITIALIZER};
+CheckpointConfig checkpoint = {.at = STAGE_REASSEMBLY};
+ReplayLog replay = {.mutex = PTHREAD_MUTEX_INITIALIZER, .first_divergence = -1};
+SweepParameter sweep_parameters[] = {
+    {"W", &system_state.W, {0}, 0},
+    {"Q", &system_state.Q, {0}, 0},
+    {"Z", &system_state.Z, {0}, 0},
+    {"speed", &system_state.speed, {0}, 0},
+    {"fuel", &system_state.initial_fuel, {0}, 0},
+};
+#define SWEEP_PARAM_COUNT (int)(sizeof(sweep_parameters) / sizeof(sweep_parameters[0]))
 
 // Declaraciones de función
 void optimize_drone_distribution();
+void hungarian_assign(const double* cost, int rows, int cols, int* row_to_col);
+void scheduler_parallel_for(int count, void (*task)(int index, long tick), long tick);
 void log_phase_header(const char* phase_name);
 void log_sub_phase(const char* sub_phase_name);
-void log_event(const char* event_type, const char* format, ...);
-void log_status(const char* format, ...);
+void log_write(LogLevel level, LogCategory category, LogKind kind, const char* tag, const char* format, ...);
+
+// Macros de log: los niveles bajo LOG_MIN_LEVEL se descartan al compilar
+#define log_at(level, category, ...) \
+    do { if ((level) >= LOG_MIN_LEVEL) log_write(level, category, LOG_KIND_MESSAGE, NULL, __VA_ARGS__); } while (0)
+#define log_debug(category, ...) log_at(LOG_DEBUG, category, __VA_ARGS__)
+#define log_message(...) log_at(LOG_INFO, LOG_CAT_SYSTEM, __VA_ARGS__)
+#define log_drone(...) log_at(LOG_INFO, LOG_CAT_DRONE, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_WARN, LOG_CAT_SYSTEM, __VA_ARGS__)
+#define log_error(...) log_at(LOG_ERROR, LOG_CAT_SYSTEM, __VA_ARGS__)
+#define log_event(event_type, ...) log_write(LOG_INFO, LOG_CAT_COMM, LOG_KIND_EVENT, event_type, __VA_ARGS__)
+#define log_status(...) log_write(LOG_INFO, LOG_CAT_SYSTEM, LOG_KIND_STATUS, NULL, __VA_ARGS__)
 void fly_in_circles(Drone* drone);
 int try_extract_drones_from_swarm(Swarm* target_swarm, int source_swarm_id, int* needed_attack, int* needed_camera, int target_swarm_id);
-int try_extract_drones_from_swarm_exclusive(Swarm* target_swarm, int source_swarm_id, int* needed_attack, int* needed_camera, int target_swarm_id, int* drones_reassigned);
 void wait_for_defense_zone_crossing();
 void wait_for_reassembly_ready();
 void command_final_attack();
 void command_detonation();
 void wait_for_all_drones_at_target();
+void process_events();
+void retask_note_loss(int drone_id);
+void retask_note_move(int swarm_id, int target_id);
+void retask_end_tick();
+int replay_stage(ReplayKind kind, int type, int a, int b);
+void replay_note_event(const Event* event);
+void replay_end_tick(long tick);
 
-// Funciones de utilidad
-void log_message(const char* format, ...) {
-    va_list args;
-    va_start(args, format);
-    
-    pthread_mutex_lock(&log_mutex);
-    time_t now = time(NULL);
-    struct tm* tm_info = localtime(&now);
-    char time_str[26];
-    strftime(time_str, 26, "%H:%M:%S", tm_info);
-    
-    printf("[%s] ", time_str);
-    vprintf(format, args);
-    printf("\n");
-    fflush(stdout);
-    
-    pthread_mutex_unlock(&log_mutex);
-    va_end(args);
-}
-
-// Función para mostrar separadores de fase de manera limpia
-void log_phase_header(const char* phase_name) {
-    pthread_mutex_lock(&log_mutex);
-    printf("\n");
-    printf("╔══════════════════════════════════════════════════════════════════════════════╗\n");
-    printf("║                              %-45s ║\n", phase_name);
-    printf("╚══════════════════════════════════════════════════════════════════════════════╝\n");
-    fflush(stdout);
-    pthread_mutex_unlock(&log_mutex);
-}
-
-// Función para mostrar sub-fases de manera organizada
-void log_sub_phase(const char* sub_phase_name) {
-    pthread_mutex_lock(&log_mutex);
-    printf("  ┌─ %s\n", sub_phase_name);
-    fflush(stdout);
-    pthread_mutex_unlock(&log_mutex);
+// Funciones de reloj de simulación
+// Ticks de simulación completados
+long sim_now() {
+    return atomic_load_explicit(&scheduler.clock_tick, memory_order_acquire);
 }
 
-// Función para mostrar eventos importantes de manera destacada
-void log_event(const char* event_type, const char* format, ...) {
-    va_list args;
-    va_start(args, format);
-    
-    pthread_mutex_lock(&log_mutex);
-    time_t now = time(NULL);
-    struct tm* tm_info = localtime(&now);
-    char time_str[26];
-    strftime(time_str, 26, "%H:%M:%S", tm_info);
-    
-    printf("  │ [%s] [%s] ", time_str, event_type);
-    vprintf(format, args);
-    printf("\n");
-    fflush(stdout);
-    
-    pthread_mutex_unlock(&log_mutex);
-    va_end(args);
+// Hora simulada: hora de inicio más el tiempo simulado transcurrido
+time_t sim_time_now() {
+    return system_state.start_time + sim_now() / TICKS_PER_SECOND;
 }
 
-// Función para mostrar estado del sistema de manera organizada
-void log_status(const char* format, ...) {
-    va_list args;
-    va_start(args, format);
-    
-    pthread_mutex_lock(&log_mutex);
-    printf("  │ ");
-    vprintf(format, args);
-    printf("\n");
-    fflush(stdout);
-    
-    pthread_mutex_unlock(&log_mutex);
-    va_end(args);
+// Reloj monotónico en nanosegundos (el mismo para todos los procesos del equipo)
+uint64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
 }
 
-// Función para calcular distancia entre dos posiciones
-double calculate_distance(Position p1, Position p2) {
-    int dx = p1.x - p2.x;
-    int dy = p1.y - p2.y;
-    return sqrt(dx * dx + dy * dy);
-}
+// Funciones de log asíncrono
+_Thread_local LogRing* log_thread_ring; // Anillo del hilo actual (se toma al primer uso)
 
-// Función para mover drone hacia un objetivo
-void move_drone_towards(Drone* drone, Position target) {
-    double distance = calculate_distance(drone->pos, target);
-    if (distance <= system_state.speed) {
-        drone->pos = target;
-        drone->distance_traveled += (int)distance;
-    } else {
-        double ratio = system_state.speed / distance;
-        int dx = (int)((target.x - drone->pos.x) * ratio);
-        int dy = (int)((target.y - drone->pos.y) * ratio);
-        drone->pos.x += dx;
-        drone->pos.y += dy;
-        drone->distance_traveled += system_state.speed;
+// Función para crear un anillo vacío
+LogRing* log_ring_create() {
+    LogRing* ring = calloc(1, sizeof(LogRing));
+    if (!ring || posix_memalign((void**)&ring->buffer, ARENA_ALIGNMENT, LOG_RING_SIZE) != 0) {
+        free(ring);
+        return NULL;
     }
+    ring->mask = LOG_RING_SIZE - 1;
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->retired, 0);
+    return ring;
 }
 
-// Función para verificar si un drone está en una zona
-int is_drone_in_zone(Drone* drone, int zone_start, int zone_end) {
-    return drone->pos.y >= zone_start && drone->pos.y <= zone_end;
-}
-
-// Función para verificar probabilidad
-int check_probability(int percentage) {
-    // Función simple y precisa de probabilidad
-    // percentage debe estar entre 0 y 100
-    if (percentage <= 0) return 0;
-    if (percentage >= 100) return 1;
-    
-    // Generar número aleatorio entre 0 y 99
-    int random_value = rand() % 100;
-    
-    // Retornar true si el valor aleatorio es menor que el porcentaje
-    return random_value < percentage;
+// Función que corre al terminar un hilo con anillo: lo deja para el próximo hilo nuevo
+// (lo que quedó sin escribir sale antes que lo del hilo nuevo, por la secuencia)
+void log_ring_retire(void* ring) {
+    atomic_store_explicit(&((LogRing*)ring)->retired, 1, memory_order_release);
 }
 
-// Función para crear nombre de FIFO
-void create_fifo_name(char* buffer, int drone_id) {
-    snprintf(buffer, 64, "%s/drone_%d", FIFO_PATH, drone_id);
+void log_ring_key_create() {
+    pthread_key_create(&logger.ring_key, log_ring_retire);
 }
 
-// Función para crear FIFO
-int create_drone_fifo(int drone_id) {
-    char fifo_name[64];
-    create_fifo_name(fifo_name, drone_id);
+// Función para obtener el anillo del hilo actual: el suyo, uno reciclado de un hilo que
+// terminó, uno nuevo o, si no quedan, el compartido (slot 0). NULL solo sin ninguno.
+LogRing* log_ring_for_thread() {
+    if (log_thread_ring) {
+        return log_thread_ring;
+    }
     
-    if (mkfifo(fifo_name, 0666) == -1 && errno != EEXIST) {
-        log_message("Error creando FIFO para drone %d: %s", drone_id, strerror(errno));
-        return -1;
+    LogRing* ring = NULL;
+    int count = atomic_load(&logger.ring_count);
+    for (int i = 1; i < count && i < LOG_MAX_RINGS && !ring; i++) {
+        LogRing* candidate = atomic_load_explicit(&logger.rings[i], memory_order_acquire);
+        int retired = 1;
+        if (candidate && atomic_compare_exchange_strong(&candidate->retired, &retired, 0)) {
+            ring = candidate;
+        }
     }
     
-    int fd = open(fifo_name, O_RDWR | O_NONBLOCK);
-    if (fd == -1) {
-        log_message("Error abriendo FIFO para drone %d: %s", drone_id, strerror(errno));
-        return -1;
+    // Slot nuevo sin pasarse de LOG_MAX_RINGS (la cuenta no crece más allá)
+    while (!ring && count < LOG_MAX_RINGS) {
+        if (atomic_compare_exchange_weak(&logger.ring_count, &count, count + 1)) {
+            ring = log_ring_create();
+            if (ring) {
+                atomic_store_explicit(&logger.rings[count], ring, memory_order_release);
+            }
+            break;
+        }
     }
     
-    return fd;
+    if (ring) {
+        pthread_setspecific(logger.ring_key, ring);
+    } else {
+        ring = atomic_load_explicit(&logger.rings[0], memory_order_acquire);
+    }
+    log_thread_ring = ring;
+    return ring;
 }
 
-// Función para enviar evento
-void send_event(EventType type, int drone_id, int swarm_id, int truck_id, const char* data) {
-    pthread_mutex_lock(&system_state.system_mutex);
-    
-    if (system_state.event_count < MAX_EVENTS) {
-        Event* event = &system_state.event_queue[system_state.event_tail];
-        event->type = type;
-        event->drone_id = drone_id;
-        event->swarm_id = swarm_id;
-        event->truck_id = truck_id;
-        event->timestamp = time(NULL);
-        if (data) {
-            strncpy(event->data, data, sizeof(event->data) - 1);
-            event->data[sizeof(event->data) - 1] = '\0';
-        } else {
-            event->data[0] = '\0';
+// Función para capturar los argumentos según el formato: enteros, punteros y dobles
+// ocupan 8 bytes; las cadenas se copian (hasta LOG_MAX_STRING) con su terminador
+size_t log_capture_args(const char* format, va_list args, char* out, size_t capacity) {
+    size_t used = 0;
+    
+    for (const char* p = format; *p; p++) {
+        if (*p != '%') continue;
+        p++;
+        if (*p == '%') continue;
+        
+        while (*p && strchr("-+ #0", *p)) p++;
+        if (*p == '*') {
+            long long width = va_arg(args, int);
+            if (used + 8 <= capacity) { memcpy(out + used, &width, 8); used += 8; }
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                long long precision = va_arg(args, int);
+                if (used + 8 <= capacity) { memcpy(out + used, &precision, 8); used += 8; }
+                p++;
+            }
+            while (*p >= '0' && *p <= '9') p++;
         }
         
-        system_state.event_tail = (system_state.event_tail + 1) % MAX_EVENTS;
-        system_state.event_count++;
+        int longs = 0, size_t_arg = 0;
+        while (*p && strchr("hlzjtL", *p)) {
+            if (*p == 'l') longs++;
+            if (*p == 'z' || *p == 'j' || *p == 't') size_t_arg = 1;
+            p++;
+        }
+        if (!*p) break;
         
-        log_message("Evento enviado: %d (Drone %d, Swarm %d, Truck %d)", 
-                   type, drone_id, swarm_id, truck_id);
-    }
-    
-    pthread_mutex_unlock(&system_state.system_mutex);
-}
-
-// Función para enviar comando
-void send_command(CommandType type, int target_id, const char* data) {
-    Command cmd;
-    cmd.type = type;
-    cmd.target_id = target_id;
-    if (data) {
-        strncpy(cmd.data, data, sizeof(cmd.data) - 1);
-        cmd.data[sizeof(cmd.data) - 1] = '\0';
-    } else {
-        cmd.data[0] = '\0';
-    }
-    
-    if (write(system_state.center_fifo_fd, &cmd, sizeof(cmd)) == -1) {
-        log_message("Error enviando comando: %s", strerror(errno));
+        char slot[8];
+        switch (*p) {
+            case 'd': case 'i': case 'c': {
+                long long value = size_t_arg ? (long long)va_arg(args, ssize_t) :
+                                  longs >= 2 ? va_arg(args, long long) :
+                                  longs == 1 ? va_arg(args, long) : va_arg(args, int);
+                memcpy(slot, &value, 8);
+                break;
+            }
+            case 'u': case 'x': case 'X': case 'o': {
+                unsigned long long value = size_t_arg ? va_arg(args, size_t) :
+                                           longs >= 2 ? va_arg(args, unsigned long long) :
+                                           longs == 1 ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+                memcpy(slot, &value, 8);
+                break;
+            }
+            case 'f': case 'e': case 'g': case 'E': case 'G': {
+                double value = va_arg(args, double);
+                memcpy(slot, &value, 8);
+                break;
+            }
+            case 's': {
+                const char* text = va_arg(args, const char*);
+                if (!text) text = "(null)";
+                size_t length = strnlen(text, LOG_MAX_STRING - 1);
+                if (used + length + 1 > capacity) return used;
+                memcpy(out + used, text, length);
+                out[used + length] = '\0';
+                used += length + 1;
+                continue;
+            }
+            default: {
+                void* value = va_arg(args, void*);
+                memcpy(slot, &value, 8);
+                break;
+            }
+        }
+        if (used + 8 > capacity) return used;
+        memcpy(out + used, slot, 8);
+        used += 8;
     }
+    return used;
 }
 
-// Hilo de navegación del drone
-void* drone_navigation_thread(void* arg) {
-    Drone* drone = (Drone*)arg;
-    
-    while (drone->active && drone->state != DRONE_STATE_DESTROYED && system_state.simulation_running) {
-        // Verificar si la simulación sigue corriendo ANTES de procesar navegación
-        if (!system_state.simulation_running) {
-            break;
+// Función para expandir el formato con los argumentos capturados (la usa el formateador)
+size_t log_expand(const char* format, const char* payload, size_t payload_size, char* out, size_t capacity) {
+    size_t used = 0, read = 0;
+    
+    for (const char* p = format; *p && used + 1 < capacity; p++) {
+        if (*p != '%') {
+            out[used++] = *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[used++] = '%';
+            p++;
+            continue;
+        }
+        
+        // Reconstruir la especificación sin modificador de longitud: los enteros
+        // se capturaron como 64 bits y se imprimen con "ll"
+        char spec[32];
+        size_t spec_len = 0;
+        int star_args[2], stars = 0;
+        spec[spec_len++] = *p++;
+        while (*p && strchr("-+ #0123456789.*", *p) && spec_len < sizeof(spec) - 4) {
+            if (*p == '*' && stars < 2 && read + 8 <= payload_size) {
+                long long value;
+                memcpy(&value, payload + read, 8);
+                read += 8;
+                star_args[stars++] = (int)value;
+            }
+            spec[spec_len++] = *p++;
         }
+        while (*p && strchr("hlzjtL", *p)) p++;
+        if (!*p) break;
         
-        pthread_mutex_lock(&drone->mutex);
+        char conversion = *p;
+        int written = 0;
+        size_t room = capacity - used;
         
-        switch (drone->state) {
-            case DRONE_STATE_FLYING_TO_ASSEMBLY:
-                if (calculate_distance(drone->pos, drone->target) <= system_state.speed) {
-                    drone->pos = drone->target;
-                    drone->state = DRONE_STATE_CIRCLING_ASSEMBLY;
-                    if (system_state.simulation_running) {
-                        log_message("Drone %d llegó al punto de ensamble, comenzando patrulla circular", drone->id);
-                    }
-                } else {
-                    move_drone_towards(drone, drone->target);
+        if (conversion == 's') {
+            const char* text = read < payload_size ? payload + read : "";
+            read += strlen(text) + 1;
+            spec[spec_len++] = 's';
+            spec[spec_len] = '\0';
+            written = stars == 2 ? snprintf(out + used, room, spec, star_args[0], star_args[1], text) :
+                      stars == 1 ? snprintf(out + used, room, spec, star_args[0], text) :
+                                   snprintf(out + used, room, spec, text);
+        } else {
+            char slot[8] = {0};
+            if (read + 8 <= payload_size) {
+                memcpy(slot, payload + read, 8);
+            }
+            read += 8;
+            
+            if (strchr("diuxXoc", conversion)) {
+                if (conversion != 'c') {
+                    spec[spec_len++] = 'l';
+                    spec[spec_len++] = 'l';
                 }
-                break;
-                
-            case DRONE_STATE_CIRCLING_ASSEMBLY:
-                // Volar en círculos alrededor del punto de ensamble
-                fly_in_circles(drone);
-                break;
-                
-            case DRONE_STATE_FLYING_TO_TARGET:
-                if (calculate_distance(drone->pos, drone->target) <= system_state.speed) {
-                    drone->pos = drone->target;
-                    drone->state = DRONE_STATE_AT_TARGET;
-                    if (system_state.simulation_running) {
-                        log_message("Drone %d llegó al objetivo (distancia recorrida: %d unidades)", drone->id, drone->distance_traveled);
-                        send_event(EVT_AT_TARGET, drone->id, drone->swarm_id, drone->truck_id, "AT_TARGET");
-                    }
+                spec[spec_len++] = conversion;
+                spec[spec_len] = '\0';
+                long long value;
+                memcpy(&value, slot, 8);
+                if (conversion == 'c') {
+                    written = snprintf(out + used, room, spec, (int)value);
+                } else if (stars == 1) {
+                    written = snprintf(out + used, room, spec, star_args[0], value);
                 } else {
-                    move_drone_towards(drone, drone->target);
-                    
-                    // Verificar si está en zona de defensa (solo entre Y=33 y Y=66)
-                    // Verificar solo ocasionalmente para reducir probabilidad acumulada
-                    static int defense_check_counter = 0;
-                    defense_check_counter++;
-                    
-                    if (is_drone_in_zone(drone, DEFENSE_ZONE_START, DEFENSE_ZONE_END) && 
-                        (defense_check_counter % 5 == 0)) { // Solo verificar cada 5 ticks (500ms)
-                        if (check_probability(drone->shoot_down_probability)) {
-                            drone->state = DRONE_STATE_DESTROYED;
-                            if (system_state.simulation_running) {
-                                log_message("Drone %d derribado por defensas enemigas en zona de defensa (Y=%d)", 
-                                           drone->id, drone->pos.y);
-                                send_event(EVT_DESTROYED, drone->id, drone->swarm_id, drone->truck_id, "SHOT_DOWN");
-                            }
-                            break;
-                        }
-                    }
-                }
-                
-                // Verificar si la comunicación está activa antes de continuar navegación
-                if (!drone->communication_active) {
-                    // Si no hay comunicación, pausar la navegación (drone en modo autónomo básico)
-                    // Solo mantiene posición actual, no puede recibir nuevos comandos
-                    break; // Sale del switch, continúa el loop pero sin moverse
+                    written = snprintf(out + used, room, spec, value);
                 }
-                
-                break;
+            } else if (strchr("feEgG", conversion)) {
+                spec[spec_len++] = conversion;
+                spec[spec_len] = '\0';
+                double value;
+                memcpy(&value, slot, 8);
+                written = stars == 1 ? snprintf(out + used, room, spec, star_args[0], value) :
+                                       snprintf(out + used, room, spec, value);
+            } else {
+                spec[spec_len++] = 'p';
+                spec[spec_len] = '\0';
+                void* value;
+                memcpy(&value, slot, 8);
+                written = snprintf(out + used, room, spec, value);
+            }
         }
         
-        pthread_mutex_unlock(&drone->mutex);
-        usleep(100000); // 100ms
+        if (written > 0) {
+            used += (size_t)written < room ? (size_t)written : room - 1;
+        }
     }
     
-    return NULL;
+    out[used] = '\0';
+    return used;
 }
 
-// Hilo de combustible del drone
-void* drone_fuel_thread(void* arg) {
-    Drone* drone = (Drone*)arg;
-    
-    while (drone->active && drone->state != DRONE_STATE_DESTROYED && system_state.simulation_running) {
-        pthread_mutex_lock(&drone->mutex);
-        
-        drone->fuel--;
-        if (drone->fuel <= 0) {
-            drone->state = DRONE_STATE_FUEL_EMPTY;
-            log_message("Drone %d se quedó sin combustible", drone->id);
-            send_event(EVT_FUEL_EMPTY, drone->id, drone->swarm_id, drone->truck_id, "FUEL_EMPTY");
+// Función para dar formato a un registro como línea (o líneas) de salida
+size_t log_format_record(const LogRecord* record, const char* time_str, char* out, size_t capacity) {
+    char text[LOG_MAX_RECORD];
+    const char* payload = (const char*)(record + 1);
+    log_expand(record->format, payload, record->size - sizeof(LogRecord), text, sizeof(text));
+    
+    int written = 0;
+    switch ((LogKind)record->kind) {
+        case LOG_KIND_MESSAGE:
+            written = snprintf(out, capacity, "[%s] %s\n", time_str, text);
+            break;
+        case LOG_KIND_EVENT:
+            written = snprintf(out, capacity, "  │ [%s] [%s] %s\n", time_str, record->tag, text);
+            break;
+        case LOG_KIND_STATUS:
+            written = snprintf(out, capacity, "  │ %s\n", text);
+            break;
+        case LOG_KIND_PHASE:
+            written = snprintf(out, capacity,
+                               "\n"
+                               "╔══════════════════════════════════════════════════════════════════════════════╗\n"
+                               "║                              %-45s ║\n"
+                               "╚══════════════════════════════════════════════════════════════════════════════╝\n",
+                               text);
+            break;
+        case LOG_KIND_SUB_PHASE:
+            written = snprintf(out, capacity, "  ┌─ %s\n", text);
             break;
-        }
-        
-        pthread_mutex_unlock(&drone->mutex);
-        sleep(1); // 1 segundo por tick
     }
     
-    return NULL;
+    if (written < 0) return 0;
+    return (size_t)written < capacity ? (size_t)written : capacity - 1;
+}
+
+// Función para construir un registro completo (cabecera y argumentos) en "out"
+size_t log_build_record(LogRecord* record, LogLevel level, LogCategory category, LogKind kind,
+                        const char* tag, const char* format, va_list args) {
+    size_t payload = log_capture_args(format, args, (char*)(record + 1), LOG_MAX_RECORD - sizeof(LogRecord));
+    record->size = (uint32_t)((sizeof(LogRecord) + payload + 7) & ~(size_t)7);
+    record->level = level;
+    record->category = category;
+    record->kind = kind;
+    record->padding = 0;
+    record->tick = sim_now();
+    record->format = format;
+    record->tag = tag;
+    return record->size;
 }
 
-// Hilo de comunicación del drone
-void* drone_communication_thread(void* arg) {
-    Drone* drone = (Drone*)arg;
+// Función para escribir un registro directamente (sin hilo de log o sin anillos libres)
+void log_write_direct(const LogRecord* record) {
+    char time_str[16];
+    time_t now = system_state.start_time + record->tick / TICKS_PER_SECOND;
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    strftime(time_str, sizeof(time_str), "%H:%M:%S", &tm_info);
     
-    while (drone->active && drone->state != DRONE_STATE_DESTROYED && system_state.simulation_running) {
-        usleep(100000); // 100ms = 1 décima de segundo
-        
-        // Verificar si la simulación sigue corriendo ANTES de procesar comunicación
-        if (!system_state.simulation_running) {
-            break;
-        }
-        
-        pthread_mutex_lock(&drone->mutex);
-        
-        // Verificar pérdida de comunicación (Q% de probabilidad) - solo cada segundo
-        static int comm_check_counter = 0;
-        comm_check_counter++;
-        
-        if (drone->communication_active && comm_check_counter >= 10 && check_probability(system_state.Q)) {
-            drone->communication_active = 0;
-            drone->last_communication_loss = time(NULL);
-            drone->communication_timeout = 0;
-            drone->reestablish_attempts = 0;
-            comm_check_counter = 0; // Resetear contador
-            
-            // Solo loguear si la simulación está activa
-            if (system_state.simulation_running) {
-                log_event("COM_LOST", "Drone %d: COMUNICACIÓN PERDIDA", drone->id);
+    char line[LOG_MAX_RECORD + 512];
+    size_t length = log_format_record(record, time_str, line, sizeof(line));
+    
+    pthread_mutex_lock(&log_mutex);
+    fwrite(line, 1, length, stdout);
+    fflush(stdout);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+// Función para reservar espacio contiguo en el anillo; escribe una marca de salto si el
+// registro no cabe antes del final. Devuelve el desplazamiento o -1 si está lleno.
+long log_ring_reserve(LogRing* ring, size_t size) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t offset = tail & ring->mask;
+    size_t to_end = ring->mask + 1 - offset;
+    size_t needed = size <= to_end ? size : to_end + size;
+    
+    if (needed > ring->mask + 1 - (tail - head)) {
+        return -1;
+    }
+    if (size > to_end) {
+        uint32_t wrap = LOG_WRAP;
+        memcpy(ring->buffer + offset, &wrap, sizeof(wrap));
+        return (long)(tail + to_end);
+    }
+    return (long)tail;
+}
+
+// Función principal de log: filtra, captura los argumentos y encola el registro
+void log_write(LogLevel level, LogCategory category, LogKind kind, const char* tag, const char* format, ...) {
+    // Los recuadros de fase se muestran siempre; el resto pasa por los filtros
+    if ((logger.hide_phases || (kind != LOG_KIND_PHASE && kind != LOG_KIND_SUB_PHASE)) &&
+        ((int)level < logger.level || !(logger.category_mask & (1u << category)))) {
+        return;
+    }
+    
+    _Alignas(8) char storage[LOG_MAX_RECORD];
+    LogRecord* record = (LogRecord*)storage;
+    va_list args;
+    va_start(args, format);
+    size_t size = log_build_record(record, level, category, kind, tag, format, args);
+    va_end(args);
+    
+    LogRing* ring = atomic_load_explicit(&logger.started, memory_order_acquire) ? log_ring_for_thread() : NULL;
+    if (!ring) {
+        log_write_direct(record);
+        return;
+    }
+    
+    // El anillo compartido admite un escritor a la vez
+    int shared = ring == atomic_load_explicit(&logger.rings[0], memory_order_relaxed);
+    if (shared) {
+        pthread_mutex_lock(&logger.shared_mutex);
+    }
+    
+    long position;
+    while ((position = log_ring_reserve(ring, size)) < 0) {
+        if (logger.drop_when_full) {
+            atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+            if (shared) {
+                pthread_mutex_unlock(&logger.shared_mutex);
+            }
+            return;
+        }
+        atomic_fetch_add_explicit(&logger.waits, 1, memory_order_relaxed);
+        pthread_cond_signal(&logger.condition); // Despertar al hilo de log para que vacíe
+        sched_yield();
+    }
+    
+    // La secuencia se toma después de reservar: todo número repartido llega al anillo
+    record->sequence = atomic_fetch_add_explicit(&logger.sequence, 1, memory_order_relaxed);
+    memcpy(ring->buffer + ((size_t)position & ring->mask), record, size);
+    atomic_store_explicit(&ring->tail, (size_t)position + size, memory_order_release);
+    if (shared) {
+        pthread_mutex_unlock(&logger.shared_mutex);
+    }
+}
+
+// Función para mostrar separadores de fase de manera limpia
+void log_phase_header(const char* phase_name) {
+    log_write(LOG_INFO, LOG_CAT_SYSTEM, LOG_KIND_PHASE, NULL, "%s", phase_name);
+}
+
+// Función para mostrar sub-fases de manera organizada
+void log_sub_phase(const char* sub_phase_name) {
+    log_write(LOG_INFO, LOG_CAT_SYSTEM, LOG_KIND_SUB_PHASE, NULL, "%s", sub_phase_name);
+}
+
+// Función para obtener el registro en la cabeza de un anillo (saltando marcas de salto)
+LogRecord* log_ring_peek(LogRing* ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    
+    while (head != tail) {
+        LogRecord* record = (LogRecord*)(ring->buffer + (head & ring->mask));
+        if (record->size != LOG_WRAP) {
+            return record;
+        }
+        head += ring->mask + 1 - (head & ring->mask);
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+    }
+    return NULL;
+}
+
+// Función para volcar la salida acumulada
+void log_flush_output() {
+    if (logger.output_used > 0) {
+        fwrite(logger.output, 1, logger.output_used, stdout);
+        fflush(stdout);
+        logger.output_used = 0;
+    }
+}
+
+// Función para escribir los registros disponibles en orden de secuencia; devuelve cuántos
+int log_drain() {
+    int written = 0;
+    int rings = atomic_load(&logger.ring_count);
+    if (rings > LOG_MAX_RINGS) rings = LOG_MAX_RINGS;
+    
+    for (;;) {
+        LogRing* ring = NULL;
+        LogRecord* record = NULL;
+        for (int i = 0; i < rings && !record; i++) {
+            LogRing* candidate = atomic_load_explicit(&logger.rings[i], memory_order_acquire);
+            LogRecord* head = candidate ? log_ring_peek(candidate) : NULL;
+            if (head && head->sequence == logger.next_sequence) {
+                ring = candidate;
+                record = head;
             }
         }
+        if (!record) {
+            return written;
+        }
         
-        // Si la comunicación está perdida, intentar reestablecerla
-        if (!drone->communication_active) {
-            drone->communication_timeout++;
-            
-            // Verificar si se reestablece (50% de probabilidad cada segundo, no cada décima)
-            if (drone->communication_timeout % 10 == 0 && check_probability(50)) {
-                drone->communication_active = 1;
-                drone->reestablish_attempts++;
-                
-                // Solo loguear si la simulación está activa
-                if (system_state.simulation_running) {
-                    log_event("COM_REST", "Drone %d: COMUNICACIÓN REESTABLECIDA después de %d segundos (intento %d)", 
-                             drone->id, drone->communication_timeout / 10, drone->reestablish_attempts);
-                }
+        // Consumir del mismo anillo mientras siga la secuencia (ráfagas de un hilo)
+        while (record && record->sequence == logger.next_sequence) {
+            time_t second = system_state.start_time + record->tick / TICKS_PER_SECOND;
+            if (second != logger.cached_second) {
+                struct tm tm_info;
+                localtime_r(&second, &tm_info);
+                strftime(logger.cached_time, sizeof(logger.cached_time), "%H:%M:%S", &tm_info);
+                logger.cached_second = second;
             }
             
-            // Verificar timeout (Z segundos) - solo mostrar mensaje una vez
-            if (drone->communication_timeout >= system_state.Z * 10 && drone->reestablish_attempts == 0) {
-                // Solo loguear si la simulación está activa
-                if (system_state.simulation_running) {
-                    log_event("COM_TIMEOUT", "Drone %d: TIMEOUT DE COMUNICACIÓN alcanzado (%d segundos) - DRONE PERDIDO", 
-                             drone->id, system_state.Z);
-                }
-                
-                drone->state = DRONE_STATE_DESTROYED;
-                
-                // Enviar evento de drone perdido solo si la simulación está activa
-                if (system_state.simulation_running) {
-                    send_event(EVT_DESTROYED, drone->id, drone->swarm_id, drone->truck_id, "COMM_LOST");
-                }
-                
-                pthread_mutex_unlock(&drone->mutex);
-                break;
+            if (logger.output_used + LOG_MAX_RECORD + 512 > LOG_OUTPUT_BUFFER) {
+                log_flush_output();
             }
+            logger.output_used += log_format_record(record, logger.cached_time,
+                                                    logger.output + logger.output_used,
+                                                    LOG_OUTPUT_BUFFER - logger.output_used);
+            
+            size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+            atomic_store_explicit(&ring->head, head + record->size, memory_order_release);
+            logger.next_sequence++;
+            written++;
+            record = log_ring_peek(ring);
         }
-        
-        pthread_mutex_unlock(&drone->mutex);
     }
-    
-    return NULL;
 }
 
-// Hilo de payload del drone
-void* drone_payload_thread(void* arg) {
-    Drone* drone = (Drone*)arg;
+// Hilo de log: da formato y escribe en lotes; espera LOG_IDLE_MS cuando no hay nada
+void* log_thread(void* arg) {
+    (void)arg;
     
-    while (drone->active && drone->state != DRONE_STATE_DESTROYED && system_state.simulation_running) {
-        // Verificar si la simulación sigue corriendo ANTES de procesar payload
-        if (!system_state.simulation_running) {
-            break;
+    for (;;) {
+        if (log_drain() > 0) {
+            continue;
         }
+        log_flush_output();
         
-        pthread_mutex_lock(&drone->mutex);
-        
-        if (drone->state == DRONE_STATE_AT_TARGET) {
-            if (drone->type == DRONE_TYPE_ATTACK) {
-                // Drone de ataque espera comando para detonar
-                // NO detona automáticamente
-                static int logged_attack_drones[100] = {0}; // Array para evitar mensajes repetidos
-                if (!logged_attack_drones[drone->id] && system_state.simulation_running) {
-                    log_message("Drone de ataque %d llegó al objetivo, esperando comando para detonar", drone->id);
-                    logged_attack_drones[drone->id] = 1;
-                }
-                
-            } else if (drone->type == DRONE_TYPE_CAMERA) {
-                // Drone cámara NO hace reporte automático aquí
-                // Solo espera a que los drones de ataque detonen
-                static int logged_camera_drones[100] = {0}; // Array para evitar mensajes repetidos
-                if (!logged_camera_drones[drone->id] && system_state.simulation_running) {
-                    log_message("Drone cámara %d en posición de vigilancia, esperando detonaciones", drone->id);
-                    logged_camera_drones[drone->id] = 1;
-                }
-            }
+        if (atomic_load(&logger.shutdown) &&
+            logger.next_sequence == atomic_load(&logger.sequence)) {
+            break;
         }
         
-        pthread_mutex_unlock(&drone->mutex);
-        usleep(100000); // 100ms
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_IDLE_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&logger.mutex);
+        if (!atomic_load(&logger.shutdown)) {
+            pthread_cond_timedwait(&logger.condition, &logger.mutex, &deadline);
+        }
+        pthread_mutex_unlock(&logger.mutex);
     }
     
+    log_flush_output();
     return NULL;
 }
 
-// Función para volar en círculos alrededor del punto de ensamble
-void fly_in_circles(Drone* drone) {
-    // Radio del círculo de patrulla
-    const int patrol_radius = 3;
-    
-    // Calcular el centro del círculo (punto de ensamble)
-    Position center = drone->target;
-    
-    // Calcular ángulo actual basado en el tiempo
-    static int angle_counter = 0;
-    angle_counter = (angle_counter + 1) % 360;
-    
-    // Convertir ángulo a radianes
-    double angle_rad = (angle_counter * 3.14159) / 180.0;
+// Función para arrancar el hilo de log (antes de eso se escribe directamente)
+void start_logger() {
+    pthread_mutex_init(&logger.mutex, NULL);
+    pthread_cond_init(&logger.condition, NULL);
+    pthread_mutex_init(&logger.shared_mutex, NULL);
+    pthread_once(&logger.key_once, log_ring_key_create);
+    atomic_store(&logger.shutdown, 0);
+    
+    // Slot 0: el anillo compartido por los hilos que se quedan sin uno propio
+    atomic_store_explicit(&logger.rings[0], log_ring_create(), memory_order_release);
+    atomic_store(&logger.ring_count, 1);
+    
+    if (pthread_create(&logger.thread, NULL, log_thread, NULL) == 0) {
+        atomic_store_explicit(&logger.started, 1, memory_order_release);
+    }
+}
+
+// Función para detener el hilo de log después de escribir todo lo pendiente
+void stop_logger() {
+    if (!atomic_exchange(&logger.started, 0)) {
+        return;
+    }
     
-    // Calcular nueva posición en el círculo
-    int new_x = center.x + (int)(patrol_radius * cos(angle_rad));
-    int new_y = center.y + (int)(patrol_radius * sin(angle_rad));
+    pthread_mutex_lock(&logger.mutex);
+    atomic_store(&logger.shutdown, 1);
+    pthread_cond_signal(&logger.condition);
+    pthread_mutex_unlock(&logger.mutex);
+    pthread_join(logger.thread, NULL);
     
-    // Mover drone a la nueva posición
-    drone->pos.x = new_x;
-    drone->pos.y = new_y;
+    unsigned long dropped = atomic_load(&logger.dropped);
+    if (dropped > 0) {
+        log_message("Log: %lu mensajes descartados por anillo lleno", dropped);
+    }
     
-    // Incrementar distancia recorrida
-    drone->distance_traveled += system_state.speed;
+    int rings = atomic_load(&logger.ring_count);
+    for (int i = 0; i < rings && i < LOG_MAX_RINGS; i++) {
+        LogRing* ring = atomic_exchange(&logger.rings[i], NULL);
+        if (ring) {
+            free(ring->buffer);
+            free(ring);
+        }
+    }
+    atomic_store(&logger.ring_count, 0);
+    pthread_mutex_destroy(&logger.shared_mutex);
+    log_thread_ring = NULL; // Los demás hilos productores ya terminaron
+    pthread_setspecific(logger.ring_key, NULL);
+}
+
+// Función para interpretar una lista de categorías separadas por coma
+unsigned parse_log_categories(const char* list) {
+    static const char* names[LOG_CAT_COUNT] = {"system", "fleet", "drone", "comm", "events"};
+    unsigned mask = 0;
     
-    // Verificar si el enjambre está listo para avanzar
-    // (esto se maneja en el centro de comando)
+    if (strncmp(list, "all", 3) == 0) {
+        return (1u << LOG_CAT_COUNT) - 1;
+    }
+    for (int i = 0; i < LOG_CAT_COUNT; i++) {
+        const char* found = strstr(list, names[i]);
+        if (found) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
 }
 
-// Función para crear un drone
-Drone* create_drone(int id, int truck_id, int swarm_id, DroneType type, Position start_pos, Position target_pos) {
-    Drone* drone = malloc(sizeof(Drone));
-    if (!drone) {
-        log_message("Error: No se pudo asignar memoria para drone %d", id);
+// Función para interpretar un nivel de log
+int parse_log_level(const char* name) {
+    if (strncmp(name, "debug", 5) == 0) return LOG_DEBUG;
+    if (strncmp(name, "info", 4) == 0) return LOG_INFO;
+    if (strncmp(name, "warn", 4) == 0) return LOG_WARN;
+    if (strncmp(name, "error", 5) == 0) return LOG_ERROR;
+    return atoi(name);
+}
+
+// Funciones de traza binaria
+_Thread_local TraceBuffer* trace_thread_buffer; // Buffer de traza del hilo actual
+
+// Función para obtener (o registrar) el buffer de traza del hilo actual
+TraceBuffer* trace_buffer_for_thread() {
+    if (trace_thread_buffer) {
+        return trace_thread_buffer;
+    }
+    
+    int slot = atomic_fetch_add(&trace.buffer_count, 1);
+    if (slot >= TRACE_MAX_BUFFERS) {
+        return NULL;
+    }
+    TraceBuffer* buffer = calloc(1, sizeof(TraceBuffer));
+    if (!buffer) {
         return NULL;
     }
+    atomic_store_explicit(&trace.buffers[slot], buffer, memory_order_release);
+    trace_thread_buffer = buffer;
+    return buffer;
+}
+
+// Funciones de telemetría (anillos de la región compartida)
+_Thread_local ShmTelemetryRing* telemetry_thread_ring; // Anillo del hilo actual
+_Thread_local unsigned telemetry_thread_generation; // Región en la que se tomó
+
+// Función para obtener (o tomar) el anillo de telemetría del hilo actual; NULL si no quedan
+ShmTelemetryRing* telemetry_ring_for_thread() {
+    if (telemetry_thread_generation != channel.generation) {
+        ShmHeader* header = channel.header;
+        uint32_t index = atomic_fetch_add_explicit(&header->rings_used, 1, memory_order_relaxed);
+        telemetry_thread_ring = index < header->ring_count ?
+                                (ShmTelemetryRing*)(channel.base + header->rings_offset + index * header->ring_size) : NULL;
+        telemetry_thread_generation = channel.generation;
+    }
+    return telemetry_thread_ring;
+}
+
+// Función para publicar un registro en el anillo de telemetría del hilo (pisa lo más viejo)
+void telemetry_publish(const TraceRecord* record) {
+    ShmTelemetryRing* ring = telemetry_ring_for_thread();
+    if (!ring) {
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->records[head & (SHM_RING_RECORDS - 1)] = *record;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Función para registrar un evento de dominio en la traza y en la telemetría (no hace
+// nada si ambas están apagadas)
+void trace_emit(TraceKind kind, int drone_id, int swarm_id, int value, int aux) {
+    if (!trace.enabled && !channel.header) {
+        return;
+    }
     
-    drone->id = id;
-    drone->truck_id = truck_id;
-    drone->swarm_id = swarm_id;
-    drone->type = type;
-    drone->state = DRONE_STATE_FLYING_TO_ASSEMBLY;
-    drone->pos = start_pos;
-    drone->target = target_pos;
-    drone->fuel = system_state.initial_fuel;
-    drone->max_fuel = system_state.initial_fuel;
-    drone->distance_traveled = 0;
+    TraceRecord record;
+    record.tick = (uint32_t)sim_now();
+    record.drone_id = (uint32_t)drone_id;
+    record.swarm_id = (uint32_t)swarm_id;
+    record.kind = (uint8_t)kind;
+    record.value = (uint8_t)value;
+    record.aux = (uint16_t)aux;
+    if (channel.header) {
+        telemetry_publish(&record);
+    }
+    if (!trace.enabled) {
+        return;
+    }
     
-    // Asignar probabilidad individual de derribo (0% a 5%)
-    drone->shoot_down_probability = rand() % 6; // 0 a 5
+    TraceBuffer* buffer = trace_buffer_for_thread();
+    if (!buffer) {
+        return;
+    }
+    if (buffer->count == buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : TRACE_BUFFER_RECORDS;
+        TraceRecord* records = realloc(buffer->records, capacity * sizeof(TraceRecord));
+        if (!records) {
+            return;
+        }
+        buffer->records = records;
+        buffer->capacity = capacity;
+    }
     
-    drone->active = 1;
+    buffer->records[buffer->count++] = record;
+}
+
+// Hilo escritor: vuelca al archivo el buffer de salida que le entregan
+void* trace_writer_thread(void* arg) {
+    (void)arg;
+    
+    pthread_mutex_lock(&trace.mutex);
+    while (1) {
+        while (trace.pending < 0 && !trace.shutdown) {
+            pthread_cond_wait(&trace.condition, &trace.mutex);
+        }
+        if (trace.pending < 0) {
+            break;
+        }
+        
+        int index = trace.pending;
+        pthread_mutex_unlock(&trace.mutex);
+        
+        size_t written = 0;
+        while (written < trace.staging_used[index]) {
+            ssize_t n = write(trace.fd, trace.staging[index] + written, trace.staging_used[index] - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                log_error("Error escribiendo la traza: %s", strerror(errno));
+                break;
+            }
+            written += (size_t)n;
+        }
+        
+        pthread_mutex_lock(&trace.mutex);
+        trace.staging_used[index] = 0;
+        trace.pending = -1;
+        pthread_cond_broadcast(&trace.condition);
+    }
+    pthread_mutex_unlock(&trace.mutex);
+    return NULL;
+}
+
+// Función para entregar el buffer de salida activo al escritor (espera si sigue ocupado)
+void trace_submit() {
+    pthread_mutex_lock(&trace.mutex);
+    while (trace.pending >= 0) {
+        pthread_cond_wait(&trace.condition, &trace.mutex);
+    }
+    if (trace.staging_used[trace.active] > 0) {
+        trace.pending = trace.active;
+        trace.active ^= 1;
+        pthread_cond_broadcast(&trace.condition);
+    }
+    pthread_mutex_unlock(&trace.mutex);
+}
+
+// Función para juntar los registros de todos los hilos al final de un tick.
+// La llama el hilo de ticks con los trabajadores detenidos y el centro de comando en espera.
+void trace_end_tick() {
+    if (!trace.enabled) {
+        return;
+    }
     
-    // Inicializar control de comunicación
-    drone->communication_active = 1; // Inicia con comunicación activa
-    drone->communication_timeout = 0;
-    drone->reestablish_attempts = 0;
-    drone->last_communication_loss = 0;
+    int count = atomic_load(&trace.buffer_count);
+    if (count > TRACE_MAX_BUFFERS) count = TRACE_MAX_BUFFERS;
+    int active = trace.active;
     
-    // Inicializar mutex y condition variable
-    pthread_mutex_init(&drone->mutex, NULL);
-    pthread_cond_init(&drone->condition, NULL);
+    for (int i = 0; i < count; i++) {
+        TraceBuffer* buffer = atomic_load_explicit(&trace.buffers[i], memory_order_acquire);
+        if (!buffer || buffer->count == 0) {
+            continue;
+        }
+        
+        size_t bytes = buffer->count * sizeof(TraceRecord);
+        size_t needed = trace.staging_used[active] + bytes;
+        if (needed > trace.staging_capacity[active]) {
+            size_t capacity = trace.staging_capacity[active] * 2;
+            while (capacity < needed) capacity *= 2;
+            char* staging = realloc(trace.staging[active], capacity);
+            if (!staging) {
+                buffer->count = 0;
+                continue;
+            }
+            trace.staging[active] = staging;
+            trace.staging_capacity[active] = capacity;
+        }
+        memcpy(trace.staging[active] + trace.staging_used[active], buffer->records, bytes);
+        trace.staging_used[active] += bytes;
+        trace.records += buffer->count;
+        buffer->count = 0;
+    }
     
-    // Crear FIFO para comunicación
-    create_fifo_name(drone->fifo_name, id);
-    drone->fifo_fd = create_drone_fifo(id);
+    if (trace.staging_used[active] >= TRACE_FLUSH_BYTES) {
+        trace_submit();
+    }
+}
+
+// Función para abrir el archivo de traza (trace.path) y arrancar el escritor
+int trace_open() {
+    const char* path = trace.path;
+    trace.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace.fd < 0) {
+        log_error("Error: No se pudo abrir la traza %s: %s", path, strerror(errno));
+        return -1;
+    }
     
-    // Crear hilos del drone
-    pthread_create(&drone->nav_thread, NULL, drone_navigation_thread, drone);
-    pthread_create(&drone->fuel_thread, NULL, drone_fuel_thread, drone);
-    pthread_create(&drone->comm_thread, NULL, drone_communication_thread, drone);
-    pthread_create(&drone->payload_thread, NULL, drone_payload_thread, drone);
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.seed = system_state.seed;
+    header.tick_ms = TICK_MS;
+    header.drone_capacity = (uint32_t)system_state.drone_capacity;
+    if (write(trace.fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        log_error("Error escribiendo la cabecera de la traza: %s", strerror(errno));
+        close(trace.fd);
+        return -1;
+    }
     
-    log_message("Drone %d creado (Tipo: %s, Truck: %d, Swarm: %d)", 
-               id, type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA", truck_id, swarm_id);
+    for (int i = 0; i < 2; i++) {
+        trace.staging_capacity[i] = TRACE_FLUSH_BYTES * 2;
+        trace.staging[i] = malloc(trace.staging_capacity[i]);
+        trace.staging_used[i] = 0;
+    }
+    trace.active = 0;
+    trace.pending = -1;
+    trace.shutdown = 0;
+    pthread_mutex_init(&trace.mutex, NULL);
+    pthread_cond_init(&trace.condition, NULL);
+    pthread_create(&trace.writer, NULL, trace_writer_thread, NULL);
+    
+    trace.enabled = 1;
+    log_message("Traza binaria: %s", path);
+    return 0;
+}
+
+// Función para volcar lo pendiente, detener el escritor y cerrar la traza
+void trace_close() {
+    if (!trace.enabled) {
+        return;
+    }
     
-    return drone;
+    trace_end_tick();
+    trace_submit();
+    trace.enabled = 0;
+    
+    pthread_mutex_lock(&trace.mutex);
+    trace.shutdown = 1;
+    pthread_cond_broadcast(&trace.condition);
+    pthread_mutex_unlock(&trace.mutex);
+    pthread_join(trace.writer, NULL);
+    close(trace.fd);
+    
+    int count = atomic_load(&trace.buffer_count);
+    for (int i = 0; i < count && i < TRACE_MAX_BUFFERS; i++) {
+        TraceBuffer* buffer = atomic_exchange(&trace.buffers[i], NULL);
+        if (buffer) {
+            free(buffer->records);
+            free(buffer);
+        }
+    }
+    trace_thread_buffer = NULL; // Los demás hilos productores ya terminaron
+    free(trace.staging[0]);
+    free(trace.staging[1]);
+    pthread_mutex_destroy(&trace.mutex);
+    pthread_cond_destroy(&trace.condition);
+    
+    log_message("Traza: %llu registros (%.1f KB) en %s", trace.records,
+               (trace.records * sizeof(TraceRecord) + sizeof(TraceHeader)) / 1024.0, trace.path);
+}
+
+// Función para reservar una arena de memoria contigua
+int arena_init(Arena* arena, size_t size) {
+    arena->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena->base == MAP_FAILED) {
+        arena->base = NULL;
+        arena->size = 0;
+        arena->used = 0;
+        return -1;
+    }
+    arena->size = size;
+    arena->used = 0;
+    return 0;
 }
 
-// Función para crear un enjambre
-Swarm* create_swarm(int id, int truck_id, Position assembly_point, Position reassembly_point) {
-    Swarm* swarm = malloc(sizeof(Swarm));
-    if (!swarm) {
-        log_message("Error: No se pudo asignar memoria para enjambre %d", id);
+// Función para tomar un bloque alineado de la arena (memoria inicializada a cero)
+void* arena_alloc(Arena* arena, size_t size) {
+    size_t offset = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (offset + size > arena->size) {
         return NULL;
     }
+    arena->used = offset + size;
+    return arena->base + offset;
+}
+
+// Función para vaciar la arena sin devolverla al sistema (vuelve a quedar en cero)
+void arena_reset(Arena* arena) {
+    memset(arena->base, 0, arena->used);
+    arena->used = 0;
+}
+
+// Función para liberar la arena completa
+void arena_release(Arena* arena) {
+    if (arena->base) {
+        munmap(arena->base, arena->size);
+    }
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+// Funciones de acceso a los campos calientes del drone
+DroneState drone_state(const Drone* drone) {
+    return (DroneState)system_state.store.state[drone->id];
+}
+
+// Función para saber si un drone en "state" (y dentro o fuera de la zona) bloquea la barrera
+int phase_barrier_blocks(const PhaseBarrier* barrier, DroneState state, int in_zone) {
+    return (barrier->pending_states & (1u << state)) || (barrier->pending_in_zone && in_zone);
+}
+
+// Función para descontar (o sumar) un drone de la barrera armada según su transición
+void phase_barrier_transition(DroneState previous, int was_in_zone, DroneState state, int in_zone) {
+    PhaseBarrier* barrier = &system_state.barrier;
+    if (!barrier->armed) return;
+    
+    int delta = phase_barrier_blocks(barrier, state, in_zone) - phase_barrier_blocks(barrier, previous, was_in_zone);
+    if (delta != 0) {
+        atomic_fetch_add_explicit(&barrier->remaining, delta, memory_order_relaxed);
+    }
+}
+
+// Función para armar la barrera con los drones que hoy bloquean. Se llama con el reloj
+// detenido (el centro de comando lo retiene), así ninguna transición se pierde.
+// Un drone dentro de la zona también está en FLYING_TO_TARGET: no combinar ambos.
+void phase_barrier_arm(uint32_t pending_states, int pending_in_zone) {
+    PhaseBarrier* barrier = &system_state.barrier;
+    int remaining = 0;
+    for (int s = 0; s < DRONE_STATE_COUNT; s++) {
+        if (pending_states & (1u << s)) {
+            remaining += atomic_load(&system_state.state_counts[s]);
+        }
+    }
+    if (pending_in_zone) {
+        remaining += atomic_load(&system_state.drones_in_defense_zone);
+    }
     
-    swarm->id = id;
-    swarm->truck_id = truck_id;
-    swarm->ready_count = 0;
-    swarm->active_count = 0;
-    swarm->assembly_point = assembly_point;
-    swarm->reassembly_point = reassembly_point;
-    
-    pthread_mutex_init(&swarm->mutex, NULL);
+    barrier->pending_states = pending_states;
+    barrier->pending_in_zone = pending_in_zone;
+    atomic_store(&barrier->remaining, remaining);
+    barrier->armed = 1;
+}
+
+void phase_barrier_disarm() {
+    system_state.barrier.armed = 0;
+}
+
+// Función para mover un drone entre los conjuntos de bits de dos estados. Varios
+// trabajadores comparten palabras, así que los cambios son atómicos.
+void state_bits_move(int id, DroneState previous, DroneState state) {
+    uint64_t bit = 1ull << (id % 64);
+    int word = id / 64;
+    atomic_fetch_and_explicit(&system_state.state_bits[previous * system_state.state_words + word], ~bit, memory_order_relaxed);
+    atomic_fetch_or_explicit(&system_state.state_bits[state * system_state.state_words + word], bit, memory_order_relaxed);
+}
+
+// Función para recorrer los drones en un estado: devuelve el primer id >= from en
+// "state", o -1. Salta palabras vacías, así que el costo es proporcional a la respuesta
+// (más una palabra por cada 64 ids).
+int fleet_next_in_state(DroneState state, int from) {
+    if (from < 0) from = 0;
+    const _Atomic uint64_t* bits = &system_state.state_bits[state * system_state.state_words];
+    int word = from / 64;
+    if (word >= system_state.state_words) return -1;
+    
+    uint64_t current = atomic_load_explicit(&bits[word], memory_order_relaxed) & (~0ull << (from % 64));
+    while (current == 0) {
+        if (++word >= system_state.state_words) return -1;
+        current = atomic_load_explicit(&bits[word], memory_order_relaxed);
+    }
+    int id = word * 64 + __builtin_ctzll(current);
+    return id < system_state.drone_count ? id : -1;
+}
+
+// Drones de la flota en un estado (O(1))
+int fleet_count(DroneState state) {
+    return atomic_load_explicit(&system_state.state_counts[state], memory_order_relaxed);
+}
+
+// Función para saber si un drone dejó de avanzar (destruido o sin combustible) desde
+// cualquier hilo: lee los conjuntos de bits, no el almacén
+int fleet_drone_lost(int id) {
+    uint64_t bit = 1ull << (id % 64);
+    int word = id / 64;
+    uint64_t lost = atomic_load_explicit(&system_state.state_bits[DRONE_STATE_DESTROYED * system_state.state_words + word], memory_order_relaxed) |
+                    atomic_load_explicit(&system_state.state_bits[DRONE_STATE_FUEL_EMPTY * system_state.state_words + word], memory_order_relaxed);
+    return (lost & bit) != 0;
+}
+
+void drone_set_state(Drone* drone, DroneState state) {
+    DroneState previous = (DroneState)system_state.store.state[drone->id];
+    if (previous != state) {
+        trace_emit(TRACE_STATE, drone->id, drone->swarm_id, state, previous);
+        atomic_fetch_sub_explicit(&system_state.state_counts[previous], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&system_state.state_counts[state], 1, memory_order_relaxed);
+        state_bits_move(drone->id, previous, state);
+        
+        // El histograma del enjambre lo toca solo quien procesa el enjambre en el tick
+        // (o el centro de comando con el reloj detenido)
+        if (drone->in_swarm) {
+            Swarm* swarm = &system_state.swarms[drone->swarm_id];
+            swarm->state_counts[drone->type][previous]--;
+            swarm->state_counts[drone->type][state]++;
+        }
+        
+        // Solo se está en la zona de defensa mientras se vuela al objetivo
+        int was_in_zone = drone->in_defense_zone;
+        if (was_in_zone && state != DRONE_STATE_FLYING_TO_TARGET) {
+            drone->in_defense_zone = 0;
+            atomic_fetch_sub_explicit(&system_state.drones_in_defense_zone, 1, memory_order_relaxed);
+        }
+        phase_barrier_transition(previous, was_in_zone, state, drone->in_defense_zone);
+    }
+    system_state.store.state[drone->id] = state;
+}
+
+// Función para registrar la entrada o salida de la zona de defensa (alcance de alguna defensa)
+void drone_set_in_defense_zone(Drone* drone, int in_zone) {
+    if (drone->in_defense_zone == in_zone) return;
+    
+    DroneState state = drone_state(drone);
+    drone->in_defense_zone = in_zone;
+    atomic_fetch_add_explicit(&system_state.drones_in_defense_zone, in_zone ? 1 : -1, memory_order_relaxed);
+    phase_barrier_transition(state, !in_zone, state, in_zone);
+}
+
+Position drone_position(const Drone* drone) {
+    return (Position){system_state.store.pos_x[drone->id], system_state.store.pos_y[drone->id]};
+}
+
+void drone_set_position(Drone* drone, Position pos) {
+    system_state.store.pos_x[drone->id] = pos.x;
+    system_state.store.pos_y[drone->id] = pos.y;
+}
+
+Position drone_target(const Drone* drone) {
+    return (Position){system_state.store.target_x[drone->id], system_state.store.target_y[drone->id]};
+}
+
+void drone_set_target(Drone* drone, Position target) {
+    system_state.store.target_x[drone->id] = target.x;
+    system_state.store.target_y[drone->id] = target.y;
+}
+
+int drone_distance_traveled(const Drone* drone) {
+    return system_state.store.distance_traveled[drone->id];
+}
+
+// Función para reservar el almacén de campos calientes en la arena
+int drone_store_init(DroneStore* store, Arena* arena, int capacity) {
+    store->pos_x = arena_alloc(arena, sizeof(int32_t) * capacity);
+    store->pos_y = arena_alloc(arena, sizeof(int32_t) * capacity);
+    store->target_x = arena_alloc(arena, sizeof(int32_t) * capacity);
+    store->target_y = arena_alloc(arena, sizeof(int32_t) * capacity);
+    store->fuel = arena_alloc(arena, sizeof(int32_t) * capacity);
+    store->distance_traveled = arena_alloc(arena, sizeof(int32_t) * capacity);
+    store->state = arena_alloc(arena, sizeof(int32_t) * capacity);
+    store->arrived = arena_alloc(arena, sizeof(uint8_t) * capacity);
+    store->vulnerability = arena_alloc(arena, sizeof(uint32_t) * capacity);
+    store->shoot_down_threshold = arena_alloc(arena, sizeof(uint32_t) * capacity);
+    store->draws = arena_alloc(arena, sizeof(uint8_t) * capacity);
+    store->route = arena_alloc(arena, sizeof(int32_t) * capacity);
+    
+    if (!store->pos_x || !store->pos_y || !store->target_x || !store->target_y ||
+        !store->fuel || !store->distance_traveled || !store->state || !store->arrived ||
+        !store->vulnerability || !store->shoot_down_threshold || !store->draws ||
+        !store->route) {
+        return -1;
+    }
+    return 0;
+}
+
+// Tamaño en la arena del almacén de campos calientes
+size_t drone_store_size(int capacity) {
+    return (8 * sizeof(int32_t) + 2 * sizeof(uint32_t) + 2 * sizeof(uint8_t)) * (size_t)capacity + 12 * ARENA_ALIGNMENT;
+}
+
+// Función para obtener el drone j de un enjambre
+Drone* swarm_drone(const Swarm* swarm, int j) {
+    return &system_state.drones[swarm->members[j]];
+}
+
+// Función para agregar un drone a un enjambre, ampliando su bloque si hace falta
+int swarm_add_drone(Swarm* swarm, Drone* drone) {
+    if (swarm->size == swarm->capacity) {
+        int new_capacity = swarm->capacity > 0 ? swarm->capacity * 2 : 4;
+        int* members = arena_alloc(&system_state.arena, new_capacity * sizeof(int));
+        if (!members) {
+            log_error("Error: arena agotada al ampliar el enjambre %d", swarm->id);
+            return -1;
+        }
+        memcpy(members, swarm->members, swarm->size * sizeof(int));
+        swarm->members = members;
+        swarm->capacity = new_capacity;
+    }
+    
+    swarm->members[swarm->size++] = drone->id;
+    drone->swarm_id = swarm->id;
+    drone->in_swarm = 1;
+    swarm->state_counts[drone->type][drone_state(drone)]++;
+    return 0;
+}
+
+// Función para quitar el drone j de un enjambre (el último ocupa su lugar)
+void swarm_remove_drone(Swarm* swarm, int j) {
+    Drone* drone = swarm_drone(swarm, j);
+    swarm->state_counts[drone->type][drone_state(drone)]--;
+    drone->in_swarm = 0;
+    swarm->members[j] = swarm->members[--swarm->size];
+}
+
+// Drones de un tipo en un estado dentro de un enjambre (O(1))
+int swarm_count(const Swarm* swarm, DroneType type, DroneState state) {
+    return swarm->state_counts[type][state];
+}
+
+// Drones de ambos tipos en un estado dentro de un enjambre
+int swarm_count_state(const Swarm* swarm, DroneState state) {
+    return swarm->state_counts[DRONE_TYPE_ATTACK][state] + swarm->state_counts[DRONE_TYPE_CAMERA][state];
+}
+
+// Función para contar drones no destruidos de un tipo en un enjambre
+int swarm_count_alive(const Swarm* swarm, DroneType type) {
+    int count = 0;
+    for (int s = 0; s < DRONE_STATE_COUNT; s++) {
+        if (s != DRONE_STATE_DESTROYED) {
+            count += swarm->state_counts[type][s];
+        }
+    }
+    return count;
+}
+
+// Función para calcular distancia entre dos posiciones
+double calculate_distance(Position p1, Position p2) {
+    int dx = p1.x - p2.x;
+    int dy = p1.y - p2.y;
+    return sqrt(dx * dx + dy * dy);
+}
+
+// Función para mover drone hacia un objetivo (versión escalar, un drone a la vez)
+void move_drone_towards(Drone* drone, Position target) {
+    DroneStore* store = &system_state.store;
+    Position pos = drone_position(drone);
+    double distance = calculate_distance(pos, target);
+    if (distance <= system_state.speed) {
+        drone_set_position(drone, target);
+        store->distance_traveled[drone->id] += (int)distance;
+    } else {
+        double ratio = system_state.speed / distance;
+        int dx = (int)((target.x - pos.x) * ratio);
+        int dy = (int)((target.y - pos.y) * ratio);
+        drone_set_position(drone, (Position){pos.x + dx, pos.y + dy});
+        store->distance_traveled[drone->id] += system_state.speed;
+    }
+}
+
+// Kernel de cinemática escalar: mueve hacia su destino a los drones en vuelo de [begin, end).
+// Si el destino está a menos de "speed" el drone se ajusta a él y se marca como llegado
+// (sin sumar distancia); si no, avanza "speed" unidades en línea recta.
+void kinematics_scalar(DroneStore* store, int begin, int end, int speed) {
+    for (int i = begin; i < end; i++) {
+        int32_t state = store->state[i];
+        store->arrived[i] = 0;
+        if (state != DRONE_STATE_FLYING_TO_ASSEMBLY && state != DRONE_STATE_FLYING_TO_TARGET) {
+            continue;
+        }
+        
+        int dx = store->target_x[i] - store->pos_x[i];
+        int dy = store->target_y[i] - store->pos_y[i];
+        double distance = sqrt((double)dx * dx + (double)dy * dy);
+        
+        if (distance <= speed) {
+            store->pos_x[i] = store->target_x[i];
+            store->pos_y[i] = store->target_y[i];
+            store->arrived[i] = 1;
+        } else {
+            double ratio = speed / distance;
+            store->pos_x[i] += (int)(dx * ratio);
+            store->pos_y[i] += (int)(dy * ratio);
+            store->distance_traveled[i] += speed;
+        }
+    }
+}
+
+#ifdef DRONE_WARS_X86
+// Kernel de cinemática SSE2: 4 drones por iteración en dos mitades de 2 dobles.
+// Mismas operaciones IEEE que la versión escalar, así que el resultado es idéntico.
+void kinematics_sse2(DroneStore* store, int begin, int end, int speed) {
+    const __m128i fly_assembly = _mm_set1_epi32(DRONE_STATE_FLYING_TO_ASSEMBLY);
+    const __m128i fly_target = _mm_set1_epi32(DRONE_STATE_FLYING_TO_TARGET);
+    const __m128d speed_d = _mm_set1_pd((double)speed);
+    const __m128i speed_i = _mm_set1_epi32(speed);
+    int i = begin;
+    
+    for (; i + 4 <= end; i += 4) {
+        __m128i state = _mm_loadu_si128((const __m128i*)&store->state[i]);
+        __m128i flying = _mm_or_si128(_mm_cmpeq_epi32(state, fly_assembly), _mm_cmpeq_epi32(state, fly_target));
+        if (_mm_movemask_epi8(flying) == 0) {
+            memset(&store->arrived[i], 0, 4);
+            continue;
+        }
+        
+        __m128i px = _mm_loadu_si128((const __m128i*)&store->pos_x[i]);
+        __m128i py = _mm_loadu_si128((const __m128i*)&store->pos_y[i]);
+        __m128i tx = _mm_loadu_si128((const __m128i*)&store->target_x[i]);
+        __m128i ty = _mm_loadu_si128((const __m128i*)&store->target_y[i]);
+        __m128i dx = _mm_sub_epi32(tx, px);
+        __m128i dy = _mm_sub_epi32(ty, py);
+        
+        __m128d dx_lo = _mm_cvtepi32_pd(dx);
+        __m128d dx_hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(dx, _MM_SHUFFLE(1, 0, 3, 2)));
+        __m128d dy_lo = _mm_cvtepi32_pd(dy);
+        __m128d dy_hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(dy, _MM_SHUFFLE(1, 0, 3, 2)));
+        __m128d dist_lo = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx_lo, dx_lo), _mm_mul_pd(dy_lo, dy_lo)));
+        __m128d dist_hi = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx_hi, dx_hi), _mm_mul_pd(dy_hi, dy_hi)));
+        
+        // Máscara de llegada: de 2x64 bits por mitad a 4x32 bits
+        __m128i arrive = _mm_castps_si128(_mm_shuffle_ps(_mm_castpd_ps(_mm_cmple_pd(dist_lo, speed_d)),
+                                                         _mm_castpd_ps(_mm_cmple_pd(dist_hi, speed_d)),
+                                                         _MM_SHUFFLE(2, 0, 2, 0)));
+        
+        __m128d ratio_lo = _mm_div_pd(speed_d, dist_lo);
+        __m128d ratio_hi = _mm_div_pd(speed_d, dist_hi);
+        __m128i mx = _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_mul_pd(dx_lo, ratio_lo)),
+                                        _mm_cvttpd_epi32(_mm_mul_pd(dx_hi, ratio_hi)));
+        __m128i my = _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_mul_pd(dy_lo, ratio_lo)),
+                                        _mm_cvttpd_epi32(_mm_mul_pd(dy_hi, ratio_hi)));
+        
+        __m128i arrived = _mm_and_si128(arrive, flying);
+        __m128i moving = _mm_andnot_si128(arrive, flying);
+        
+        // pos = llegó ? destino : (vuela ? pos + paso : pos)
+        __m128i nx = _mm_or_si128(_mm_and_si128(arrived, tx),
+                                  _mm_andnot_si128(arrived, _mm_add_epi32(px, _mm_and_si128(moving, mx))));
+        __m128i ny = _mm_or_si128(_mm_and_si128(arrived, ty),
+                                  _mm_andnot_si128(arrived, _mm_add_epi32(py, _mm_and_si128(moving, my))));
+        _mm_storeu_si128((__m128i*)&store->pos_x[i], nx);
+        _mm_storeu_si128((__m128i*)&store->pos_y[i], ny);
+        
+        __m128i traveled = _mm_loadu_si128((const __m128i*)&store->distance_traveled[i]);
+        traveled = _mm_add_epi32(traveled, _mm_and_si128(moving, speed_i));
+        _mm_storeu_si128((__m128i*)&store->distance_traveled[i], traveled);
+        
+        int arrived_bits = _mm_movemask_ps(_mm_castsi128_ps(arrived));
+        for (int k = 0; k < 4; k++) {
+            store->arrived[i + k] = (arrived_bits >> k) & 1;
+        }
+    }
+    
+    kinematics_scalar(store, i, end, speed);
+}
+
+// Kernel de cinemática AVX2: 4 drones por iteración con dobles de 256 bits
+__attribute__((target("avx2")))
+void kinematics_avx2(DroneStore* store, int begin, int end, int speed) {
+    const __m128i fly_assembly = _mm_set1_epi32(DRONE_STATE_FLYING_TO_ASSEMBLY);
+    const __m128i fly_target = _mm_set1_epi32(DRONE_STATE_FLYING_TO_TARGET);
+    const __m256d speed_d = _mm256_set1_pd((double)speed);
+    const __m128i speed_i = _mm_set1_epi32(speed);
+    const __m256i even_lanes = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    int i = begin;
+    
+    for (; i + 4 <= end; i += 4) {
+        __m128i state = _mm_loadu_si128((const __m128i*)&store->state[i]);
+        __m128i flying = _mm_or_si128(_mm_cmpeq_epi32(state, fly_assembly), _mm_cmpeq_epi32(state, fly_target));
+        if (_mm_testz_si128(flying, flying)) {
+            memset(&store->arrived[i], 0, 4);
+            continue;
+        }
+        
+        __m128i px = _mm_loadu_si128((const __m128i*)&store->pos_x[i]);
+        __m128i py = _mm_loadu_si128((const __m128i*)&store->pos_y[i]);
+        __m128i tx = _mm_loadu_si128((const __m128i*)&store->target_x[i]);
+        __m128i ty = _mm_loadu_si128((const __m128i*)&store->target_y[i]);
+        __m128i dx = _mm_sub_epi32(tx, px);
+        __m128i dy = _mm_sub_epi32(ty, py);
+        
+        __m256d dxd = _mm256_cvtepi32_pd(dx);
+        __m256d dyd = _mm256_cvtepi32_pd(dy);
+        __m256d dist = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dxd, dxd), _mm256_mul_pd(dyd, dyd)));
+        
+        // Máscara de llegada: de 4x64 bits a 4x32 bits tomando los carriles pares
+        __m256i arrive_wide = _mm256_castpd_si256(_mm256_cmp_pd(dist, speed_d, _CMP_LE_OQ));
+        __m128i arrive = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(arrive_wide, even_lanes));
+        
+        __m256d ratio = _mm256_div_pd(speed_d, dist);
+        __m128i mx = _mm256_cvttpd_epi32(_mm256_mul_pd(dxd, ratio));
+        __m128i my = _mm256_cvttpd_epi32(_mm256_mul_pd(dyd, ratio));
+        
+        __m128i arrived = _mm_and_si128(arrive, flying);
+        __m128i moving = _mm_andnot_si128(arrive, flying);
+        
+        // pos = llegó ? destino : (vuela ? pos + paso : pos)
+        __m128i nx = _mm_blendv_epi8(_mm_add_epi32(px, _mm_and_si128(moving, mx)), tx, arrived);
+        __m128i ny = _mm_blendv_epi8(_mm_add_epi32(py, _mm_and_si128(moving, my)), ty, arrived);
+        _mm_storeu_si128((__m128i*)&store->pos_x[i], nx);
+        _mm_storeu_si128((__m128i*)&store->pos_y[i], ny);
+        
+        __m128i traveled = _mm_loadu_si128((const __m128i*)&store->distance_traveled[i]);
+        traveled = _mm_add_epi32(traveled, _mm_and_si128(moving, speed_i));
+        _mm_storeu_si128((__m128i*)&store->distance_traveled[i], traveled);
+        
+        int arrived_bits = _mm_movemask_ps(_mm_castsi128_ps(arrived));
+        for (int k = 0; k < 4; k++) {
+            store->arrived[i + k] = (arrived_bits >> k) & 1;
+        }
+    }
+    
+    kinematics_scalar(store, i, end, speed);
+}
+#endif
+
+// Generador contador (Philox4x32-10): cada sorteo es una función pura de
+// (semilla, índice, contador, flujo), así que el resultado no depende del número
+// de hilos ni del orden en que se procesan los drones, y una semilla reproduce la corrida.
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+// Flujos de números aleatorios (palabra alta del contador)
+#define RNG_STREAM_TICK 0 // Sorteos por drone y tick (derribo, pérdida y reestablecimiento)
+#define RNG_STREAM_DRONE_PROFILE 1 // Probabilidad de derribo de cada drone
+#define RNG_STREAM_DRONE_TRUCK 2 // Camión de origen de los drones de ataque
+#define RNG_STREAM_TARGET_ORDER 3 // Permutaciones de la asignación aleatoria de objetivos
+#define RNG_STREAM_BATCH 4 // Semillas de las corridas del modo lote (y de las repeticiones del barrido)
+#define RNG_STREAM_SWEEP 5 // Estratos del hipercubo latino del barrido
+
+// Probabilidad de reestablecer la comunicación en cada intento (por segundo)
+#define COMM_RESTORE_PERCENT 50
+
+// Bloque de 4 palabras de 32 bits para el contador (index, counter, stream)
+void philox4x32(uint64_t seed, uint32_t index, uint64_t counter, uint32_t stream, uint32_t out[4]) {
+    uint32_t c0 = index, c1 = (uint32_t)counter, c2 = (uint32_t)(counter >> 32), c3 = stream;
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    
+    for (int r = 0; r < PHILOX_ROUNDS; r++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0;
+        c1 = (uint32_t)p1;
+        c2 = n2;
+        c3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// Entero uniforme en [0, bound) sin sesgo de módulo (multiplicación con rechazo de Lemire).
+// Los reintentos consumen las palabras siguientes del bloque y luego avanzan el contador.
+uint32_t rng_uniform(uint32_t stream, uint32_t index, uint32_t bound) {
+    if (bound <= 1) return 0;
+    
+    uint32_t floor_rejection = -bound % bound;
+    uint32_t words[4];
+    for (uint64_t counter = 0;; counter++) {
+        philox4x32(system_state.seed, index, counter, stream, words);
+        for (int w = 0; w < 4; w++) {
+            uint64_t m = (uint64_t)words[w] * bound;
+            if ((uint32_t)m >= floor_rejection) {
+                return (uint32_t)(m >> 32);
+            }
+        }
+    }
+}
+
+// Umbral de 32 bits para un porcentaje: el sorteo acierta si palabra < umbral.
+// 100% o más se representa con UINT32_MAX y se trata como certeza.
+uint32_t rng_threshold(int percentage) {
+    if (percentage <= 0) return 0;
+    if (percentage >= 100) return UINT32_MAX;
+    return (uint32_t)(((uint64_t)percentage << 32) / 100);
+}
+
+int rng_hit(uint32_t word, uint32_t threshold) {
+    return threshold == UINT32_MAX || word < threshold;
+}
+
+// Kernel de sorteos escalar: un bloque Philox por drone y tick. La palabra 0 decide el
+// derribo, la 1 la pérdida de comunicación y la 2 el reestablecimiento; los pasos del
+// drone solo consultan el bit que les toca cuando corresponde verificar.
+void draws_scalar(DroneStore* store, int begin, int end, long tick) {
+    uint32_t comm_loss = rng_threshold(system_state.Q);
+    uint32_t comm_restore = rng_threshold(COMM_RESTORE_PERCENT);
+    uint32_t words[4];
+    
+    for (int i = begin; i < end; i++) {
+        philox4x32(system_state.seed, (uint32_t)i, (uint64_t)tick, RNG_STREAM_TICK, words);
+        store->draws[i] = (rng_hit(words[0], store->shoot_down_threshold[i]) ? DRAW_SHOOT_DOWN : 0) |
+                          (rng_hit(words[1], comm_loss) ? DRAW_COMM_LOSS : 0) |
+                          (rng_hit(words[2], comm_restore) ? DRAW_COMM_RESTORE : 0);
+    }
+}
+
+#ifdef DRONE_WARS_X86
+// Multiplicación 32x32->64 por carril: mul_epu32 solo usa los carriles pares,
+// así que los impares se desplazan y se recombinan con máscaras (sin SSE4.1).
+static inline void philox_mul_sse2(__m128i a, __m128i m, __m128i* hi, __m128i* lo) {
+    const __m128i low_mask = _mm_set_epi32(0, -1, 0, -1);
+    __m128i even = _mm_mul_epu32(a, m);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    *lo = _mm_or_si128(_mm_and_si128(even, low_mask), _mm_slli_epi64(odd, 32));
+    *hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(low_mask, odd));
+}
+
+// Comparación sin signo palabra < umbral (o umbral de certeza) en 4 carriles
+static inline __m128i rng_hit_sse2(__m128i word, __m128i threshold) {
+    const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+    __m128i below = _mm_cmplt_epi32(_mm_xor_si128(word, sign), _mm_xor_si128(threshold, sign));
+    return _mm_or_si128(below, _mm_cmpeq_epi32(threshold, _mm_set1_epi32(-1)));
+}
+
+// Kernel de sorteos SSE2: 4 drones por iteración, mismos bits que la versión escalar
+void draws_sse2(DroneStore* store, int begin, int end, long tick) {
+    const __m128i m0 = _mm_set1_epi32((int)PHILOX_M0);
+    const __m128i m1 = _mm_set1_epi32((int)PHILOX_M1);
+    const __m128i lane = _mm_set_epi32(3, 2, 1, 0);
+    const __m128i comm_loss = _mm_set1_epi32((int)rng_threshold(system_state.Q));
+    const __m128i comm_restore = _mm_set1_epi32((int)rng_threshold(COMM_RESTORE_PERCENT));
+    int i = begin;
+    
+    for (; i + 4 <= end; i += 4) {
+        __m128i c0 = _mm_add_epi32(_mm_set1_epi32(i), lane);
+        __m128i c1 = _mm_set1_epi32((int)(uint32_t)tick);
+        __m128i c2 = _mm_set1_epi32((int)(uint32_t)((uint64_t)tick >> 32));
+        __m128i c3 = _mm_set1_epi32(RNG_STREAM_TICK);
+        uint32_t k0 = (uint32_t)system_state.seed, k1 = (uint32_t)(system_state.seed >> 32);
+        
+        for (int r = 0; r < PHILOX_ROUNDS; r++) {
+            __m128i hi0, lo0, hi1, lo1;
+            philox_mul_sse2(c0, m0, &hi0, &lo0);
+            philox_mul_sse2(c2, m1, &hi1, &lo1);
+            c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+            c1 = lo1;
+            c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+            c3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        
+        __m128i shoot = rng_hit_sse2(c0, _mm_loadu_si128((const __m128i*)&store->shoot_down_threshold[i]));
+        int shoot_bits = _mm_movemask_ps(_mm_castsi128_ps(shoot));
+        int loss_bits = _mm_movemask_ps(_mm_castsi128_ps(rng_hit_sse2(c1, comm_loss)));
+        int restore_bits = _mm_movemask_ps(_mm_castsi128_ps(rng_hit_sse2(c2, comm_restore)));
+        for (int k = 0; k < 4; k++) {
+            store->draws[i + k] = (((shoot_bits >> k) & 1) ? DRAW_SHOOT_DOWN : 0) |
+                                  (((loss_bits >> k) & 1) ? DRAW_COMM_LOSS : 0) |
+                                  (((restore_bits >> k) & 1) ? DRAW_COMM_RESTORE : 0);
+        }
+    }
+    
+    draws_scalar(store, i, end, tick);
+}
+
+__attribute__((target("avx2")))
+static inline void philox_mul_avx2(__m256i a, __m256i m, __m256i* hi, __m256i* lo) {
+    __m256i even = _mm256_mul_epu32(a, m);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    *lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rng_hit_avx2(__m256i word, __m256i threshold) {
+    const __m256i sign = _mm256_set1_epi32((int)0x80000000u);
+    __m256i below = _mm256_cmpgt_epi32(_mm256_xor_si256(threshold, sign), _mm256_xor_si256(word, sign));
+    return _mm256_or_si256(below, _mm256_cmpeq_epi32(threshold, _mm256_set1_epi32(-1)));
+}
+
+// Kernel de sorteos AVX2: 8 drones por iteración, mismos bits que la versión escalar
+__attribute__((target("avx2")))
+void draws_avx2(DroneStore* store, int begin, int end, long tick) {
+    const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0);
+    const __m256i m1 = _mm256_set1_epi32((int)PHILOX_M1);
+    const __m256i lane = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i comm_loss = _mm256_set1_epi32((int)rng_threshold(system_state.Q));
+    const __m256i comm_restore = _mm256_set1_epi32((int)rng_threshold(COMM_RESTORE_PERCENT));
+    int i = begin;
+    
+    for (; i + 8 <= end; i += 8) {
+        __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32(i), lane);
+        __m256i c1 = _mm256_set1_epi32((int)(uint32_t)tick);
+        __m256i c2 = _mm256_set1_epi32((int)(uint32_t)((uint64_t)tick >> 32));
+        __m256i c3 = _mm256_set1_epi32(RNG_STREAM_TICK);
+        uint32_t k0 = (uint32_t)system_state.seed, k1 = (uint32_t)(system_state.seed >> 32);
+        
+        for (int r = 0; r < PHILOX_ROUNDS; r++) {
+            __m256i hi0, lo0, hi1, lo1;
+            philox_mul_avx2(c0, m0, &hi0, &lo0);
+            philox_mul_avx2(c2, m1, &hi1, &lo1);
+            c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int)k0));
+            c1 = lo1;
+            c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int)k1));
+            c3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        
+        __m256i shoot = rng_hit_avx2(c0, _mm256_loadu_si256((const __m256i*)&store->shoot_down_threshold[i]));
+        int shoot_bits = _mm256_movemask_ps(_mm256_castsi256_ps(shoot));
+        int loss_bits = _mm256_movemask_ps(_mm256_castsi256_ps(rng_hit_avx2(c1, comm_loss)));
+        int restore_bits = _mm256_movemask_ps(_mm256_castsi256_ps(rng_hit_avx2(c2, comm_restore)));
+        for (int k = 0; k < 8; k++) {
+            store->draws[i + k] = (((shoot_bits >> k) & 1) ? DRAW_SHOOT_DOWN : 0) |
+                                  (((loss_bits >> k) & 1) ? DRAW_COMM_LOSS : 0) |
+                                  (((restore_bits >> k) & 1) ? DRAW_COMM_RESTORE : 0);
+        }
+    }
+    
+    draws_scalar(store, i, end, tick);
+}
+#endif
+
+// Función para obtener el riesgo (punto fijo) que aporta una defensa en la celda (x, y)
+uint32_t defense_hazard_at(const EnemyDefense* defense, int x, int y) {
+    double dx = x - defense->pos.x;
+    double dy = y - defense->pos.y;
+    double distance = sqrt(dx * dx + dy * dy);
+    if (defense->range <= 0 || distance >= defense->range) {
+        return 0;
+    }
+    
+    double probability = defense->shoot_down_probability / 100.0 * (1.0 - distance / defense->range);
+    if (probability > THREAT_MAX_PROBABILITY) probability = THREAT_MAX_PROBABILITY;
+    if (probability <= 0.0) return 0;
+    return (uint32_t)lround(-log(1.0 - probability) * THREAT_HAZARD_ONE);
+}
+
+// Función para sumar (sign = 1) o restar (sign = -1) una defensa del campo de amenaza.
+// Solo recorre el cuadrado que cubre su alcance; el riesgo en enteros hace que quitar
+// una defensa deje exactamente el campo que había antes de agregarla.
+void threat_field_apply(const EnemyDefense* defense, int sign) {
+    ThreatField* field = &system_state.threat;
+    int x0 = defense->pos.x - defense->range, x1 = defense->pos.x + defense->range;
+    int y0 = defense->pos.y - defense->range, y1 = defense->pos.y + defense->range;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= field->width) x1 = field->width - 1;
+    if (y1 >= field->height) y1 = field->height - 1;
+    
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            uint32_t hazard = defense_hazard_at(defense, x, y);
+            if (hazard == 0) continue;
+            
+            int cell = y * field->width + x;
+            field->hazard[cell] += sign > 0 ? hazard : -hazard;
+            double probability = 1.0 - exp(-(field->hazard[cell] / THREAT_HAZARD_ONE));
+            field->threshold[cell] = probability >= 1.0 ? UINT32_MAX : (uint32_t)(probability * 4294967296.0);
+        }
+    }
+}
+
+// Función para activar o desactivar una defensa (con el reloj detenido)
+void enemy_defense_set_active(EnemyDefense* defense, int active) {
+    if (defense->active == active) return;
+    defense->active = active;
+    threat_field_apply(defense, active ? 1 : -1);
+    system_state.threat.version++;
+}
+
+// Función para aplicar un cambio de defensa del operador (hilo de ticks, entre dos ticks)
+void defense_apply_command(int defense_id, int active) {
+    EnemyDefense* defense = &system_state.defenses[defense_id];
+    if (defense->active == active) return;
+    enemy_defense_set_active(defense, active);
+    log_at(LOG_INFO, LOG_CAT_COMM, "Operador: defensa %d %s", defense_id, active ? "encendida" : "apagada");
+}
+
+// Umbral de derribo del campo de amenaza en una posición (0 = fuera de alcance)
+uint32_t threat_threshold_at(Position pos) {
+    const ThreatField* field = &system_state.threat;
+    int x = pos.x < 0 ? 0 : (pos.x >= field->width ? field->width - 1 : pos.x);
+    int y = pos.y < 0 ? 0 : (pos.y >= field->height ? field->height - 1 : pos.y);
+    return field->threshold[y * field->width + x];
+}
+
+// Función para calcular el umbral de derribo del tick de cada drone: una lectura del
+// campo de amenaza en su celda, escalada por su vulnerabilidad. Solo corre riesgo
+// quien vuela al objetivo.
+void threat_lookup(DroneStore* store, int begin, int end) {
+    const ThreatField* field = &system_state.threat;
+    for (int i = begin; i < end; i++) {
+        uint32_t threshold = 0;
+        if (store->state[i] == DRONE_STATE_FLYING_TO_TARGET) {
+            int x = store->pos_x[i], y = store->pos_y[i];
+            if (x >= 0 && x < field->width && y >= 0 && y < field->height) {
+                threshold = (uint32_t)(((uint64_t)field->threshold[y * field->width + x] * store->vulnerability[i]) >> 32);
+            }
+        }
+        store->shoot_down_threshold[i] = threshold;
+    }
+}
+
+// Funciones del planificador de rutas (campos de flujo)
+
+// Función para dimensionar la grilla de rutas: celdas de 1x1 salvo en mapas grandes, donde
+// crecen hasta que la grilla entra en FLOW_MAX_CELLS
+void flow_planner_init() {
+    const ThreatField* field = &system_state.threat;
+    flow.cell = 1;
+    while ((long)((field->width + flow.cell - 1) / flow.cell) * ((field->height + flow.cell - 1) / flow.cell) > FLOW_MAX_CELLS) {
+        flow.cell++;
+    }
+    flow.width = (field->width + flow.cell - 1) / flow.cell;
+    flow.height = (field->height + flow.cell - 1) / flow.cell;
+    flow.cost = NULL;
+    flow.cache_bytes = 0;
+    flow.over_budget = 0;
+}
+
+// Celda de la grilla de rutas que contiene una posición (las de fuera van al borde)
+int flow_cell_at(int x, int y) {
+    const ThreatField* field = &system_state.threat;
+    x = x < 0 ? 0 : (x >= field->width ? field->width - 1 : x);
+    y = y < 0 ? 0 : (y >= field->height ? field->height - 1 : y);
+    return (y / flow.cell) * flow.width + x / flow.cell;
+}
+
+// Centro de una celda de la grilla de rutas (dentro del mapa)
+Position flow_cell_center(int cell) {
+    const ThreatField* field = &system_state.threat;
+    int x = (cell % flow.width) * flow.cell + flow.cell / 2;
+    int y = (cell / flow.width) * flow.cell + flow.cell / 2;
+    return (Position){x < field->width ? x : field->width - 1, y < field->height ? y : field->height - 1};
+}
+
+// Función para construir la grilla de costos: cada celda cuesta por unidad de distancia el
+// combustible (1) más el riesgo medio de sus posiciones, repartido en las unidades que se
+// vuelan entre dos verificaciones de defensa y pesado con THREAT_COST_WEIGHT
+int flow_cost_build() {
+    const ThreatField* field = &system_state.threat;
+    if (!flow.cost) {
+        flow.cost = malloc(sizeof(float) * flow.width * flow.height);
+        if (!flow.cost) return -1;
+    }
+    
+    int speed = system_state.speed > 0 ? system_state.speed : 1;
+    double per_unit = THREAT_COST_WEIGHT / THREAT_HAZARD_ONE / ((double)speed * DEFENSE_CHECK_TICKS);
+    for (int cy = 0; cy < flow.height; cy++) {
+        for (int cx = 0; cx < flow.width; cx++) {
+            int x0 = cx * flow.cell, y0 = cy * flow.cell;
+            int x1 = x0 + flow.cell < field->width ? x0 + flow.cell : field->width;
+            int y1 = y0 + flow.cell < field->height ? y0 + flow.cell : field->height;
+            double hazard = 0.0;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    hazard += field->hazard[y * field->width + x];
+                }
+            }
+            flow.cost[cy * flow.width + cx] = (float)(1.0 + per_unit * hazard / ((x1 - x0) * (y1 - y0)));
+        }
+    }
+    flow.cost_version = field->version;
+    return 0;
+}
+
+// Función para subir una celda en el montículo de Dijkstra (slot = posición de cada celda)
+void flow_heap_up(int32_t* heap, int32_t* slot, const float* key, int i) {
+    int32_t cell = heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (key[heap[parent]] <= key[cell]) break;
+        heap[i] = heap[parent];
+        slot[heap[i]] = i;
+        i = parent;
+    }
+    heap[i] = cell;
+    slot[cell] = i;
+}
+
+// Función para bajar una celda en el montículo de Dijkstra
+void flow_heap_down(int32_t* heap, int32_t* slot, const float* key, int size, int i) {
+    int32_t cell = heap[i];
+    while (2 * i + 1 < size) {
+        int child = 2 * i + 1;
+        if (child + 1 < size && key[heap[child + 1]] < key[heap[child]]) child++;
+        if (key[cell] <= key[heap[child]]) break;
+        heap[i] = heap[child];
+        slot[heap[i]] = i;
+        i = child;
+    }
+    heap[i] = cell;
+    slot[cell] = i;
+}
+
+// Función para construir el campo de flujo de un objetivo: Dijkstra desde la celda del
+// objetivo sobre la grilla de rutas (8 vecinos; un paso cuesta su largo por el costo medio
+// de las dos celdas) y después cada celda adelanta su waypoint "lookahead" pasos por el
+// camino. Usa field->waypoint ya reservado.
+int flow_field_build(FlowField* field, int goal) {
+    int cells = flow.width * flow.height;
+    float* distance = malloc(sizeof(float) * cells);
+    int32_t* parent = malloc(sizeof(int32_t) * cells);
+    int32_t* heap = malloc(sizeof(int32_t) * cells);
+    int32_t* slot = malloc(sizeof(int32_t) * cells); // Posición en el montículo (-1 = fuera, -2 = cerrada)
+    if (!distance || !parent || !heap || !slot) {
+        free(distance);
+        free(parent);
+        free(heap);
+        free(slot);
+        return -1;
+    }
+    
+    for (int c = 0; c < cells; c++) {
+        distance[c] = INFINITY;
+        parent[c] = c;
+        slot[c] = -1;
+    }
+    distance[goal] = 0.0f;
+    heap[0] = goal;
+    slot[goal] = 0;
+    int size = 1;
+    
+    static const int step_x[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+    static const int step_y[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+    while (size > 0) {
+        int u = heap[0];
+        slot[u] = -2;
+        if (--size > 0) {
+            heap[0] = heap[size];
+            flow_heap_down(heap, slot, distance, size, 0);
+        }
+        
+        int ux = u % flow.width, uy = u / flow.width;
+        for (int k = 0; k < 8; k++) {
+            int vx = ux + step_x[k], vy = uy + step_y[k];
+            if (vx < 0 || vx >= flow.width || vy < 0 || vy >= flow.height) continue;
+            int v = vy * flow.width + vx;
+            if (slot[v] == -2) continue;
+            
+            float length = (k < 4 ? 1.0f : (float)M_SQRT2) * flow.cell;
+            float candidate = distance[u] + length * 0.5f * (flow.cost[u] + flow.cost[v]);
+            if (candidate < distance[v]) {
+                distance[v] = candidate;
+                parent[v] = u;
+                if (slot[v] < 0) {
+                    heap[size] = v;
+                    slot[v] = size++;
+                }
+                flow_heap_up(heap, slot, distance, slot[v]);
+            }
+        }
+    }
+    
+    for (int c = 0; c < cells; c++) {
+        field->waypoint[c] = parent[c];
+    }
+    for (int pass = 1; pass < flow.lookahead; pass++) {
+        for (int c = 0; c < cells; c++) {
+            field->waypoint[c] = parent[field->waypoint[c]];
+        }
+    }
+    field->goal = goal;
+    field->version = flow.cost_version;
+    field->built = 1;
+    
+    free(distance);
+    free(parent);
+    free(heap);
+    free(slot);
+    return 0;
+}
+
+// Tarea de construcción: un campo de flujo pendiente
+void flow_build_task(int index, long tick) {
+    (void)tick;
+    int target_id = flow.pending[index];
+    Position goal = system_state.targets[target_id].pos;
+    if (flow_field_build(&flow.fields[target_id], flow_cell_at(goal.x, goal.y)) != 0) {
+        log_error("Error: sin memoria para el campo de flujo del objetivo %d", target_id);
+    }
+}
+
+// Función para reconstruir los campos de flujo que alguien sigue y quedaron viejos (con
+// el reloj detenido). Se construyen en paralelo en el pool, uno por tarea; los que no
+// entran en FLOW_CACHE_MAX_BYTES dejan a sus drones en línea recta.
+void flow_fields_refresh() {
+    if (system_state.routing_mode != ROUTING_FLOW || !flow.fields) return;
+    
+    uint32_t version = system_state.threat.version;
+    int count = 0;
+    for (int t = 0; t < system_state.target_count; t++) {
+        FlowField* field = &flow.fields[t];
+        // Sin lugar en la caché ya no se intenta: sus drones siguen en línea recta
+        if (atomic_load_explicit(&field->wanted, memory_order_relaxed) && !(field->built && field->version == version) &&
+            (field->waypoint || !flow.over_budget)) {
+            flow.pending[count++] = t;
+        }
+    }
+    if (count == 0) return;
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((!flow.cost || flow.cost_version != version) && flow_cost_build() != 0) {
+        log_error("Error: sin memoria para la grilla de rutas");
+        return;
+    }
+    int speed = system_state.speed > 0 ? system_state.speed : 1;
+    flow.lookahead = (2 * speed + flow.cell - 1) / flow.cell;
+    if (flow.lookahead < FLOW_LOOKAHEAD) flow.lookahead = FLOW_LOOKAHEAD;
+    
+    size_t bytes = sizeof(int32_t) * flow.width * flow.height;
+    int ready = 0;
+    for (int i = 0; i < count; i++) {
+        FlowField* field = &flow.fields[flow.pending[i]];
+        field->built = 0;
+        if (!field->waypoint) {
+            if (flow.cache_bytes + bytes > FLOW_CACHE_MAX_BYTES || !(field->waypoint = malloc(bytes))) {
+                if (!flow.over_budget) {
+                    log_warn("Aviso: caché de campos de flujo llena (%.1f KB), el resto vuela en línea recta",
+                             flow.cache_bytes / 1024.0);
+                }
+                flow.over_budget = 1;
+                continue;
+            }
+            flow.cache_bytes += bytes;
+        }
+        flow.pending[ready++] = flow.pending[i];
+    }
+    if (ready == 0) return;
+    
+    if (scheduler.started) {
+        scheduler_parallel_for(ready, flow_build_task, sim_now());
+    } else {
+        for (int i = 0; i < ready; i++) flow_build_task(i, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log_message("Rutas: %d campos de flujo construidos en %.1f ms (grilla %dx%d, celdas de %d, %.1f KB)",
+                ready, (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6,
+                flow.width, flow.height, flow.cell, flow.cache_bytes / 1024.0);
+}
+
+// Función para liberar los campos de flujo y la grilla de costos de la misión
+void flow_planner_release() {
+    for (int t = 0; flow.fields && t < system_state.target_count; t++) {
+        free(flow.fields[t].waypoint);
+        flow.fields[t].waypoint = NULL;
+        flow.fields[t].built = 0;
+    }
+    free(flow.cost);
+    flow.cost = NULL;
+    flow.cache_bytes = 0;
+}
+
+// Función para mandar un drone a un objetivo: en línea recta o por su campo de flujo
+void drone_set_route(Drone* drone, int target_id) {
+    drone_set_target(drone, system_state.targets[target_id].pos);
+    if (system_state.routing_mode == ROUTING_FLOW) {
+        system_state.store.route[drone->id] = target_id;
+        atomic_store_explicit(&flow.fields[target_id].wanted, 1, memory_order_relaxed);
+    } else {
+        system_state.store.route[drone->id] = -1;
+    }
+}
+
+// Función para apuntar cada drone con ruta al waypoint de su celda (una lectura del campo
+// de flujo por drone y tick). Cerca del objetivo, o sin campo vigente, va directo a él.
+void flow_steer(DroneStore* store, int begin, int end) {
+    uint32_t version = system_state.threat.version;
+    for (int i = begin; i < end; i++) {
+        int route = store->route[i];
+        if (route < 0 || store->state[i] != DRONE_STATE_FLYING_TO_TARGET) continue;
+        
+        Position next = system_state.targets[route].pos;
+        const FlowField* field = &flow.fields[route];
+        if (field->built && field->version == version) {
+            int waypoint = field->waypoint[flow_cell_at(store->pos_x[i], store->pos_y[i])];
+            if (waypoint != field->goal) {
+                next = flow_cell_center(waypoint);
+            }
+        }
+        store->target_x[i] = next.x;
+        store->target_y[i] = next.y;
+    }
+}
+
+// Función para deshacer las llegadas a un waypoint intermedio: el kernel de cinemática
+// solo ve el destino del tick, así que quien no está en su objetivo sigue en vuelo
+void flow_settle(DroneStore* store, int begin, int end, int speed) {
+    for (int i = begin; i < end; i++) {
+        int route = store->route[i];
+        if (!store->arrived[i] || route < 0 || store->state[i] != DRONE_STATE_FLYING_TO_TARGET) continue;
+        
+        Position goal = system_state.targets[route].pos;
+        if (store->pos_x[i] != goal.x || store->pos_y[i] != goal.y) {
+            store->arrived[i] = 0;
+            store->distance_traveled[i] += speed;
+        }
+    }
+}
+
+// Kernel de sorteos activo (misma familia de instrucciones que el de cinemática)
+void (*draws_kernel)(DroneStore* store, int begin, int end, long tick) = draws_scalar;
+
+// Kernel de cinemática activo (elegido al arrancar según la CPU)
+void (*kinematics_kernel)(DroneStore* store, int begin, int end, int speed) = kinematics_scalar;
+const char* kinematics_kernel_name = "escalar";
+
+// Función para elegir el kernel de cinemática más rápido soportado por la CPU
+void select_kinematics_kernel() {
+#ifdef DRONE_WARS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kinematics_kernel = kinematics_avx2;
+        draws_kernel = draws_avx2;
+        kinematics_kernel_name = "AVX2";
+    } else {
+        kinematics_kernel = kinematics_sse2;
+        draws_kernel = draws_sse2;
+        kinematics_kernel_name = "SSE2";
+    }
+#endif
+}
+
+// Función para crear nombre de FIFO
+void create_fifo_name(char* buffer, int drone_id) {
+    snprintf(buffer, 64, "%s/drone_%d", FIFO_PATH, drone_id);
+}
+
+// Función para crear FIFO
+int create_drone_fifo(int drone_id) {
+    char fifo_name[64];
+    create_fifo_name(fifo_name, drone_id);
+    
+    if (mkfifo(fifo_name, 0666) == -1 && errno != EEXIST) {
+        log_error("Error creando FIFO para drone %d: %s", drone_id, strerror(errno));
+        return -1;
+    }
+    
+    int fd = open(fifo_name, O_RDWR | O_NONBLOCK);
+    if (fd == -1) {
+        log_error("Error abriendo FIFO para drone %d: %s", drone_id, strerror(errno));
+        return -1;
+    }
+    
+    return fd;
+}
+
+// Funciones del canal de comandos y telemetría
+
+// Función para calcular la disposición de una foto del mundo (arreglos alineados detrás
+// de la parte fija); deja los offsets en layout y devuelve los bytes de cada foto
+size_t snapshot_layout(ShmSnapshot* layout) {
+    size_t align = SHM_ALIGNMENT - 1;
+    size_t array = (sizeof(int32_t) * system_state.drone_capacity + align) & ~align;
+    memset(layout, 0, sizeof(*layout));
+    layout->x_offset = (uint32_t)((sizeof(ShmSnapshot) + align) & ~align);
+    layout->y_offset = (uint32_t)(layout->x_offset + array);
+    layout->state_offset = (uint32_t)(layout->y_offset + array);
+    return layout->state_offset + array;
+}
+
+// Función para dejar listas las fotos del mundo (en cero, sin ninguna publicada)
+void snapshots_attach(char* snapshots, size_t size, _Atomic uint64_t* published) {
+    ShmSnapshot layout;
+    snapshot_layout(&layout);
+    for (int b = 0; b < SHM_SNAPSHOT_BUFFERS; b++) {
+        ShmSnapshot* snapshot = (ShmSnapshot*)(snapshots + b * size);
+        snapshot->x_offset = layout.x_offset;
+        snapshot->y_offset = layout.y_offset;
+        snapshot->state_offset = layout.state_offset;
+    }
+    atomic_store_explicit(published, 0, memory_order_relaxed);
+    channel.snapshot_size = size;
+    channel.snapshots_published = published;
+    channel.snapshots = snapshots;
+}
+
+// Función para abrir el canal de la misión: la FIFO del centro y la región compartida
+// (una por misión, con un slot por drone de la flota) salvo en modo de compatibilidad
+int channel_open() {
+    system_state.center_fifo_fd = -1;
+    if (channel.mode == CHANNEL_NONE) {
+        return 0;
+    }
+    
+    // Crear directorio FIFO
+    mkdir(FIFO_PATH, 0777);
+    
+    // Crear FIFO del centro de comando: comandos de texto para el intérprete y, con la
+    // región compartida, el timbre de su cola
+    snprintf(system_state.center_fifo_name, sizeof(system_state.center_fifo_name), 
+             "%s/center", FIFO_PATH);
+    mkfifo(system_state.center_fifo_name, 0666);
+    system_state.center_fifo_fd = open(system_state.center_fifo_name, O_RDWR | O_NONBLOCK);
+    ShmSnapshot layout;
+    size_t snapshot_size = snapshot_layout(&layout);
+    if (channel.mode == CHANNEL_FIFO) {
+        channel.snapshot_memory = aligned_alloc(SHM_ALIGNMENT, snapshot_size * SHM_SNAPSHOT_BUFFERS);
+        if (channel.snapshot_memory) {
+            memset(channel.snapshot_memory, 0, snapshot_size * SHM_SNAPSHOT_BUFFERS);
+            snapshots_attach(channel.snapshot_memory, snapshot_size, &channel.local_published);
+        }
+        return 0;
+    }
+    
+    // Disposición: cabecera, slots, cola, anillos y fotos, cada bloque alineado
+    size_t align = SHM_ALIGNMENT - 1;
+    size_t slots_offset = (sizeof(ShmHeader) + align) & ~align;
+    size_t queue_offset = (slots_offset + sizeof(ShmCommandSlot) * system_state.drone_capacity + align) & ~align;
+    size_t rings_offset = (queue_offset + sizeof(ShmCommandQueue) + sizeof(ShmCommandCell) * SHM_QUEUE_CAPACITY + align) & ~align;
+    size_t ring_size = (sizeof(ShmTelemetryRing) + sizeof(TraceRecord) * SHM_RING_RECORDS + align) & ~align;
+    size_t snapshots_offset = rings_offset + ring_size * SHM_RING_COUNT;
+    size_t size = snapshots_offset + snapshot_size * SHM_SNAPSHOT_BUFFERS;
+    
+    int fd = shm_open(channel.name, O_CREAT | O_RDWR | O_TRUNC, 0666);
+    if (fd == -1) {
+        log_error("Error creando la región compartida %s: %s", channel.name, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        log_error("Error dimensionando la región compartida %s: %s", channel.name, strerror(errno));
+        close(fd);
+        shm_unlink(channel.name);
+        return -1;
+    }
+    char* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        log_error("Error mapeando la región compartida %s: %s", channel.name, strerror(errno));
+        shm_unlink(channel.name);
+        return -1;
+    }
+    
+    // La región recién truncada está en cero: solo hay que llenar la cabecera y los
+    // turnos de la cola (los anillos se publican recién al primer registro)
+    ShmHeader* header = (ShmHeader*)base;
+    header->version = SHM_VERSION;
+    header->header_size = sizeof(ShmHeader);
+    header->seed = system_state.seed;
+    header->tick_ms = TICK_MS;
+    header->drone_capacity = (uint32_t)system_state.drone_capacity;
+    header->queue_capacity = SHM_QUEUE_CAPACITY;
+    header->ring_count = SHM_RING_COUNT;
+    header->ring_records = SHM_RING_RECORDS;
+    header->pid = (int32_t)getpid();
+    header->slots_offset = slots_offset;
+    header->queue_offset = queue_offset;
+    header->rings_offset = rings_offset;
+    header->ring_size = ring_size;
+    header->snapshots_offset = snapshots_offset;
+    header->snapshot_size = snapshot_size;
+    snapshots_attach(base + snapshots_offset, snapshot_size, &header->snapshots_published);
+    
+    ShmCommandQueue* queue = (ShmCommandQueue*)(base + queue_offset);
+    for (uint64_t i = 0; i < SHM_QUEUE_CAPACITY; i++) {
+        atomic_store_explicit(&queue->cells[i].sequence, i, memory_order_relaxed);
+    }
+    atomic_store_explicit(&header->running, 1, memory_order_relaxed);
+    
+    // La firma va al final: quien la ve, ve la cabecera completa
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SHM_MAGIC, sizeof(header->magic));
+    
+    channel.base = base;
+    channel.size = size;
+    channel.slots = (ShmCommandSlot*)(base + slots_offset);
+    channel.queue = queue;
+    channel.generation++;
+    channel.header = header; // Último: desde acá trace_emit publica telemetría
+    log_message("Canal de comandos: región %s de %.1f KB (%d slots, %d anillos de telemetría, fotos de %.1f KB)",
+                channel.name, size / 1024.0, system_state.drone_capacity, SHM_RING_COUNT, snapshot_size / 1024.0);
+    return 0;
+}
+
+// Función para cerrar el canal de la misión (los procesos que la tengan mapeada
+// conservan la región hasta desmapearla)
+void channel_close() {
+    if (system_state.center_fifo_fd != -1) {
+        close(system_state.center_fifo_fd);
+        system_state.center_fifo_fd = -1;
+    }
+    channel.snapshots = NULL;
+    free(channel.snapshot_memory);
+    channel.snapshot_memory = NULL;
+    if (!channel.base) {
+        return;
+    }
+    
+    atomic_store_explicit(&channel.header->running, 0, memory_order_release);
+    channel.header = NULL;
+    channel.slots = NULL;
+    channel.queue = NULL;
+    munmap(channel.base, channel.size);
+    channel.base = NULL;
+    shm_unlink(channel.name);
+}
+
+// Función para publicar la foto del mundo del tick que terminó. La llama el hilo de ticks
+// con los trabajadores esperando: escribe en el buffer que no tiene la última foto y no
+// espera a los lectores (el seqlock les avisa si los alcanzó).
+void snapshot_publish(long tick) {
+    if (!channel.snapshots) return;
+    
+    uint64_t published = atomic_load_explicit(channel.snapshots_published, memory_order_relaxed);
+    ShmSnapshot* snapshot = (ShmSnapshot*)(channel.snapshots + (published % SHM_SNAPSHOT_BUFFERS) * channel.snapshot_size);
+    uint64_t sequence = atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&snapshot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    int drones = system_state.drone_count;
+    snapshot->tick = (uint64_t)tick + 1;
+    snapshot->phase = (uint32_t)system_state.phase;
+    snapshot->drone_count = (uint32_t)drones;
+    for (int state = 0; state < DRONE_STATE_COUNT; state++) {
+        snapshot->state_counts[state] = (uint32_t)fleet_count(state);
+    }
+    // El almacén es de arreglos paralelos: tres copias en bloque
+    memcpy((char*)snapshot + snapshot->x_offset, system_state.store.pos_x, sizeof(int32_t) * drones);
+    memcpy((char*)snapshot + snapshot->y_offset, system_state.store.pos_y, sizeof(int32_t) * drones);
+    memcpy((char*)snapshot + snapshot->state_offset, system_state.store.state, sizeof(int32_t) * drones);
+    
+    atomic_store_explicit(&snapshot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(channel.snapshots_published, published + 1, memory_order_release);
+}
+
+// Función para leer la parte fija de la última foto del mundo desde cualquier hilo (tick,
+// fase y drones por estado, todo del mismo tick). Devuelve -1 si todavía no hay foto.
+int snapshot_read(ShmSnapshot* out) {
+    if (!channel.snapshots) return -1;
+    return shm_snapshot_read(channel.snapshots, channel.snapshot_size, channel.snapshots_published, out,
+                             NULL, NULL, NULL, 0) < 0 ? -1 : 0;
+}
+
+// Función para encolar un comando al centro (varios productores). Devuelve -1 si la
+// cola está llena.
+int command_queue_push(ShmCommandQueue* queue, CommandType type, int target_id, int arg, const char* data) {
+    uint64_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    ShmCommandCell* cell;
+    
+    while (1) {
+        cell = &queue->cells[position & (SHM_QUEUE_CAPACITY - 1)];
+        uint64_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        if (sequence == position) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            return -1; // La celda todavía tiene un comando de la vuelta anterior
+        } else {
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+    
+    cell->type = (uint32_t)type;
+    cell->target_id = target_id;
+    cell->arg = arg;
+    cell->sent_ns = monotonic_ns();
+    snprintf(cell->data, sizeof(cell->data), "%s", data ? data : "");
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+    return 0;
+}
+
+// Función para mandar un comando a un drone: a su slot de la región compartida o, en modo
+// de compatibilidad, a su FIFO. Devuelve -1 si el drone no aplicó todavía el anterior.
+int drone_command_post(int drone_id, CommandType type, int target_id, int arg) {
+    if (channel.slots) {
+        ShmCommandSlot* slot = &channel.slots[drone_id];
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+        if (atomic_load_explicit(&slot->ack, memory_order_acquire) != seq) {
+            return -1;
+        }
+        slot->type = (uint32_t)type;
+        slot->target_id = target_id;
+        slot->arg = arg;
+        atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+        return 0;
+    }
+    
+    Drone* drone = &system_state.drones[drone_id];
+    if (drone->fifo_fd == -1) {
+        return -1;
+    }
+    Command cmd = {type, target_id, {0}};
+    snprintf(cmd.data, sizeof(cmd.data), "%d", arg);
+    return write(drone->fifo_fd, &cmd, sizeof(cmd)) == sizeof(cmd) ? 0 : -1;
+}
+
+// Función para reservar la cola de eventos (capacidad redondeada a potencia de 2)
+int event_queue_init(EventQueue* queue, size_t capacity, EventOverflowPolicy policy) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    
+    if (posix_memalign((void**)&queue->cells, ARENA_ALIGNMENT, sizeof(EventCell) * size) != 0) {
+        queue->cells = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+    queue->mask = size - 1;
+    queue->policy = policy;
+    queue->consumer = pthread_self();
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    
+    atomic_init(&queue->overflow_stub.next, NULL);
+    atomic_init(&queue->overflow_tail, &queue->overflow_stub);
+    queue->overflow_head = &queue->overflow_stub;
+    
+    atomic_init(&queue->enqueued, 0);
+    atomic_init(&queue->dropped, 0);
+    atomic_init(&queue->overflowed, 0);
+    atomic_init(&queue->blocked, 0);
+    atomic_init(&queue->high_watermark, 0);
+    return 0;
+}
+
+// Función para registrar la ocupación máxima observada de la cola
+void event_queue_note_depth(EventQueue* queue, size_t depth) {
+    size_t seen = atomic_load_explicit(&queue->high_watermark, memory_order_relaxed);
+    while (depth > seen &&
+           !atomic_compare_exchange_weak_explicit(&queue->high_watermark, &seen, depth,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Función para intentar encolar en el anillo (Vyukov): cada celda lleva un número de
+// secuencia que indica si está libre para la posición que el productor reservó
+int event_queue_try_push(EventQueue* queue, const Event* event) {
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    
+    for (;;) {
+        EventCell* cell = &queue->cells[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->event = *event;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                event_queue_note_depth(queue, pos + 1 - atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed));
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0; // Anillo lleno
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// Función para encolar en la lista de desborde (cola MPSC intrusiva, sin límite)
+void event_queue_push_overflow(EventQueue* queue, EventNode* node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    EventNode* prev = atomic_exchange_explicit(&queue->overflow_tail, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+// Función para sacar un nodo de la lista de desborde (solo el consumidor).
+// Devuelve NULL si está vacía o si un productor aún no terminó de enlazar su nodo.
+EventNode* event_queue_pop_overflow(EventQueue* queue) {
+    EventNode* head = queue->overflow_head;
+    EventNode* next = atomic_load_explicit(&head->next, memory_order_acquire);
+    
+    if (head == &queue->overflow_stub) {
+        if (!next) {
+            return NULL;
+        }
+        queue->overflow_head = next;
+        head = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next) {
+        queue->overflow_head = next;
+        return head;
+    }
+    if (head != atomic_load_explicit(&queue->overflow_tail, memory_order_acquire)) {
+        return NULL;
+    }
+    event_queue_push_overflow(queue, &queue->overflow_stub);
+    next = atomic_load_explicit(&head->next, memory_order_acquire);
+    if (next) {
+        queue->overflow_head = next;
+        return head;
+    }
+    return NULL;
+}
+
+// Función para sacar hasta "max" eventos de una vez (solo el consumidor):
+// primero el anillo y después lo que haya desbordado
+int event_queue_pop_batch(EventQueue* queue, Event* out, int max) {
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    int count = 0;
+    
+    while (count < max) {
+        EventCell* cell = &queue->cells[pos & queue->mask];
+        if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + 1) {
+            break; // Vacío, o un productor todavía está escribiendo esta celda
+        }
+        out[count++] = cell->event;
+        atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+        pos++;
+    }
+    atomic_store_explicit(&queue->dequeue_pos, pos, memory_order_relaxed);
+    
+    while (count < max) {
+        EventNode* node = event_queue_pop_overflow(queue);
+        if (!node) {
+            break;
+        }
+        out[count++] = node->event;
+        free(node);
+    }
+    return count;
+}
+
+// Función para liberar la cola y lo que quede en el desborde
+void event_queue_destroy(EventQueue* queue) {
+    EventNode* node;
+    while ((node = event_queue_pop_overflow(queue)) != NULL) {
+        free(node);
+    }
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+// Función para encolar un evento aplicando la política de desborde si el anillo está lleno
+void event_queue_push(EventQueue* queue, const Event* event) {
+    if (event_queue_try_push(queue, event)) {
+        atomic_fetch_add_explicit(&queue->enqueued, 1, memory_order_relaxed);
+        return;
+    }
+    
+    switch (queue->policy) {
+        case EVENT_OVERFLOW_DROP:
+            atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+            return;
+            
+        case EVENT_OVERFLOW_GROW: {
+            EventNode* node = malloc(sizeof(EventNode));
+            if (!node) {
+                atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+                return;
+            }
+            node->event = *event;
+            event_queue_push_overflow(queue, node);
+            atomic_fetch_add_explicit(&queue->overflowed, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&queue->enqueued, 1, memory_order_relaxed);
+            return;
+        }
+            
+        case EVENT_OVERFLOW_BLOCK:
+            atomic_fetch_add_explicit(&queue->blocked, 1, memory_order_relaxed);
+            while (!event_queue_try_push(queue, event)) {
+                if (pthread_equal(pthread_self(), queue->consumer)) {
+                    process_events(); // El consumidor no puede esperarse a sí mismo
+                } else {
+                    sched_yield();
+                }
+            }
+            atomic_fetch_add_explicit(&queue->enqueued, 1, memory_order_relaxed);
+            return;
+    }
+}
+
+// Función para mostrar las estadísticas de la cola de eventos
+void event_queue_log_stats(EventQueue* queue) {
+    log_message("Cola de eventos: %lu encolados, %lu descartados, %lu desbordados, %lu bloqueos, máximo %zu/%zu",
+               atomic_load(&queue->enqueued), atomic_load(&queue->dropped),
+               atomic_load(&queue->overflowed), atomic_load(&queue->blocked),
+               atomic_load(&queue->high_watermark), queue->mask + 1);
+}
+
+// Función para enviar evento (sin bloqueos: los trabajadores no se serializan aquí)
+void send_event(EventType type, int drone_id, int swarm_id, int truck_id, const char* data) {
+    Event event;
+    event.type = type;
+    event.drone_id = drone_id;
+    event.swarm_id = swarm_id;
+    event.truck_id = truck_id;
+    event.timestamp = sim_time_now();
+    event.data = data ? data : "";
+    
+    trace_emit(TRACE_EVENT, drone_id, swarm_id, type, 0);
+    if (replay.mode) {
+        replay_note_event(&event);
+    }
+    if (type == EVT_DESTROYED || type == EVT_FUEL_EMPTY) {
+        retask_note_loss(drone_id);
+    }
+    event_queue_push(&system_state.events, &event);
+}
+
+// Función para enviar un comando al intérprete del centro. retask: target_id = objetivo
+// nuevo, arg = enjambre; report_ok/report_fail: target_id = objetivo. Con la región
+// compartida va a su cola y se toca el timbre; si no, como línea de texto por la FIFO.
+void send_command(CommandType type, int target_id, int arg, const char* data) {
+    if (system_state.center_fifo_fd == -1) {
+        return;
+    }
+    
+    char line[64];
+    int length;
+    if (channel.queue) {
+        if (command_queue_push(channel.queue, type, target_id, arg, data) != 0) {
+            log_error("Error enviando comando: cola de comandos llena");
+            return;
+        }
+        line[0] = '\n'; // Timbre: línea vacía
+        length = 1;
+    } else if (type == CMD_RETASK) {
+        length = snprintf(line, sizeof(line), "retask %d %d\n", arg, target_id);
+    } else if (type == CMD_GO_ATTACK_GLOBAL) {
+        length = snprintf(line, sizeof(line), "attack\n");
+    } else {
+        length = snprintf(line, sizeof(line), "%s %d\n", shm_command_names[type], target_id);
+    }
+    
+    // Con la FIFO llena el timbre sobra: el intérprete ya tiene qué leer
+    if (write(system_state.center_fifo_fd, line, length) == -1 && (errno != EAGAIN || !channel.queue)) {
+        log_error("Error enviando comando: %s", strerror(errno));
+    }
+}
+
+// Función para aplicar un comando recibido por el drone
+void drone_apply_command(Drone* drone, CommandType type, int target_id) {
+    switch (type) {
+        case CMD_RETASK: {
+            // Solo se redirige a quien vuela hacia un objetivo o espera en otro la detonación
+            DroneState state = drone_state(drone);
+            if (target_id < 0 || target_id >= system_state.target_count ||
+                (state != DRONE_STATE_FLYING_TO_TARGET && state != DRONE_STATE_AT_TARGET)) {
+                break;
+            }
+            Position goal = system_state.targets[target_id].pos;
+            Position pos = drone_position(drone);
+            if (state == DRONE_STATE_AT_TARGET && pos.x == goal.x && pos.y == goal.y) {
+                break;
+            }
+            drone_set_route(drone, target_id);
+            drone_set_state(drone, DRONE_STATE_FLYING_TO_TARGET);
+            log_drone("Drone %d redirigido al objetivo %d", drone->id, target_id);
+            break;
+        }
+        default:
+            log_debug(LOG_CAT_COMM, "Drone %d: comando %d sin efecto", drone->id, (int)type);
+            break;
+    }
+}
+
+// Paso de comandos del drone (un tick): lo pendiente en su slot de la región compartida
+// (una lectura atómica) o, en modo de compatibilidad, en su FIFO
+void drone_command_step(Drone* drone) {
+    if (channel.slots) {
+        ShmCommandSlot* slot = &channel.slots[drone->id];
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != atomic_load_explicit(&slot->ack, memory_order_relaxed)) {
+            drone_apply_command(drone, (CommandType)slot->type, slot->target_id);
+            atomic_store_explicit(&slot->ack, seq, memory_order_release);
+        }
+    } else if (drone->fifo_fd != -1) {
+        Command cmd;
+        while (read(drone->fifo_fd, &cmd, sizeof(cmd)) == sizeof(cmd)) {
+            drone_apply_command(drone, cmd.type, cmd.target_id);
+        }
+    }
+}
+
+// Paso de navegación del drone (un tick). El movimiento ya lo hizo el kernel de
+// cinemática para toda la flota; aquí solo se resuelven llegadas y defensas.
+void drone_navigation_step(Drone* drone, long tick) {
+    int arrived = system_state.store.arrived[drone->id];
+    
+    switch (drone_state(drone)) {
+        case DRONE_STATE_FLYING_TO_ASSEMBLY:
+            if (arrived) {
+                drone_set_state(drone, DRONE_STATE_CIRCLING_ASSEMBLY);
+                if (system_state.simulation_running) {
+                    log_drone("Drone %d llegó al punto de ensamble, comenzando patrulla circular", drone->id);
+                }
+            }
+            break;
+            
+        case DRONE_STATE_CIRCLING_ASSEMBLY:
+            // Volar en círculos alrededor del punto de ensamble
+            fly_in_circles(drone);
+            break;
+            
+        case DRONE_STATE_FLYING_TO_TARGET:
+            if (arrived) {
+                drone_set_state(drone, DRONE_STATE_AT_TARGET);
+                if (system_state.simulation_running) {
+                    log_drone("Drone %d llegó al objetivo (distancia recorrida: %d unidades)", drone->id, drone_distance_traveled(drone));
+                    send_event(EVT_AT_TARGET, drone->id, drone->swarm_id, drone->truck_id, "AT_TARGET");
+                }
+            } else {
+                // Está en zona de defensa si alguna defensa lo alcanza (campo de amenaza).
+                // Cada drone verifica cada 5 ticks, escalonado por id para repartir la carga;
+                // el sorteo ya usó el umbral de su celda (threat_lookup)
+                int in_zone = threat_threshold_at(drone_position(drone)) > 0;
+                drone_set_in_defense_zone(drone, in_zone);
+                if (in_zone && (tick + drone->id) % DEFENSE_CHECK_TICKS == 0) {
+                    if (system_state.store.draws[drone->id] & DRAW_SHOOT_DOWN) {
+                        trace_emit(TRACE_SHOT_DOWN, drone->id, drone->swarm_id, 0, drone_position(drone).y);
+                        atomic_fetch_add_explicit(&system_state.losses[LOSS_SHOT_DOWN], 1, memory_order_relaxed);
+                        drone_set_state(drone, DRONE_STATE_DESTROYED);
+                        if (system_state.simulation_running) {
+                            log_drone("Drone %d derribado por defensas enemigas en zona de defensa (Y=%d)", 
+                                       drone->id, drone_position(drone).y);
+                            send_event(EVT_DESTROYED, drone->id, drone->swarm_id, drone->truck_id, "SHOT_DOWN");
+                        }
+                    }
+                }
+            }
+            break;
+            
+        default:
+            break;
+    }
+}
+
+// Paso de combustible del drone (un tick; consume una unidad por segundo)
+void drone_fuel_step(Drone* drone, long tick) {
+    if (tick % TICKS_PER_SECOND != 0) {
+        return;
+    }
+    
+    if (--system_state.store.fuel[drone->id] <= 0) {
+        drone_set_state(drone, DRONE_STATE_FUEL_EMPTY);
+        atomic_fetch_add_explicit(&system_state.losses[LOSS_FUEL_EMPTY], 1, memory_order_relaxed);
+        log_drone("Drone %d se quedó sin combustible", drone->id);
+        send_event(EVT_FUEL_EMPTY, drone->id, drone->swarm_id, drone->truck_id, "FUEL_EMPTY");
+    }
+}
+
+// Paso de comunicación del drone (un tick = 1 décima de segundo)
+void drone_communication_step(Drone* drone) {
+    // Verificar pérdida de comunicación (Q% de probabilidad) - solo cada segundo
+    drone->comm_check_ticks++;
+    if (drone->comm_check_ticks >= TICKS_PER_SECOND) {
+        drone->comm_check_ticks = 0;
+        
+        if (drone->communication_active && (system_state.store.draws[drone->id] & DRAW_COMM_LOSS)) {
+            drone->communication_active = 0;
+            drone->last_communication_loss = sim_time_now();
+            trace_emit(TRACE_COMM_LOST, drone->id, drone->swarm_id, 0, 0);
+            drone->communication_timeout = 0;
+            drone->reestablish_attempts = 0;
+            
+            // Solo loguear si la simulación está activa
+            if (system_state.simulation_running) {
+                log_event("COM_LOST", "Drone %d: COMUNICACIÓN PERDIDA", drone->id);
+            }
+        }
+    }
+    
+    // Si la comunicación está perdida, intentar reestablecerla
+    if (!drone->communication_active) {
+        drone->communication_timeout++;
+        
+        // Verificar si se reestablece (50% de probabilidad cada segundo, no cada décima)
+        if (drone->communication_timeout % TICKS_PER_SECOND == 0 &&
+            (system_state.store.draws[drone->id] & DRAW_COMM_RESTORE)) {
+            drone->communication_active = 1;
+            drone->reestablish_attempts++;
+            trace_emit(TRACE_COMM_RESTORED, drone->id, drone->swarm_id, 0,
+                       drone->communication_timeout / TICKS_PER_SECOND);
+            
+            // Solo loguear si la simulación está activa
+            if (system_state.simulation_running) {
+                log_event("COM_REST", "Drone %d: COMUNICACIÓN REESTABLECIDA después de %d segundos (intento %d)", 
+                         drone->id, drone->communication_timeout / TICKS_PER_SECOND, drone->reestablish_attempts);
+            }
+        }
+        
+        // Verificar timeout (Z segundos) - solo mostrar mensaje una vez
+        if (drone->communication_timeout >= system_state.Z * TICKS_PER_SECOND && drone->reestablish_attempts == 0) {
+            // Solo loguear si la simulación está activa
+            if (system_state.simulation_running) {
+                log_event("COM_TIMEOUT", "Drone %d: TIMEOUT DE COMUNICACIÓN alcanzado (%d segundos) - DRONE PERDIDO", 
+                         drone->id, system_state.Z);
+            }
+            
+            trace_emit(TRACE_COMM_TIMEOUT, drone->id, drone->swarm_id, 0, system_state.Z);
+            atomic_fetch_add_explicit(&system_state.losses[LOSS_COMM_LOST], 1, memory_order_relaxed);
+            drone_set_state(drone, DRONE_STATE_DESTROYED);
+            
+            // Enviar evento de drone perdido solo si la simulación está activa
+            if (system_state.simulation_running) {
+                send_event(EVT_DESTROYED, drone->id, drone->swarm_id, drone->truck_id, "COMM_LOST");
+            }
+        }
+    }
+}
+
+// Paso de payload del drone (un tick)
+void drone_payload_step(Drone* drone) {
+    if (drone_state(drone) != DRONE_STATE_AT_TARGET || drone->payload_logged || !system_state.simulation_running) {
+        return;
+    }
+    
+    if (drone->type == DRONE_TYPE_ATTACK) {
+        // Drone de ataque espera comando para detonar
+        // NO detona automáticamente
+        log_drone("Drone de ataque %d llegó al objetivo, esperando comando para detonar", drone->id);
+    } else if (drone->type == DRONE_TYPE_CAMERA) {
+        // Drone cámara NO hace reporte automático aquí
+        // Solo espera a que los drones de ataque detonen
+        log_drone("Drone cámara %d en posición de vigilancia, esperando detonaciones", drone->id);
+    }
+    drone->payload_logged = 1;
+}
+
+// Función para avanzar un drone un tick (navegación, combustible, comunicación y payload)
+void drone_tick(Drone* drone, long tick) {
+    // Un drone sin combustible queda inmóvil; uno destruido ya no participa
+    if (drone->active && drone_state(drone) != DRONE_STATE_DESTROYED && drone_state(drone) != DRONE_STATE_FUEL_EMPTY) {
+        drone_command_step(drone);
+        drone_navigation_step(drone, tick);
+        
+        if (drone_state(drone) != DRONE_STATE_DESTROYED) {
+            drone_fuel_step(drone, tick);
+        }
+        if (drone_state(drone) != DRONE_STATE_DESTROYED) {
+            drone_communication_step(drone);
+        }
+        if (drone_state(drone) != DRONE_STATE_DESTROYED) {
+            drone_payload_step(drone);
+        }
+    }
+}
+
+// Función para avanzar todos los drones de un enjambre un tick
+void swarm_tick(Swarm* swarm, long tick) {
+    for (int j = 0; j < swarm->size; j++) {
+        drone_tick(swarm_drone(swarm, j), tick);
+    }
+}
+
+// Tarea de cinemática: mueve un bloque de KINEMATICS_CHUNK drones del almacén
+// y saca sus sorteos del tick
+void kinematics_task(int chunk, long tick) {
+    int begin = chunk * KINEMATICS_CHUNK;
+    int end = begin + KINEMATICS_CHUNK;
+    if (end > system_state.drone_count) {
+        end = system_state.drone_count;
+    }
+    flow_steer(&system_state.store, begin, end);
+    kinematics_kernel(&system_state.store, begin, end, system_state.speed);
+    flow_settle(&system_state.store, begin, end, system_state.speed);
+    threat_lookup(&system_state.store, begin, end);
+    draws_kernel(&system_state.store, begin, end, tick);
+}
+
+// Tarea por enjambre: llegadas, defensas, combustible, comunicación y payload
+void swarm_task(int index, long tick) {
+    swarm_tick(&system_state.swarms[index], tick);
+}
+
+// Función para procesar la parte de un trabajador: primero su rango, luego roba de los demás
+void scheduler_run_share(int worker_id, long tick) {
+    for (int k = 0; k < scheduler.worker_count; k++) {
+        WorkRange* range = &scheduler.ranges[(worker_id + k) % scheduler.worker_count];
+        int index;
+        
+        while ((index = atomic_fetch_add_explicit(&range->next, 1, memory_order_relaxed)) < range->end) {
+            scheduler.task(index, tick);
+        }
+    }
+}
+
+// Hilo trabajador del pool
+void* scheduler_worker_thread(void* arg) {
+    int worker_id = (int)(long)arg;
+    unsigned long seen_generation = 0;
+    
+    while (1) {
+        pthread_mutex_lock(&scheduler.mutex);
+        while (!scheduler.shutdown && scheduler.generation == seen_generation) {
+            pthread_cond_wait(&scheduler.start_condition, &scheduler.mutex);
+        }
+        if (scheduler.shutdown) {
+            pthread_mutex_unlock(&scheduler.mutex);
+            break;
+        }
+        seen_generation = scheduler.generation;
+        long tick = scheduler.current_tick;
+        pthread_mutex_unlock(&scheduler.mutex);
+        
+        scheduler_run_share(worker_id, tick);
+        
+        pthread_mutex_lock(&scheduler.mutex);
+        if (--scheduler.pending == 0) {
+            pthread_cond_signal(&scheduler.done_condition);
+        }
+        pthread_mutex_unlock(&scheduler.mutex);
+    }
+    
+    return NULL;
+}
+
+// Función para ejecutar una tarea sobre [0, count) repartida entre el pool
+void scheduler_parallel_for(int count, void (*task)(int index, long tick), long tick) {
+    int workers = scheduler.worker_count;
+    
+    // Con pocas unidades de trabajo no vale la pena despertar al pool
+    if (workers > count) {
+        workers = count > 0 ? count : 1;
+    }
+    
+    // Repartir las unidades en rangos contiguos, uno por trabajador
+    scheduler.task = task;
+    for (int w = 0; w < scheduler.worker_count; w++) {
+        int begin = (w < workers) ? (int)((long)count * w / workers) : count;
+        int end = (w < workers) ? (int)((long)count * (w + 1) / workers) : count;
+        atomic_store_explicit(&scheduler.ranges[w].next, begin, memory_order_relaxed);
+        scheduler.ranges[w].end = end;
+    }
+    
+    if (workers == 1) {
+        scheduler_run_share(0, tick);
+        return;
+    }
+    
+    pthread_mutex_lock(&scheduler.mutex);
+    scheduler.current_tick = tick;
+    scheduler.pending = scheduler.worker_count - 1;
+    scheduler.generation++;
+    pthread_cond_broadcast(&scheduler.start_condition);
+    pthread_mutex_unlock(&scheduler.mutex);
+    
+    // El hilo de ticks también trabaja como trabajador 0
+    scheduler_run_share(0, tick);
+    
+    pthread_mutex_lock(&scheduler.mutex);
+    while (scheduler.pending > 0) {
+        pthread_cond_wait(&scheduler.done_condition, &scheduler.mutex);
+    }
+    pthread_mutex_unlock(&scheduler.mutex);
+}
+
+// Función para ejecutar un tick completo: primero el kernel de cinemática sobre
+// toda la flota, luego la lógica de cada enjambre
+void scheduler_run_tick(long tick) {
+    int chunks = (system_state.drone_count + KINEMATICS_CHUNK - 1) / KINEMATICS_CHUNK;
+    scheduler_parallel_for(chunks, kinematics_task, tick);
+    scheduler_parallel_for(system_state.swarm_count, swarm_task, tick);
+}
+
+// Función para sumar milisegundos a un instante
+void timespec_add_ms(struct timespec* ts, long ms) {
+    ts->tv_nsec += ms * 1000000L;
+    while (ts->tv_nsec >= 1000000000L) {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+// Función del hilo de ticks al final de cada tick: aplica las defensas que el operador
+// encendió o apagó y, si el campo de amenaza cambió desde "version" (también por un
+// comando repetido del registro), rehace las rutas antes del tick siguiente
+void defense_end_tick(uint32_t version) {
+    if (atomic_exchange(&system_state.defense_requested, 0)) {
+        for (int d = 0; d < system_state.defense_count; d++) {
+            int active = atomic_exchange(&system_state.defenses[d].requested, -1);
+            if (active >= 0) {
+                defense_apply_command(d, active);
+            }
+        }
+    }
+    if (system_state.threat.version != version) {
+        flow_fields_refresh();
+    }
+}
+
+// Hilo de ticks: avanza la simulación mientras el centro de comando espera.
+// En tiempo real cada tick dura TICK_MS; en tiempo virtual los ticks corren sin pausa.
+void* scheduler_tick_thread(void* arg) {
+    (void)arg;
+    struct timespec next_tick;
+    clock_gettime(CLOCK_MONOTONIC, &next_tick);
+    
+    while (1) {
+        pthread_mutex_lock(&scheduler.clock_mutex);
+        while (system_state.simulation_running &&
+               !(scheduler.controller_waiting && sim_now() < scheduler.wake_tick)) {
+            pthread_cond_wait(&scheduler.clock_condition, &scheduler.clock_mutex);
+        }
+        pthread_mutex_unlock(&scheduler.clock_mutex);
+        
+        if (!system_state.simulation_running) {
+            break;
+        }
+        
+        if (!system_state.virtual_time) {
+            // No recuperar ticks perdidos mientras el reloj estuvo retenido
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (now.tv_sec > next_tick.tv_sec || 
+                (now.tv_sec == next_tick.tv_sec && now.tv_nsec > next_tick.tv_nsec)) {
+                next_tick = now;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_tick, NULL);
+            timespec_add_ms(&next_tick, TICK_MS);
+        }
+        
+        long tick = sim_now();
+        uint64_t tick_start = scheduler.tick_ns ? monotonic_ns() : 0;
+        uint32_t threat_version = system_state.threat.version;
+        scheduler_run_tick(tick);
+        trace_end_tick();
+        retask_end_tick();
+        replay_end_tick(tick);
+        defense_end_tick(threat_version);
+        snapshot_publish(tick);
+        if (scheduler.tick_ns && scheduler.tick_ns_count < scheduler.tick_ns_capacity) {
+            scheduler.tick_ns[scheduler.tick_ns_count++] = monotonic_ns() - tick_start;
+        }
+        
+        pthread_mutex_lock(&scheduler.clock_mutex);
+        atomic_store_explicit(&scheduler.clock_tick, tick + 1, memory_order_release);
+        if (channel.header) {
+            atomic_store_explicit(&channel.header->tick, (uint64_t)tick + 1, memory_order_release);
+        }
+        // Un ataque pedido por el operador corta la espera por los enjambres al final de
+        // este tick (el centro sigue actuando solo entre ticks)
+        if (tick + 1 >= scheduler.wake_tick ||
+            (scheduler.wake_on_barrier && atomic_load(&system_state.barrier.remaining) <= 0) ||
+            (system_state.phase == 1 && atomic_load(&system_state.attack_requested))) {
+            scheduler.controller_waiting = 0;
+            pthread_cond_signal(&scheduler.controller_condition);
+        }
+        pthread_mutex_unlock(&scheduler.clock_mutex);
+    }
+    
+    return NULL;
+}
+
+// Función para que el centro de comando deje avanzar el reloj hasta "ticks" ticks;
+// con "on_barrier" también vuelve al final del tick en que la barrera llega a cero
+void sim_wait_ticks(long ticks, int on_barrier) {
+    if (!scheduler.started) {
+        return;
+    }
+    
+    // Si cambió alguna defensa, las rutas se rehacen antes de soltar el reloj
+    flow_fields_refresh();
+    
+    pthread_mutex_lock(&scheduler.clock_mutex);
+    scheduler.wake_tick = sim_now() + ticks;
+    scheduler.wake_on_barrier = on_barrier;
+    scheduler.controller_waiting = 1;
+    pthread_cond_signal(&scheduler.clock_condition);
+    while (scheduler.controller_waiting && system_state.simulation_running) {
+        // Mientras espera, el centro de comando consume eventos para que la cola
+        // no se llene (y los productores con política "block" puedan avanzar)
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        timespec_add_ms(&deadline, EVENT_DRAIN_MS);
+        pthread_cond_timedwait(&scheduler.controller_condition, &scheduler.clock_mutex, &deadline);
+        
+        pthread_mutex_unlock(&scheduler.clock_mutex);
+        process_events();
+        pthread_mutex_lock(&scheduler.clock_mutex);
+    }
+    scheduler.wake_on_barrier = 0;
+    pthread_mutex_unlock(&scheduler.clock_mutex);
+}
+
+void sim_sleep_ticks(long ticks) {
+    sim_wait_ticks(ticks, 0);
+}
+
+// Función para esperar hasta que la barrera armada llegue a cero o pasen "ticks" ticks.
+// Devuelve 1 si la barrera se cumplió.
+int sim_wait_barrier(long ticks) {
+    if (atomic_load(&system_state.barrier.remaining) > 0) {
+        sim_wait_ticks(ticks, 1);
+    }
+    return atomic_load(&system_state.barrier.remaining) <= 0;
+}
+
+// Función para detener la simulación y liberar el reloj
+void stop_simulation() {
+    if (!scheduler.started) {
+        system_state.simulation_running = 0;
+        return;
+    }
+    
+    pthread_mutex_lock(&scheduler.clock_mutex);
+    system_state.simulation_running = 0;
+    pthread_cond_broadcast(&scheduler.clock_condition);
+    pthread_cond_broadcast(&scheduler.controller_condition);
+    pthread_mutex_unlock(&scheduler.clock_mutex);
+}
+
+// Función para arrancar el pool de trabajadores y el hilo de ticks (el reloj arranca en
+// start_tick: 0, o el tick de un punto de control restaurado)
+void start_tick_scheduler(long start_tick) {
+    int workers = system_state.workers;
+    if (workers <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cores > 0 ? (int)cores : 1;
+    }
+    if (workers > MAX_WORKERS) {
+        workers = MAX_WORKERS;
+    }
+    
+    scheduler.worker_count = workers;
+    scheduler.generation = 0;
+    scheduler.pending = 0;
+    scheduler.shutdown = 0;
+    pthread_mutex_init(&scheduler.mutex, NULL);
+    pthread_cond_init(&scheduler.start_condition, NULL);
+    pthread_cond_init(&scheduler.done_condition, NULL);
+    
+    atomic_store(&scheduler.clock_tick, start_tick);
+    scheduler.wake_tick = 0;
+    scheduler.controller_waiting = 0;
+    scheduler.wake_on_barrier = 0;
+    pthread_mutex_init(&scheduler.clock_mutex, NULL);
+    pthread_cond_init(&scheduler.clock_condition, NULL);
+    pthread_cond_init(&scheduler.controller_condition, NULL);
+    
+    for (int w = 1; w < workers; w++) {
+        pthread_create(&scheduler.workers[w], NULL, scheduler_worker_thread, (void*)(long)w);
+    }
+    pthread_create(&scheduler.tick_thread, NULL, scheduler_tick_thread, NULL);
+    scheduler.started = 1;
+    
+    log_message("Planificador iniciado: %d hilos trabajadores para %d drones (tiempo %s, cinemática %s)", 
+               workers, system_state.drone_count, system_state.virtual_time ? "virtual" : "real",
+               kinematics_kernel_name);
+}
+
+// Función para detener el planificador (la simulación ya debe estar detenida)
+void stop_tick_scheduler() {
+    if (!scheduler.started) return;
+    
+    pthread_join(scheduler.tick_thread, NULL);
+    
+    pthread_mutex_lock(&scheduler.mutex);
+    scheduler.shutdown = 1;
+    pthread_cond_broadcast(&scheduler.start_condition);
+    pthread_mutex_unlock(&scheduler.mutex);
+    
+    for (int w = 1; w < scheduler.worker_count; w++) {
+        pthread_join(scheduler.workers[w], NULL);
+    }
+    
+    pthread_mutex_destroy(&scheduler.mutex);
+    pthread_cond_destroy(&scheduler.start_condition);
+    pthread_cond_destroy(&scheduler.done_condition);
+    pthread_mutex_destroy(&scheduler.clock_mutex);
+    pthread_cond_destroy(&scheduler.clock_condition);
+    pthread_cond_destroy(&scheduler.controller_condition);
+    scheduler.started = 0;
+}
+
+// Funciones del intérprete de comandos
+
+// Función para cerrar la cuenta de un comando: aplicado (con su latencia de despacho
+// desde received_ns) o rechazado
+void command_finish(int result, uint64_t received_ns, const char* name) {
+    if (result != 0) {
+        interpreter.rejected++;
+        log_warn("Aviso: comando rechazado: %s", name);
+        return;
+    }
+    
+    interpreter.applied++;
+    uint64_t elapsed = monotonic_ns() - received_ns;
+    uint64_t bucket = elapsed / 1000;
+    interpreter.latency[bucket < COMMAND_LATENCY_BUCKETS ? bucket : COMMAND_LATENCY_BUCKETS - 1]++;
+    if (elapsed > interpreter.latency_max_ns) {
+        interpreter.latency_max_ns = elapsed;
+    }
+}
+
+// Función para mandar un retask al slot de un drone. Si el drone no aplicó todavía el
+// anterior queda pendiente y se reintenta en cada pasada (gana el último objetivo).
+void command_post_retask(int drone_id, int target_id) {
+    if (interpreter.pending_target[drone_id] < 0) {
+        if (drone_command_post(drone_id, CMD_RETASK, target_id, 0) == 0) {
+            return;
+        }
+        interpreter.pending[interpreter.pending_count++] = drone_id;
+    }
+    interpreter.pending_target[drone_id] = target_id;
+}
+
+// Función para reintentar los retask pendientes; los de drones perdidos se descartan
+void command_retry_pending() {
+    int kept = 0;
+    for (int i = 0; i < interpreter.pending_count; i++) {
+        int drone_id = interpreter.pending[i];
+        if (!fleet_drone_lost(drone_id) &&
+            drone_command_post(drone_id, CMD_RETASK, interpreter.pending_target[drone_id], 0) != 0) {
+            interpreter.pending[kept++] = drone_id;
+            continue;
+        }
+        interpreter.pending_target[drone_id] = -1;
+    }
+    interpreter.pending_count = kept;
+}
+
+// Función para validar los argumentos de un comando del centro (attack no lleva;
+// retask: target_id y el enjambre en arg; report_ok/report_fail: target_id;
+// defense: la defensa en target_id y 0/1 en arg)
+int command_valid(CommandType type, int target_id, int arg) {
+    if (type == CMD_GO_ATTACK_GLOBAL) {
+        return 1;
+    }
+    if (type == CMD_SET_DEFENSE) {
+        return target_id >= 0 && target_id < system_state.defense_count && (arg == 0 || arg == 1);
+    }
+    if (target_id < 0 || target_id >= system_state.target_count) {
+        return 0;
+    }
+    return type != CMD_RETASK || (arg >= 0 && arg < system_state.swarm_count);
+}
+
+// Función para validar un retask_drone (drone existente y vivo, objetivo existente)
+int command_drone_valid(int drone_id, int target_id) {
+    return drone_id >= 0 && drone_id < system_state.drone_count &&
+           target_id >= 0 && target_id < system_state.target_count && !fleet_drone_lost(drone_id);
+}
+
+// Función para redirigir un enjambre: cambia su asignación y avisa a cada drone vivo
+int command_retask_swarm(int swarm_id, int target_id) {
+    if (!command_valid(CMD_RETASK, target_id, swarm_id)) {
+        return -1;
+    }
+    
+    Swarm* swarm = &system_state.swarms[swarm_id];
+    system_state.target_assignments[swarm_id] = target_id;
+    retask_note_move(swarm_id, target_id);
+    int posted = 0;
+    pthread_mutex_lock(&swarm->mutex);
+    for (int j = 0; j < swarm->size; j++) {
+        if (!fleet_drone_lost(swarm->members[j])) {
+            command_post_retask(swarm->members[j], target_id);
+            posted++;
+        }
+    }
+    pthread_mutex_unlock(&swarm->mutex);
+    
+    log_debug(LOG_CAT_COMM, "Operador: enjambre %d redirigido al objetivo %d (%d drones)",
+           swarm_id, target_id, posted);
+    return 0;
+}
+
+// Función para redirigir un solo drone (su enjambre conserva la asignación)
+int command_retask_drone(int drone_id, int target_id) {
+    if (!command_drone_valid(drone_id, target_id)) {
+        return -1;
+    }
+    command_post_retask(drone_id, target_id);
+    log_debug(LOG_CAT_COMM, "Operador: drone %d redirigido al objetivo %d", drone_id, target_id);
+    return 0;
+}
+
+// Función para despachar un comando al centro. Devuelve -1 si se rechaza.
+int command_dispatch(CommandType type, int target_id, int arg) {
+    switch (type) {
+        case CMD_GO_ATTACK_GLOBAL:
+            // El centro de comando lo atiende al final del tick en curso (si todavía espera
+            // a los enjambres); se lo despierta para que no espere a su próxima revisión
+            atomic_store(&system_state.attack_requested, 1);
+            pthread_mutex_lock(&scheduler.clock_mutex);
+            pthread_cond_signal(&scheduler.controller_condition);
+            pthread_mutex_unlock(&scheduler.clock_mutex);
+            log_at(LOG_INFO, LOG_CAT_COMM, "Operador: ataque global solicitado");
+            return 0;
+            
+        case CMD_RETASK:
+            return command_retask_swarm(arg, target_id);
+            
+        case CMD_REPORT_OK:
+        case CMD_REPORT_FAIL: {
+            if (!command_valid(type, target_id, arg)) {
+                return -1;
+            }
+            // Va al flujo de eventos como un reporte de cámara sin drone
+            Event event = {type == CMD_REPORT_OK ? EVT_CAM_REPORT_OK : EVT_CAM_REPORT_FAIL,
+                           -1, -1, -1, "REPORTE DEL OPERADOR", sim_time_now()};
+            if (replay.mode) {
+                replay_note_event(&event);
+            }
+            event_queue_push(&system_state.events, &event);
+            log_at(LOG_INFO, LOG_CAT_COMM, "Operador: %s del objetivo %d", shm_command_names[type], target_id);
+            return 0;
+        }
+            
+        case CMD_SET_DEFENSE:
+            if (!command_valid(type, target_id, arg)) {
+                return -1;
+            }
+            // El campo de amenaza solo cambia entre ticks: lo aplica el hilo de ticks
+            atomic_store(&system_state.defenses[target_id].requested, arg);
+            atomic_store(&system_state.defense_requested, 1);
+            return 0;
+    }
+    return -1;
+}
+
+// Función para despachar un comando que llega del operador: en el momento, o al final del
+// tick si se registra o repite la misión (validado antes, como en vivo)
+int command_submit(CommandType type, int target_id, int arg) {
+    if (replay.mode) {
+        return command_valid(type, target_id, arg) ? replay_stage(REPLAY_COMMAND, type, target_id, arg) : -1;
+    }
+    return command_dispatch(type, target_id, arg);
+}
+
+// Función para interpretar y despachar un comando de texto:
+//   attack | retask S T | retask_drone D T | report_ok T | report_fail T | defense D 0|1 | status
+// Devuelve 0 si el texto estaba vacío (el timbre de la cola) y 1 si era un comando.
+int command_execute_text(char* text, uint64_t received_ns) {
+    char* save;
+    char* name = strtok_r(text, " \t\r", &save);
+    if (!name) {
+        return 0;
+    }
+    char* first = strtok_r(NULL, " \t\r", &save);
+    char* second = strtok_r(NULL, " \t\r", &save);
+    int a, b;
+    int arguments = (first && sscanf(first, "%d", &a) == 1) + (second && sscanf(second, "%d", &b) == 1);
+    
+    int result = -1;
+    interpreter.received++;
+    if (strcmp(name, "attack") == 0) {
+        result = command_submit(CMD_GO_ATTACK_GLOBAL, -1, 0);
+    } else if (strcmp(name, "retask") == 0 && arguments == 2) {
+        result = command_submit(CMD_RETASK, b, a);
+    } else if (strcmp(name, "retask_drone") == 0 && arguments == 2) {
+        if (!replay.mode) {
+            result = command_retask_drone(a, b);
+        } else if (command_drone_valid(a, b)) {
+            result = replay_stage(REPLAY_RETASK_DRONE, CMD_RETASK, b, a);
+        }
+    } else if (strcmp(name, "report_ok") == 0 && arguments == 1) {
+        result = command_submit(CMD_REPORT_OK, a, 0);
+    } else if (strcmp(name, "report_fail") == 0 && arguments == 1) {
+        result = command_submit(CMD_REPORT_FAIL, a, 0);
+    } else if (strcmp(name, "defense") == 0 && arguments == 2) {
+        result = command_submit(CMD_SET_DEFENSE, a, b);
+    } else if (strcmp(name, "status") == 0) {
+        // Todo del mismo tick: la última foto del mundo (antes de la primera, las cuentas vivas)
+        ShmSnapshot snapshot = {.tick = (uint64_t)sim_now()};
+        if (snapshot_read(&snapshot) != 0) {
+            snapshot.state_counts[DRONE_STATE_FLYING_TO_TARGET] = fleet_count(DRONE_STATE_FLYING_TO_TARGET);
+            snapshot.state_counts[DRONE_STATE_AT_TARGET] = fleet_count(DRONE_STATE_AT_TARGET);
+        }
+        log_status("Operador: tick %llu, %u drones volando al objetivo, %u en el objetivo; "
+                   "%lu comandos (%lu aplicados, %lu rechazados), %d retask pendientes",
+                   (unsigned long long)snapshot.tick, snapshot.state_counts[DRONE_STATE_FLYING_TO_TARGET],
+                   snapshot.state_counts[DRONE_STATE_AT_TARGET],
+                   interpreter.received, interpreter.applied, interpreter.rejected, interpreter.pending_count);
+        result = 0;
+    }
+    command_finish(result, received_ns, name);
+    return 1;
+}
+
+// Función para partir lo leído de una fuente en comandos (uno por línea, o separados por
+// ";"). Lo que queda sin separador espera a la próxima lectura. Devuelve los comandos.
+int command_consume(CommandLineBuffer* line, const char* input, size_t length, uint64_t received_ns) {
+    int count = 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = input[i];
+        if (c != '\n' && c != ';') {
+            if (line->used + 1 < sizeof(line->data)) {
+                line->data[line->used++] = c;
+            } else {
+                line->overflowed = 1;
+            }
+            continue;
+        }
+        
+        if (line->overflowed) {
+            interpreter.received++;
+            interpreter.rejected++;
+            log_warn("Aviso: comando de más de %d bytes descartado", COMMAND_LINE_MAX);
+            count++;
+        } else {
+            line->data[line->used] = '\0';
+            count += command_execute_text(line->data, received_ns);
+        }
+        line->used = 0;
+        line->overflowed = 0;
+    }
+    return count;
+}
+
+// Función para leer una fuente de texto: todo lo disponible si es no bloqueante (la FIFO)
+// o una lectura si no (la entrada estándar). Devuelve los comandos, o -1 si se cerró.
+int command_read_source(int fd, CommandLineBuffer* line, int drain, uint64_t received_ns) {
+    static char buffer[COMMAND_READ_CHUNK]; // Solo lo usa el hilo del intérprete
+    int count = 0;
+    while (1) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length > 0) {
+            count += command_consume(line, buffer, (size_t)length, received_ns);
+            if (drain) continue;
+        } else if (length == 0) {
+            return -1;
+        } else if (errno == EINTR) {
+            continue;
+        }
+        return count;
+    }
+}
+
+// Función para consumir la cola de comandos de la región compartida (un solo consumidor)
+int command_drain_queue(uint64_t received_ns) {
+    ShmCommandQueue* queue = channel.queue;
+    if (!queue) {
+        return 0;
+    }
+    
+    uint64_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    int count = 0;
+    while (1) {
+        ShmCommandCell* cell = &queue->cells[position & (SHM_QUEUE_CAPACITY - 1)];
+        if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != position + 1) {
+            break;
+        }
+        uint32_t type = cell->type;
+        int target_id = cell->target_id;
+        int arg = cell->arg;
+        uint64_t sent_ns = cell->sent_ns;
+        atomic_store_explicit(&cell->sequence, position + SHM_QUEUE_CAPACITY, memory_order_release);
+        position++;
+        
+        interpreter.received++;
+        int known = type <= CMD_SET_DEFENSE;
+        command_finish(known ? command_submit((CommandType)type, target_id, arg) : -1,
+                       sent_ns ? sent_ns : received_ns, known ? shm_command_names[type] : "desconocido");
+        count++;
+    }
+    atomic_store_explicit(&queue->tail, position, memory_order_release);
+    return count;
+}
+
+// Hilo del intérprete de comandos: cada despertar lee las fuentes listas, vacía la cola
+// compartida y reintenta los retask pendientes
+void* command_interpreter_thread(void* arg) {
+    (void)arg;
+    struct epoll_event events[4];
+    int stop = 0;
+    
+    while (!stop) {
+        // Con retask pendientes se reintenta cada milisegundo: los drones aplican en su tick
+        int timeout = interpreter.pending_count > 0 ? 1 : COMMAND_POLL_MS;
+        int ready = epoll_wait(interpreter.epoll_fd, events, 4, timeout);
+        if (ready == -1 && errno != EINTR) {
+            log_error("Error esperando comandos: %s", strerror(errno));
+            break;
+        }
+        
+        uint64_t now = monotonic_ns();
+        int burst = 0;
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == interpreter.stop_fd) {
+                stop = 1;
+            } else if (fd == STDIN_FILENO) {
+                int count = command_read_source(fd, &interpreter.stdin_line, 0, now);
+                if (count < 0) {
+                    epoll_ctl(interpreter.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+                    log_debug(LOG_CAT_COMM, "Entrada del operador cerrada");
+                } else {
+                    burst += count;
+                }
+            } else {
+                int count = command_read_source(fd, &interpreter.fifo_line, 1, now);
+                burst += count > 0 ? count : 0;
+            }
+        }
+        burst += command_drain_queue(now);
+        if (interpreter.pending_count > 0) {
+            command_retry_pending();
+        }
+        if (burst > interpreter.burst_max) {
+            interpreter.burst_max = burst;
+        }
+    }
+    return NULL;
+}
+
+// Función para arrancar el intérprete de comandos (solo con canal: el modo lote y el
+// barrido no lo usan)
+void start_command_interpreter() {
+    if (channel.mode == CHANNEL_NONE) {
+        return;
+    }
+    
+    interpreter.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    interpreter.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    interpreter.pending_target = malloc(sizeof(int32_t) * system_state.drone_capacity);
+    interpreter.pending = malloc(sizeof(int) * system_state.drone_capacity);
+    if (interpreter.epoll_fd == -1 || interpreter.stop_fd == -1 ||
+        !interpreter.pending_target || !interpreter.pending) {
+        log_error("Error iniciando el intérprete de comandos: %s", strerror(errno));
+        if (interpreter.epoll_fd != -1) close(interpreter.epoll_fd);
+        if (interpreter.stop_fd != -1) close(interpreter.stop_fd);
+        free(interpreter.pending_target);
+        free(interpreter.pending);
+        interpreter.pending_target = NULL;
+        interpreter.pending = NULL;
+        return;
+    }
+    for (int i = 0; i < system_state.drone_capacity; i++) {
+        interpreter.pending_target[i] = -1;
+    }
+    interpreter.pending_count = 0;
+    interpreter.fifo_line.used = 0;
+    interpreter.fifo_line.overflowed = 0;
+    interpreter.stdin_line.used = 0;
+    interpreter.stdin_line.overflowed = 0;
+    interpreter.received = 0;
+    interpreter.applied = 0;
+    interpreter.rejected = 0;
+    interpreter.burst_max = 0;
+    interpreter.latency_max_ns = 0;
+    memset(interpreter.latency, 0, sizeof(interpreter.latency));
+    
+    struct epoll_event event = {.events = EPOLLIN};
+    event.data.fd = interpreter.stop_fd;
+    epoll_ctl(interpreter.epoll_fd, EPOLL_CTL_ADD, interpreter.stop_fd, &event);
+    if (system_state.center_fifo_fd != -1) {
+        event.data.fd = system_state.center_fifo_fd;
+        epoll_ctl(interpreter.epoll_fd, EPOLL_CTL_ADD, system_state.center_fifo_fd, &event);
+    }
+    // Un archivo regular (o /dev/null) no se puede esperar con epoll: se ignora
+    int read_stdin = interpreter.read_stdin;
+    if (read_stdin) {
+        event.data.fd = STDIN_FILENO;
+        read_stdin = epoll_ctl(interpreter.epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0;
+    }
+    
+    pthread_create(&interpreter.thread, NULL, command_interpreter_thread, NULL);
+    interpreter.started = 1;
+    log_message("Intérprete de comandos escuchando en %s%s%s", system_state.center_fifo_name,
+                channel.queue ? ", la cola compartida" : "", read_stdin ? " y la entrada estándar" : "");
+}
+
+// Función para obtener el percentil p (0..1) del histograma de latencia, en µs
+unsigned long command_latency_percentile(double p) {
+    unsigned long rank = (unsigned long)ceil(p * interpreter.applied);
+    unsigned long seen = 0;
+    for (int b = 0; b < COMMAND_LATENCY_BUCKETS; b++) {
+        seen += interpreter.latency[b];
+        if (seen >= rank && seen > 0) {
+            return (unsigned long)b + 1;
+        }
+    }
+    return COMMAND_LATENCY_BUCKETS;
+}
+
+// Función para detener el intérprete e informar sus cuentas
+void stop_command_interpreter() {
+    if (!interpreter.started) return;
+    
+    uint64_t one = 1;
+    if (write(interpreter.stop_fd, &one, sizeof(one)) != sizeof(one)) {
+        log_error("Error deteniendo el intérprete de comandos: %s", strerror(errno));
+    }
+    pthread_join(interpreter.thread, NULL);
+    close(interpreter.epoll_fd);
+    close(interpreter.stop_fd);
+    free(interpreter.pending_target);
+    free(interpreter.pending);
+    interpreter.pending_target = NULL;
+    interpreter.pending = NULL;
+    interpreter.started = 0;
+    
+    if (interpreter.received == 0) {
+        return;
+    }
+    log_message("Intérprete de comandos: %lu recibidos, %lu aplicados, %lu rechazados, ráfaga máxima %d",
+                interpreter.received, interpreter.applied, interpreter.rejected, interpreter.burst_max);
+    if (interpreter.applied > 0) {
+        log_message("Latencia de despacho: p50 <= %lu µs, p99 <= %lu µs, máxima %.1f µs",
+                    command_latency_percentile(0.5), command_latency_percentile(0.99),
+                    interpreter.latency_max_ns / 1000.0);
+    }
+}
+
+// Función para volar en círculos alrededor del punto de ensamble
+void fly_in_circles(Drone* drone) {
+    // Radio del círculo de patrulla
+    const int patrol_radius = 3;
+    
+    // Calcular el centro del círculo (punto de ensamble)
+    Position center = drone_target(drone);
+    
+    // Avanzar el ángulo de patrulla de este drone
+    drone->patrol_angle = (drone->patrol_angle + 1) % 360;
+    
+    // Convertir ángulo a radianes
+    double angle_rad = (drone->patrol_angle * 3.14159) / 180.0;
+    
+    // Calcular nueva posición en el círculo
+    int new_x = center.x + (int)(patrol_radius * cos(angle_rad));
+    int new_y = center.y + (int)(patrol_radius * sin(angle_rad));
+    
+    // Mover drone a la nueva posición
+    drone_set_position(drone, (Position){new_x, new_y});
+    
+    // Incrementar distancia recorrida
+    system_state.store.distance_traveled[drone->id] += system_state.speed;
+    
+    // Verificar si el enjambre está listo para avanzar
+    // (esto se maneja en el centro de comando)
+}
+
+// Función para crear un drone en su posición de la arena
+Drone* create_drone(int id, int truck_id, int swarm_id, DroneType type, Position start_pos, Position target_pos) {
+    if (id >= system_state.drone_capacity) {
+        log_error("Error: No hay espacio en la arena para drone %d", id);
+        return NULL;
+    }
+    Drone* drone = &system_state.drones[id];
+    
+    drone->id = id;
+    drone->truck_id = truck_id;
+    drone->swarm_id = swarm_id;
+    drone->type = type;
+    drone->max_fuel = system_state.initial_fuel;
+    
+    // Campos calientes en el almacén estructura-de-arreglos
+    trace_emit(TRACE_SPAWN, id, swarm_id, type, truck_id);
+    drone_set_state(drone, DRONE_STATE_FLYING_TO_ASSEMBLY);
+    drone_set_position(drone, start_pos);
+    drone_set_target(drone, target_pos);
+    system_state.store.fuel[id] = system_state.initial_fuel;
+    system_state.store.distance_traveled[id] = 0;
+    system_state.store.arrived[id] = 0;
+    system_state.store.route[id] = -1;
+    
+    // Asignar probabilidad individual de derribo (0% a 5%): bajo una defensa con W=100%
+    // el drone caería con esa probabilidad; en general sufre shoot_down_probability/5
+    // del riesgo del campo de amenaza
+    drone->shoot_down_probability = rng_uniform(RNG_STREAM_DRONE_PROFILE, id, 6); // 0 a 5
+    system_state.store.vulnerability[id] = rng_threshold(drone->shoot_down_probability * 20);
+    
+    drone->active = 1;
+    
+    // Inicializar control de comunicación
+    drone->communication_active = 1; // Inicia con comunicación activa
+    drone->communication_timeout = 0;
+    drone->reestablish_attempts = 0;
+    drone->last_communication_loss = 0;
+    drone->comm_check_ticks = 0;
+    drone->patrol_angle = 0;
+    drone->payload_logged = 0;
+    
+    // Crear FIFO para comunicación (solo en modo de compatibilidad; si no, el drone
+    // recibe comandos por su slot de la región compartida)
+    drone->fifo_fd = -1;
+    drone->fifo_name[0] = '\0';
+    if (channel.mode == CHANNEL_FIFO) {
+        create_fifo_name(drone->fifo_name, id);
+        drone->fifo_fd = create_drone_fifo(id);
+    }
+    
+    // El drone no tiene hilos propios: el planificador de ticks lo avanza
+    
+    log_debug(LOG_CAT_FLEET, "Drone %d creado (Tipo: %s, Truck: %d, Swarm: %d)", 
+               id, type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA", truck_id, swarm_id);
+    
+    return drone;
+}
+
+// Función para crear un enjambre en su posición de la arena
+Swarm* create_swarm(int id, int truck_id, int attack, int camera, Position assembly_point, Position reassembly_point) {
+    Swarm* swarm = &system_state.swarms[id];
+    int swarm_size = attack + camera;
+    
+    swarm->id = id;
+    swarm->truck_id = truck_id;
+    swarm->size = 0;
+    swarm->capacity = swarm_size;
+    swarm->members = arena_alloc(&system_state.arena, swarm_size * sizeof(int));
+    swarm->attack_quota = attack;
+    swarm->camera_quota = camera;
+    swarm->ready_count = 0;
+    swarm->active_count = 0;
+    swarm->assembly_point = assembly_point;
+    swarm->reassembly_point = reassembly_point;
+    
+    if (!swarm->members) {
+        log_error("Error: No hay espacio en la arena para enjambre %d", id);
+        return NULL;
+    }
+    
+    pthread_mutex_init(&swarm->mutex, NULL);
+    
+    // Crear drones del enjambre con distribución mixta de camiones
+    // pero manteniendo la proporción nominal (ataque:cámara)
+    for (int i = 0; i < swarm_size; i++) {
+        DroneType type = (i < swarm->attack_quota) ? DRONE_TYPE_ATTACK : DRONE_TYPE_CAMERA;
+        int drone_id = system_state.drone_count;
+        
+        // Distribuir drones aleatoriamente de diferentes camiones
+        // pero manteniendo la proporción nominal (ataque:cámara)
+        int source_truck;
+        if (type == DRONE_TYPE_CAMERA) {
+            // Los drones cámara siempre del camión principal para consistencia
+            source_truck = truck_id;
+        } else {
+            // Los drones de ataque se distribuyen aleatoriamente entre los camiones
+            source_truck = rng_uniform(RNG_STREAM_DRONE_TRUCK, drone_id, system_state.truck_count);
+        }
+        
+        Position start_pos = system_state.trucks[source_truck].pos;
+        
+        Drone* drone = create_drone(drone_id, source_truck, id, type, start_pos, assembly_point);
+        if (drone) {
+            system_state.drone_count++;
+            swarm_add_drone(swarm, drone);
+            swarm->active_count++;
+        }
+    }
+    
+    log_at(LOG_INFO, LOG_CAT_FLEET, "Enjambre %d creado con %d drones", id, swarm->active_count);
+    return swarm;
+}
+
+// Función para calcular el tamaño de arena que necesita la flota configurada
+size_t fleet_arena_size() {
+    size_t swarms = system_state.swarm_capacity;
+    size_t drones = system_state.drone_capacity;
+    size_t slack = 16 * ARENA_ALIGNMENT; // Relleno de alineación entre bloques
+    
+    return sizeof(Truck) * system_state.truck_count + slack +
+           sizeof(Target) * system_state.target_count + slack +
+           sizeof(EnemyDefense) * system_state.defense_count + slack +
+           2 * sizeof(uint32_t) * (system_state.map_width + 1) * (system_state.map_height + 1) + 2 * slack +
+           2 * sizeof(Position) * system_state.truck_count + 2 * slack +
+           sizeof(int) * swarms + slack +
+           (sizeof(int) + sizeof(uint8_t)) * system_state.target_count + 2 * slack +
+           (sizeof(FlowField) + sizeof(int)) * system_state.target_count + 2 * slack +
+           sizeof(Swarm) * swarms + slack +
+           sizeof(Drone) * drones + slack +
+           drone_store_size(drones) +
+           DRONE_STATE_COUNT * ((drones + 63) / 64) * sizeof(uint64_t) + slack +
+           // Motor de re-asignación en vuelo (desde el ataque global)
+           4 * sizeof(int) * swarms + sizeof(RetaskCandidate) * swarms + 5 * slack +
+           (4 * sizeof(int) + 2) * system_state.target_count + 6 * slack +
+           (sizeof(int) + 1) * drones + 2 * slack +
+           // Bloques de miembros: el inicial más el crecimiento por duplicación
+           // durante el re-ensamblaje (acotado por 4 veces la flota)
+           drones * sizeof(int) + swarms * ARENA_ALIGNMENT +
+           4 * drones * sizeof(int) + swarms * 2 * ARENA_ALIGNMENT;
+}
+
+// Función para reservar todos los componentes de la flota en la arena
+int allocate_fleet() {
+    int swarm_size = system_state.attack_per_swarm + system_state.camera_per_swarm;
+    
+    system_state.swarm_capacity = system_state.swarms_requested > 0 ? 
+                                  system_state.swarms_requested : system_state.truck_count;
+    system_state.drone_capacity = system_state.swarm_capacity * swarm_size;
+    if (scenario.header.swarm_count > 0) {
+        // Composición por enjambre del escenario
+        system_state.drone_capacity = 0;
+        for (int i = 0; i < system_state.swarm_capacity; i++) {
+            system_state.drone_capacity += scenario.swarms[i].attack + scenario.swarms[i].camera;
+        }
+    }
+    
+    // En un barrido la arena de la misión anterior se reutiliza si alcanza
+    size_t size = fleet_arena_size();
+    if (system_state.arena.base && system_state.arena.size >= size) {
+        arena_reset(&system_state.arena);
+    } else {
+        arena_release(&system_state.arena);
+        if (arena_init(&system_state.arena, size) != 0) {
+            log_error("Error: No se pudo reservar la arena de la flota: %s", strerror(errno));
+            return -1;
+        }
+    }
+    
+    Arena* arena = &system_state.arena;
+    system_state.trucks = arena_alloc(arena, sizeof(Truck) * system_state.truck_count);
+    system_state.targets = arena_alloc(arena, sizeof(Target) * system_state.target_count);
+    system_state.defenses = arena_alloc(arena, sizeof(EnemyDefense) * system_state.defense_count);
+    system_state.threat.width = system_state.map_width + 1;
+    system_state.threat.height = system_state.map_height + 1;
+    system_state.threat.version = 0;
+    system_state.threat.hazard = arena_alloc(arena, sizeof(uint32_t) * system_state.threat.width * system_state.threat.height);
+    system_state.threat.threshold = arena_alloc(arena, sizeof(uint32_t) * system_state.threat.width * system_state.threat.height);
+    system_state.assembly_points = arena_alloc(arena, sizeof(Position) * system_state.truck_count);
+    system_state.reassembly_points = arena_alloc(arena, sizeof(Position) * system_state.truck_count);
+    system_state.target_assignments = arena_alloc(arena, sizeof(int) * system_state.swarm_capacity);
+    system_state.target_outcome = arena_alloc(arena, sizeof(int) * system_state.target_count);
+    system_state.target_confirmed = arena_alloc(arena, sizeof(uint8_t) * system_state.target_count);
+    flow.fields = arena_alloc(arena, sizeof(FlowField) * system_state.target_count);
+    flow.pending = arena_alloc(arena, sizeof(int) * system_state.target_count);
+    system_state.swarms = arena_alloc(arena, sizeof(Swarm) * system_state.swarm_capacity);
+    system_state.drones = arena_alloc(arena, sizeof(Drone) * system_state.drone_capacity);
+    system_state.state_words = (system_state.drone_capacity + 63) / 64;
+    system_state.state_bits = arena_alloc(arena, DRONE_STATE_COUNT * system_state.state_words * sizeof(uint64_t));
+    
+    if (drone_store_init(&system_state.store, arena, system_state.drone_capacity) != 0) {
+        log_error("Error: arena de la flota demasiado pequeña para el almacén de drones");
+        return -1;
+    }
+    
+    if (!system_state.trucks || !system_state.targets || !system_state.defenses ||
+        !system_state.threat.hazard || !system_state.threat.threshold ||
+        !system_state.assembly_points || !system_state.reassembly_points ||
+        !system_state.target_assignments || !system_state.target_outcome || !system_state.target_confirmed ||
+        !flow.fields || !flow.pending ||
+        !system_state.swarms || !system_state.drones || !system_state.state_bits) {
+        log_error("Error: arena de la flota demasiado pequeña");
+        return -1;
+    }
+    flow_planner_init();
+    
+    log_message("Arena de la flota: %.1f KB para %d enjambres y %d drones", 
+               arena->size / 1024.0, system_state.swarm_capacity, system_state.drone_capacity);
+    return 0;
+}
+
+// Camión de origen de un enjambre (el del escenario, o en ronda por los camiones)
+int swarm_truck_for(int swarm_id) {
+    return scenario.header.swarm_count > 0 ? scenario.swarms[swarm_id].truck : swarm_id % system_state.truck_count;
+}
+
+// Drones de ataque de un enjambre según su composición
+int swarm_attack_for(int swarm_id) {
+    return scenario.header.swarm_count > 0 ? scenario.swarms[swarm_id].attack : system_state.attack_per_swarm;
+}
+
+// Cobertura que aporta un enjambre al asignarlo: sus drones de ataque, o uno si es solo de
+// cámaras (así los enjambres sin ataque también se reparten entre los objetivos)
+int swarm_coverage(int swarm_id) {
+    int attack = swarm_attack_for(swarm_id);
+    return attack > 0 ? attack : 1;
+}
+
+// Ataques que cubre un objetivo por ronda de asignación (al menos uno, para que toda ronda avance)
+int target_demand(int target_id) {
+    int required = system_state.targets[target_id].required_attacks;
+    return required > 0 ? required : 1;
+}
+
+// Función para mezclar un arreglo con Fisher-Yates usando los índices first.. del flujo de permutaciones
+void shuffle_indices(int* items, int count, uint32_t first) {
+    for (int i = count - 1; i > 0; i--) {
+        int k = rng_uniform(RNG_STREAM_TARGET_ORDER, first + i, i + 1);
+        int tmp = items[i];
+        items[i] = items[k];
+        items[k] = tmp;
+    }
+}
+
+// Asignación aleatoria (para despistar al enemigo), O(enjambres + objetivos): los enjambres
+// en orden barajado cubren los objetivos, también barajados, hasta sus required_attacks;
+// si sobran enjambres se repite por rondas con un nuevo orden de objetivos
+void assign_targets_random(int* covered) {
+    int swarms = system_state.swarm_capacity;
+    int targets = system_state.target_count;
+    int* swarm_order = malloc(sizeof(int) * swarms);
+    int* target_order = malloc(sizeof(int) * targets);
+    
+    for (int i = 0; i < swarms; i++) swarm_order[i] = i;
+    shuffle_indices(swarm_order, swarms, 0);
+    
+    int next = 0;
+    for (int round = 1; next < swarms; round++) {
+        for (int k = 0; k < targets; k++) target_order[k] = k;
+        shuffle_indices(target_order, targets, (uint32_t)swarms + (uint32_t)round * targets);
+        
+        for (int k = 0; k < targets && next < swarms; k++) {
+            int t = target_order[k];
+            while (next < swarms && covered[t] < round * target_demand(t)) {
+                int s = swarm_order[next++];
+                system_state.target_assignments[s] = t;
+                covered[t] += swarm_coverage(s);
+            }
+        }
+    }
+    
+    free(swarm_order);
+    free(target_order);
+}
+
+// Función para obtener el rectángulo del mapa con amenaza (el alcance de las defensas
+// activas); vacío (low > high) si no hay ninguna
+void threat_bounds(Position* low, Position* high) {
+    *low = (Position){system_state.threat.width, system_state.threat.height};
+    *high = (Position){-1, -1};
+    for (int d = 0; d < system_state.defense_count; d++) {
+        const EnemyDefense* defense = &system_state.defenses[d];
+        if (!defense->active || defense->range <= 0) continue;
+        if (defense->pos.x - defense->range < low->x) low->x = defense->pos.x - defense->range;
+        if (defense->pos.y - defense->range < low->y) low->y = defense->pos.y - defense->range;
+        if (defense->pos.x + defense->range > high->x) high->x = defense->pos.x + defense->range;
+        if (defense->pos.y + defense->range > high->y) high->y = defense->pos.y + defense->range;
+    }
+    if (low->x < 0) low->x = 0;
+    if (low->y < 0) low->y = 0;
+    if (high->x >= system_state.threat.width) high->x = system_state.threat.width - 1;
+    if (high->y >= system_state.threat.height) high->y = system_state.threat.height - 1;
+}
+
+// Exposición a las defensas en línea recta de from a to: riesgo acumulado del campo de
+// amenaza en cada verificación de defensa del trayecto (una cada DEFENSE_CHECK_TICKS
+// ticks). Los trayectos largos se muestrean en a lo sumo ASSIGN_PATH_SAMPLES puntos y
+// los que no tocan el rectángulo [low, high] con amenaza no se recorren.
+double path_threat_exposure(Position from, Position to, Position low, Position high) {
+    if ((from.x < low.x && to.x < low.x) || (from.x > high.x && to.x > high.x) ||
+        (from.y < low.y && to.y < low.y) || (from.y > high.y && to.y > high.y)) {
+        return 0.0;
+    }
+    
+    const ThreatField* field = &system_state.threat;
+    double length = calculate_distance(from, to);
+    double step = (double)system_state.speed * DEFENSE_CHECK_TICKS;
+    if (step <= 0 || length < step) return 0.0;
+    double stride = length / ASSIGN_PATH_SAMPLES > step ? length / ASSIGN_PATH_SAMPLES : step;
+    double exposure = 0.0;
+    
+    for (double along = stride; along <= length; along += stride) {
+        double f = along / length;
+        int x = (int)(from.x + (to.x - from.x) * f + 0.5); // Coordenadas no negativas: redondeo simple
+        int y = (int)(from.y + (to.y - from.y) * f + 0.5);
+        if (x >= low.x && x <= high.x && y >= low.y && y <= high.y) {
+            exposure += field->hazard[y * field->width + x] / THREAT_HAZARD_ONE;
+        }
+    }
+    return exposure * (stride / step);
+}
+
+// Par (camión de origen, objetivo) de la asignación optimizada con su costo
+typedef struct {
+    double cost;
+    int truck;
+    int target;
+} AssignmentPair;
+
+// Función para ordenar pares por costo (desempate por índices, para que sea determinista)
+int compare_assignment_pairs(const void* a, const void* b) {
+    const AssignmentPair* pa = a;
+    const AssignmentPair* pb = b;
+    if (pa->cost != pb->cost) return pa->cost < pb->cost ? -1 : 1;
+    if (pa->truck != pb->truck) return pa->truck - pb->truck;
+    return pa->target - pb->target;
+}
+
+// Asignación exacta para flotas chicas: cada objetivo ofrece por ronda los huecos que
+// cubren sus required_attacks (más caros en cada ronda siguiente, así primero se cubren
+// todos) y el método húngaro reparte los enjambres en los huecos. Devuelve -1 si el
+// problema es demasiado grande y hay que usar la voraz.
+int assign_targets_exact(const double* truck_cost, int* covered) {
+    int swarms = system_state.swarm_capacity;
+    int targets = system_state.target_count;
+    if (swarms > ASSIGN_EXACT_MAX) return -1;
+    
+    // Huecos por ronda de cada objetivo, con el tamaño medio de ataque de los enjambres
+    int attack = 0;
+    for (int s = 0; s < swarms; s++) attack += swarm_attack_for(s);
+    int mean_attack = attack > 0 ? (attack + swarms - 1) / swarms : 1;
+    long per_round = 0;
+    for (int t = 0; t < targets; t++) per_round += (target_demand(t) + mean_attack - 1) / mean_attack;
+    long rounds = (swarms + per_round - 1) / per_round;
+    long slots = rounds * per_round;
+    if (slots * swarms > ASSIGN_EXACT_CELLS) return -1;
+    
+    int* slot_target = malloc(sizeof(int) * slots);
+    double* cost = malloc(sizeof(double) * slots * swarms);
+    int* swarm_slot = malloc(sizeof(int) * swarms);
+    long k = 0;
+    for (long r = 0; r < rounds; r++) {
+        for (int t = 0; t < targets; t++) {
+            for (int n = (target_demand(t) + mean_attack - 1) / mean_attack; n > 0; n--) {
+                slot_target[k] = t;
+                for (int s = 0; s < swarms; s++) {
+                    cost[(long)s * slots + k] = truck_cost[swarm_truck_for(s) * targets + t] + r * ASSIGN_ROUND_PENALTY;
+                }
+                k++;
+            }
+        }
+    }
+    
+    hungarian_assign(cost, swarms, (int)slots, swarm_slot);
+    for (int s = 0; s < swarms; s++) {
+        int t = slot_target[swarm_slot[s]];
+        system_state.target_assignments[s] = t;
+        covered[t] += swarm_attack_for(s);
+    }
+    
+    free(slot_target);
+    free(cost);
+    free(swarm_slot);
+    return 0;
+}
+
+// Asignación optimizada: el costo de mandar un enjambre a un objetivo es la exposición a
+// las defensas en el trayecto desde su punto de ensamble, más la distancia y una
+// penalización si el combustible no alcanza. Los enjambres de un mismo camión salen del
+// mismo punto, así que los costos son camiones x objetivos. Con flotas grandes los pares
+// se recorren de más barato a más caro cubriendo los objetivos por rondas.
+void assign_targets_optimized(int* covered) {
+    int swarms = system_state.swarm_capacity;
+    int targets = system_state.target_count;
+    int trucks = system_state.truck_count;
+    size_t pair_count = (size_t)trucks * targets;
+    double* truck_cost = malloc(sizeof(double) * pair_count);
+    double seconds_per_unit = 1.0 / ((system_state.speed > 0 ? system_state.speed : 1) * TICKS_PER_SECOND);
+    Position low, high;
+    threat_bounds(&low, &high);
+    
+    for (int o = 0; o < trucks; o++) {
+        Position start = system_state.trucks[o].pos;
+        Position assembly = system_state.assembly_points[o];
+        for (int t = 0; t < targets; t++) {
+            Position target = system_state.targets[t].pos;
+            double distance = calculate_distance(assembly, target);
+            double flight = (calculate_distance(start, assembly) + distance) * seconds_per_unit;
+            double fuel_short = flight - system_state.initial_fuel * ASSIGN_FUEL_RESERVE;
+            truck_cost[(size_t)o * targets + t] = distance + THREAT_COST_WEIGHT * path_threat_exposure(assembly, target, low, high) +
+                                                  (fuel_short > 0 ? ASSIGN_FUEL_PENALTY * fuel_short : 0.0);
+        }
+    }
+    if (assign_targets_exact(truck_cost, covered) == 0) {
+        free(truck_cost);
+        return;
+    }
+    
+    AssignmentPair* pairs = malloc(sizeof(AssignmentPair) * pair_count);
+    for (size_t p = 0; p < pair_count; p++) {
+        pairs[p] = (AssignmentPair){truck_cost[p], (int)(p / targets), (int)(p % targets)};
+    }
+    qsort(pairs, pair_count, sizeof(AssignmentPair), compare_assignment_pairs);
+    
+    // Enjambres de cada camión en orden de id (conteo por camión y desplazamientos)
+    int* truck_start = calloc(trucks + 1, sizeof(int));
+    int* truck_next = malloc(sizeof(int) * trucks);
+    int* by_truck = malloc(sizeof(int) * swarms);
+    for (int s = 0; s < swarms; s++) truck_start[swarm_truck_for(s) + 1]++;
+    for (int o = 0; o < trucks; o++) truck_start[o + 1] += truck_start[o];
+    for (int o = 0; o < trucks; o++) truck_next[o] = truck_start[o];
+    for (int s = 0; s < swarms; s++) by_truck[truck_next[swarm_truck_for(s)]++] = s;
+    for (int o = 0; o < trucks; o++) truck_next[o] = truck_start[o];
+    
+    int assigned = 0;
+    for (int round = 1; assigned < swarms; round++) {
+        for (size_t p = 0; p < pair_count && assigned < swarms; p++) {
+            int o = pairs[p].truck, t = pairs[p].target;
+            while (truck_next[o] < truck_start[o + 1] && covered[t] < round * target_demand(t)) {
+                int s = by_truck[truck_next[o]++];
+                system_state.target_assignments[s] = t;
+                covered[t] += swarm_coverage(s);
+                assigned++;
+            }
+        }
+    }
+    
+    free(truck_cost);
+    free(pairs);
+    free(truck_start);
+    free(truck_next);
+    free(by_truck);
+}
+
+// Función para asignar un objetivo a cada enjambre según assignment= (aleatoria u optimizada)
+void assign_targets() {
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    int* covered = calloc(system_state.target_count, sizeof(int)); // Ataques asignados por objetivo
+    
+    if (system_state.assignment_mode == ASSIGNMENT_OPTIMIZED) {
+        assign_targets_optimized(covered);
+    } else {
+        assign_targets_random(covered);
+    }
+    
+    // Objetivos sin cubrir según los drones de ataque reales (covered cuenta uno por
+    // enjambre solo de cámaras)
+    memset(covered, 0, sizeof(int) * system_state.target_count);
+    for (int s = 0; s < system_state.swarm_capacity; s++) {
+        covered[system_state.target_assignments[s]] += swarm_attack_for(s);
+    }
+    int uncovered = 0;
+    for (int t = 0; t < system_state.target_count; t++) {
+        if (covered[t] < system_state.targets[t].required_attacks) uncovered++;
+    }
+    free(covered);
+    
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+    double elapsed_ms = (finished_at.tv_sec - started_at.tv_sec) * 1e3 + (finished_at.tv_nsec - started_at.tv_nsec) / 1e6;
+    log_message("Asignación %s: %d enjambres a %d objetivos en %.2f ms (%d objetivos sin cubrir)",
+               system_state.assignment_mode == ASSIGNMENT_OPTIMIZED ? "optimizada" : "aleatoria",
+               system_state.swarm_capacity, system_state.target_count, elapsed_ms, uncovered);
+}
+
+// Función para comparar candidatos por costo (desempata el id, así el orden no depende de qsort)
+int retask_candidate_compare(const void* a, const void* b) {
+    const RetaskCandidate* left = a;
+    const RetaskCandidate* right = b;
+    if (left->cost != right->cost) {
+        return left->cost < right->cost ? -1 : 1;
+    }
+    return left->swarm - right->swarm;
+}
+
+// Función para ordenar ids de drone de menor a mayor
+int retask_id_compare(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Función para sacar un enjambre de la lista de su objetivo y ponerlo en la de otro (con
+// el mutex del motor tomado)
+void retask_move(int swarm_id, int target_id) {
+    int from = retask.swarm_target[swarm_id];
+    if (from == target_id) return;
+    
+    int next = retask.swarm_next[swarm_id], prev = retask.swarm_prev[swarm_id];
+    if (prev >= 0) retask.swarm_next[prev] = next; else retask.target_head[from] = next;
+    if (next >= 0) retask.swarm_prev[next] = prev;
+    retask.target_attack[from] -= retask.swarm_attack[swarm_id];
+    
+    retask.swarm_prev[swarm_id] = -1;
+    retask.swarm_next[swarm_id] = retask.target_head[target_id];
+    if (retask.target_head[target_id] >= 0) retask.swarm_prev[retask.target_head[target_id]] = swarm_id;
+    retask.target_head[target_id] = swarm_id;
+    retask.target_attack[target_id] += retask.swarm_attack[swarm_id];
+    retask.swarm_target[swarm_id] = target_id;
+    system_state.target_assignments[swarm_id] = target_id;
+    
+    if (retask.target_attack[target_id] >= system_state.targets[target_id].required_attacks) {
+        retask.target_lost[target_id] = 0;
+    }
+}
+
+// Función para mandar CMD_RETASK a los drones vivos de un enjambre. Corre en el hilo de
+// ticks entre dos ticks (los trabajadores esperan), así que se aplica en el lugar y cada
+// drone sale hacia el objetivo nuevo en el tick siguiente.
+void retask_issue(int swarm_id, int target_id) {
+    Swarm* swarm = &system_state.swarms[swarm_id];
+    pthread_mutex_lock(&swarm->mutex);
+    for (int j = 0; j < swarm->size; j++) {
+        Drone* drone = swarm_drone(swarm, j);
+        if (!fleet_drone_lost(drone->id)) {
+            drone_apply_command(drone, CMD_RETASK, target_id);
+        }
+    }
+    pthread_mutex_unlock(&swarm->mutex);
+}
+
+// Función para cubrir un objetivo que quedó por debajo de sus required_attacks con
+// enjambres que sobran en otros objetivos (o que atacan objetivos ya abandonados). Solo
+// se consideran los que llegan con el combustible que les queda; entre ellos gana el de
+// menor distancia más riesgo en el trayecto. Si no alcanzan, el objetivo se abandona y
+// sus enjambres quedan libres para cubrir otros.
+void retask_cover(int target_id, Position low, Position high) {
+    Target* target = &system_state.targets[target_id];
+    int need = target->required_attacks - retask.target_attack[target_id];
+    if (need <= 0 || retask.target_lost[target_id]) return;
+    retask.shortfalls++;
+    
+    double seconds_per_unit = 1.0 / ((system_state.speed > 0 ? system_state.speed : 1) * TICKS_PER_SECOND);
+    int count = 0;
+    for (int s = 0; s < system_state.swarm_count; s++) {
+        int from = retask.swarm_target[s];
+        if (from == target_id || retask.swarm_attack[s] <= 0) continue;
+        int spare = retask.target_lost[from] ? retask.target_attack[from] :
+                    retask.target_attack[from] - system_state.targets[from].required_attacks;
+        if (retask.swarm_attack[s] > spare) continue;
+        
+        // El primer drone de ataque vivo del enjambre decide si llega
+        Swarm* swarm = &system_state.swarms[s];
+        for (int j = 0; j < swarm->size; j++) {
+            int id = swarm->members[j];
+            if (!retask.counted[id]) continue;
+            Position pos = (Position){system_state.store.pos_x[id], system_state.store.pos_y[id]};
+            double distance = calculate_distance(pos, target->pos);
+            if (distance * seconds_per_unit <= system_state.store.fuel[id] * ASSIGN_FUEL_RESERVE) {
+                retask.candidates[count++] = (RetaskCandidate){
+                    distance + THREAT_COST_WEIGHT * path_threat_exposure(pos, target->pos, low, high), s};
+            }
+            break;
+        }
+    }
+    qsort(retask.candidates, count, sizeof(RetaskCandidate), retask_candidate_compare);
+    
+    // Más baratos primero, sin dejar corto al objetivo de donde sale cada uno
+    int chosen = 0, covered = 0;
+    for (int i = 0; i < count && covered < need; i++) {
+        int s = retask.candidates[i].swarm;
+        int from = retask.swarm_target[s];
+        int spare = retask.target_lost[from] ? retask.target_attack[from] :
+                    retask.target_attack[from] - system_state.targets[from].required_attacks;
+        if (retask.target_taken[from] + retask.swarm_attack[s] > spare) continue;
+        retask.target_taken[from] += retask.swarm_attack[s];
+        retask.candidates[chosen++] = retask.candidates[i];
+        covered += retask.swarm_attack[s];
+    }
+    for (int i = 0; i < chosen; i++) {
+        retask.target_taken[retask.swarm_target[retask.candidates[i].swarm]] = 0;
+    }
+    
+    if (covered < need) {
+        retask.target_lost[target_id] = 1;
+        retask.abandoned++;
+        log_warn("Re-asignación: objetivo %d sin cubrir (%d/%d ataques), sus enjambres quedan libres",
+                 target_id, retask.target_attack[target_id], target->required_attacks);
+        return;
+    }
+    for (int i = 0; i < chosen; i++) {
+        int s = retask.candidates[i].swarm;
+        log_message("Re-asignación: enjambre %d pasa del objetivo %d al %d (%d drones de ataque)",
+                    s, retask.swarm_target[s], target_id, retask.swarm_attack[s]);
+        retask_move(s, target_id);
+        retask_issue(s, target_id);
+        retask.moves++;
+    }
+}
+
+// Función para registrar la pérdida de un drone (desde los trabajadores, sin bloqueos).
+// Cada drone se pierde una sola vez, así que la lista nunca pasa de drone_capacity.
+void retask_note_loss(int drone_id) {
+    if (!atomic_load_explicit(&retask.active, memory_order_acquire)) return;
+    int index = atomic_fetch_add_explicit(&retask.lost_count, 1, memory_order_relaxed);
+    retask.lost[index] = drone_id;
+}
+
+// Función para anotar un retask del operador, así el motor no lo deshace
+void retask_note_move(int swarm_id, int target_id) {
+    if (!atomic_load_explicit(&retask.active, memory_order_acquire)) return;
+    pthread_mutex_lock(&retask.mutex);
+    if (atomic_load_explicit(&retask.active, memory_order_relaxed)) {
+        retask_move(swarm_id, target_id);
+    }
+    pthread_mutex_unlock(&retask.mutex);
+}
+
+// Función del hilo de ticks al final de cada tick (los trabajadores esperan): descuenta las
+// pérdidas nuevas y recalcula solo los objetivos que quedaron cortos
+void retask_end_tick() {
+    if (!atomic_load_explicit(&retask.active, memory_order_relaxed)) return;
+    int lost_count = atomic_load_explicit(&retask.lost_count, memory_order_relaxed);
+    if (lost_count == retask.lost_seen) return;
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&retask.mutex);
+    // Los trabajadores anotan en el orden en que corren: por id, la decisión no depende de él
+    qsort(retask.lost + retask.lost_seen, lost_count - retask.lost_seen, sizeof(int), retask_id_compare);
+    int short_count = 0;
+    for (; retask.lost_seen < lost_count; retask.lost_seen++) {
+        int id = retask.lost[retask.lost_seen];
+        if (!retask.counted[id]) continue;
+        retask.counted[id] = 0;
+        retask.losses++;
+        int s = system_state.drones[id].swarm_id;
+        int t = retask.swarm_target[s];
+        retask.swarm_attack[s]--;
+        retask.target_attack[t]--;
+        if (!retask.target_lost[t] && !retask.target_queued[t] &&
+            retask.target_attack[t] < system_state.targets[t].required_attacks) {
+            retask.target_queued[t] = 1;
+            retask.short_targets[short_count++] = t;
+        }
+    }
+    
+    if (short_count > 0) {
+        Position low, high;
+        threat_bounds(&low, &high);
+        for (int i = 0; i < short_count; i++) {
+            retask.target_queued[retask.short_targets[i]] = 0;
+            retask_cover(retask.short_targets[i], low, high);
+        }
+    }
+    pthread_mutex_unlock(&retask.mutex);
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    retask.busy_ms += (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// Función para arrancar el motor al dar el ataque global (con el reloj detenido): cuenta
+// los drones de ataque que salieron hacia cada objetivo
+void retask_engine_start() {
+    if (!retask.enabled || system_state.swarm_count == 0) return;
+    
+    // En la arena (reservado por fleet_arena_size), así entra en los puntos de control
+    Arena* arena = &system_state.arena;
+    int swarms = system_state.swarm_count, targets = system_state.target_count;
+    retask.swarm_attack = arena_alloc(arena, sizeof(int) * swarms);
+    retask.swarm_target = arena_alloc(arena, sizeof(int) * swarms);
+    retask.swarm_next = arena_alloc(arena, sizeof(int) * swarms);
+    retask.swarm_prev = arena_alloc(arena, sizeof(int) * swarms);
+    retask.target_attack = arena_alloc(arena, sizeof(int) * targets);
+    retask.target_head = arena_alloc(arena, sizeof(int) * targets);
+    retask.target_taken = arena_alloc(arena, sizeof(int) * targets);
+    retask.target_lost = arena_alloc(arena, targets);
+    retask.target_queued = arena_alloc(arena, targets);
+    retask.short_targets = arena_alloc(arena, sizeof(int) * targets);
+    retask.counted = arena_alloc(arena, system_state.drone_capacity);
+    retask.lost = arena_alloc(arena, sizeof(int) * system_state.drone_capacity);
+    retask.candidates = arena_alloc(arena, sizeof(RetaskCandidate) * swarms);
+    if (!retask.swarm_attack || !retask.swarm_target || !retask.swarm_next || !retask.swarm_prev ||
+        !retask.target_attack || !retask.target_head || !retask.target_taken || !retask.target_lost ||
+        !retask.target_queued || !retask.short_targets || !retask.counted || !retask.lost || !retask.candidates) {
+        log_error("Error: arena de la flota demasiado pequeña para el motor de re-asignación, sigue sin re-asignar");
+        return;
+    }
+    
+    for (int t = 0; t < targets; t++) retask.target_head[t] = -1;
+    for (int s = 0; s < swarms; s++) {
+        Swarm* swarm = &system_state.swarms[s];
+        int t = system_state.target_assignments[s];
+        retask.swarm_target[s] = t;
+        retask.swarm_prev[s] = -1;
+        retask.swarm_next[s] = retask.target_head[t];
+        if (retask.target_head[t] >= 0) retask.swarm_prev[retask.target_head[t]] = s;
+        retask.target_head[t] = s;
+        for (int j = 0; j < swarm->size; j++) {
+            Drone* drone = swarm_drone(swarm, j);
+            DroneState state = drone_state(drone);
+            if (drone->type == DRONE_TYPE_ATTACK &&
+                (state == DRONE_STATE_FLYING_TO_TARGET || state == DRONE_STATE_AT_TARGET)) {
+                retask.counted[drone->id] = 1;
+                retask.swarm_attack[s]++;
+            }
+        }
+        retask.target_attack[t] += retask.swarm_attack[s];
+    }
+    atomic_store(&retask.lost_count, 0);
+    retask.lost_seen = 0;
+    retask.losses = retask.moves = 0;
+    retask.shortfalls = retask.abandoned = 0;
+    retask.busy_ms = 0;
+    atomic_store_explicit(&retask.active, 1, memory_order_release);
+}
+
+// Función para detener el motor antes del re-ensamblaje (con el reloj detenido)
+void retask_engine_stop() {
+    if (!atomic_load(&retask.active)) return;
+    pthread_mutex_lock(&retask.mutex);
+    atomic_store(&retask.active, 0);
+    pthread_mutex_unlock(&retask.mutex);
+    log_message("Re-asignación en vuelo: %lu drones de ataque perdidos, %d objetivos cortos, "
+                "%lu enjambres redirigidos, %d objetivos abandonados (%.2f ms en total)",
+                retask.losses, retask.shortfalls, retask.moves, retask.abandoned, retask.busy_ms);
+}
+
+// Función para soltar los arreglos del motor de re-asignación (viven en la arena)
+void retask_engine_release() {
+    retask.swarm_attack = retask.swarm_target = retask.swarm_next = retask.swarm_prev = NULL;
+    retask.target_attack = retask.target_head = retask.target_taken = retask.short_targets = retask.lost = NULL;
+    retask.target_lost = retask.target_queued = retask.counted = NULL;
+    retask.candidates = NULL;
+    atomic_store(&retask.active, 0);
+}
+
+// Función para pasar un puntero a la arena a su offset en el punto de control
+uint64_t checkpoint_offset_of(const void* pointer) {
+    return pointer ? (uint64_t)((const char*)pointer - system_state.arena.base) : CHECKPOINT_NULL;
+}
+
+// Función para volver de un offset del punto de control a un puntero a la arena
+void* checkpoint_pointer_at(uint64_t offset) {
+    return offset == CHECKPOINT_NULL ? NULL : system_state.arena.base + offset;
+}
+
+// Función para escribir el punto de control de la misión (con el reloj detenido, justo
+// antes de "stage"). Los eventos pendientes se consumen antes: la cola no se guarda.
+int checkpoint_write(MissionStage stage) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    process_events();
+    
+    Arena* arena = &system_state.arena;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t arena_offset = (sizeof(CheckpointHeader) + page - 1) & ~(page - 1);
+    int fd = open(checkpoint.path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd == -1) {
+        log_error("Error creando el punto de control %s: %s", checkpoint.path, strerror(errno));
+        return -1;
+    }
+    // El archivo cubre la arena entera; lo que no se usó queda como hueco
+    if (ftruncate(fd, (off_t)(arena_offset + arena->size)) != 0) {
+        log_error("Error dimensionando el punto de control %s: %s", checkpoint.path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    char* image = mmap(NULL, arena_offset + arena->used, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        log_error("Error mapeando el punto de control %s: %s", checkpoint.path, strerror(errno));
+        return -1;
+    }
+    
+    // El intérprete puede estar moviendo enjambres: el motor queda quieto durante la copia
+    pthread_mutex_lock(&retask.mutex);
+    CheckpointHeader* header = (CheckpointHeader*)image;
+    header->version = CHECKPOINT_VERSION;
+    header->header_size = sizeof(CheckpointHeader);
+    header->value_count = CHECKPOINT_VALUE_COUNT;
+    header->pointer_count = CHECKPOINT_POINTER_COUNT;
+    header->stage = stage;
+    header->tick = sim_now();
+    header->arena_offset = arena_offset;
+    header->arena_size = arena->size;
+    header->arena_used = arena->used;
+    int i = 0;
+#define CHECKPOINT_SAVE_VALUE(field) header->values[i++] = (int64_t)(field);
+    CHECKPOINT_VALUES(CHECKPOINT_SAVE_VALUE)
+#undef CHECKPOINT_SAVE_VALUE
+    i = 0;
+#define CHECKPOINT_SAVE_POINTER(field) header->pointers[i++] = checkpoint_offset_of(field);
+    CHECKPOINT_POINTERS(CHECKPOINT_SAVE_POINTER)
+#undef CHECKPOINT_SAVE_POINTER
+    for (int state = 0; state < DRONE_STATE_COUNT; state++) {
+        header->state_counts[state] = atomic_load(&system_state.state_counts[state]);
+    }
+    for (int c = 0; c < LOSS_CAUSE_COUNT; c++) {
+        header->losses[c] = atomic_load(&system_state.losses[c]);
+    }
+    
+    // Imagen de la arena sin punteros ni estado del proceso
+    char* copy = image + arena_offset;
+    memcpy(copy, arena->base, arena->used);
+    Swarm* swarms = (Swarm*)(copy + checkpoint_offset_of(system_state.swarms));
+    for (int s = 0; s < system_state.swarm_count; s++) {
+        swarms[s].members = (int*)(uintptr_t)checkpoint_offset_of(system_state.swarms[s].members);
+        memset(&swarms[s].mutex, 0, sizeof(swarms[s].mutex));
+    }
+    FlowField* fields = (FlowField*)(copy + checkpoint_offset_of(flow.fields));
+    for (int t = 0; t < system_state.target_count; t++) {
+        fields[t].waypoint = NULL;
+        fields[t].built = 0;
+    }
+    Drone* drones = (Drone*)(copy + checkpoint_offset_of(system_state.drones));
+    for (int d = 0; d < system_state.drone_count; d++) {
+        drones[d].fifo_fd = -1;
+    }
+    pthread_mutex_unlock(&retask.mutex);
+    
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    munmap(image, arena_offset + arena->used);
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log_message("Punto de control %s escrito antes de la etapa %s: tick %ld, %d drones, %.1f KB en %.1f ms",
+                checkpoint.path, mission_stage_names[stage], sim_now(), system_state.drone_count,
+                (arena_offset + arena->used) / 1024.0,
+                (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    return 0;
+}
+
+// Función para abrir un punto de control y validar su cabecera. Devuelve el descriptor,
+// o -1 si no es un punto de control de esta versión.
+int checkpoint_open(const char* path, CheckpointHeader* header) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        log_error("Error abriendo el punto de control %s: %s", path, strerror(errno));
+        return -1;
+    }
+    struct stat info;
+    if (pread(fd, header, sizeof(*header), 0) != (ssize_t)sizeof(*header) || fstat(fd, &info) != 0 ||
+        memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0) {
+        log_error("%s: no es un punto de control de Drone Wars 2", path);
+        close(fd);
+        return -1;
+    }
+    if (header->version != CHECKPOINT_VERSION || header->header_size != sizeof(CheckpointHeader) ||
+        header->value_count != CHECKPOINT_VALUE_COUNT || header->pointer_count != CHECKPOINT_POINTER_COUNT ||
+        header->stage <= STAGE_ASSEMBLY || header->stage >= STAGE_COUNT ||
+        header->arena_offset + header->arena_size > (uint64_t)info.st_size) {
+        log_error("%s: versión %u de punto de control no soportada o archivo incompleto", path, header->version);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Función para cargar los escalares de la misión de un punto de control (la semilla de
+// --seed o de config.txt tiene prioridad: con otra semilla la continuación es otra)
+void checkpoint_apply_values(const CheckpointHeader* header) {
+    uint64_t seed = system_state.seed;
+    int i = 0;
+#define CHECKPOINT_LOAD_VALUE(field) field = header->values[i++];
+    CHECKPOINT_VALUES(CHECKPOINT_LOAD_VALUE)
+#undef CHECKPOINT_LOAD_VALUE
+    for (int state = 0; state < DRONE_STATE_COUNT; state++) {
+        atomic_store(&system_state.state_counts[state], (int)header->state_counts[state]);
+    }
+    for (int c = 0; c < LOSS_CAUSE_COUNT; c++) {
+        atomic_store(&system_state.losses[c], (int)header->losses[c]);
+    }
+    if (system_state.seed_set) {
+        system_state.seed = seed;
+    }
+}
+
+// Función para leer solo la configuración de la misión de un punto de control (el modo
+// lote la necesita antes de crear las corridas)
+int checkpoint_load_configuration(const char* path) {
+    CheckpointHeader header;
+    int fd = checkpoint_open(path, &header);
+    if (fd == -1) {
+        return -1;
+    }
+    close(fd);
+    checkpoint_apply_values(&header);
+    return 0;
+}
+
+// Función para restaurar un punto de control: mapea la imagen como arena (copia en
+// escritura, nada se lee por adelantado) y rehace los punteros. Tarda lo que tarda
+// recorrer los enjambres, sin importar el tamaño de la flota.
+int checkpoint_restore(const char* path) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CheckpointHeader header;
+    int fd = checkpoint_open(path, &header);
+    if (fd == -1) {
+        return -1;
+    }
+    char* base = mmap(NULL, header.arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)header.arena_offset);
+    close(fd);
+    if (base == MAP_FAILED) {
+        log_error("Error mapeando el punto de control %s: %s", path, strerror(errno));
+        return -1;
+    }
+    
+    checkpoint_apply_values(&header);
+    arena_release(&system_state.arena);
+    system_state.arena = (Arena){base, header.arena_size, header.arena_used};
+    int i = 0;
+#define CHECKPOINT_LOAD_POINTER(field) field = checkpoint_pointer_at(header.pointers[i++]);
+    CHECKPOINT_POINTERS(CHECKPOINT_LOAD_POINTER)
+#undef CHECKPOINT_LOAD_POINTER
+    
+    for (int s = 0; s < system_state.swarm_count; s++) {
+        Swarm* swarm = &system_state.swarms[s];
+        swarm->members = checkpoint_pointer_at((uint64_t)(uintptr_t)swarm->members);
+        pthread_mutex_init(&swarm->mutex, NULL);
+    }
+    flow_planner_init();
+    
+    checkpoint.resume = (MissionStage)header.stage;
+    checkpoint.resume_tick = (long)header.tick;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    log_message("Punto de control %s restaurado en %.2f ms: tick %ld, etapa %s, %d drones (semilla %llu)",
+                path, (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6,
+                checkpoint.resume_tick, mission_stage_names[checkpoint.resume], system_state.drone_count,
+                (unsigned long long)system_state.seed);
+    return 0;
+}
+
+// Función para saber si la misión pasa por "stage" (las anteriores a la restaurada ya
+// ocurrieron) y, si es la etapa pedida, escribir antes el punto de control
+int mission_stage(MissionStage stage) {
+    if (stage < checkpoint.resume) {
+        return 0;
+    }
+    if (checkpoint.path[0] && stage == checkpoint.at && stage != checkpoint.resume) {
+        checkpoint_write(stage);
+    }
+    return 1;
+}
+
+// Funciones del registro de misión (record / replay)
+
+// Función para mezclar los bits de un valor de 64 bits (finalizador de splitmix64)
+uint64_t replay_mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ull;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+// Función para resumir un texto (FNV-1a)
+uint64_t replay_hash_text(const char* text) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (; *text; text++) {
+        hash = (hash ^ (uint8_t)*text) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Función para sumar un evento al resumen del tick en curso (desde cualquier hilo). La
+// suma no depende del orden en que los trabajadores emiten.
+void replay_note_event(const Event* event) {
+    uint64_t digest = replay_mix(((uint64_t)event->type << 32) ^ (uint32_t)event->drone_id);
+    digest = replay_mix(digest ^ ((uint64_t)(uint32_t)event->swarm_id << 32) ^ (uint32_t)event->truck_id);
+    digest = replay_mix(digest ^ (uint64_t)event->timestamp ^ replay_hash_text(event->data));
+    atomic_fetch_add_explicit(&replay.tick_digest, digest, memory_order_relaxed);
+    atomic_fetch_add_explicit(&replay.tick_events, 1, memory_order_relaxed);
+}
+
+// Función para dejar un comando del operador para el final del tick (desde el intérprete).
+// Al repetir, los comandos en vivo se rechazan: los del registro ocupan su lugar.
+int replay_stage(ReplayKind kind, int type, int a, int b) {
+    if (replay.mode == REPLAY_PLAY) {
+        return -1;
+    }
+    pthread_mutex_lock(&replay.mutex);
+    if (replay.staged_count == replay.staged_capacity) {
+        int grown = replay.staged_capacity > 0 ? replay.staged_capacity * 2 : 16;
+        ReplayRecord* resized = realloc(replay.staged, sizeof(ReplayRecord) * grown);
+        if (!resized) {
+            pthread_mutex_unlock(&replay.mutex);
+            return -1;
+        }
+        replay.staged = resized;
+        replay.staged_capacity = grown;
+    }
+    replay.staged[replay.staged_count++] = (ReplayRecord){0, (uint8_t)kind, (uint8_t)type, 0, a, b, 0};
+    pthread_mutex_unlock(&replay.mutex);
+    return 0;
+}
+
+// Función para aplicar un comando del registro (hilo de ticks, entre dos ticks: se aplica
+// en el lugar, sin pasar por el slot de cada drone)
+void replay_apply(const ReplayRecord* record) {
+    int target_id = record->a;
+    if (record->value == CMD_SET_DEFENSE) {
+        if (command_valid(CMD_SET_DEFENSE, target_id, record->b)) {
+            defense_apply_command(target_id, record->b);
+        }
+        return;
+    }
+    if (record->value != CMD_GO_ATTACK_GLOBAL && (target_id < 0 || target_id >= system_state.target_count)) {
+        return;
+    }
+    if (record->kind == REPLAY_RETASK_DRONE) {
+        int drone_id = record->b;
+        if (drone_id >= 0 && drone_id < system_state.drone_count && !fleet_drone_lost(drone_id)) {
+            drone_apply_command(&system_state.drones[drone_id], CMD_RETASK, target_id);
+            log_debug(LOG_CAT_COMM, "Operador: drone %d redirigido al objetivo %d", drone_id, target_id);
+        }
+    } else if (record->value == CMD_RETASK) {
+        int swarm_id = record->b;
+        if (swarm_id >= 0 && swarm_id < system_state.swarm_count) {
+            system_state.target_assignments[swarm_id] = target_id;
+            retask_note_move(swarm_id, target_id);
+            retask_issue(swarm_id, target_id);
+            log_at(LOG_INFO, LOG_CAT_COMM, "Operador: enjambre %d redirigido al objetivo %d", swarm_id, target_id);
+        }
+    } else {
+        command_dispatch((CommandType)record->value, target_id, record->b);
+    }
+}
+
+// Función para escribir un registro (al registrar; sin espacio en disco se deja de registrar)
+void replay_write(const ReplayRecord* record) {
+    if (replay.file && fwrite(record, sizeof(*record), 1, replay.file) != 1) {
+        log_error("Error escribiendo el registro %s: %s", replay.path, strerror(errno));
+        fclose(replay.file);
+        replay.file = NULL;
+    }
+}
+
+// Función para anotar una diferencia con la corrida registrada
+void replay_diverged(long tick, int events, const ReplayRecord* expected) {
+    if (replay.divergent_ticks++ == 0) {
+        replay.first_divergence = tick;
+        log_error("Replay: el tick %ld difiere de la corrida registrada (%d eventos, se esperaban %d)",
+                  tick, events, expected ? expected->a : 0);
+    }
+}
+
+// Función del hilo de ticks al final de cada tick: cierra el resumen de los eventos del
+// tick y aplica los comandos del operador que caen en él. Al registrar los escribe; al
+// repetir los compara con el registro y aplica los comandos registrados.
+void replay_end_tick(long tick) {
+    if (replay.mode == REPLAY_OFF) return;
+    uint64_t digest = atomic_exchange_explicit(&replay.tick_digest, 0, memory_order_relaxed);
+    int events = atomic_exchange_explicit(&replay.tick_events, 0, memory_order_relaxed);
+    replay.events += events;
+    
+    if (replay.mode == REPLAY_RECORD) {
+        if (events > 0) {
+            replay_write(&(ReplayRecord){(uint32_t)tick, REPLAY_EVENTS, 0, 0, events, 0, digest});
+        }
+        pthread_mutex_lock(&replay.mutex);
+        for (int i = 0; i < replay.staged_count; i++) {
+            replay.staged[i].tick = (uint32_t)tick;
+            replay_write(&replay.staged[i]);
+            replay_apply(&replay.staged[i]);
+        }
+        replay.staged_count = 0;
+        pthread_mutex_unlock(&replay.mutex);
+        return;
+    }
+    
+    // Los ticks con eventos que la repetición ya pasó sin emitirlos también difieren
+    ReplayRecord* records = replay.records;
+    while (replay.cursor < replay.record_count && records[replay.cursor].kind == REPLAY_EVENTS &&
+           records[replay.cursor].tick < tick) {
+        replay_diverged(records[replay.cursor].tick, 0, &records[replay.cursor]);
+        replay.cursor++;
+    }
+    ReplayRecord* expected = NULL;
+    if (replay.cursor < replay.record_count && records[replay.cursor].kind == REPLAY_EVENTS &&
+        records[replay.cursor].tick == tick) {
+        expected = &records[replay.cursor++];
+    }
+    if (expected ? expected->a != events || expected->digest != digest : events > 0) {
+        replay_diverged(tick, events, expected);
+    }
+    while (replay.cursor < replay.record_count && records[replay.cursor].tick <= tick &&
+           records[replay.cursor].kind <= REPLAY_RETASK_DRONE) {
+        replay_apply(&records[replay.cursor++]);
+    }
+}
+
+// Función para resumir el informe final de la misión (lo mismo que copia el modo lote)
+uint64_t replay_report_digest() {
+    uint64_t digest = replay_mix((uint64_t)system_state.drone_count);
+    for (int t = 0; t < system_state.target_count; t++) {
+        digest = replay_mix(digest ^ ((uint64_t)(uint32_t)system_state.target_outcome[t] << 8) ^
+                            system_state.target_confirmed[t]);
+    }
+    for (int c = 0; c < LOSS_CAUSE_COUNT; c++) {
+        digest = replay_mix(digest ^ (uint64_t)atomic_load(&system_state.losses[c]));
+    }
+    for (int state = 0; state < DRONE_STATE_COUNT; state++) {
+        digest = replay_mix(digest ^ (uint64_t)atomic_load(&system_state.state_counts[state]));
+    }
+    return digest;
+}
+
+// Función para cerrar el registro al terminar la misión (el reloj ya se detuvo): los
+// eventos después del último tick cuentan como un tick más, y se agrega el informe final
+void replay_finish() {
+    if (replay.mode == REPLAY_OFF) return;
+    long tick = sim_now();
+    replay_end_tick(tick);
+    ReplayRecord end = {(uint32_t)tick, REPLAY_END, 0, 0, (int32_t)replay.events, 0, replay_report_digest()};
+    
+    if (replay.mode == REPLAY_RECORD) {
+        replay_write(&end);
+        if (replay.file) {
+            fclose(replay.file);
+            replay.file = NULL;
+            log_message("Registro de la misión en %s: %ld ticks, %llu eventos (repetir con --replay %s)",
+                        replay.path, tick, replay.events, replay.path);
+        }
+        pthread_mutex_lock(&replay.mutex); // El intérprete todavía corre
+        free(replay.staged);
+        replay.staged = NULL;
+        replay.staged_count = replay.staged_capacity = 0;
+        pthread_mutex_unlock(&replay.mutex);
+        return;
+    }
+    
+    const ReplayRecord* expected = NULL;
+    for (long i = replay.cursor; i < replay.record_count && !expected; i++) {
+        if (replay.records[i].kind == REPLAY_END) {
+            expected = &replay.records[i];
+        } else if (replay.records[i].kind == REPLAY_EVENTS) {
+            replay_diverged(replay.records[i].tick, 0, &replay.records[i]);
+        }
+    }
+    replay.end_matched = expected && expected->tick == end.tick && expected->a == end.a && expected->digest == end.digest;
+    if (replay.divergent_ticks == 0 && replay.end_matched) {
+        log_message("Replay idéntico a %s: %ld ticks, %llu eventos, mismo informe final", replay.path, tick, replay.events);
+    } else {
+        log_error("Replay distinto de %s: %ld ticks con otros eventos (el primero, %ld), informe final %s",
+                  replay.path, replay.divergent_ticks, replay.first_divergence,
+                  replay.end_matched ? "igual" : "distinto");
+    }
+    free(replay.records);
+    free(replay.config);
+    free(replay.scenario);
+    replay.records = NULL;
+    replay.config = NULL;
+    replay.scenario = NULL;
+    replay.record_count = replay.cursor = 0;
+}
+
+// Función para leer un archivo entero (para guardarlo en el registro). Devuelve NULL y
+// size 0 si no se puede leer o está vacío.
+char* replay_read_file(const char* path, long* size) {
+    char* data = NULL;
+    *size = 0;
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) == 0 && (*size = ftell(file)) > 0 &&
+        (data = malloc(*size)) && fseek(file, 0, SEEK_SET) == 0) {
+        *size = (long)fread(data, 1, *size, file);
+    } else {
+        *size = 0;
+    }
+    fclose(file);
+    return data;
+}
+
+// Función para empezar a registrar la misión (después de elegir la semilla)
+int replay_open_record(const char* config_path) {
+    // config.txt y el escenario van dentro del registro: la repetición no depende de que
+    // sigan igual (ni de que sigan existiendo)
+    long size = 0, scenario_size = 0;
+    char* config = replay_read_file(config_path, &size);
+    char* scenario_data = NULL;
+    if (scenario.path[0]) {
+        scenario_data = replay_read_file(scenario.path, &scenario_size);
+        if (!scenario_data) {
+            log_error("Error leyendo el escenario %s para el registro", scenario.path);
+            free(config);
+            return -1;
+        }
+    }
+    
+    replay.file = fopen(replay.path, "wb");
+    if (!replay.file) {
+        log_error("Error creando el registro %s: %s", replay.path, strerror(errno));
+        free(config);
+        free(scenario_data);
+        return -1;
+    }
+    
+    ReplayHeader header = {0};
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.record_size = sizeof(ReplayRecord);
+    header.seed = system_state.seed;
+    header.start_time = system_state.start_time;
+    header.tick_ms = TICK_MS;
+    header.config_size = (uint32_t)size;
+    header.scenario_size = (uint32_t)scenario_size;
+    snprintf(header.scenario, sizeof(header.scenario), "%s", scenario.path);
+    int written = fwrite(&header, sizeof(header), 1, replay.file) == 1 &&
+                  (size == 0 || fwrite(config, 1, size, replay.file) == (size_t)size) &&
+                  (scenario_size == 0 || fwrite(scenario_data, 1, scenario_size, replay.file) == (size_t)scenario_size);
+    free(config);
+    free(scenario_data);
+    if (!written) {
+        log_error("Error escribiendo el registro %s: %s", replay.path, strerror(errno));
+        fclose(replay.file);
+        replay.file = NULL;
+        return -1;
+    }
+    replay.mode = REPLAY_RECORD;
+    log_message("Registrando la misión en %s", replay.path);
+    return 0;
+}
+
+// Función para cargar un registro entero para repetirlo: deja la semilla, la hora de
+// inicio y el escenario de la corrida registrada (config.txt lo lee load_configuration)
+int replay_load(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        log_error("Error abriendo el registro %s: %s", path, strerror(errno));
+        return -1;
+    }
+    
+    ReplayHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0) {
+        log_error("%s: no es un registro de misión de Drone Wars 2", path);
+        fclose(file);
+        return -1;
+    }
+    if (header.version != REPLAY_VERSION || header.record_size != sizeof(ReplayRecord) || header.tick_ms != TICK_MS) {
+        log_error("%s: versión %u con registros de %u bytes y ticks de %u ms no soportada",
+                  path, header.version, header.record_size, header.tick_ms);
+        fclose(file);
+        return -1;
+    }
     
-    // Crear drones del enjambre con distribución mixta de camiones
-    // pero manteniendo la proporción 4:1 (ataque:cámara)
-    for (int i = 0; i < DRONES_PER_SWARM; i++) {
-        DroneType type = (i < ATTACK_DRONES_PER_SWARM) ? DRONE_TYPE_ATTACK : DRONE_TYPE_CAMERA;
-        int drone_id = system_state.drone_count;
-        
-        // Distribuir drones aleatoriamente de diferentes camiones
-        // pero manteniendo la proporción 4:1 (ataque:cámara)
-        int source_truck;
-        if (i == 4) {
-            // El drone cámara siempre del camión principal para consistencia
-            source_truck = truck_id;
-        } else {
-            // Los drones de ataque se distribuyen aleatoriamente entre los camiones
-            source_truck = rand() % NUM_TRUCKS;
-        }
-        
-        Position start_pos = system_state.trucks[source_truck].pos;
-        
-        swarm->drones[i] = create_drone(drone_id, source_truck, id, type, start_pos, assembly_point);
-        if (swarm->drones[i]) {
-            system_state.all_drones[system_state.drone_count++] = swarm->drones[i];
-            swarm->active_count++;
-        }
+    replay.config = malloc(header.config_size + 1);
+    replay.scenario = malloc(header.scenario_size + 1);
+    long start = (long)sizeof(header) + header.config_size + header.scenario_size;
+    long end = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    replay.record_count = end >= start ? (end - start) / (long)sizeof(ReplayRecord) : 0;
+    replay.records = malloc(sizeof(ReplayRecord) * (replay.record_count + 1));
+    int loaded = replay.config && replay.scenario && replay.records && end >= start &&
+                 fseek(file, sizeof(header), SEEK_SET) == 0 &&
+                 fread(replay.config, 1, header.config_size, file) == header.config_size &&
+                 fread(replay.scenario, 1, header.scenario_size, file) == header.scenario_size &&
+                 fread(replay.records, sizeof(ReplayRecord), replay.record_count, file) == (size_t)replay.record_count;
+    fclose(file);
+    if (!loaded) {
+        log_error("%s: registro incompleto", path);
+        return -1;
     }
     
-    log_message("Enjambre %d creado con %d drones", id, swarm->active_count);
-    return swarm;
+    replay.config_size = header.config_size;
+    replay.scenario_size = header.scenario_size;
+    snprintf(replay.path, sizeof(replay.path), "%s", path);
+    replay.mode = REPLAY_PLAY;
+    system_state.seed = header.seed;
+    system_state.seed_set = 1;
+    system_state.start_time = (time_t)header.start_time;
+    // El escenario guardado manda sobre --scenario (scenario_load lo lee del registro)
+    scenario.path[0] = '\0';
+    if (header.scenario_size > 0) {
+        snprintf(scenario.path, sizeof(scenario.path), "%s", header.scenario[0] ? header.scenario : path);
+    }
+    log_message("Repitiendo la misión de %s: %ld registros, semilla %llu",
+                path, replay.record_count, (unsigned long long)header.seed);
+    return 0;
 }
 
 // Función para inicializar el sistema
 void initialize_system() {
     log_message("=== INICIANDO DRONE WARS 2 ===");
     
-    // Inicializar mutex y condition variables
+    // Inicializar mutex
     pthread_mutex_init(&system_state.system_mutex, NULL);
-    pthread_cond_init(&system_state.system_condition, NULL);
-    pthread_mutex_init(&log_mutex, NULL);
     
     // Inicializar estado del sistema
     system_state.swarm_count = 0;
     system_state.drone_count = 0;
-    system_state.event_count = 0;
-    system_state.event_head = 0;
-    system_state.event_tail = 0;
     system_state.global_attack_commanded = 0;
     system_state.all_swarms_ready = 0;
+    atomic_store(&system_state.attack_requested, 0);
+    atomic_store(&system_state.defense_requested, 0);
     system_state.simulation_running = 1;
     system_state.phase = 1;
+    for (int c = 0; c < LOSS_CAUSE_COUNT; c++) {
+        atomic_store(&system_state.losses[c], 0);
+    }
     
-    // Asignación aleatoria de objetivos a enjambres (para despistar al enemigo)
-    system_state.target_assignments[0] = rand() % NUM_TARGETS;
-    system_state.target_assignments[1] = rand() % NUM_TARGETS;
-    system_state.target_assignments[2] = rand() % NUM_TARGETS;
+    if (allocate_fleet() != 0) {
+        exit(EXIT_FAILURE);
+    }
     
-    // Asegurar que no haya conflictos (cada enjambre ataque un objetivo diferente)
-    while (system_state.target_assignments[1] == system_state.target_assignments[0]) {
-        system_state.target_assignments[1] = rand() % NUM_TARGETS;
+    // Histograma de estados: todos los huecos de la arena empiezan en CREATED
+    for (int s = 0; s < DRONE_STATE_COUNT; s++) {
+        atomic_store(&system_state.state_counts[s], 0);
     }
-    while (system_state.target_assignments[2] == system_state.target_assignments[0] || 
-           system_state.target_assignments[2] == system_state.target_assignments[1]) {
-        system_state.target_assignments[2] = rand() % NUM_TARGETS;
+    atomic_store(&system_state.state_counts[DRONE_STATE_CREATED], system_state.drone_capacity);
+    for (int id = 0; id < system_state.drone_capacity; id++) {
+        system_state.state_bits[DRONE_STATE_CREATED * system_state.state_words + id / 64] |= 1ull << (id % 64);
     }
+    atomic_store(&system_state.drones_in_defense_zone, 0);
+    system_state.barrier.armed = 0;
     
-    // Crear directorio FIFO
-    mkdir(FIFO_PATH, 0777);
-    
-    // Crear FIFO del centro de comando
-    snprintf(system_state.center_fifo_name, sizeof(system_state.center_fifo_name), 
-             "%s/center", FIFO_PATH);
-    mkfifo(system_state.center_fifo_name, 0666);
-    system_state.center_fifo_fd = open(system_state.center_fifo_name, O_RDWR | O_NONBLOCK);
+    if (event_queue_init(&system_state.events, system_state.event_queue_capacity, system_state.event_overflow) != 0) {
+        log_error("Error: No se pudo reservar la cola de eventos");
+        exit(EXIT_FAILURE);
+    }
     
-    // Inicializar posiciones fijas
-    // Camiones
-    system_state.trucks[0].pos = (Position){25, 0};
-    system_state.trucks[1].pos = (Position){50, 0};
-    system_state.trucks[2].pos = (Position){75, 0};
+    // Traza binaria opcional (trace= en config.txt o --trace)
+    if (trace.path[0] && trace_open() != 0) {
+        exit(EXIT_FAILURE);
+    }
     
-    // Objetivos
-    system_state.targets[0].pos = (Position){0, 25};
-    system_state.targets[1].pos = (Position){0, 50};
-    system_state.targets[2].pos = (Position){0, 75};
+    // Canal de comandos y telemetría (región compartida, o las FIFOs de siempre)
+    if (channel_open() != 0) {
+        exit(EXIT_FAILURE);
+    }
     
-    // Puntos de ensamblaje
-    system_state.assembly_points[0] = (Position){25, 16};
-    system_state.assembly_points[1] = (Position){50, 16};
-    system_state.assembly_points[2] = (Position){75, 16};
+    // Inicializar posiciones: las que lista el escenario; el resto como siempre, con
+    // camiones, puntos de ensamble y re-ensamble repartidos a lo ancho del mapa
+    for (int i = 0; i < system_state.truck_count; i++) {
+        if (scenario.header.truck_count > 0) {
+            const ScenarioTruck* truck = &scenario.trucks[i];
+            system_state.trucks[i].pos = (Position){truck->x, truck->y};
+            system_state.assembly_points[i] = (Position){truck->assembly_x, truck->assembly_y};
+            system_state.reassembly_points[i] = (Position){truck->reassembly_x, truck->reassembly_y};
+            continue;
+        }
+        int x = (i + 1) * system_state.map_width / (system_state.truck_count + 1);
+        system_state.trucks[i].pos = (Position){x, 0};
+        system_state.assembly_points[i] = (Position){x, system_state.assembly_y};
+        system_state.reassembly_points[i] = (Position){x, system_state.reassembly_y};
+    }
     
-    // Puntos de re-ensamblaje
-    system_state.reassembly_points[0] = (Position){25, 82};
-    system_state.reassembly_points[1] = (Position){50, 82};
-    system_state.reassembly_points[2] = (Position){75, 82};
+    // Objetivos repartidos a lo alto sobre X=0
+    for (int i = 0; i < system_state.target_count; i++) {
+        system_state.targets[i].pos = (Position){0, (i + 1) * system_state.map_height / (system_state.target_count + 1)};
+        // Un objetivo pide al menos una detonación (aunque los enjambres sean solo de cámaras)
+        system_state.targets[i].required_attacks = system_state.attack_per_swarm > 0 ? system_state.attack_per_swarm : 1;
+        if (scenario.header.target_count > 0) {
+            system_state.targets[i].pos = (Position){scenario.targets[i].x, scenario.targets[i].y};
+            if (scenario.targets[i].required_attacks > 0) {
+                system_state.targets[i].required_attacks = scenario.targets[i].required_attacks;
+            }
+        }
+    }
     
-    // Defensas enemigas
-    system_state.defenses[0].pos = (Position){10, 100};
-    system_state.defenses[1].pos = (Position){90, 100};
+    // Defensas enemigas repartidas a lo ancho del mapa en el centro de la zona de defensa
+    for (int i = 0; i < system_state.defense_count; i++) {
+        system_state.defenses[i].pos = (Position){(i + 1) * system_state.map_width / (system_state.defense_count + 1),
+                                                  (system_state.defense_zone_start + system_state.defense_zone_end) / 2};
+        system_state.defenses[i].shoot_down_probability = system_state.W;
+        system_state.defenses[i].range = system_state.defense_range;
+        if (scenario.header.defense_count > 0) {
+            const ScenarioDefense* defense = &scenario.defenses[i];
+            system_state.defenses[i].pos = (Position){defense->x, defense->y};
+            if (defense->probability >= 0) system_state.defenses[i].shoot_down_probability = defense->probability;
+            if (defense->range >= 0) system_state.defenses[i].range = defense->range;
+        }
+    }
     
     // Inicializar objetivos
-    for (int i = 0; i < NUM_TARGETS; i++) {
+    for (int i = 0; i < system_state.target_count; i++) {
         system_state.targets[i].id = i;
         system_state.targets[i].state = TARGET_STATE_INTACT;
         system_state.targets[i].attack_count = 0;
-        system_state.targets[i].required_attacks = 4;
     }
     
-    // Inicializar defensas
-    for (int i = 0; i < NUM_ENEMY_DEFENSES; i++) {
+    // Inicializar defensas y construir el campo de amenaza
+    for (int i = 0; i < system_state.defense_count; i++) {
         system_state.defenses[i].id = i;
-        system_state.defenses[i].shoot_down_probability = system_state.W;
+        atomic_init(&system_state.defenses[i].requested, -1);
+        enemy_defense_set_active(&system_state.defenses[i], 1);
     }
     
     // Inicializar camiones
-    for (int i = 0; i < NUM_TRUCKS; i++) {
+    for (int i = 0; i < system_state.truck_count; i++) {
         system_state.trucks[i].id = i;
-        system_state.trucks[i].pos = system_state.trucks[i].pos;
-        system_state.trucks[i].swarm = NULL;
+        system_state.trucks[i].swarm_count = 0;
         system_state.trucks[i].drone_count = 0;
         system_state.trucks[i].active = 1;
     }
     
+    // Asignación de objetivos a enjambres (necesita el mapa y el campo de amenaza armados)
+    assign_targets();
+    
     log_message("Sistema inicializado correctamente");
     
-    // Mostrar asignación aleatoria de objetivos
-    log_message("=== ASIGNACIÓN ALEATORIA DE OBJETIVOS ===");
-    for (int i = 0; i < NUM_TRUCKS; i++) {
-        log_message("Enjambre %d → Objetivo %d (Posición: %d,%d)", 
+    // Mostrar asignación de objetivos
+    log_message("=== ASIGNACIÓN DE OBJETIVOS ===");
+    for (int i = 0; i < system_state.swarm_capacity; i++) {
+        log_at(LOG_INFO, LOG_CAT_FLEET, "Enjambre %d → Objetivo %d (Posición: %d,%d)", 
                    i, system_state.target_assignments[i],
                    system_state.targets[system_state.target_assignments[i]].pos.x,
                    system_state.targets[system_state.target_assignments[i]].pos.y);
     }
 }
 
-// Función para crear enjambres
+// Función para inicializar el sistema desde un punto de control (restore= o --restore):
+// la flota sale de la imagen; la cola de eventos, la traza y el canal son nuevos
+void restore_system() {
+    log_message("=== RESTAURANDO DRONE WARS 2 ===");
+    
+    pthread_mutex_init(&system_state.system_mutex, NULL);
+    atomic_store(&system_state.attack_requested, 0);
+    atomic_store(&system_state.defense_requested, 0);
+    system_state.simulation_running = 1;
+    
+    if (checkpoint_restore(checkpoint.restore_path) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    // Los cambios de defensa sin aplicar eran del operador de la corrida anterior
+    for (int d = 0; d < system_state.defense_count; d++) {
+        atomic_store(&system_state.defenses[d].requested, -1);
+    }
+    
+    if (event_queue_init(&system_state.events, system_state.event_queue_capacity, system_state.event_overflow) != 0) {
+        log_error("Error: No se pudo reservar la cola de eventos");
+        exit(EXIT_FAILURE);
+    }
+    if (trace.path[0] && trace_open() != 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (channel_open() != 0) {
+        exit(EXIT_FAILURE);
+    }
+    
+    // Las FIFOs de los drones son del proceso que escribió el punto de control
+    for (int id = 0; id < system_state.drone_count; id++) {
+        Drone* drone = &system_state.drones[id];
+        drone->fifo_name[0] = '\0';
+        if (channel.mode == CHANNEL_FIFO) {
+            create_fifo_name(drone->fifo_name, id);
+            drone->fifo_fd = create_drone_fifo(id);
+        }
+    }
+}
+
+// Función para preparar la misión: desde el principio o desde un punto de control
+void mission_init() {
+    if (checkpoint.restore_path[0]) {
+        restore_system();
+    } else {
+        initialize_system();
+    }
+}
+
+// Función para crear enjambres (repartidos entre los camiones)
 void create_swarms() {
     log_sub_phase("Creando enjambres");
     
-    for (int i = 0; i < NUM_TRUCKS; i++) {
+    for (int i = 0; i < system_state.swarm_capacity; i++) {
         int swarm_id = system_state.swarm_count;
-        Position assembly_point = system_state.assembly_points[i];
-        Position reassembly_point = system_state.reassembly_points[i];
+        int truck_id = swarm_truck_for(i);
+        int attack = swarm_attack_for(i);
+        int camera = scenario.header.swarm_count > 0 ? scenario.swarms[i].camera : system_state.camera_per_swarm;
+        Position assembly_point = system_state.assembly_points[truck_id];
+        Position reassembly_point = system_state.reassembly_points[truck_id];
         
-        Swarm* swarm = create_swarm(swarm_id, i, assembly_point, reassembly_point);
+        Swarm* swarm = create_swarm(swarm_id, truck_id, attack, camera, assembly_point, reassembly_point);
         if (swarm) {
-            system_state.swarms[system_state.swarm_count++] = swarm;
-            system_state.trucks[i].swarm = swarm;
-            system_state.trucks[i].drone_count = DRONES_PER_SWARM;
+            system_state.swarm_count++;
+            system_state.trucks[truck_id].swarm_count++;
+            system_state.trucks[truck_id].drone_count += swarm->size;
         }
     }
     
     log_status("Se crearon %d enjambres", system_state.swarm_count);
 }
 
+// Función para transferir el drone j de un enjambre a otro
+Drone* swarm_transfer_drone(Swarm* source, int j, Swarm* target) {
+    Drone* drone = swarm_drone(source, j);
+    
+    swarm_remove_drone(source, j);
+    if (swarm_add_drone(target, drone) != 0) {
+        // Sin espacio en el destino: el drone vuelve a su enjambre
+        swarm_add_drone(source, drone);
+        return NULL;
+    }
+    
+    source->active_count--;
+    target->active_count++;
+    trace_emit(TRACE_TRANSFER, drone->id, target->id, 0, 0);
+    return drone;
+}
+
 // Función para optimizar la distribución de drones entre enjambres
 void optimize_drone_distribution() {
     log_message("Optimizando distribución de drones entre enjambres...");
     
     // Permitir que cada enjambre pueda recibir drones de cualquier camión
-    // manteniendo la proporción 4:1 (ataque:cámara)
+    // manteniendo la proporción nominal (ataque:cámara)
     for (int i = 0; i < system_state.swarm_count; i++) {
-        Swarm* swarm = system_state.swarms[i];
-        if (swarm) {
-            int needed_attack = 0;
-            int needed_camera = 0;
-            
-            // Contar qué tipos de drones necesitamos
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (!swarm->drones[j] || swarm->drones[j]->state == DRONE_STATE_DESTROYED) {
-                    if (j < ATTACK_DRONES_PER_SWARM) {
-                        needed_attack++;
-                    } else {
-                        needed_camera++;
-                    }
-                }
-            }
+        Swarm* swarm = &system_state.swarms[i];
+        
+        // Contar qué tipos de drones necesitamos
+        int needed_attack = swarm->attack_quota - swarm_count_alive(swarm, DRONE_TYPE_ATTACK);
+        int needed_camera = swarm->camera_quota - swarm_count_alive(swarm, DRONE_TYPE_CAMERA);
+        if (needed_attack < 0) needed_attack = 0;
+        if (needed_camera < 0) needed_camera = 0;
+        
+        if (needed_attack > 0 || needed_camera > 0) {
+            log_message("Enjambre %d necesita %d drones de ataque y %d drones cámara", 
+                       i, needed_attack, needed_camera);
             
-            if (needed_attack > 0 || needed_camera > 0) {
-                log_message("Enjambre %d necesita %d drones de ataque y %d drones cámara", 
-                           i, needed_attack, needed_camera);
-                
-                // Buscar drones disponibles en otros enjambres
-                for (int k = 0; k < system_state.swarm_count; k++) {
-                    if (k != i && system_state.swarms[k] && system_state.swarms[k]->active_count > DRONES_PER_SWARM) {
-                        Swarm* other_swarm = system_state.swarms[k];
-                        pthread_mutex_lock(&other_swarm->mutex);
+            // Buscar drones disponibles en otros enjambres
+            for (int k = 0; k < system_state.swarm_count; k++) {
+                Swarm* other_swarm = &system_state.swarms[k];
+                if (k != i && other_swarm->active_count > other_swarm->attack_quota + other_swarm->camera_quota) {
+                    pthread_mutex_lock(&other_swarm->mutex);
+                    
+                    int l = 0;
+                    while (l < other_swarm->size && (needed_attack > 0 || needed_camera > 0)) {
+                        Drone* drone = swarm_drone(other_swarm, l);
                         
-                        for (int l = 0; l < DRONES_PER_SWARM; l++) {
-                            if (other_swarm->drones[l] && 
-                                other_swarm->drones[l]->state == DRONE_STATE_READY) {
+                        // Verificar si necesitamos este tipo de drone
+                        if (drone_state(drone) == DRONE_STATE_READY &&
+                            ((drone->type == DRONE_TYPE_ATTACK && needed_attack > 0) ||
+                             (drone->type == DRONE_TYPE_CAMERA && needed_camera > 0))) {
+                            
+                            // Transferir drone
+                            if (swarm_transfer_drone(other_swarm, l, swarm)) {
+                                drone_set_target(drone, swarm->assembly_point);
+                                drone_set_state(drone, DRONE_STATE_FLYING_TO_ASSEMBLY);
+                                
+                                if (drone->type == DRONE_TYPE_ATTACK) needed_attack--;
+                                else needed_camera--;
                                 
-                                // Verificar si necesitamos este tipo de drone
-                                DroneType drone_type = other_swarm->drones[l]->type;
-                                if ((drone_type == DRONE_TYPE_ATTACK && needed_attack > 0) ||
-                                    (drone_type == DRONE_TYPE_CAMERA && needed_camera > 0)) {
-                                    
-                                    // Transferir drone
-                                    other_swarm->drones[l]->swarm_id = i;
-                                    other_swarm->drones[l]->target = swarm->assembly_point;
-                                    other_swarm->drones[l]->state = DRONE_STATE_FLYING_TO_ASSEMBLY;
-                                    
-                                    // Encontrar posición vacía en el enjambre destino
-                                    for (int m = 0; m < DRONES_PER_SWARM; m++) {
-                                        if (!swarm->drones[m] || swarm->drones[m]->state == DRONE_STATE_DESTROYED) {
-                                            swarm->drones[m] = other_swarm->drones[l];
-                                            other_swarm->drones[l] = NULL;
-                                            other_swarm->active_count--;
-                                            swarm->active_count++;
-                                            
-                                            if (drone_type == DRONE_TYPE_ATTACK) needed_attack--;
-                                            else needed_camera--;
-                                            
-                                            log_message("Drone %d (Tipo: %s, Truck: %d) transferido del enjambre %d al enjambre %d", 
-                                                       swarm->drones[m]->id, 
-                                                       drone_type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA",
-                                                       swarm->drones[m]->truck_id, k, i);
-                                            break;
-                                        }
-                                    }
-                                    
-                                    if (needed_attack == 0 && needed_camera == 0) break;
-                                }
+                                log_message("Drone %d (Tipo: %s, Truck: %d) transferido del enjambre %d al enjambre %d", 
+                                           drone->id, 
+                                           drone->type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA",
+                                           drone->truck_id, k, i);
+                                continue; // La posición l ahora tiene otro drone
                             }
                         }
-                        
-                        pthread_mutex_unlock(&other_swarm->mutex);
-                        if (needed_attack == 0 && needed_camera == 0) break;
+                        l++;
                     }
+                    
+                    pthread_mutex_unlock(&other_swarm->mutex);
+                    if (needed_attack == 0 && needed_camera == 0) break;
                 }
             }
         }
@@ -963,44 +5975,56 @@ void optimize_drone_distribution() {
     log_message("Optimización de distribución completada");
 }
 
-// Función para esperar a que todos los enjambres estén listos
+// Función para esperar una barrera de fase ya armada. Cada PHASE_REPORT_SECONDS
+// segundos simulados informa cuántos drones faltan; max_seconds <= 0 = sin límite.
+// En la fase 1 un ataque pedido por el operador también termina la espera.
+// Devuelve 1 si la barrera se cumplió.
+int wait_for_phase_barrier(int max_seconds, const char* waiting_message) {
+    int waited = 0;
+    int reached = atomic_load(&system_state.barrier.remaining) <= 0;
+    
+    while (!reached && system_state.simulation_running && (max_seconds <= 0 || waited < max_seconds) &&
+           !(system_state.phase == 1 && atomic_load(&system_state.attack_requested))) {
+        if (waiting_message) {
+            log_message(waiting_message, atomic_load(&system_state.barrier.remaining));
+        }
+        int seconds = PHASE_REPORT_SECONDS;
+        if (max_seconds > 0 && seconds > max_seconds - waited) {
+            seconds = max_seconds - waited;
+        }
+        reached = sim_wait_barrier((long)seconds * TICKS_PER_SECOND);
+        waited += seconds;
+    }
+    
+    phase_barrier_disarm();
+    return reached;
+}
+
+// Función para esperar a que todos los enjambres estén listos: bloquean los drones
+// vivos que todavía no están en patrulla circular ni listos
 void wait_for_all_swarms_ready() {
     log_message("=== ESPERANDO A QUE TODOS LOS ENJAMBRES ESTÉN LISTOS ===");
     
-    while (system_state.simulation_running) {
-        int all_ready = 1;
-        
-        for (int i = 0; i < system_state.swarm_count; i++) {
-            Swarm* swarm = system_state.swarms[i];
-            if (swarm && swarm->active_count > 0) {
-                int swarm_ready = 0;
-                pthread_mutex_lock(&swarm->mutex);
-                
-                for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                    if (swarm->drones[j] && 
-                        (swarm->drones[j]->state == DRONE_STATE_READY || 
-                         swarm->drones[j]->state == DRONE_STATE_CIRCLING_ASSEMBLY)) {
-                        swarm_ready++;
-                    }
-                }
-                
-                swarm->ready_count = swarm_ready;
-                if (swarm_ready < swarm->active_count) {
-                    all_ready = 0;
-                }
-                
-                pthread_mutex_unlock(&swarm->mutex);
-            }
-        }
-        
-        if (all_ready) {
-            system_state.all_swarms_ready = 1;
-            log_message("Todos los enjambres están listos para el ataque");
-            break;
+    phase_barrier_arm(DRONE_STATES_ALL & ~(STATE_BIT(DRONE_STATE_CREATED) | STATE_BIT(DRONE_STATE_CIRCLING_ASSEMBLY) |
+                                           STATE_BIT(DRONE_STATE_READY) | STATE_BIT(DRONE_STATE_DESTROYED) |
+                                           STATE_BIT(DRONE_STATE_FUEL_EMPTY)), 0);
+    if (!wait_for_phase_barrier(0, NULL)) {
+        if (!system_state.simulation_running || !atomic_load(&system_state.attack_requested)) {
+            return;
         }
-        
-        usleep(500000); // 500ms
+        // Los que todavía no llegaron al ensamble se quedan fuera del ataque
+        log_message("El operador adelantó el ataque: %d drones todavía no están listos",
+                    atomic_load(&system_state.barrier.remaining));
+    }
+    
+    for (int i = 0; i < system_state.swarm_count; i++) {
+        Swarm* swarm = &system_state.swarms[i];
+        swarm->ready_count = swarm_count_state(swarm, DRONE_STATE_READY) +
+                             swarm_count_state(swarm, DRONE_STATE_CIRCLING_ASSEMBLY);
     }
+    
+    system_state.all_swarms_ready = 1;
+    log_message("Todos los enjambres están listos para el ataque");
 }
 
 // Función para comandar ataque global
@@ -1012,23 +6036,23 @@ void command_global_attack() {
     
     // Enviar comando a todos los enjambres
     for (int i = 0; i < system_state.swarm_count; i++) {
-        Swarm* swarm = system_state.swarms[i];
-        if (swarm && swarm->active_count > 0) {
-            // Los drones van al objetivo asignado aleatoriamente
+        Swarm* swarm = &system_state.swarms[i];
+        if (swarm->active_count > 0) {
+            // Los drones van al objetivo asignado (assign_targets)
             int target_id = system_state.target_assignments[i];
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (swarm->drones[j] && 
-                    (swarm->drones[j]->state == DRONE_STATE_READY || 
-                     swarm->drones[j]->state == DRONE_STATE_CIRCLING_ASSEMBLY)) {
+            for (int j = 0; j < swarm->size; j++) {
+                Drone* drone = swarm_drone(swarm, j);
+                if (drone_state(drone) == DRONE_STATE_READY || 
+                    drone_state(drone) == DRONE_STATE_CIRCLING_ASSEMBLY) {
                     
                     // Si está volando en círculos, cambiar a READY primero
-                    if (swarm->drones[j]->state == DRONE_STATE_CIRCLING_ASSEMBLY) {
-                        swarm->drones[j]->state = DRONE_STATE_READY;
-                        log_message("Drone %d terminó patrulla circular, listo para ataque", swarm->drones[j]->id);
+                    if (drone_state(drone) == DRONE_STATE_CIRCLING_ASSEMBLY) {
+                        drone_set_state(drone, DRONE_STATE_READY);
+                        log_message("Drone %d terminó patrulla circular, listo para ataque", drone->id);
                     }
                     
-                    swarm->drones[j]->target = system_state.targets[target_id].pos;
-                    swarm->drones[j]->state = DRONE_STATE_FLYING_TO_TARGET;
+                    drone_set_route(drone, target_id);
+                    drone_set_state(drone, DRONE_STATE_FLYING_TO_TARGET);
                 }
             }
             
@@ -1036,6 +6060,12 @@ void command_global_attack() {
         }
     }
     
+    // Rutas que rodean las defensas (un campo de flujo por objetivo atacado)
+    flow_fields_refresh();
+    
+    // Desde acá cada pérdida puede redirigir enjambres
+    retask_engine_start();
+    
     log_message("Comando de ataque global enviado a todos los enjambres");
 }
 
@@ -1045,47 +6075,13 @@ void wait_for_defense_zone_crossing() {
     
     system_state.phase = 3;
     
-    int drones_in_defense_zone = 1;
-    int max_wait_time = 20;
-    int wait_time = 0;
-    
     log_message("Monitoreando cruce de zona de defensa...");
     
-    while (drones_in_defense_zone > 0 && wait_time < max_wait_time) {
-        drones_in_defense_zone = 0;
-        
-        // Contar drones que aún están en la zona de defensa
-        for (int i = 0; i < system_state.swarm_count; i++) {
-            Swarm* swarm = system_state.swarms[i];
-            if (swarm && swarm->active_count > 0) {
-                pthread_mutex_lock(&swarm->mutex);
-                
-                for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                    if (swarm->drones[j] && 
-                        swarm->drones[j]->state == DRONE_STATE_FLYING_TO_TARGET &&
-                        is_drone_in_zone(swarm->drones[j], DEFENSE_ZONE_START, DEFENSE_ZONE_END)) {
-                        drones_in_defense_zone++;
-                    }
-                }
-                
-                pthread_mutex_unlock(&swarm->mutex);
-            }
-        }
-        
-        if (drones_in_defense_zone > 0) {
-            // Solo mostrar mensaje cada 5 segundos para evitar spam
-            if (wait_time % 5 == 0) {
-                log_message("Esperando... %d drones aún en zona de defensa", drones_in_defense_zone);
-            }
-            sleep(1);
-            wait_time++;
-        }
-    }
-    
-    if (wait_time >= max_wait_time) {
-        log_message("Tiempo de espera agotado, continuando...");
-    } else {
+    phase_barrier_arm(0, 1);
+    if (wait_for_phase_barrier(20, "Esperando... %d drones aún en zona de defensa")) {
         log_message("Todos los drones están cruzando la zona de defensa");
+    } else {
+        log_message("Tiempo de espera agotado, continuando...");
     }
 }
 
@@ -1095,63 +6091,14 @@ void wait_for_reassembly_ready() {
     
     system_state.phase = 31;
     
-    int drones_not_at_reassembly = 1;
-    int max_wait_time = 20;
-    int wait_time = 0;
-    
     log_message("Esperando a que todos los drones lleguen al punto de re-ensamblaje...");
     
-    while (drones_not_at_reassembly > 0 && wait_time < max_wait_time) {
-        drones_not_at_reassembly = 0;
-        
-        // Contar drones que aún no han llegado al punto de re-ensamblaje
-        for (int i = 0; i < system_state.swarm_count; i++) {
-            Swarm* swarm = system_state.swarms[i];
-            if (swarm && swarm->active_count > 0) {
-                pthread_mutex_lock(&swarm->mutex);
-                
-                int ready_count = 0;
-                int flying_count = 0;
-                int destroyed_count = 0;
-                
-                for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                    if (swarm->drones[j]) {
-                        if (swarm->drones[j]->state == DRONE_STATE_READY) {
-                            ready_count++;
-                        } else if (swarm->drones[j]->state == DRONE_STATE_FLYING_TO_TARGET) {
-                            flying_count++;
-                        } else if (swarm->drones[j]->state == DRONE_STATE_DESTROYED) {
-                            destroyed_count++;
-                        } else {
-                            drones_not_at_reassembly++;
-                        }
-                    }
-                }
-                
-                pthread_mutex_unlock(&swarm->mutex);
-                
-                // Mostrar estado detallado cada 5 segundos
-                if (wait_time % 5 == 0) {
-                    log_message("Enjambre %d: %d READY, %d volando, %d destruidos, %d pendientes", 
-                               i, ready_count, flying_count, destroyed_count, drones_not_at_reassembly);
-                }
-            }
-        }
-        
-        if (drones_not_at_reassembly > 0) {
-            // Solo mostrar mensaje cada 5 segundos para evitar spam
-            if (wait_time % 5 == 0) {
-                log_message("Esperando... %d drones aún no han llegado al re-ensamblaje", drones_not_at_reassembly);
-            }
-            sleep(1);
-            wait_time++;
-        }
-    }
-    
-    if (wait_time >= max_wait_time) {
-        log_message("Tiempo de espera agotado, continuando...");
-    } else {
+    phase_barrier_arm(DRONE_STATES_ALL & ~(STATE_BIT(DRONE_STATE_CREATED) | STATE_BIT(DRONE_STATE_READY) |
+                                           STATE_BIT(DRONE_STATE_FLYING_TO_TARGET) | STATE_BIT(DRONE_STATE_DESTROYED)), 0);
+    if (wait_for_phase_barrier(20, "Esperando... %d drones aún no han llegado al re-ensamblaje")) {
         log_message("¡Todos los drones han llegado al punto de re-ensamblaje!");
+    } else {
+        log_message("Tiempo de espera agotado, continuando...");
     }
     
     system_state.phase = 4;
@@ -1169,89 +6116,47 @@ void command_final_attack() {
     log_message("Comando de ataque final confirmado");
 }
 
-// Función para esperar a que todos los drones lleguen al objetivo
+// Función para esperar a que todos los drones lleguen al objetivo: bloquean todos los
+// drones no derribados que aún no están en el objetivo
 void wait_for_all_drones_at_target() {
     log_message("=== FASE 4.1: ESPERANDO A QUE TODOS LLEGUEN AL OBJETIVO ===");
     
     system_state.phase = 41;
     
-    int drones_not_at_target = 1;
-    int max_wait_time = 30; // Aumentar tiempo de espera
-    int wait_time = 0;
-    
     log_message("Esperando a que los drones lleguen al objetivo...");
     
-    while (drones_not_at_target > 0 && wait_time < max_wait_time) {
-        drones_not_at_target = 0;
-        int total_active_drones = 0;
-        int at_target_count_total = 0;
-        
-        // Contar drones que aún no han llegado al objetivo
-        for (int i = 0; i < system_state.swarm_count; i++) {
-            Swarm* swarm = system_state.swarms[i];
-            if (swarm && swarm->active_count > 0) {
-                pthread_mutex_lock(&swarm->mutex);
-                
-                int at_target_count = 0;
-                int flying_count = 0;
-                int destroyed_count = 0;
-                
-                for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                    if (swarm->drones[j]) {
-                        if (swarm->drones[j]->state == DRONE_STATE_AT_TARGET) {
-                            at_target_count++;
-                            at_target_count_total++;
-                        } else if (swarm->drones[j]->state == DRONE_STATE_FLYING_TO_TARGET) {
-                            flying_count++;
-                            drones_not_at_target++;
-                        } else if (swarm->drones[j]->state == DRONE_STATE_DESTROYED) {
-                            destroyed_count++;
-                        } else {
-                            drones_not_at_target++;
-                        }
-                        
-                        if (swarm->drones[j]->state != DRONE_STATE_DESTROYED) {
-                            total_active_drones++;
-                        }
-                    }
-                }
-                
-                pthread_mutex_unlock(&swarm->mutex);
-                
-                // Mostrar estado detallado cada 5 segundos
-                if (wait_time % 5 == 0) {
-                    log_message("Enjambre %d: %d en objetivo, %d volando, %d destruidos", 
-                               i, at_target_count, flying_count, destroyed_count);
-                }
-            }
-        }
-        
-        // SOLO continuar cuando TODOS los drones activos hayan llegado al objetivo
-        if (total_active_drones > 0 && at_target_count_total == total_active_drones) {
-            break;
-        }
-        
-        if (drones_not_at_target > 0) {
-            // Solo mostrar mensaje cada 5 segundos para evitar spam
-            if (wait_time % 5 == 0) {
-                log_message("Esperando... %d drones aún no han llegado al objetivo (%d/%d en objetivo, %.1f%%)", 
-                           drones_not_at_target, at_target_count_total, total_active_drones,
-                           total_active_drones > 0 ? (at_target_count_total * 100.0) / total_active_drones : 0);
-            }
-            sleep(1);
-            wait_time++;
-        }
-    }
-    
-    if (wait_time >= max_wait_time) {
-        log_message("Tiempo de espera agotado, continuando con detonación...");
-    } else {
+    phase_barrier_arm(DRONE_STATES_ALL & ~(STATE_BIT(DRONE_STATE_CREATED) | STATE_BIT(DRONE_STATE_AT_TARGET) |
+                                           STATE_BIT(DRONE_STATE_DESTROYED)), 0);
+    if (wait_for_phase_barrier(30, "Esperando... %d drones aún no han llegado al objetivo")) {
         log_message("¡TODOS los drones han llegado al objetivo! Procediendo con re-ensamblaje...");
+    } else {
+        log_message("Tiempo de espera agotado, continuando con detonación...");
     }
     
     system_state.phase = 42; // Cambiar a fase de re-ensamblaje
 }
 
+// Función para determinar el estado del objetivo según los drones de ataque que detonaron
+TargetState target_outcome_for(int detonated_attack, int required_attacks) {
+    if (detonated_attack > 0 && detonated_attack >= required_attacks) {
+        return TARGET_STATE_DESTROYED;
+    } else if (detonated_attack > 0) {
+        return TARGET_STATE_PARTIAL;
+    }
+    return TARGET_STATE_INTACT;
+}
+
+const char* target_status_for(int detonated_attack, int required_attacks) {
+    switch (target_outcome_for(detonated_attack, required_attacks)) {
+        case TARGET_STATE_DESTROYED:
+            return "DESTRUIDO";
+        case TARGET_STATE_PARTIAL:
+            return "PARCIALMENTE DESTRUIDO";
+        default:
+            return "INTACTO";
+    }
+}
+
 // Función para enviar comando de detonación a todos los drones de ataque
 void command_detonation() {
     log_message("=== FASE 5: ENVIANDO COMANDO DE DETONACIÓN ===");
@@ -1260,53 +6165,57 @@ void command_detonation() {
     
     // Enviar comando de detonación a todos los drones de ataque que están en el objetivo
     for (int i = 0; i < system_state.swarm_count; i++) {
-        Swarm* swarm = system_state.swarms[i];
-        if (swarm && swarm->active_count > 0) {
+        Swarm* swarm = &system_state.swarms[i];
+        int attack_in_position = swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_AT_TARGET) +
+                                 swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_REASSEMBLED);
+        int camera_in_position = swarm_count(swarm, DRONE_TYPE_CAMERA, DRONE_STATE_AT_TARGET) +
+                                 swarm_count(swarm, DRONE_TYPE_CAMERA, DRONE_STATE_REASSEMBLED);
+        // El histograma dice de antemano si hay algo que hacer en este enjambre
+        if (swarm->active_count > 0 && (attack_in_position > 0 || camera_in_position > 0)) {
             pthread_mutex_lock(&swarm->mutex);
             
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (swarm->drones[j] && 
-                    (swarm->drones[j]->state == DRONE_STATE_AT_TARGET || 
-                     swarm->drones[j]->state == DRONE_STATE_REASSEMBLED)) {
+            // Primero detonan los drones de ataque...
+            for (int j = 0; j < swarm->size && attack_in_position > 0; j++) {
+                Drone* drone = swarm_drone(swarm, j);
+                if (drone->type == DRONE_TYPE_ATTACK &&
+                    (drone_state(drone) == DRONE_STATE_AT_TARGET || drone_state(drone) == DRONE_STATE_REASSEMBLED)) {
+                    // Enviar comando de detonación a drones de ataque
+                    drone_set_state(drone, DRONE_STATE_DETONATED);
+                    log_message("Drone de ataque %d detonó en objetivo", drone->id);
+                    send_event(EVT_DETONATED, drone->id, drone->swarm_id, drone->truck_id, "DETONATED");
+                    attack_in_position--;
+                }
+            }
+            int detonated_attack = swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_DETONATED);
+            
+            // ...y luego los drones cámara reportan el resultado
+            for (int j = 0; j < swarm->size && camera_in_position > 0; j++) {
+                Drone* drone = swarm_drone(swarm, j);
+                if (drone->type == DRONE_TYPE_CAMERA &&
+                    (drone_state(drone) == DRONE_STATE_AT_TARGET || drone_state(drone) == DRONE_STATE_REASSEMBLED)) {
+                    // Drone cámara hace reporte final del estado del objetivo
+                    log_message("Drone cámara %d haciendo reporte final del estado del objetivo", drone->id);
                     
-                    if (swarm->drones[j]->type == DRONE_TYPE_ATTACK) {
-                        // Enviar comando de detonación a drones de ataque
-                        swarm->drones[j]->state = DRONE_STATE_DETONATED;
-                        log_message("Drone de ataque %d detonó en objetivo", swarm->drones[j]->id);
-                        send_event(EVT_DETONATED, swarm->drones[j]->id, swarm->drones[j]->swarm_id, swarm->drones[j]->truck_id, "DETONATED");
-                        
-                    } else if (swarm->drones[j]->type == DRONE_TYPE_CAMERA) {
-                        // Drone cámara hace reporte final del estado del objetivo
-                        log_message("Drone cámara %d haciendo reporte final del estado del objetivo", swarm->drones[j]->id);
-                        
-                        // Contar drones de ataque que detonaron para determinar estado del objetivo
-                        int detonated_attack = 0;
-                        for (int k = 0; k < ATTACK_DRONES_PER_SWARM; k++) {
-                            if (swarm->drones[k] && swarm->drones[k]->state == DRONE_STATE_DETONATED) {
-                                detonated_attack++;
-                            }
-                        }
-                        
-                        // Determinar estado del objetivo según drones que detonaron
-                        const char* target_status;
-                        if (detonated_attack >= 4) {
-                            target_status = "OBJETIVO DESTRUIDO";
-                        } else if (detonated_attack > 0) {
-                            target_status = "OBJETIVO PARCIALMENTE DESTRUIDO";
-                        } else {
-                            target_status = "OBJETIVO INTACTO";
-                        }
-                        
-                        // Enviar reporte con el estado del objetivo
-                        send_event(EVT_CAM_REPORT_OK, swarm->drones[j]->id, swarm->drones[j]->swarm_id, swarm->drones[j]->truck_id, target_status);
-                        
-                        log_message("Drone cámara %d reporta: %s (%d drones de ataque detonaron)", 
-                                   swarm->drones[j]->id, target_status, detonated_attack);
-                        
-                        // Drone cámara completa misión y se autodestruye después del reporte
-                        swarm->drones[j]->state = DRONE_STATE_MISSION_COMPLETE;
-                        log_message("Drone cámara %d se autodestruye después de completar su misión", swarm->drones[j]->id);
+                    // Determinar estado del objetivo según drones que detonaron
+                    const char* target_status;
+                    if (detonated_attack > 0 && detonated_attack >= swarm->attack_quota) {
+                        target_status = "OBJETIVO DESTRUIDO";
+                    } else if (detonated_attack > 0) {
+                        target_status = "OBJETIVO PARCIALMENTE DESTRUIDO";
+                    } else {
+                        target_status = "OBJETIVO INTACTO";
                     }
+                    
+                    // Enviar reporte con el estado del objetivo
+                    send_event(EVT_CAM_REPORT_OK, drone->id, drone->swarm_id, drone->truck_id, target_status);
+                    
+                    log_message("Drone cámara %d reporta: %s (%d drones de ataque detonaron)", 
+                               drone->id, target_status, detonated_attack);
+                    
+                    // Drone cámara completa misión y se autodestruye después del reporte
+                    drone_set_state(drone, DRONE_STATE_MISSION_COMPLETE);
+                    log_message("Drone cámara %d se autodestruye después de completar su misión", drone->id);
+                    camera_in_position--;
                 }
             }
             
@@ -1319,107 +6228,91 @@ void command_detonation() {
     // ESTADO FINAL: Mostrar estado de cada enjambre, cada dron y estado del objetivo
     log_message("=== ESTADO FINAL DE LA SIMULACIÓN ===");
     
-    // Mostrar estado de cada objetivo
+    // Mostrar estado de cada objetivo: se suman todos los enjambres asignados a él
     log_message("=== ESTADO DE LOS OBJETIVOS ===");
-    for (int i = 0; i < NUM_TARGETS; i++) {
-        // Buscar qué enjambre ataca este objetivo según las asignaciones aleatorias
-        int attacking_swarm = -1;
-        for (int j = 0; j < system_state.swarm_count; j++) {
-            if (system_state.target_assignments[j] == i) {
-                attacking_swarm = j;
-                break;
-            }
+    int* detonated_by_target = calloc(system_state.target_count, sizeof(int));
+    int* camera_by_target = calloc(system_state.target_count, sizeof(int));
+    int* attackers_by_target = calloc(system_state.target_count, sizeof(int));
+    int* first_attacker = malloc(sizeof(int) * system_state.target_count);
+    int* alive_attackers = calloc(system_state.target_count, sizeof(int));
+    
+    for (int i = 0; i < system_state.target_count; i++) {
+        first_attacker[i] = -1;
+    }
+    
+    for (int j = 0; j < system_state.swarm_count; j++) {
+        Swarm* swarm = &system_state.swarms[j];
+        int target_id = system_state.target_assignments[j];
+        
+        if (first_attacker[target_id] < 0) {
+            first_attacker[target_id] = j;
+        }
+        attackers_by_target[target_id]++;
+        if (swarm->active_count <= 0) {
+            continue;
         }
+        alive_attackers[target_id]++;
         
-        if (attacking_swarm >= 0) {
-            Swarm* swarm = system_state.swarms[attacking_swarm];
-            if (swarm && swarm->active_count > 0) {
-                int detonated_attack = 0;
-                int camera_active = 0;
-                
-                pthread_mutex_lock(&swarm->mutex);
-                
-                // Contar drones de ataque que detonaron en ESTE enjambre
-                for (int k = 0; k < ATTACK_DRONES_PER_SWARM; k++) {
-                    if (swarm->drones[k] && swarm->drones[k]->state == DRONE_STATE_DETONATED) {
-                        detonated_attack++;
-                    }
-                }
-                
-                // Verificar si el drone cámara completó su misión (no fue destruido por torretas)
-                for (int k = ATTACK_DRONES_PER_SWARM; k < DRONES_PER_SWARM; k++) {
-                    if (swarm->drones[k] && swarm->drones[k]->state == DRONE_STATE_MISSION_COMPLETE) {
-                        camera_active = 1;
-                    }
-                }
-                
-                pthread_mutex_unlock(&swarm->mutex);
-                
-                // Determinar estado del objetivo
-                const char* target_status;
-                const char* confirmation_status = camera_active ? "CONFIRMADO" : "SIN CONFIRMAR";
-                
-                if (detonated_attack >= 4) {
-                    target_status = "DESTRUIDO";
-                } else if (detonated_attack > 0) {
-                    target_status = "PARCIALMENTE DESTRUIDO";
-                } else {
-                    target_status = "INTACTO";
-                }
-                
+        // Drones de ataque que detonaron en ESTE enjambre, y si algún drone cámara
+        // completó su misión (no fue destruido por torretas)
+        detonated_by_target[target_id] += swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_DETONATED);
+        if (swarm_count(swarm, DRONE_TYPE_CAMERA, DRONE_STATE_MISSION_COMPLETE) > 0) {
+            camera_by_target[target_id] = 1;
+        }
+    }
+    
+    for (int i = 0; i < system_state.target_count; i++) {
+        int attacking_swarm = first_attacker[i];
+        
+        // Guardar el resultado para las estadísticas del modo lote
+        system_state.target_outcome[i] = -1;
+        system_state.target_confirmed[i] = camera_by_target[i] ? 1 : 0;
+        
+        if (attacking_swarm >= 0 && alive_attackers[i] > 0) {
+            system_state.target_outcome[i] = target_outcome_for(detonated_by_target[i], system_state.targets[i].required_attacks);
+            const char* target_status = target_status_for(detonated_by_target[i], system_state.targets[i].required_attacks);
+            const char* confirmation_status = camera_by_target[i] ? "CONFIRMADO" : "SIN CONFIRMAR";
+            
+            if (attackers_by_target[i] == 1) {
                 log_message("Objetivo %d: %s %s (%d drones de ataque detonaron) - Atacado por enjambre %d", 
-                           i, target_status, confirmation_status, detonated_attack, attacking_swarm);
+                           i, target_status, confirmation_status, detonated_by_target[i], attacking_swarm);
             } else {
-                log_message("Objetivo %d: ESTADO DESCONOCIDO (enjambre %d destruido)", i, attacking_swarm);
+                log_message("Objetivo %d: %s %s (%d drones de ataque detonaron) - Atacado por enjambre %d y %d más", 
+                           i, target_status, confirmation_status, detonated_by_target[i], attacking_swarm,
+                           attackers_by_target[i] - 1);
             }
+        } else if (attacking_swarm >= 0) {
+            log_message("Objetivo %d: ESTADO DESCONOCIDO (enjambre %d destruido)", i, attacking_swarm);
         } else {
             log_message("Objetivo %d: SIN ASIGNAR", i);
         }
     }
     
+    free(detonated_by_target);
+    free(camera_by_target);
+    free(attackers_by_target);
+    free(first_attacker);
+    free(alive_attackers);
+    
     log_message("=== ESTADO DE LOS ENJAMBRES ===");
     
     for (int i = 0; i < system_state.swarm_count; i++) {
-        Swarm* swarm = system_state.swarms[i];
-        if (swarm && swarm->active_count > 0) {
-            int attack_drones = 0;
-            int camera_drones = 0;
-            int destroyed_attack = 0;
-            int destroyed_camera = 0;
-            
-            pthread_mutex_lock(&swarm->mutex);
-            
-            // Contar estado de cada dron en el enjambre
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (swarm->drones[j]) {
-                    if (swarm->drones[j]->state == DRONE_STATE_DESTROYED) {
-                        if (j < ATTACK_DRONES_PER_SWARM) {
-                            destroyed_attack++;
-                        } else {
-                            destroyed_camera++;
-                        }
-                    } else if (swarm->drones[j]->state == DRONE_STATE_DETONATED) {
-                        // Los drones detonados no cuentan como activos
-                        if (j < ATTACK_DRONES_PER_SWARM) {
-                            destroyed_attack++;
-                        }
-                    } else if (swarm->drones[j]->state == DRONE_STATE_MISSION_COMPLETE) {
-                        // Los drones cámara que completaron misión no cuentan como activos
-                        if (j >= ATTACK_DRONES_PER_SWARM) {
-                            destroyed_camera++;
-                        }
-                    } else if (swarm->drones[j]->state != DRONE_STATE_FLYING_TO_TARGET) {
-                        // Solo contar como activos los que no están volando al objetivo
-                        if (j < ATTACK_DRONES_PER_SWARM) {
-                            attack_drones++;
-                        } else {
-                            camera_drones++;
-                        }
-                    }
-                }
-            }
-            
-            pthread_mutex_unlock(&swarm->mutex);
+        Swarm* swarm = &system_state.swarms[i];
+        if (swarm->active_count > 0) {
+            // Los detonados (ataque) y los que completaron misión (cámara) no cuentan como
+            // activos; tampoco los que aún vuelan al objetivo
+            int destroyed_attack = swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_DESTROYED) +
+                                   swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_DETONATED);
+            int destroyed_camera = swarm_count(swarm, DRONE_TYPE_CAMERA, DRONE_STATE_DESTROYED) +
+                                   swarm_count(swarm, DRONE_TYPE_CAMERA, DRONE_STATE_MISSION_COMPLETE);
+            int attack_drones = swarm_count_alive(swarm, DRONE_TYPE_ATTACK) -
+                                swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_DETONATED) -
+                                swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_MISSION_COMPLETE) -
+                                swarm_count(swarm, DRONE_TYPE_ATTACK, DRONE_STATE_FLYING_TO_TARGET);
+            int camera_drones = swarm_count_alive(swarm, DRONE_TYPE_CAMERA) -
+                                swarm_count(swarm, DRONE_TYPE_CAMERA, DRONE_STATE_DETONATED) -
+                                swarm_count(swarm, DRONE_TYPE_CAMERA, DRONE_STATE_MISSION_COMPLETE) -
+                                swarm_count(swarm, DRONE_TYPE_CAMERA, DRONE_STATE_FLYING_TO_TARGET);
             
             // Mostrar estado del enjambre
             log_message("Enjambre %d: %d ataque activos, %d cámara activos, %d ataque destruidos, %d cámara destruidos", 
@@ -1427,158 +6320,197 @@ void command_detonation() {
             
             // Mostrar estado de cada dron individual
             pthread_mutex_lock(&swarm->mutex);
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (swarm->drones[j]) {
-                    const char* drone_type = (j < ATTACK_DRONES_PER_SWARM) ? "ATAQUE" : "CÁMARA";
-                    const char* drone_status;
-                    
-                    // Estados más claros y descriptivos
-                    switch (swarm->drones[j]->state) {
-                        case DRONE_STATE_DESTROYED:
-                            drone_status = "DESTRUIDO";
-                            break;
-                        case DRONE_STATE_DETONATED:
-                            drone_status = "DETONÓ EN OBJETIVO";
-                            break;
-                        case DRONE_STATE_MISSION_COMPLETE:
-                            drone_status = "MISIÓN COMPLETADA";
-                            break;
-                        case DRONE_STATE_AT_TARGET:
-                            drone_status = "EN OBJETIVO";
-                            break;
-                        case DRONE_STATE_REASSEMBLED:
-                            drone_status = "RE-ENSAMBLADO";
-                            break;
-                        case DRONE_STATE_FLYING_TO_TARGET:
-                            drone_status = "VOLANDO AL OBJETIVO";
-                            break;
-                        case DRONE_STATE_READY:
-                            drone_status = "EN PUNTO DE ENSAMBLAJE";
-                            break;
-                        case DRONE_STATE_CIRCLING_ASSEMBLY:
-                            drone_status = "PATRULLANDO EN CÍRCULOS";
-                            break;
-                        default:
-                            drone_status = "ESTADO DESCONOCIDO";
-                            break;
-                    }
-                    
-                    // Agregar estado de comunicación
-                    const char* comm_status = swarm->drones[j]->communication_active ? "COMUNICACIÓN ACTIVA" : "COMUNICACIÓN PERDIDA";
-                    
-                    log_message("  Drone %d (%s): %s | %s", swarm->drones[j]->id, drone_type, drone_status, comm_status);
+            for (int j = 0; j < swarm->size; j++) {
+                Drone* drone = swarm_drone(swarm, j);
+                const char* drone_type = (drone->type == DRONE_TYPE_ATTACK) ? "ATAQUE" : "CÁMARA";
+                const char* drone_status;
+                
+                // Estados más claros y descriptivos
+                switch (drone_state(drone)) {
+                    case DRONE_STATE_DESTROYED:
+                        drone_status = "DESTRUIDO";
+                        break;
+                    case DRONE_STATE_DETONATED:
+                        drone_status = "DETONÓ EN OBJETIVO";
+                        break;
+                    case DRONE_STATE_MISSION_COMPLETE:
+                        drone_status = "MISIÓN COMPLETADA";
+                        break;
+                    case DRONE_STATE_AT_TARGET:
+                        drone_status = "EN OBJETIVO";
+                        break;
+                    case DRONE_STATE_REASSEMBLED:
+                        drone_status = "RE-ENSAMBLADO";
+                        break;
+                    case DRONE_STATE_FLYING_TO_TARGET:
+                        drone_status = "VOLANDO AL OBJETIVO";
+                        break;
+                    case DRONE_STATE_READY:
+                        drone_status = "EN PUNTO DE ENSAMBLAJE";
+                        break;
+                    case DRONE_STATE_CIRCLING_ASSEMBLY:
+                        drone_status = "PATRULLANDO EN CÍRCULOS";
+                        break;
+                    default:
+                        drone_status = "ESTADO DESCONOCIDO";
+                        break;
+                }
+                
+                // Agregar estado de comunicación
+                const char* comm_status = drone->communication_active ? "COMUNICACIÓN ACTIVA" : "COMUNICACIÓN PERDIDA";
+                
+                log_message("  Drone %d (%s): %s | %s", drone->id, drone_type, drone_status, comm_status);
+            }
+            pthread_mutex_unlock(&swarm->mutex);
+        }
+    }
+}
+
+// Función para resolver una asignación de costo mínimo (método húngaro con potenciales,
+// O(filas^2 * columnas)). cost es filas x columnas con filas <= columnas; devuelve en
+// row_to_col la columna de cada fila.
+void hungarian_assign(const double* cost, int rows, int cols, int* row_to_col) {
+    double* u = calloc(rows + 1, sizeof(double));
+    double* v = calloc(cols + 1, sizeof(double));
+    double* min_slack = malloc(sizeof(double) * (cols + 1));
+    int* col_row = calloc(cols + 1, sizeof(int)); // Fila asignada a cada columna (1..rows, 0 = libre)
+    int* way = malloc(sizeof(int) * (cols + 1));
+    uint8_t* used = malloc(cols + 1);
+    
+    for (int row = 1; row <= rows; row++) {
+        col_row[0] = row;
+        int col0 = 0;
+        for (int c = 0; c <= cols; c++) {
+            min_slack[c] = INFINITY;
+            used[c] = 0;
+        }
+        
+        // Camino aumentante más barato desde la fila nueva hasta una columna libre
+        do {
+            used[col0] = 1;
+            int row0 = col_row[col0], col1 = 0;
+            double delta = INFINITY;
+            for (int c = 1; c <= cols; c++) {
+                if (used[c]) continue;
+                double slack = cost[(row0 - 1) * cols + (c - 1)] - u[row0] - v[c];
+                if (slack < min_slack[c]) {
+                    min_slack[c] = slack;
+                    way[c] = col0;
+                }
+                if (min_slack[c] < delta) {
+                    delta = min_slack[c];
+                    col1 = c;
                 }
             }
-            pthread_mutex_unlock(&swarm->mutex);
-        }
+            for (int c = 0; c <= cols; c++) {
+                if (used[c]) {
+                    u[col_row[c]] += delta;
+                    v[c] -= delta;
+                } else {
+                    min_slack[c] -= delta;
+                }
+            }
+            col0 = col1;
+        } while (col_row[col0] != 0);
+        
+        do {
+            int col1 = way[col0];
+            col_row[col0] = col_row[col1];
+            col0 = col1;
+        } while (col0 != 0);
     }
+    
+    for (int c = 1; c <= cols; c++) {
+        if (col_row[c] > 0) row_to_col[col_row[c] - 1] = c - 1;
+    }
+    free(u);
+    free(v);
+    free(min_slack);
+    free(col_row);
+    free(way);
+    free(used);
 }
 
-// Función auxiliar para extraer drones de un enjambre específico con asignación exclusiva
-int try_extract_drones_from_swarm_exclusive(Swarm* target_swarm, int source_swarm_id, int* needed_attack, int* needed_camera, int target_swarm_id, int* drones_reassigned) {
-    Swarm* source_swarm = system_state.swarms[source_swarm_id];
-    if (!source_swarm) {
-        return 0;
+// Función para emparejar la oferta con la demanda de un tipo de drone minimizando la
+// distancia total. Hasta REASSEMBLY_OPTIMAL_MAX unidades por lado resuelve la asignación
+// óptima; por encima, cada hueco toma el drone libre más cercano. Deja en match la
+// demanda asignada a cada oferta (-1 = se queda) y devuelve 1 si la solución es óptima.
+int reassembly_match(const ReassemblyUnit* supply, int supply_count,
+                     const ReassemblyUnit* demand, int demand_count, int* match) {
+    for (int s = 0; s < supply_count; s++) match[s] = -1;
+    if (supply_count == 0 || demand_count == 0) {
+        return 1;
     }
     
-    // Verificar si el enjambre fuente está completo (4 ataque + 1 cámara = 5 drones activos)
-    int source_attack_drones = 0;
-    int source_camera_drones = 0;
-    
-    pthread_mutex_lock(&source_swarm->mutex);
-    
-    for (int j = 0; j < DRONES_PER_SWARM; j++) {
-        if (source_swarm->drones[j] && source_swarm->drones[j]->state != DRONE_STATE_DESTROYED) {
-            if (j < ATTACK_DRONES_PER_SWARM) {
-                source_attack_drones++;
+    if (supply_count <= REASSEMBLY_OPTIMAL_MAX && demand_count <= REASSEMBLY_OPTIMAL_MAX) {
+        // Las filas son el lado más chico: sobran columnas, nunca filas
+        int by_demand = demand_count <= supply_count;
+        int rows = by_demand ? demand_count : supply_count;
+        int cols = by_demand ? supply_count : demand_count;
+        double* cost = calloc((size_t)rows * cols, sizeof(double));
+        int* row_to_col = malloc(sizeof(int) * rows);
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+                const ReassemblyUnit* a = by_demand ? &demand[r] : &supply[r];
+                const ReassemblyUnit* b = by_demand ? &supply[c] : &demand[c];
+                cost[r * cols + c] = calculate_distance(a->pos, b->pos);
+            }
+        }
+        hungarian_assign(cost, rows, cols, row_to_col);
+        for (int r = 0; r < rows; r++) {
+            if (by_demand) {
+                match[row_to_col[r]] = r;
             } else {
-                source_camera_drones++;
+                match[r] = row_to_col[r];
             }
         }
+        free(cost);
+        free(row_to_col);
+        return 1;
     }
     
-    // Solo extraer de enjambres INCOMPLETOS (regla 1: no extraer de enjambres completos)
-    if (source_attack_drones == ATTACK_DRONES_PER_SWARM && source_camera_drones == 1) {
-        pthread_mutex_unlock(&source_swarm->mutex);
-        return 0; // Es un enjambre completo, no extraer
-    }
-    
-    // Solo extraer drones EXCEDENTES (que no empeoren el enjambre fuente)
-    int excess_attack = 0;
-    int excess_camera = 0;
-    
-    if (source_attack_drones > ATTACK_DRONES_PER_SWARM) {
-        excess_attack = source_attack_drones - ATTACK_DRONES_PER_SWARM;
-    }
-    if (source_camera_drones > 1) {
-        excess_camera = source_camera_drones - 1;
-    }
-    
-    // Si no hay excedentes, no extraer
-    if (excess_attack == 0 && excess_camera == 0) {
-        pthread_mutex_unlock(&source_swarm->mutex);
-        return 0;
-    }
-    
-    pthread_mutex_unlock(&source_swarm->mutex);
-    
-    int drones_extracted = 0;
-    pthread_mutex_lock(&source_swarm->mutex);
-    
-    // Buscar drones disponibles del tipo que necesitamos
-    for (int j = 0; j < DRONES_PER_SWARM && (*needed_attack > 0 || *needed_camera > 0); j++) {
-        if (source_swarm->drones[j] && 
-            source_swarm->drones[j]->state == DRONE_STATE_AT_TARGET &&
-            !drones_reassigned[source_swarm->drones[j]->id]) { // Verificar que no haya sido re-asignado (regla 2)
-            
-            DroneType drone_type = source_swarm->drones[j]->type;
-            
-            if ((drone_type == DRONE_TYPE_ATTACK && *needed_attack > 0 && excess_attack > 0) ||
-                (drone_type == DRONE_TYPE_CAMERA && *needed_camera > 0 && excess_camera > 0)) {
-                
-                // Marcar este drone como re-asignado para evitar conflictos (regla 2)
-                drones_reassigned[source_swarm->drones[j]->id] = 1;
-                
-                // Transferir drone (mantener en estado AT_TARGET ya que está en el objetivo)
-                source_swarm->drones[j]->swarm_id = target_swarm_id;
-                
-                // Encontrar posición vacía en el enjambre destino
-                for (int m = 0; m < DRONES_PER_SWARM; m++) {
-                    if (!target_swarm->drones[m] || target_swarm->drones[m]->state == DRONE_STATE_DESTROYED) {
-                        target_swarm->drones[m] = source_swarm->drones[j];
-                        source_swarm->drones[j] = NULL;
-                        source_swarm->active_count--;
-                        target_swarm->active_count++;
-                        
-                        if (drone_type == DRONE_TYPE_ATTACK) {
-                            (*needed_attack)--;
-                            excess_attack--;
-                        } else {
-                            (*needed_camera)--;
-                            excess_camera--;
-                        }
-                        
-                        drones_extracted++;
-                        
-                        log_message("Drone %d (Tipo: %s) transferido del enjambre %d al enjambre %d", 
-                                   target_swarm->drones[m]->id, 
-                                   drone_type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA", 
-                                   source_swarm_id, target_swarm_id);
-                        break;
-                    }
-                }
+    for (int d = 0; d < demand_count; d++) {
+        int best = -1;
+        double best_distance = INFINITY;
+        for (int s = 0; s < supply_count; s++) {
+            if (match[s] >= 0) continue;
+            double distance = calculate_distance(supply[s].pos, demand[d].pos);
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = s;
             }
         }
+        if (best < 0) break; // Sin oferta libre
+        match[best] = d;
+    }
+    return 0;
+}
+
+// Función para mover un drone ya elegido de su enjambre a otro (bloquea ambos enjambres
+// en orden de id)
+int reassembly_transfer(int drone_id, Swarm* source, Swarm* target) {
+    Swarm* first = source->id < target->id ? source : target;
+    Swarm* second = source->id < target->id ? target : source;
+    pthread_mutex_lock(&first->mutex);
+    pthread_mutex_lock(&second->mutex);
+    
+    int transferred = 0;
+    for (int j = 0; j < source->size; j++) {
+        if (source->members[j] == drone_id) {
+            transferred = swarm_transfer_drone(source, j, target) != NULL;
+            break;
+        }
     }
     
-    pthread_mutex_unlock(&source_swarm->mutex);
-    return drones_extracted;
+    pthread_mutex_unlock(&second->mutex);
+    pthread_mutex_unlock(&first->mutex);
+    return transferred;
 }
 
 // Función auxiliar para extraer drones de un enjambre específico (versión original para compatibilidad)
 int try_extract_drones_from_swarm(Swarm* target_swarm, int source_swarm_id, int* needed_attack, int* needed_camera, int target_swarm_id) {
-    Swarm* source_swarm = system_state.swarms[source_swarm_id];
-    if (!source_swarm || source_swarm->active_count <= DRONES_PER_SWARM) {
+    Swarm* source_swarm = &system_state.swarms[source_swarm_id];
+    if (source_swarm->active_count <= source_swarm->attack_quota + source_swarm->camera_quota) {
         return 0; // No se puede extraer de enjambres completos
     }
     
@@ -1586,40 +6518,35 @@ int try_extract_drones_from_swarm(Swarm* target_swarm, int source_swarm_id, int*
     pthread_mutex_lock(&source_swarm->mutex);
     
     // Buscar drones disponibles del tipo que necesitamos
-    for (int j = 0; j < DRONES_PER_SWARM && (*needed_attack > 0 || *needed_camera > 0); j++) {
-        if (source_swarm->drones[j] && source_swarm->drones[j]->state == DRONE_STATE_READY) {
-            DroneType drone_type = source_swarm->drones[j]->type;
+    int j = 0;
+    while (j < source_swarm->size && (*needed_attack > 0 || *needed_camera > 0)) {
+        Drone* drone = swarm_drone(source_swarm, j);
+        
+        if (drone_state(drone) == DRONE_STATE_READY) {
+            DroneType drone_type = drone->type;
             
             if ((drone_type == DRONE_TYPE_ATTACK && *needed_attack > 0) ||
                 (drone_type == DRONE_TYPE_CAMERA && *needed_camera > 0)) {
                 
                 // Transferir drone
-                source_swarm->drones[j]->swarm_id = target_swarm_id;
-                source_swarm->drones[j]->target = target_swarm->reassembly_point;
-                source_swarm->drones[j]->state = DRONE_STATE_FLYING_TO_ASSEMBLY;
-                
-                // Encontrar posición vacía en el enjambre destino
-                for (int m = 0; m < DRONES_PER_SWARM; m++) {
-                    if (!target_swarm->drones[m] || target_swarm->drones[m]->state == DRONE_STATE_DESTROYED) {
-                        target_swarm->drones[m] = source_swarm->drones[j];
-                        source_swarm->drones[j] = NULL;
-                        source_swarm->active_count--;
-                        target_swarm->active_count++;
-                        
-                        if (drone_type == DRONE_TYPE_ATTACK) (*needed_attack)--;
-                        else (*needed_camera)--;
-                        
-                        drones_extracted++;
-                        
-                        log_message("Drone %d (Tipo: %s) transferido del enjambre %d al enjambre %d", 
-                                   target_swarm->drones[m]->id, 
-                                   drone_type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA", 
-                                   source_swarm_id, target_swarm_id);
-                        break;
-                    }
+                if (swarm_transfer_drone(source_swarm, j, target_swarm)) {
+                    drone_set_target(drone, target_swarm->reassembly_point);
+                    drone_set_state(drone, DRONE_STATE_FLYING_TO_ASSEMBLY);
+                    
+                    if (drone_type == DRONE_TYPE_ATTACK) (*needed_attack)--;
+                    else (*needed_camera)--;
+                    
+                    drones_extracted++;
+                    
+                    log_message("Drone %d (Tipo: %s) transferido del enjambre %d al enjambre %d", 
+                               drone->id, 
+                               drone_type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA", 
+                               source_swarm_id, target_swarm_id);
+                    continue; // La posición j ahora tiene otro drone
                 }
             }
         }
+        j++;
     }
     
     pthread_mutex_unlock(&source_swarm->mutex);
@@ -1630,43 +6557,33 @@ int try_extract_drones_from_swarm(Swarm* target_swarm, int source_swarm_id, int*
 void handle_reassembly() {
     log_message("=== FASE 4.2: MANEJANDO RE-ENSAMBLAJE ===");
     
+    // Los enjambres se rearman: las cuentas del motor dejan de valer
+    retask_engine_stop();
+    
     system_state.phase = 42;
     
     // Primera pasada: identificar enjambres incompletos y completos
-    int incomplete_swarms[MAX_DRONES / DRONES_PER_SWARM];
-    int complete_swarms[MAX_DRONES / DRONES_PER_SWARM];
+    int* incomplete_swarms = malloc(sizeof(int) * (system_state.swarm_count + 1));
     int incomplete_count = 0;
     int complete_count = 0;
     
     for (int i = 0; i < system_state.swarm_count; i++) {
-        Swarm* swarm = system_state.swarms[i];
-        if (swarm && swarm->active_count > 0) {
-            int active_drones = 0;
-            int attack_drones = 0;
-            int camera_drones = 0;
-            
+        Swarm* swarm = &system_state.swarms[i];
+        if (swarm->active_count > 0) {
             pthread_mutex_lock(&swarm->mutex);
             
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (swarm->drones[j] && swarm->drones[j]->state != DRONE_STATE_DESTROYED) {
-                    active_drones++;
-                    if (j < ATTACK_DRONES_PER_SWARM) {
-                        attack_drones++;
-                    } else {
-                        camera_drones++;
-                    }
-                }
-            }
+            int attack_drones = swarm_count_alive(swarm, DRONE_TYPE_ATTACK);
+            int camera_drones = swarm_count_alive(swarm, DRONE_TYPE_CAMERA);
             
-            // Un enjambre está completo si tiene exactamente 4 drones de ataque y 1 cámara
-            if (attack_drones == ATTACK_DRONES_PER_SWARM && camera_drones == 1) {
-                complete_swarms[complete_count++] = i;
+            // Un enjambre está completo si tiene exactamente su composición nominal
+            if (attack_drones == swarm->attack_quota && camera_drones == swarm->camera_quota) {
+                complete_count++;
                 log_message("Enjambre %d COMPLETO (%d ataque, %d cámara)", i, attack_drones, camera_drones);
             } else {
                 incomplete_swarms[incomplete_count++] = i;
                 log_message("Enjambre %d INCOMPLETO (%d ataque, %d cámara) - necesita %d ataque, %d cámara", 
                            i, attack_drones, camera_drones, 
-                           ATTACK_DRONES_PER_SWARM - attack_drones, 1 - camera_drones);
+                           swarm->attack_quota - attack_drones, swarm->camera_quota - camera_drones);
             }
             
             pthread_mutex_unlock(&swarm->mutex);
@@ -1678,116 +6595,91 @@ void handle_reassembly() {
     // Si no hay enjambres incompletos, no hay nada que hacer
     if (incomplete_count == 0) {
         log_message("Todos los enjambres están completos, no se requiere re-ensamblaje");
+        free(incomplete_swarms);
         return;
     }
     
-    // Array para marcar drones que ya han sido re-asignados (regla 2: asignación exclusiva)
-    int drones_reassigned[100] = {0}; // Asumiendo máximo 100 drones
-    
-    // Segunda pasada: re-ensamblar cada enjambre incompleto de forma independiente
-    for (int idx = 0; idx < incomplete_count; idx++) {
-        int i = incomplete_swarms[idx];
-        Swarm* swarm = system_state.swarms[i];
-        
-        if (!swarm) continue;
-        
-        pthread_mutex_lock(&swarm->mutex);
-        
-        // Contar qué tipos de drones necesitamos
-        int needed_attack = 0;
-        int needed_camera = 0;
-        
-        for (int j = 0; j < DRONES_PER_SWARM; j++) {
-            if (!swarm->drones[j] || swarm->drones[j]->state == DRONE_STATE_DESTROYED) {
-                if (j < ATTACK_DRONES_PER_SWARM) {
-                    needed_attack++;
-                } else {
-                    needed_camera++;
+    // Segunda pasada, por tipo de drone: la oferta son los excedentes en el objetivo de los
+    // enjambres incompletos (nunca se toca un enjambre completo y cada drone se mueve a lo
+    // sumo una vez) y la demanda los huecos, ubicados en el objetivo del enjambre que los
+    // tiene, que es donde se re-ensambla. Se emparejan por distancia real.
+    ReassemblyUnit* supply = malloc(sizeof(ReassemblyUnit) * system_state.drone_capacity);
+    ReassemblyUnit* demand = malloc(sizeof(ReassemblyUnit) * system_state.drone_capacity);
+    int* match = malloc(sizeof(int) * system_state.drone_capacity);
+    double total_distance = 0.0;
+    int total_transferred = 0;
+    
+    for (int type = DRONE_TYPE_ATTACK; type <= DRONE_TYPE_CAMERA; type++) {
+        int supply_count = 0;
+        int demand_count = 0;
+        for (int idx = 0; idx < incomplete_count; idx++) {
+            Swarm* swarm = &system_state.swarms[incomplete_swarms[idx]];
+            Position rendezvous = system_state.targets[system_state.target_assignments[swarm->id]].pos;
+            
+            pthread_mutex_lock(&swarm->mutex);
+            int quota = type == DRONE_TYPE_ATTACK ? swarm->attack_quota : swarm->camera_quota;
+            int balance = swarm_count_alive(swarm, type) - quota;
+            for (; balance < 0; balance++) {
+                demand[demand_count++] = (ReassemblyUnit){swarm->id, -1, rendezvous};
+            }
+            for (int j = 0; j < swarm->size && balance > 0; j++) {
+                Drone* drone = swarm_drone(swarm, j);
+                if ((int)drone->type == type && drone_state(drone) == DRONE_STATE_AT_TARGET) {
+                    supply[supply_count++] = (ReassemblyUnit){swarm->id, drone->id, drone_position(drone)};
+                    balance--;
                 }
             }
+            pthread_mutex_unlock(&swarm->mutex);
         }
         
-        if (needed_attack > 0 || needed_camera > 0) {
-            log_message("Enjambre %d necesita %d drones de ataque y %d drones cámara", 
-                       i, needed_attack, needed_camera);
-            
-            // Búsqueda alternada entre vecinos izquierda y derecha
-            int search_radius = 1;
-            int drones_found = 0;
-            
-            while (drones_found < (needed_attack + needed_camera) && search_radius <= system_state.swarm_count) {
-                // Buscar en enjambres vecinos (izquierda y derecha)
-                int left_swarm = i - search_radius;
-                int right_swarm = i + search_radius;
-                
-                // Buscar a la izquierda
-                if (left_swarm >= 0) {
-                    log_message("Enjambre %d solicitando drones al enjambre vecino izquierdo %d", i, left_swarm);
-                    drones_found += try_extract_drones_from_swarm_exclusive(swarm, left_swarm, &needed_attack, &needed_camera, i, drones_reassigned);
-                }
-                
-                // Buscar a la derecha
-                if (right_swarm < system_state.swarm_count) {
-                    log_message("Enjambre %d solicitando drones al enjambre vecino derecho %d", i, right_swarm);
-                    drones_found += try_extract_drones_from_swarm_exclusive(swarm, right_swarm, &needed_attack, &needed_camera, i, drones_reassigned);
-                }
-                
-                // Si no se encontraron drones en los vecinos inmediatos, buscar en enjambres más lejanos
-                if (drones_found == 0) {
-                    search_radius++;
-                } else {
-                    break; // Se encontraron drones, no buscar más lejos
-                }
+        int optimal = reassembly_match(supply, supply_count, demand, demand_count, match);
+        int transferred = 0;
+        double distance = 0.0;
+        for (int s = 0; s < supply_count; s++) {
+            if (match[s] < 0) continue;
+            Swarm* source = &system_state.swarms[supply[s].swarm];
+            Swarm* target = &system_state.swarms[demand[match[s]].swarm];
+            if (reassembly_transfer(supply[s].drone, source, target)) {
+                double moved = calculate_distance(supply[s].pos, demand[match[s]].pos);
+                transferred++;
+                distance += moved;
+                log_message("Drone %d (Tipo: %s) transferido del enjambre %d al enjambre %d (%.1f unidades)",
+                           supply[s].drone, type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA",
+                           source->id, target->id, moved);
             }
-            
-            log_message("Enjambre %d completado con %d drones transferidos", i, drones_found);
         }
         
-        pthread_mutex_unlock(&swarm->mutex);
+        log_message("Re-ensamblaje %s: %d huecos, %d excedentes, %d transferidos, %.1f unidades (%s)",
+                   type == DRONE_TYPE_ATTACK ? "ATAQUE" : "CÁMARA", demand_count, supply_count,
+                   transferred, distance, optimal ? "asignación óptima" : "voraz por cercanía");
+        total_transferred += transferred;
+        total_distance += distance;
     }
+    log_message("Distancia total de reposicionamiento: %.1f unidades (%d drones transferidos)",
+               total_distance, total_transferred);
+    
+    free(supply);
+    free(demand);
+    free(match);
+    free(incomplete_swarms);
     
     // Tercera pasada: cambiar estado de todos los drones a REASSEMBLED
+    // (se recorre el conjunto de bits de AT_TARGET, no toda la flota)
     log_message("Cambiando estado de todos los drones a REASSEMBLED...");
-    for (int i = 0; i < system_state.swarm_count; i++) {
-        Swarm* swarm = system_state.swarms[i];
-        if (swarm && swarm->active_count > 0) {
-            pthread_mutex_lock(&swarm->mutex);
-            
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (swarm->drones[j] && swarm->drones[j]->state == DRONE_STATE_AT_TARGET) {
-                    swarm->drones[j]->state = DRONE_STATE_REASSEMBLED;
-                }
-            }
-            
-            pthread_mutex_unlock(&swarm->mutex);
-        }
+    for (int id = fleet_next_in_state(DRONE_STATE_AT_TARGET, 0); id >= 0;
+         id = fleet_next_in_state(DRONE_STATE_AT_TARGET, id + 1)) {
+        drone_set_state(&system_state.drones[id], DRONE_STATE_REASSEMBLED);
     }
     
     log_message("Re-ensamblaje completado, todos los drones están listos para la detonación");
     
     // Mostrar estado final de cada enjambre
     for (int i = 0; i < system_state.swarm_count; i++) {
-        Swarm* swarm = system_state.swarms[i];
-        if (swarm && swarm->active_count > 0) {
-            int attack_count = 0;
-            int camera_count = 0;
-            int destroyed_count = 0;
-            
-            pthread_mutex_lock(&swarm->mutex);
-            
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (swarm->drones[j]) {
-                    if (swarm->drones[j]->state == DRONE_STATE_DESTROYED) {
-                        destroyed_count++;
-                    } else if (j < ATTACK_DRONES_PER_SWARM) {
-                        attack_count++;
-                    } else {
-                        camera_count++;
-                    }
-                }
-            }
-            
-            pthread_mutex_unlock(&swarm->mutex);
+        Swarm* swarm = &system_state.swarms[i];
+        if (swarm->active_count > 0) {
+            int attack_count = swarm_count_alive(swarm, DRONE_TYPE_ATTACK);
+            int camera_count = swarm_count_alive(swarm, DRONE_TYPE_CAMERA);
+            int destroyed_count = swarm_count_state(swarm, DRONE_STATE_DESTROYED);
             
             log_message("Enjambre %d final: %d ataque, %d cámara, %d destruidos", 
                        i, attack_count, camera_count, destroyed_count);
@@ -1797,45 +6689,52 @@ void handle_reassembly() {
 
 // Función para procesar eventos
 void process_events() {
-    while (system_state.event_count > 0) {
-        pthread_mutex_lock(&system_state.system_mutex);
-        
-        Event* event = &system_state.event_queue[system_state.event_head];
-        system_state.event_head = (system_state.event_head + 1) % MAX_EVENTS;
-        system_state.event_count--;
-        
-        pthread_mutex_unlock(&system_state.system_mutex);
-        
-        // Procesar evento según su tipo
-        switch (event->type) {
-            case EVT_READY:
-                log_message("Drone %d reporta READY", event->drone_id);
-                break;
-                
-            case EVT_AT_TARGET:
-                log_message("Drone %d llegó al objetivo", event->drone_id);
-                break;
-                
-            case EVT_DETONATED:
-                log_message("Drone %d detonó exitosamente", event->drone_id);
-                // Incrementar contador de ataques al objetivo
-                break;
-                
-            case EVT_CAM_REPORT_OK:
-                log_message("Drone cámara %d reporta: %s", event->drone_id, event->data);
-                break;
-                
-            case EVT_CAM_REPORT_FAIL:
-                log_message("Drone cámara %d falló en reportar", event->drone_id);
-                break;
-                
-            case EVT_DESTROYED:
-                log_message("Drone %d fue destruido", event->drone_id);
-                break;
-                
-            case EVT_FUEL_EMPTY:
-                log_message("Drone %d se quedó sin combustible", event->drone_id);
-                break;
+    Event batch[EVENT_BATCH];
+    int count;
+    
+    while ((count = event_queue_pop_batch(&system_state.events, batch, EVENT_BATCH)) > 0) {
+        for (int k = 0; k < count; k++) {
+            Event* event = &batch[k];
+            
+            // Procesar evento según su tipo
+            switch (event->type) {
+                case EVT_READY:
+                    log_at(LOG_INFO, LOG_CAT_EVENTS, "Drone %d reporta READY", event->drone_id);
+                    break;
+                    
+                case EVT_AT_TARGET:
+                    log_at(LOG_INFO, LOG_CAT_EVENTS, "Drone %d llegó al objetivo", event->drone_id);
+                    break;
+                    
+                case EVT_DETONATED:
+                    log_at(LOG_INFO, LOG_CAT_EVENTS, "Drone %d detonó exitosamente", event->drone_id);
+                    // Incrementar contador de ataques al objetivo
+                    break;
+                    
+                case EVT_CAM_REPORT_OK:
+                    if (event->drone_id < 0) {
+                        log_at(LOG_INFO, LOG_CAT_EVENTS, "Reporte del operador: objetivo confirmado");
+                    } else {
+                        log_at(LOG_INFO, LOG_CAT_EVENTS, "Drone cámara %d reporta: %s", event->drone_id, event->data);
+                    }
+                    break;
+                    
+                case EVT_CAM_REPORT_FAIL:
+                    if (event->drone_id < 0) {
+                        log_at(LOG_INFO, LOG_CAT_EVENTS, "Reporte del operador: objetivo sin confirmar");
+                    } else {
+                        log_at(LOG_INFO, LOG_CAT_EVENTS, "Drone cámara %d falló en reportar", event->drone_id);
+                    }
+                    break;
+                    
+                case EVT_DESTROYED:
+                    log_at(LOG_INFO, LOG_CAT_EVENTS, "Drone %d fue destruido", event->drone_id);
+                    break;
+                    
+                case EVT_FUEL_EMPTY:
+                    log_at(LOG_INFO, LOG_CAT_EVENTS, "Drone %d se quedó sin combustible", event->drone_id);
+                    break;
+            }
         }
     }
 }
@@ -1846,104 +6745,477 @@ void check_simulation_status() {
     int completed_swarms = 0;
     
     for (int i = 0; i < system_state.swarm_count; i++) {
-        Swarm* swarm = system_state.swarms[i];
-        if (swarm) {
-            int swarm_active = 0;
-            for (int j = 0; j < DRONES_PER_SWARM; j++) {
-                if (swarm->drones[j] && swarm->drones[j]->state != DRONE_STATE_DESTROYED) {
-                    swarm_active++;
-                }
+        Swarm* swarm = &system_state.swarms[i];
+        int swarm_active = swarm->size - swarm_count_state(swarm, DRONE_STATE_DESTROYED);
+        if (swarm_active == 0) {
+            completed_swarms++;
+        }
+        active_drones += swarm_active;
+    }
+    
+    // Solo marcar como completada si ya pasamos por la fase de detonación
+    if (completed_swarms == system_state.swarm_count && system_state.phase >= 5) {
+        log_message("=== SIMULACIÓN COMPLETADA ===");
+        stop_simulation();
+    }
+    
+    // Solo mostrar estado cuando hay cambios significativos
+    static int last_active_drones = -1;
+    static int last_completed_swarms = -1;
+    
+    if (active_drones != last_active_drones || completed_swarms != last_completed_swarms) {
+        log_message("Estado: %d drones activos, %d enjambres completados", 
+                   active_drones, completed_swarms);
+        last_active_drones = active_drones;
+        last_completed_swarms = completed_swarms;
+    }
+}
+
+// Función principal del centro de comando
+void command_center() {
+    log_message("Centro de Comando iniciado");
+    
+    // ===== FASE 1: ENSAMBLAJE Y OPTIMIZACIÓN =====
+    // (una misión restaurada ya tiene los enjambres y sigue desde su etapa)
+    int from_start = checkpoint.resume == STAGE_ASSEMBLY;
+    if (from_start) {
+        log_phase_header("FASE 1: ENSAMBLAJE Y OPTIMIZACIÓN");
+        create_swarms();
+    }
+    start_tick_scheduler(checkpoint.resume_tick);
+    start_command_interpreter();
+    
+    // Esperar a que todos los enjambres estén listos
+    if (from_start) {
+        log_sub_phase("Esperando a que todos los enjambres estén listos");
+        wait_for_all_swarms_ready();
+    }
+    
+    // ===== FASE 2: ATAQUE Y CRUCE DE ZONA DE DEFENSA =====
+    if (mission_stage(STAGE_ATTACK)) {
+        log_phase_header("FASE 2: ATAQUE Y CRUCE DE ZONA DE DEFENSA");
+        command_global_attack();
+    }
+    
+    // ===== FASE 3: CRUZANDO ZONA DE DEFENSA =====
+    if (mission_stage(STAGE_DEFENSE)) {
+        log_phase_header("FASE 3: CRUZANDO ZONA DE DEFENSA");
+        wait_for_defense_zone_crossing();
+    }
+    
+    // ===== FASE 4: ATAQUE FINAL =====
+    if (mission_stage(STAGE_FINAL_ATTACK)) {
+        log_phase_header("FASE 4: ATAQUE FINAL");
+        command_final_attack();
+        
+        // ===== FASE 4.1: ESPERANDO A QUE TODOS LLEGUEN AL OBJETIVO =====
+        log_sub_phase("Esperando a que todos los drones lleguen al objetivo");
+        wait_for_all_drones_at_target();
+    }
+    
+    // ===== FASE 4.2: RE-ENSAMBLAJE ANTES DE LA DETONACIÓN =====
+    if (mission_stage(STAGE_REASSEMBLY)) {
+        log_phase_header("FASE 4.2: RE-ENSAMBLAJE ANTES DE LA DETONACIÓN");
+        handle_reassembly();
+    }
+    
+    // ===== FASE 5: DETONACIÓN =====
+    mission_stage(STAGE_DETONATION);
+    log_phase_header("FASE 5: DETONACIÓN");
+    command_detonation();
+    
+    // Esperar a que se complete la detonación
+    log_sub_phase("Esperando a que se complete la detonación");
+    sim_sleep_ticks(2 * TICKS_PER_SECOND);
+    
+    // Marcar simulación como completada después de la detonación
+    log_phase_header("SIMULACIÓN COMPLETADA");
+    log_status("Simulación completada. Terminando...");
+    stop_simulation();
+    
+    // Procesar eventos finales una vez más
+    process_events();
+    replay_finish();
+    event_queue_log_stats(&system_state.events);
+    
+    log_status("Centro de Comando finalizado");
+}
+
+// Función para interpretar los valores de un parámetro del barrido:
+// "inicio:fin:paso" (paso 1 si se omite) o una lista "a,b,c"
+int parse_sweep_values(SweepParameter* parameter, const char* spec) {
+    int start, end, step = 1;
+    parameter->count = 0;
+    
+    if (sscanf(spec, "%d:%d:%d", &start, &end, &step) >= 2 && strchr(spec, ':')) {
+        if (step == 0 || (end - start) / step < 0) {
+            return -1;
+        }
+        for (int v = start; (step > 0 ? v <= end : v >= end) && parameter->count < SWEEP_MAX_VALUES; v += step) {
+            parameter->values[parameter->count++] = v;
+        }
+        return 0;
+    }
+    
+    const char* cursor = spec;
+    while (*cursor && *cursor != '\n' && parameter->count < SWEEP_MAX_VALUES) {
+        char* next;
+        long value = strtol(cursor, &next, 10);
+        if (next == cursor) {
+            return -1;
+        }
+        parameter->values[parameter->count++] = (int)value;
+        cursor = *next == ',' ? next + 1 : next;
+    }
+    return parameter->count > 0 ? 0 : -1;
+}
+
+// Función para reservar lugar para un registro más en un arreglo del escenario
+void* scenario_push(void** items, int* capacity, uint32_t count, size_t size) {
+    if ((int)count >= *capacity) {
+        int grown = *capacity > 0 ? *capacity * 2 : 64;
+        void* resized = realloc(*items, size * grown);
+        if (!resized) {
+            return NULL;
+        }
+        *items = resized;
+        *capacity = grown;
+    }
+    return (char*)*items + size * count;
+}
+
+// Función para verificar que ningún tipo de entidad del escenario pasa del máximo
+int scenario_counts_valid(const ScenarioHeader* header, const char* path) {
+    if (header->truck_count > SCENARIO_MAX_ENTITIES || header->target_count > SCENARIO_MAX_ENTITIES ||
+        header->defense_count > SCENARIO_MAX_ENTITIES || header->swarm_count > SCENARIO_MAX_ENTITIES) {
+        log_error("Error: %s: más de %d camiones, objetivos, defensas o enjambres", path, SCENARIO_MAX_ENTITIES);
+        return 0;
+    }
+    return 1;
+}
+
+// Función para leer los enteros que siguen a la palabra clave de una línea del escenario.
+// Devuelve cuántos leyó, o -1 si sobra texto que no es un comentario.
+int scenario_read_ints(const char* cursor, int32_t* values, int max) {
+    int count = 0;
+    while (count < max) {
+        char* next;
+        long value = strtol(cursor, &next, 10);
+        if (next == cursor) break;
+        values[count++] = (int32_t)value;
+        cursor = next;
+    }
+    while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n') cursor++;
+    return *cursor == '\0' || *cursor == '#' ? count : -1;
+}
+
+// Función para leer un escenario de texto, una entidad por línea:
+//   map W H | zones ensamble defensa_inicio defensa_fin re-ensamble
+//   truck x y [ax ay rx ry] | target x y [ataques] | defense x y [W [alcance]]
+//   swarm camión ataque cámara
+int scenario_load_text(FILE* file, const char* path) {
+    ScenarioHeader* header = &scenario.header;
+    char line[512];
+    int line_number = 0;
+    
+    header->map_width = MAP_WIDTH;
+    header->map_height = MAP_HEIGHT;
+    header->assembly_y = header->defense_start = header->defense_end = header->reassembly_y = -1;
+    
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char* word = line;
+        while (*word == ' ' || *word == '\t') word++;
+        if (*word == '#' || *word == '\n' || *word == '\r' || *word == '\0') continue;
+        
+        char* cursor = word;
+        while (*cursor && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r') cursor++;
+        size_t length = cursor - word;
+        int32_t v[6];
+        int n = scenario_read_ints(cursor, v, 6);
+        void* record = NULL;
+        
+        if (length == 3 && strncmp(word, "map", 3) == 0 && n == 2) {
+            header->map_width = v[0];
+            header->map_height = v[1];
+            continue;
+        } else if (length == 5 && strncmp(word, "zones", 5) == 0 && n == 4) {
+            header->assembly_y = v[0];
+            header->defense_start = v[1];
+            header->defense_end = v[2];
+            header->reassembly_y = v[3];
+            continue;
+        } else if (length == 5 && strncmp(word, "truck", 5) == 0 && (n == 2 || n == 6)) {
+            ScenarioTruck* truck = record = scenario_push((void**)&scenario.trucks, &scenario.capacity[0],
+                                                          header->truck_count, sizeof(ScenarioTruck));
+            if (truck) {
+                *truck = n == 6 ? (ScenarioTruck){v[0], v[1], v[2], v[3], v[4], v[5]}
+                                : (ScenarioTruck){v[0], v[1], -1, -1, -1, -1};
+                header->truck_count++;
+            }
+        } else if (length == 6 && strncmp(word, "target", 6) == 0 && (n == 2 || n == 3)) {
+            ScenarioTarget* target = record = scenario_push((void**)&scenario.targets, &scenario.capacity[1],
+                                                            header->target_count, sizeof(ScenarioTarget));
+            if (target) {
+                *target = (ScenarioTarget){v[0], v[1], n == 3 ? v[2] : 0};
+                header->target_count++;
+            }
+        } else if (length == 7 && strncmp(word, "defense", 7) == 0 && n >= 2 && n <= 4) {
+            ScenarioDefense* defense = record = scenario_push((void**)&scenario.defenses, &scenario.capacity[2],
+                                                              header->defense_count, sizeof(ScenarioDefense));
+            if (defense) {
+                *defense = (ScenarioDefense){v[0], v[1], n >= 3 ? v[2] : -1, n == 4 ? v[3] : -1};
+                header->defense_count++;
             }
-            if (swarm_active == 0) {
-                completed_swarms++;
+        } else if (length == 5 && strncmp(word, "swarm", 5) == 0 && n == 3) {
+            ScenarioSwarm* swarm = record = scenario_push((void**)&scenario.swarms, &scenario.capacity[3],
+                                                          header->swarm_count, sizeof(ScenarioSwarm));
+            if (swarm) {
+                *swarm = (ScenarioSwarm){v[0], v[1], v[2]};
+                header->swarm_count++;
             }
-            active_drones += swarm_active;
+        } else {
+            line[strcspn(line, "\r\n")] = '\0';
+            log_error("Error: %s:%d: línea de escenario inválida: %s", path, line_number, word);
+            return -1;
+        }
+        
+        if (!record) {
+            log_error("Error: sin memoria para el escenario %s", path);
+            return -1;
+        }
+        if (!scenario_counts_valid(header, path)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Función para leer un arreglo de registros del escenario binario
+int scenario_read_array(FILE* file, void** items, uint32_t count, size_t size) {
+    if (count == 0) return 0;
+    *items = malloc(size * count);
+    return *items && fread(*items, size, count, file) == count ? 0 : -1;
+}
+
+// Función para leer un escenario binario (ver ScenarioHeader)
+int scenario_load_binary(FILE* file, const char* path) {
+    ScenarioHeader* header = &scenario.header;
+    if (fread(header, sizeof(*header), 1, file) != 1 || header->version != SCENARIO_VERSION) {
+        log_error("Error: %s: versión de escenario binario no soportada", path);
+        return -1;
+    }
+    // Las cuentas vienen del archivo: se validan antes de reservar los arreglos
+    if (!scenario_counts_valid(header, path)) {
+        return -1;
+    }
+    if (scenario_read_array(file, (void**)&scenario.trucks, header->truck_count, sizeof(ScenarioTruck)) != 0 ||
+        scenario_read_array(file, (void**)&scenario.targets, header->target_count, sizeof(ScenarioTarget)) != 0 ||
+        scenario_read_array(file, (void**)&scenario.defenses, header->defense_count, sizeof(ScenarioDefense)) != 0 ||
+        scenario_read_array(file, (void**)&scenario.swarms, header->swarm_count, sizeof(ScenarioSwarm)) != 0) {
+        log_error("Error: %s: escenario binario truncado", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Función para verificar que un punto del escenario está dentro del mapa
+int scenario_point_valid(int x, int y) {
+    return x >= 0 && x <= scenario.header.map_width && y >= 0 && y <= scenario.header.map_height;
+}
+
+// Función para completar los valores por defecto del escenario y validarlo
+int scenario_finalize(const char* path) {
+    ScenarioHeader* header = &scenario.header;
+    if (header->map_width < 1 || header->map_width > SCENARIO_MAX_MAP ||
+        header->map_height < 1 || header->map_height > SCENARIO_MAX_MAP) {
+        log_error("Error: %s: mapa de %dx%d fuera de rango (máximo %d)", path,
+                  header->map_width, header->map_height, SCENARIO_MAX_MAP);
+        return -1;
+    }
+    
+    // Zonas no indicadas: las de siempre, escaladas a la altura del mapa
+    if (header->assembly_y < 0) header->assembly_y = ASSEMBLY_POINT_Y * header->map_height / MAP_HEIGHT;
+    if (header->defense_start < 0) header->defense_start = DEFENSE_ZONE_START * header->map_height / MAP_HEIGHT;
+    if (header->defense_end < 0) header->defense_end = DEFENSE_ZONE_END * header->map_height / MAP_HEIGHT;
+    if (header->reassembly_y < 0) header->reassembly_y = REASSEMBLY_POINT_Y * header->map_height / MAP_HEIGHT;
+    if (header->assembly_y > header->map_height || header->reassembly_y > header->map_height ||
+        header->defense_start > header->defense_end || header->defense_end > header->map_height) {
+        log_error("Error: %s: zonas fuera del mapa o desordenadas", path);
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < header->truck_count; i++) {
+        ScenarioTruck* truck = &scenario.trucks[i];
+        if (truck->assembly_x < 0) {
+            truck->assembly_x = truck->x;
+            truck->assembly_y = header->assembly_y;
+        }
+        if (truck->reassembly_x < 0) {
+            truck->reassembly_x = truck->x;
+            truck->reassembly_y = header->reassembly_y;
+        }
+        if (!scenario_point_valid(truck->x, truck->y) || !scenario_point_valid(truck->assembly_x, truck->assembly_y) ||
+            !scenario_point_valid(truck->reassembly_x, truck->reassembly_y)) {
+            log_error("Error: %s: camión %u fuera del mapa", path, i);
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < header->target_count; i++) {
+        if (!scenario_point_valid(scenario.targets[i].x, scenario.targets[i].y) || scenario.targets[i].required_attacks < 0) {
+            log_error("Error: %s: objetivo %u inválido", path, i);
+            return -1;
         }
     }
-    
-    // Solo marcar como completada si ya pasamos por la fase de detonación
-    if (completed_swarms == system_state.swarm_count && system_state.phase >= 5) {
-        log_message("=== SIMULACIÓN COMPLETADA ===");
-        system_state.simulation_running = 0;
+    for (uint32_t i = 0; i < header->defense_count; i++) {
+        ScenarioDefense* defense = &scenario.defenses[i];
+        if (!scenario_point_valid(defense->x, defense->y) || defense->probability < -1 || defense->probability > 100 ||
+            defense->range < -1) {
+            log_error("Error: %s: defensa %u inválida", path, i);
+            return -1;
+        }
     }
-    
-    // Solo mostrar estado cuando hay cambios significativos
-    static int last_active_drones = -1;
-    static int last_completed_swarms = -1;
-    
-    if (active_drones != last_active_drones || completed_swarms != last_completed_swarms) {
-        log_message("Estado: %d drones activos, %d enjambres completados", 
-                   active_drones, completed_swarms);
-        last_active_drones = active_drones;
-        last_completed_swarms = completed_swarms;
+    for (uint32_t i = 0; i < header->swarm_count; i++) {
+        ScenarioSwarm* swarm = &scenario.swarms[i];
+        if (swarm->truck < 0 || swarm->attack < 0 || swarm->camera < 0 || swarm->attack + swarm->camera < 1) {
+            log_error("Error: %s: enjambre %u inválido", path, i);
+            return -1;
+        }
     }
+    return 0;
 }
 
-// Función principal del centro de comando
-void command_center() {
-    log_message("Centro de Comando iniciado");
-    
-    // ===== FASE 1: ENSAMBLAJE Y OPTIMIZACIÓN =====
-    log_phase_header("FASE 1: ENSAMBLAJE Y OPTIMIZACIÓN");
-    create_swarms();
-    
-    // Esperar a que todos los enjambres estén listos
-    log_sub_phase("Esperando a que todos los enjambres estén listos");
-    wait_for_all_swarms_ready();
-    
-    // ===== FASE 2: ATAQUE Y CRUCE DE ZONA DE DEFENSA =====
-    log_phase_header("FASE 2: ATAQUE Y CRUCE DE ZONA DE DEFENSA");
-    command_global_attack();
-    
-    // ===== FASE 3: CRUZANDO ZONA DE DEFENSA =====
-    log_phase_header("FASE 3: CRUZANDO ZONA DE DEFENSA");
-    wait_for_defense_zone_crossing();
-    
-    // ===== FASE 4: ATAQUE FINAL =====
-    log_phase_header("FASE 4: ATAQUE FINAL");
-    command_final_attack();
-    
-    // ===== FASE 4.1: ESPERANDO A QUE TODOS LLEGUEN AL OBJETIVO =====
-    log_sub_phase("Esperando a que todos los drones lleguen al objetivo");
-    wait_for_all_drones_at_target();
-    
-    // ===== FASE 4.2: RE-ENSAMBLAJE ANTES DE LA DETONACIÓN =====
-    log_phase_header("FASE 4.2: RE-ENSAMBLAJE ANTES DE LA DETONACIÓN");
-    handle_reassembly();
-    
-    // ===== FASE 5: DETONACIÓN =====
-    log_phase_header("FASE 5: DETONACIÓN");
-    command_detonation();
-    
-    // Esperar a que se complete la detonación
-    log_sub_phase("Esperando a que se complete la detonación");
-    sleep(2);
-    
-    // Marcar simulación como completada después de la detonación
-    log_phase_header("SIMULACIÓN COMPLETADA");
-    log_status("Simulación completada. Terminando...");
-    system_state.simulation_running = 0;
+// Función para cargar un escenario de texto o binario (se distingue por la firma)
+int scenario_load(const char* path) {
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    
+    // Al repetir una misión se usa el escenario guardado en su registro
+    FILE* file = replay.mode == REPLAY_PLAY && replay.scenario_size > 0 ?
+                 fmemopen(replay.scenario, replay.scenario_size, "rb") : fopen(path, "rb");
+    if (!file) {
+        log_error("Error: No se pudo abrir el escenario %s: %s", path, strerror(errno));
+        return -1;
+    }
     
-    // Procesar eventos finales una vez más
-    process_events();
+    char magic[sizeof(SCENARIO_MAGIC)] = {0};
+    int binary = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                 memcmp(magic, SCENARIO_MAGIC, sizeof(magic)) == 0;
+    rewind(file);
+    int status = binary ? scenario_load_binary(file, path) : scenario_load_text(file, path);
+    fclose(file);
+    if (status != 0 || scenario_finalize(path) != 0) {
+        return -1;
+    }
+    scenario.loaded = 1;
+    
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+    double elapsed_ms = (finished_at.tv_sec - started_at.tv_sec) * 1e3 + (finished_at.tv_nsec - started_at.tv_nsec) / 1e6;
+    log_message("Escenario %s (%s): mapa %dx%d, %u camiones, %u objetivos, %u defensas, %u enjambres en %.2f ms",
+               path, binary ? "binario" : "texto", scenario.header.map_width, scenario.header.map_height,
+               scenario.header.truck_count, scenario.header.target_count, scenario.header.defense_count,
+               scenario.header.swarm_count, elapsed_ms);
+    return 0;
+}
+
+// Función para escribir el escenario cargado en formato binario
+int scenario_write_binary(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        log_error("Error: No se pudo crear %s: %s", path, strerror(errno));
+        return -1;
+    }
     
-    log_status("Centro de Comando finalizado");
+    ScenarioHeader header = scenario.header;
+    memcpy(header.magic, SCENARIO_MAGIC, sizeof(header.magic));
+    header.version = SCENARIO_VERSION;
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(scenario.trucks, sizeof(ScenarioTruck), header.truck_count, file) == header.truck_count &&
+             fwrite(scenario.targets, sizeof(ScenarioTarget), header.target_count, file) == header.target_count &&
+             fwrite(scenario.defenses, sizeof(ScenarioDefense), header.defense_count, file) == header.defense_count &&
+             fwrite(scenario.swarms, sizeof(ScenarioSwarm), header.swarm_count, file) == header.swarm_count;
+    if (fclose(file) != 0 || !ok) {
+        log_error("Error escribiendo el escenario %s", path);
+        return -1;
+    }
+    log_message("Escenario binario escrito en %s", path);
+    return 0;
+}
+
+// Función para aplicar el escenario cargado sobre la configuración: mapa, zonas y la
+// cantidad de cada entidad que lista
+int scenario_apply() {
+    const ScenarioHeader* header = &scenario.header;
+    system_state.map_width = header->map_width;
+    system_state.map_height = header->map_height;
+    system_state.assembly_y = header->assembly_y;
+    system_state.defense_zone_start = header->defense_start;
+    system_state.defense_zone_end = header->defense_end;
+    system_state.reassembly_y = header->reassembly_y;
+    
+    if (header->truck_count > 0) system_state.truck_count = header->truck_count;
+    if (header->target_count > 0) system_state.target_count = header->target_count;
+    if (header->defense_count > 0) system_state.defense_count = header->defense_count;
+    if (header->swarm_count > 0) system_state.swarms_requested = header->swarm_count;
+    
+    for (uint32_t i = 0; i < header->swarm_count; i++) {
+        if (scenario.swarms[i].truck >= system_state.truck_count) {
+            log_error("Error: el enjambre %u del escenario usa el camión %d y hay %d", i,
+                      scenario.swarms[i].truck, system_state.truck_count);
+            return -1;
+        }
+    }
+    return 0;
 }
 
 // Función para cargar configuración
-void load_configuration() {
-    FILE* config_file = fopen("config.txt", "r");
+void load_configuration(const char* path) {
+    // Mapa y zonas de siempre (un escenario puede cambiarlos)
+    system_state.map_width = MAP_WIDTH;
+    system_state.map_height = MAP_HEIGHT;
+    system_state.assembly_y = ASSEMBLY_POINT_Y;
+    system_state.defense_zone_start = DEFENSE_ZONE_START;
+    system_state.defense_zone_end = DEFENSE_ZONE_END;
+    system_state.reassembly_y = REASSEMBLY_POINT_Y;
+    
+    // Al repetir una misión se usa el config.txt guardado en su registro
+    FILE* config_file = replay.mode == REPLAY_PLAY ?
+                        (replay.config_size > 0 ? fmemopen(replay.config, replay.config_size, "r") : NULL) :
+                        fopen(path, "r");
     if (!config_file) {
-        log_message("Error: No se pudo abrir config.txt, usando valores por defecto");
+        log_warn("Aviso: No se pudo abrir %s, usando valores por defecto", replay.mode == REPLAY_PLAY ? replay.path : path);
         system_state.W = 30;
         system_state.Q = 10;
         system_state.Z = 4;
         system_state.speed = 2;
         system_state.initial_fuel = 100;
         system_state.ticks = 1000;
+        system_state.workers = 0;
+        system_state.truck_count = DEFAULT_TRUCKS;
+        system_state.target_count = DEFAULT_TARGETS;
+        system_state.defense_count = NUM_ENEMY_DEFENSES;
+        system_state.defense_range = DEFAULT_DEFENSE_RANGE;
+        system_state.attack_per_swarm = DEFAULT_ATTACK_PER_SWARM;
+        system_state.camera_per_swarm = DEFAULT_CAMERA_PER_SWARM;
+        system_state.event_queue_capacity = DEFAULT_EVENT_QUEUE;
+        system_state.event_overflow = EVENT_OVERFLOW_GROW;
+        system_state.assignment_mode = ASSIGNMENT_RANDOM;
+        system_state.routing_mode = ROUTING_FLOW;
         return;
     }
     
+    // Tamaño de flota por defecto (3 camiones, 3 enjambres 4+1, 3 objetivos)
+    system_state.truck_count = DEFAULT_TRUCKS;
+    system_state.target_count = DEFAULT_TARGETS;
+    system_state.defense_count = NUM_ENEMY_DEFENSES;
+    system_state.defense_range = DEFAULT_DEFENSE_RANGE;
+    system_state.attack_per_swarm = DEFAULT_ATTACK_PER_SWARM;
+    system_state.camera_per_swarm = DEFAULT_CAMERA_PER_SWARM;
+    system_state.event_queue_capacity = DEFAULT_EVENT_QUEUE;
+    system_state.event_overflow = EVENT_OVERFLOW_GROW;
+    system_state.assignment_mode = ASSIGNMENT_RANDOM;
+    system_state.routing_mode = ROUTING_FLOW;
+    
     char line[256];
     while (fgets(line, sizeof(line), config_file)) {
         if (strncmp(line, "W=", 2) == 0) {
@@ -1958,84 +7230,868 @@ void load_configuration() {
             system_state.initial_fuel = atoi(line + 5);
         } else if (strncmp(line, "ticks=", 6) == 0) {
             system_state.ticks = atoi(line + 6);
+        } else if (strncmp(line, "workers=", 8) == 0) {
+            system_state.workers = atoi(line + 8);
+        } else if (strncmp(line, "virtual_time=", 13) == 0) {
+            system_state.virtual_time = atoi(line + 13);
+        } else if (strncmp(line, "event_queue=", 12) == 0) {
+            system_state.event_queue_capacity = atoi(line + 12);
+        } else if (strncmp(line, "assignment=", 11) == 0) {
+            if (strncmp(line + 11, "optimized", 9) == 0) {
+                system_state.assignment_mode = ASSIGNMENT_OPTIMIZED;
+            } else if (strncmp(line + 11, "random", 6) == 0) {
+                system_state.assignment_mode = ASSIGNMENT_RANDOM;
+            } else {
+                log_warn("Aviso: assignment desconocido, usando random");
+            }
+        } else if (strncmp(line, "retasking=", 10) == 0) {
+            retask.enabled = atoi(line + 10);
+        } else if (strncmp(line, "routing=", 8) == 0) {
+            if (strncmp(line + 8, "flow", 4) == 0) {
+                system_state.routing_mode = ROUTING_FLOW;
+            } else if (strncmp(line + 8, "straight", 8) == 0) {
+                system_state.routing_mode = ROUTING_STRAIGHT;
+            } else {
+                log_warn("Aviso: routing desconocido, usando flow");
+            }
+        } else if (strncmp(line, "event_overflow=", 15) == 0) {
+            if (strncmp(line + 15, "block", 5) == 0) {
+                system_state.event_overflow = EVENT_OVERFLOW_BLOCK;
+            } else if (strncmp(line + 15, "drop", 4) == 0) {
+                system_state.event_overflow = EVENT_OVERFLOW_DROP;
+            } else if (strncmp(line + 15, "grow", 4) == 0) {
+                system_state.event_overflow = EVENT_OVERFLOW_GROW;
+            } else {
+                log_warn("Aviso: event_overflow desconocido, usando grow");
+            }
+        } else if (strncmp(line, "batch_runs=", 11) == 0 && !system_state.batch_runs) {
+            system_state.batch_runs = atoi(line + 11);
+        } else if (strncmp(line, "batch_jobs=", 11) == 0 && !system_state.batch_jobs) {
+            system_state.batch_jobs = atoi(line + 11);
+        } else if (strncmp(line, "batch_min_runs=", 15) == 0) {
+            system_state.batch_min_runs = atoi(line + 15);
+        } else if (strncmp(line, "batch_ci=", 9) == 0 && system_state.batch_ci <= 0) {
+            system_state.batch_ci = atof(line + 9);
+        } else if (strncmp(line, "sweep_output=", 13) == 0 && !system_state.sweep_path[0]) {
+            sscanf(line + 13, "%255s", system_state.sweep_path);
+        } else if (strncmp(line, "sweep_mode=", 11) == 0) {
+            system_state.sweep_lhs = strncmp(line + 11, "lhs", 3) == 0;
+        } else if (strncmp(line, "sweep_samples=", 14) == 0) {
+            system_state.sweep_samples = atoi(line + 14);
+        } else if (strncmp(line, "sweep_seeds=", 12) == 0) {
+            system_state.sweep_seeds = atoi(line + 12);
+        } else if (strncmp(line, "sweep_", 6) == 0) {
+            // sweep_<parámetro>=valores (W, Q, Z, speed, fuel)
+            char* equals = strchr(line, '=');
+            int found = 0;
+            for (int p = 0; equals && p < SWEEP_PARAM_COUNT; p++) {
+                if ((size_t)(equals - line - 6) == strlen(sweep_parameters[p].name) &&
+                    strncmp(line + 6, sweep_parameters[p].name, equals - line - 6) == 0) {
+                    found = 1;
+                    if (parse_sweep_values(&sweep_parameters[p], equals + 1) != 0) {
+                        log_warn("Aviso: valores de barrido inválidos para %s, se ignora", sweep_parameters[p].name);
+                    }
+                }
+            }
+            if (!found) {
+                line[strcspn(line, "\n")] = '\0';
+                log_warn("Aviso: parámetro de barrido desconocido: %s", line);
+            }
+        } else if (strncmp(line, "log_level=", 10) == 0) {
+            logger.level = parse_log_level(line + 10);
+        } else if (strncmp(line, "log_categories=", 15) == 0) {
+            logger.category_mask = parse_log_categories(line + 15);
+        } else if (strncmp(line, "log_overflow=", 13) == 0) {
+            logger.drop_when_full = strncmp(line + 13, "drop", 4) == 0;
+        } else if (strncmp(line, "channel=", 8) == 0) {
+            if (strncmp(line + 8, "shm", 3) == 0) {
+                channel.mode = CHANNEL_SHM;
+            } else if (strncmp(line + 8, "fifo", 4) == 0) {
+                channel.mode = CHANNEL_FIFO;
+            } else if (strncmp(line + 8, "none", 4) == 0) {
+                channel.mode = CHANNEL_NONE;
+            } else {
+                log_warn("Aviso: channel desconocido, usando shm");
+            }
+        } else if (strncmp(line, "shm_name=", 9) == 0) {
+            sscanf(line + 9, "%63s", channel.name);
+        } else if (strncmp(line, "commands_stdin=", 15) == 0) {
+            interpreter.read_stdin = atoi(line + 15) != 0;
+        } else if (strncmp(line, "trace=", 6) == 0 && !trace.path[0]) {
+            sscanf(line + 6, "%255s", trace.path);
+        } else if (strncmp(line, "scenario=", 9) == 0 && !scenario.path[0]) {
+            sscanf(line + 9, "%255s", scenario.path);
+        } else if (strncmp(line, "checkpoint=", 11) == 0 && !checkpoint.path[0]) {
+            sscanf(line + 11, "%255s", checkpoint.path);
+        } else if (strncmp(line, "checkpoint_at=", 14) == 0) {
+            MissionStage stage = STAGE_COUNT;
+            for (int st = STAGE_ATTACK; st < STAGE_COUNT; st++) {
+                if (strncmp(line + 14, mission_stage_names[st], strlen(mission_stage_names[st])) == 0) {
+                    stage = (MissionStage)st;
+                }
+            }
+            if (stage == STAGE_COUNT) {
+                log_warn("Aviso: checkpoint_at desconocido, usando reassembly");
+                stage = STAGE_REASSEMBLY;
+            }
+            checkpoint.at = stage;
+        } else if (strncmp(line, "restore=", 8) == 0 && !checkpoint.restore_path[0]) {
+            sscanf(line + 8, "%255s", checkpoint.restore_path);
+        } else if (strncmp(line, "record=", 7) == 0 && !replay.path[0]) {
+            sscanf(line + 7, "%255s", replay.path);
+        } else if (strncmp(line, "seed=", 5) == 0 && !system_state.seed_set) {
+            system_state.seed = strtoull(line + 5, NULL, 0);
+            system_state.seed_set = 1;
+        } else if (strncmp(line, "trucks=", 7) == 0) {
+            system_state.truck_count = atoi(line + 7);
+        } else if (strncmp(line, "targets=", 8) == 0) {
+            system_state.target_count = atoi(line + 8);
+        } else if (strncmp(line, "defenses=", 9) == 0) {
+            system_state.defense_count = atoi(line + 9);
+        } else if (strncmp(line, "defense_range=", 14) == 0) {
+            system_state.defense_range = atoi(line + 14);
+        } else if (strncmp(line, "swarms=", 7) == 0) {
+            system_state.swarms_requested = atoi(line + 7);
+        } else if (strncmp(line, "attack_per_swarm=", 17) == 0) {
+            system_state.attack_per_swarm = atoi(line + 17);
+        } else if (strncmp(line, "camera_per_swarm=", 17) == 0) {
+            system_state.camera_per_swarm = atoi(line + 17);
         }
     }
     
     fclose(config_file);
     
+    // Valores mínimos para una flota válida
+    if (system_state.truck_count < 1) system_state.truck_count = 1;
+    if (system_state.target_count < 1) system_state.target_count = 1;
+    if (system_state.defense_count < 0) system_state.defense_count = 0;
+    if (system_state.defense_range < 0) system_state.defense_range = 0;
+    if (system_state.attack_per_swarm < 0) system_state.attack_per_swarm = 0;
+    if (system_state.camera_per_swarm < 0) system_state.camera_per_swarm = 0;
+    if (system_state.attack_per_swarm + system_state.camera_per_swarm < 1) system_state.attack_per_swarm = 1;
+    if (system_state.event_queue_capacity < 2) system_state.event_queue_capacity = DEFAULT_EVENT_QUEUE;
+    if (system_state.batch_ci <= 0) system_state.batch_ci = DEFAULT_BATCH_CI;
+    if (system_state.batch_min_runs < 2) system_state.batch_min_runs = DEFAULT_BATCH_MIN_RUNS;
+    
     log_message("Configuración cargada: W=%d%%, Q=%d%%, Z=%ds, speed=%d, fuel=%d, ticks=%d",
                system_state.W, system_state.Q, system_state.Z, system_state.speed, 
                system_state.initial_fuel, system_state.ticks);
+    log_message("Flota: %d camiones, %d objetivos, %d enjambres de %d ataque + %d cámara",
+               system_state.truck_count, system_state.target_count,
+               system_state.swarms_requested > 0 ? system_state.swarms_requested : system_state.truck_count,
+               system_state.attack_per_swarm, system_state.camera_per_swarm);
+    log_message("Defensas: %d con alcance %d", system_state.defense_count, system_state.defense_range);
 }
 
 // Función para limpiar recursos
 void cleanup_system() {
     log_message("Limpiando recursos del sistema...");
     
+    // Detener el intérprete de comandos (despierta al centro con el reloj del planificador)
+    stop_command_interpreter();
+    
+    // Detener el planificador y su pool de trabajadores
+    stop_tick_scheduler();
+    
+    // Volcar y cerrar la traza (después del último tick)
+    trace_close();
+    
     // Detener todos los drones
     for (int i = 0; i < system_state.drone_count; i++) {
-        if (system_state.all_drones[i]) {
-            system_state.all_drones[i]->active = 0;
-            
-            // Esperar a que terminen los hilos
-            pthread_join(system_state.all_drones[i]->nav_thread, NULL);
-            pthread_join(system_state.all_drones[i]->fuel_thread, NULL);
-            pthread_join(system_state.all_drones[i]->comm_thread, NULL);
-            pthread_join(system_state.all_drones[i]->payload_thread, NULL);
-            
-            // Cerrar FIFO
-            if (system_state.all_drones[i]->fifo_fd != -1) {
-                close(system_state.all_drones[i]->fifo_fd);
-            }
-            
-            // Destruir mutex y condition variable
-            pthread_mutex_destroy(&system_state.all_drones[i]->mutex);
-            pthread_cond_destroy(&system_state.all_drones[i]->condition);
-            
-            // Liberar memoria
-            free(system_state.all_drones[i]);
+        Drone* drone = &system_state.drones[i];
+        drone->active = 0;
+        
+        // Cerrar FIFO
+        if (drone->fifo_fd != -1) {
+            close(drone->fifo_fd);
         }
+        
     }
     
-    // Liberar enjambres
+    // Destruir mutex de los enjambres
     for (int i = 0; i < system_state.swarm_count; i++) {
-        if (system_state.swarms[i]) {
-            pthread_mutex_destroy(&system_state.swarms[i]->mutex);
-            free(system_state.swarms[i]);
-        }
+        pthread_mutex_destroy(&system_state.swarms[i].mutex);
     }
     
-    // Cerrar FIFO del centro
-    if (system_state.center_fifo_fd != -1) {
-        close(system_state.center_fifo_fd);
-    }
+    // Cerrar el canal de comandos (FIFO del centro o región compartida)
+    channel_close();
     
-    // Destruir mutex y condition variables del sistema
+    // Destruir mutex del sistema
     pthread_mutex_destroy(&system_state.system_mutex);
-    pthread_cond_destroy(&system_state.system_condition);
-    pthread_mutex_destroy(&log_mutex);
+    
+    // Liberar la cola de eventos
+    event_queue_destroy(&system_state.events);
+    
+    // Liberar los campos de flujo (fuera de la arena)
+    flow_planner_release();
+    
+    // Soltar el motor de re-asignación (antes que la arena)
+    retask_engine_release();
+    
+    // Liberar la arena de la flota de una sola vez (salvo que la reutilice la siguiente misión)
+    if (!system_state.reuse_arena) {
+        arena_release(&system_state.arena);
+    }
     
     log_message("Recursos del sistema limpiados");
 }
 
-// Función principal
-int main() {
-    // Inicializar generador de números aleatorios
-    srand(time(NULL));
-    
-    // Cargar configuración
-    load_configuration();
-    
-    // Inicializar sistema
-    initialize_system();
+// Resultado de una corrida del lote (en memoria compartida con el proceso padre)
+typedef struct {
+    int status; // 0 = pendiente, 1 = completada, -1 = falló
+    int drone_count;
+    uint64_t seed;
+    int losses[LOSS_CAUSE_COUNT];
+} BatchRunResult;
+
+// Acumulador de media y varianza (Welford)
+typedef struct {
+    long n;
+    double mean;
+    double m2;
+} RunningStat;
+
+void running_stat_add(RunningStat* stat, double x) {
+    stat->n++;
+    double delta = x - stat->mean;
+    stat->mean += delta / stat->n;
+    stat->m2 += delta * (x - stat->mean);
+}
+
+// Semi-ancho del intervalo de confianza del 95% de la media (aproximación normal)
+double running_stat_half_width(const RunningStat* stat) {
+    if (stat->n < 2) return 1.0;
+    return BATCH_Z95 * sqrt(stat->m2 / (stat->n - 1) / stat->n);
+}
+
+// Intervalo de Wilson del 95% para una proporción de "hits" en "n" corridas
+void wilson_interval(long hits, long n, double* low, double* high) {
+    if (n == 0) {
+        *low = 0.0;
+        *high = 1.0;
+        return;
+    }
+    double p = (double)hits / n;
+    double z2 = BATCH_Z95 * BATCH_Z95;
+    double denominator = 1.0 + z2 / n;
+    double center = (p + z2 / (2.0 * n)) / denominator;
+    double margin = BATCH_Z95 * sqrt(p * (1.0 - p) / n + z2 / (4.0 * n * n)) / denominator;
+    *low = center - margin;
+    *high = center + margin;
+}
+
+// Pérdidas de una causa a lo largo del lote: fracción de la flota por corrida y
+// totales acumulados de drones perdidos sobre drones lanzados
+typedef struct {
+    RunningStat rate;
+    long lost;
+    long fleet;
+} LossStat;
+
+void loss_stat_add(LossStat* stat, int lost, int fleet) {
+    running_stat_add(&stat->rate, (double)lost / fleet);
+    stat->lost += lost;
+    stat->fleet += fleet;
+}
+
+// Intervalo del 95% de la fracción de pérdidas. La aproximación normal sola da límites
+// negativos y un ancho nulo cuando las pérdidas son raras (todas las corridas en 0),
+// así que se toma la unión con el intervalo de Wilson de los drones acumulados y se
+// recorta a [0, 1]
+void loss_interval(const LossStat* stat, double* low, double* high) {
+    double mean = stat->rate.mean;
+    double half = running_stat_half_width(&stat->rate);
+    wilson_interval(stat->lost, stat->fleet, low, high);
+    *low = fmax(0.0, fmin(*low, mean - half));
+    *high = fmin(1.0, fmax(*high, mean + half));
+}
+
+// Función para obtener el resultado de la corrida "run" dentro de la memoria compartida
+BatchRunResult* batch_result(char* results, size_t stride, int run) {
+    return (BatchRunResult*)(results + stride * run);
+}
+
+// Función para ejecutar una misión completa en el proceso actual
+void run_mission() {
+    // Inicializar sistema (o restaurarlo de un punto de control)
+    mission_init();
     
     // Ejecutar centro de comando
     command_center();
     
     // Limpiar recursos
     cleanup_system();
+}
+
+// Función para ejecutar una corrida del lote en un proceso hijo
+void batch_child(int run, char* results, size_t stride) {
+    BatchRunResult* result = batch_result(results, stride, run);
+    int8_t* outcomes = (int8_t*)(result + 1);
+    
+    // Cada hijo arranca su propio hilo de log (los hilos no sobreviven al fork)
+    // y solo muestra errores
+    logger.level = LOG_ERROR;
+    logger.hide_phases = 1;
+    start_logger();
+    
+    // Con restore= cada corrida es una continuación distinta del mismo punto de control:
+    // la imagen se comparte entre los hijos hasta que cada uno escribe sus páginas
+    system_state.seed = result->seed;
+    system_state.seed_set = 1;
+    system_state.virtual_time = 1;
+    trace.path[0] = '\0';
+    checkpoint.path[0] = '\0';
+    channel.mode = CHANNEL_NONE;
+    mission_init();
+    command_center();
+    
+    // Copiar el resultado antes de liberar la arena
+    result->drone_count = system_state.drone_count;
+    for (int c = 0; c < LOSS_CAUSE_COUNT; c++) {
+        result->losses[c] = atomic_load(&system_state.losses[c]);
+    }
+    for (int t = 0; t < system_state.target_count; t++) {
+        outcomes[2 * t] = (int8_t)system_state.target_outcome[t];
+        outcomes[2 * t + 1] = (int8_t)system_state.target_confirmed[t];
+    }
+    result->status = 1;
+    
+    cleanup_system();
+    stop_logger();
+    _exit(EXIT_SUCCESS);
+}
+
+// Función para decidir si los intervalos ya son suficientemente estrechos
+int batch_converged(long completed, long* destroyed, LossStat* losses) {
+    if (completed < system_state.batch_min_runs) {
+        return 0;
+    }
+    for (int t = 0; t < system_state.target_count; t++) {
+        double low, high;
+        wilson_interval(destroyed[t], completed, &low, &high);
+        if ((high - low) / 2.0 > system_state.batch_ci) {
+            return 0;
+        }
+    }
+    for (int c = 0; c < LOSS_CAUSE_COUNT; c++) {
+        double low, high;
+        loss_interval(&losses[c], &low, &high);
+        if ((high - low) / 2.0 > system_state.batch_ci) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Modo lote: N misiones independientes en procesos hijos, con semillas distintas,
+// y estadísticas agregadas por objetivo y por causa de pérdida
+int run_batch() {
+    int runs = system_state.batch_runs;
+    int jobs = system_state.batch_jobs;
+    if (jobs <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cores > 0 ? (int)cores : 1;
+    }
+    if (jobs > runs) {
+        jobs = runs;
+    }
+    // Con una misión por núcleo, cada misión usa un solo hilo salvo que se pida otra cosa
+    if (system_state.workers <= 0) {
+        system_state.workers = 1;
+    }
+    
+    // Resultados en memoria compartida: cabecera más (estado, confirmado) por objetivo
+    size_t stride = (sizeof(BatchRunResult) + 2 * (size_t)system_state.target_count + 7) & ~(size_t)7;
+    size_t size = stride * runs;
+    char* results = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        log_error("Error: No se pudo reservar la memoria del lote: %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    
+    // Semilla de cada corrida derivada de la semilla base
+    for (int run = 0; run < runs; run++) {
+        uint32_t words[4];
+        philox4x32(system_state.seed, (uint32_t)run, 0, RNG_STREAM_BATCH, words);
+        batch_result(results, stride, run)->seed = ((uint64_t)words[1] << 32) | words[0];
+    }
+    
+    // Los hilos no sobreviven al fork: detener el log antes de crear hijos
+    log_message("Lote: %d corridas en %d procesos (semilla base %llu, IC objetivo ±%.1f%%)",
+               runs, jobs, (unsigned long long)system_state.seed, system_state.batch_ci * 100.0);
+    stop_logger();
+    
+    pid_t* pids = calloc(runs, sizeof(pid_t));
+    long* destroyed = calloc(system_state.target_count, sizeof(long));
+    long* partial = calloc(system_state.target_count, sizeof(long));
+    long* intact = calloc(system_state.target_count, sizeof(long));
+    long* confirmed = calloc(system_state.target_count, sizeof(long));
+    LossStat losses[LOSS_CAUSE_COUNT];
+    memset(losses, 0, sizeof(losses));
+    
+    int launched = 0, running = 0, completed = 0, failed = 0, stopped_early = 0;
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    
+    while (running > 0 || (launched < runs && !stopped_early)) {
+        while (running < jobs && launched < runs && !stopped_early) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                batch_child(launched, results, stride);
+            }
+            if (pid < 0) {
+                log_error("Error: fork falló: %s", strerror(errno));
+                break;
+            }
+            pids[launched++] = pid;
+            running++;
+        }
+        if (running == 0) {
+            break;
+        }
+        
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            break;
+        }
+        running--;
+        
+        int run = 0;
+        while (run < launched && pids[run] != pid) run++;
+        BatchRunResult* result = batch_result(results, stride, run);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || result->status != 1) {
+            result->status = -1;
+            failed++;
+            log_message("Corrida %d (semilla %llu): FALLÓ (%s %d)", run, (unsigned long long)result->seed,
+                       WIFSIGNALED(status) ? "señal" : "código", WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+            continue;
+        }
+        
+        // Agregar el resultado de la corrida
+        completed++;
+        int8_t* outcomes = (int8_t*)(result + 1);
+        int destroyed_now = 0;
+        for (int t = 0; t < system_state.target_count; t++) {
+            if (outcomes[2 * t] == TARGET_STATE_DESTROYED) { destroyed[t]++; destroyed_now++; }
+            else if (outcomes[2 * t] == TARGET_STATE_PARTIAL) partial[t]++;
+            else if (outcomes[2 * t] == TARGET_STATE_INTACT) intact[t]++;
+            if (outcomes[2 * t + 1]) confirmed[t]++;
+        }
+        int fleet = result->drone_count > 0 ? result->drone_count : 1;
+        for (int c = 0; c < LOSS_CAUSE_COUNT; c++) {
+            loss_stat_add(&losses[c], result->losses[c], fleet);
+        }
+        log_message("Corrida %d (semilla %llu): %d/%d objetivos destruidos; pérdidas: %d derribados, %d sin comunicación, %d sin combustible",
+                   run, (unsigned long long)result->seed, destroyed_now, system_state.target_count,
+                   result->losses[LOSS_SHOT_DOWN], result->losses[LOSS_COMM_LOST], result->losses[LOSS_FUEL_EMPTY]);
+        
+        if (!stopped_early && batch_converged(completed, destroyed, losses)) {
+            stopped_early = launched < runs;
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+    double elapsed = (finished_at.tv_sec - started_at.tv_sec) + (finished_at.tv_nsec - started_at.tv_nsec) / 1e9;
+    
+    // Informe agregado
+    log_message("=== RESULTADOS DEL LOTE: %d corridas completadas, %d fallidas (%.1f s) ===", completed, failed, elapsed);
+    for (int t = 0; t < system_state.target_count; t++) {
+        double low, high;
+        wilson_interval(destroyed[t], completed, &low, &high);
+        double n = completed > 0 ? completed : 1;
+        log_message("Objetivo %d: DESTRUIDO %.1f%% [IC95 %.1f%%, %.1f%%], PARCIAL %.1f%%, INTACTO %.1f%%, DESCONOCIDO %.1f%%, CONFIRMADO %.1f%%",
+                   t, 100.0 * destroyed[t] / n, 100.0 * low, 100.0 * high,
+                   100.0 * partial[t] / n, 100.0 * intact[t] / n,
+                   100.0 * (completed - destroyed[t] - partial[t] - intact[t]) / n,
+                   100.0 * confirmed[t] / n);
+    }
+    const char* cause_names[LOSS_CAUSE_COUNT] = {"SHOT_DOWN", "COMM_LOST", "FUEL_EMPTY"};
+    for (int c = 0; c < LOSS_CAUSE_COUNT; c++) {
+        double low, high;
+        loss_interval(&losses[c], &low, &high);
+        log_message("Pérdidas %s: %.2f%% de la flota por misión [IC95 %.2f%%, %.2f%%]",
+                   cause_names[c], 100.0 * losses[c].rate.mean, 100.0 * low, 100.0 * high);
+    }
+    if (stopped_early) {
+        log_message("Parada temprana: todos los intervalos dentro de ±%.1f%% tras %d corridas",
+                   system_state.batch_ci * 100.0, completed);
+    }
+    
+    free(pids);
+    free(destroyed);
+    free(partial);
+    free(intact);
+    free(confirmed);
+    munmap(results, size);
+    return failed > 0 && completed == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Estado compartido del barrido entre el padre y los procesos trabajadores
+typedef struct {
+    atomic_long next_task; // Próxima misión a tomar (punto * semillas + repetición)
+    atomic_long completed;
+    long current[]; // Misión en curso de cada trabajador (-1 = ninguna)
+} SweepShared;
+
+// Función para fijar los parámetros del punto "point" del barrido. En rejilla el
+// punto se descompone en base mixta; en hipercubo latino se lee la tabla de índices.
+void sweep_apply_point(long point, const int* lhs_indices, int dimensions) {
+    int d = 0;
+    for (int p = 0; p < SWEEP_PARAM_COUNT; p++) {
+        SweepParameter* parameter = &sweep_parameters[p];
+        if (parameter->count == 0) continue;
+        int index;
+        if (lhs_indices) {
+            index = lhs_indices[point * dimensions + d];
+        } else {
+            index = (int)(point % parameter->count);
+            point /= parameter->count;
+        }
+        *parameter->field = parameter->values[index];
+        d++;
+    }
+}
+
+// Función para armar el hipercubo latino: cada dimensión se parte en "samples"
+// estratos, se permutan al azar y cada punto toma un valor dentro de su estrato
+int* sweep_latin_hypercube(int samples, int dimensions) {
+    int* indices = malloc(sizeof(int) * (size_t)samples * (dimensions > 0 ? dimensions : 1));
+    int* strata = malloc(sizeof(int) * samples);
+    int d = 0;
+    
+    for (int p = 0; p < SWEEP_PARAM_COUNT; p++) {
+        SweepParameter* parameter = &sweep_parameters[p];
+        if (parameter->count == 0) continue;
+        
+        for (int i = 0; i < samples; i++) strata[i] = i;
+        for (int i = 0; i < samples - 1; i++) {
+            int k = i + rng_uniform(RNG_STREAM_SWEEP, (uint32_t)(d * samples + i), samples - i);
+            int tmp = strata[i];
+            strata[i] = strata[k];
+            strata[k] = tmp;
+        }
+        for (int i = 0; i < samples; i++) {
+            // Posición uniforme dentro del estrato, llevada a un índice de la lista de valores
+            uint32_t jitter = rng_uniform(RNG_STREAM_SWEEP, (uint32_t)((dimensions + d) * samples + i), 1u << 16);
+            double u = (strata[i] + jitter / 65536.0) / samples;
+            indices[(size_t)i * dimensions + d] = (int)(u * parameter->count);
+        }
+        d++;
+    }
+    
+    free(strata);
+    return indices;
+}
+
+// Función de cada proceso trabajador del barrido: toma misiones de la cola compartida
+// hasta agotarla, reutilizando el proceso, el hilo de log y la arena entre misiones
+void sweep_worker(int worker, SweepShared* shared, long total, const int* lhs_indices, int dimensions, int csv_fd) {
+    logger.level = LOG_ERROR;
+    logger.hide_phases = 1;
+    start_logger();
+    
+    system_state.virtual_time = 1;
+    system_state.reuse_arena = 1;
+    trace.path[0] = '\0';
+    channel.mode = CHANNEL_NONE;
+    uint64_t base_seed = system_state.seed;
+    
+    long task;
+    while ((task = atomic_fetch_add(&shared->next_task, 1)) < total) {
+        long point = task / system_state.sweep_seeds;
+        int repetition = (int)(task % system_state.sweep_seeds);
+        shared->current[worker] = task;
+        
+        // Misma semilla para la repetición r de todos los puntos (números aleatorios
+        // comunes): las diferencias entre puntos se deben a los parámetros
+        uint32_t words[4];
+        philox4x32(base_seed, (uint32_t)repetition, 0, RNG_STREAM_BATCH, words);
+        system_state.seed = ((uint64_t)words[1] << 32) | words[0];
+        sweep_apply_point(point, lhs_indices, dimensions);
+        
+        initialize_system();
+        command_center();
+        
+        int destroyed = 0, partial = 0, intact = 0, confirmed = 0;
+        for (int t = 0; t < system_state.target_count; t++) {
+            if (system_state.target_outcome[t] == TARGET_STATE_DESTROYED) destroyed++;
+            else if (system_state.target_outcome[t] == TARGET_STATE_PARTIAL) partial++;
+            else if (system_state.target_outcome[t] == TARGET_STATE_INTACT) intact++;
+            if (system_state.target_confirmed[t]) confirmed++;
+        }
+        
+        // Una fila por write(): con O_APPEND las filas de varios procesos no se mezclan
+        char row[512];
+        int length = snprintf(row, sizeof(row), "%ld,%d,%llu,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.4f\n",
+                              point, repetition, (unsigned long long)system_state.seed,
+                              system_state.W, system_state.Q, system_state.Z,
+                              system_state.speed, system_state.initial_fuel, system_state.drone_count,
+                              destroyed, partial, intact, system_state.target_count - destroyed - partial - intact,
+                              confirmed,
+                              atomic_load(&system_state.losses[LOSS_SHOT_DOWN]),
+                              atomic_load(&system_state.losses[LOSS_COMM_LOST]),
+                              atomic_load(&system_state.losses[LOSS_FUEL_EMPTY]),
+                              (double)destroyed / system_state.target_count);
+        if (write(csv_fd, row, length) != length) {
+            log_error("Error escribiendo %s: %s", system_state.sweep_path, strerror(errno));
+        }
+        
+        cleanup_system();
+        shared->current[worker] = -1;
+        atomic_fetch_add(&shared->completed, 1);
+    }
+    
+    arena_release(&system_state.arena);
+    stop_logger();
+    _exit(EXIT_SUCCESS);
+}
+
+// Modo barrido: recorre una rejilla o un hipercubo latino de parámetros de config.txt,
+// con varias semillas por punto, repartiendo las misiones entre procesos trabajadores
+// y escribiendo una fila CSV por misión a medida que terminan
+int run_sweep() {
+    int dimensions = 0;
+    long points = 1;
+    for (int p = 0; p < SWEEP_PARAM_COUNT; p++) {
+        if (sweep_parameters[p].count == 0) continue;
+        dimensions++;
+        if (!system_state.sweep_lhs) {
+            points *= sweep_parameters[p].count;
+        }
+    }
+    if (system_state.sweep_samples < 1) system_state.sweep_samples = DEFAULT_SWEEP_SAMPLES;
+    if (system_state.sweep_seeds < 1) system_state.sweep_seeds = 1;
+    if (system_state.sweep_lhs && dimensions > 0) {
+        points = system_state.sweep_samples;
+    }
+    long total = points * system_state.sweep_seeds;
+    
+    int jobs = system_state.batch_jobs;
+    if (jobs <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cores > 0 ? (int)cores : 1;
+    }
+    if (jobs > total) {
+        jobs = (int)total;
+    }
+    if (system_state.workers <= 0) {
+        system_state.workers = 1;
+    }
+    
+    int csv_fd = open(system_state.sweep_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (csv_fd < 0) {
+        log_error("Error: No se pudo crear %s: %s", system_state.sweep_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const char* header = "punto,repeticion,semilla,W,Q,Z,speed,fuel,drones,destruidos,parciales,intactos,"
+                         "sin_ataque,confirmados,derribados,sin_comunicacion,sin_combustible,exito\n";
+    if (write(csv_fd, header, strlen(header)) < 0) {
+        log_error("Error escribiendo %s: %s", system_state.sweep_path, strerror(errno));
+        close(csv_fd);
+        return EXIT_FAILURE;
+    }
+    
+    int* lhs_indices = system_state.sweep_lhs && dimensions > 0 ?
+                       sweep_latin_hypercube(system_state.sweep_samples, dimensions) : NULL;
+    
+    size_t size = sizeof(SweepShared) + sizeof(long) * jobs;
+    SweepShared* shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        log_error("Error: No se pudo reservar la memoria del barrido: %s", strerror(errno));
+        free(lhs_indices);
+        close(csv_fd);
+        return EXIT_FAILURE;
+    }
+    atomic_init(&shared->next_task, 0);
+    atomic_init(&shared->completed, 0);
+    for (int w = 0; w < jobs; w++) shared->current[w] = -1;
+    
+    log_message("Barrido (%s): %d parámetros, %ld puntos x %d semillas = %ld misiones en %d procesos → %s",
+               system_state.sweep_lhs ? "hipercubo latino" : "rejilla", dimensions, points,
+               system_state.sweep_seeds, total, jobs, system_state.sweep_path);
+    stop_logger();
+    
+    pid_t* pids = calloc(jobs, sizeof(pid_t));
+    int running = 0;
+    long failed = 0;
+    struct timespec started_at, finished_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+    
+    for (int w = 0; w < jobs; w++) {
+        fflush(stdout);
+        pids[w] = fork();
+        if (pids[w] == 0) {
+            sweep_worker(w, shared, total, lhs_indices, dimensions, csv_fd);
+        }
+        if (pids[w] < 0) {
+            log_error("Error: fork falló: %s", strerror(errno));
+            continue;
+        }
+        running++;
+    }
+    
+    // Si un trabajador muere, su misión queda sin fila y otro proceso lo reemplaza
+    while (running > 0) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            break;
+        }
+        running--;
+        
+        int w = 0;
+        while (w < jobs && pids[w] != pid) w++;
+        if (w == jobs || (WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+            continue;
+        }
+        failed++;
+        log_message("Misión %ld del barrido: FALLÓ (%s %d)", shared->current[w],
+                   WIFSIGNALED(status) ? "señal" : "código", WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+        shared->current[w] = -1;
+        if (atomic_load(&shared->next_task) < total) {
+            fflush(stdout);
+            pids[w] = fork();
+            if (pids[w] == 0) {
+                sweep_worker(w, shared, total, lhs_indices, dimensions, csv_fd);
+            }
+            if (pids[w] > 0) {
+                running++;
+            }
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &finished_at);
+    double elapsed = (finished_at.tv_sec - started_at.tv_sec) + (finished_at.tv_nsec - started_at.tv_nsec) / 1e9;
+    long completed = atomic_load(&shared->completed);
+    log_message("=== BARRIDO TERMINADO: %ld misiones completadas, %ld fallidas (%.1f s, %.1f misiones/s) → %s ===",
+               completed, failed, elapsed, elapsed > 0 ? completed / elapsed : 0.0, system_state.sweep_path);
+    
+    free(pids);
+    free(lhs_indices);
+    munmap(shared, size);
+    close(csv_fd);
+    return failed > 0 && completed == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Función principal (drone_bench incluye este archivo con DRONE_WARS2_LIBRARY y trae la suya)
+#ifndef DRONE_WARS2_LIBRARY
+int main(int argc, char* argv[]) {
+    const char* config_path = "config.txt";
+    const char* compile_output = NULL;
+    const char* replay_path = NULL;
+    int force_virtual = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--virtual") == 0) {
+            force_virtual = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            // La traza de la línea de comandos tiene prioridad sobre config.txt
+            snprintf(trace.path, sizeof(trace.path), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            // El escenario de la línea de comandos tiene prioridad sobre config.txt
+            snprintf(scenario.path, sizeof(scenario.path), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--compile-scenario") == 0 && i + 2 < argc) {
+            // Convertir un escenario (texto o binario) a binario y salir
+            snprintf(scenario.path, sizeof(scenario.path), "%s", argv[++i]);
+            compile_output = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            system_state.batch_runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            system_state.batch_jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ci") == 0 && i + 1 < argc) {
+            system_state.batch_ci = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            // El CSV del barrido de la línea de comandos tiene prioridad sobre config.txt
+            snprintf(system_state.sweep_path, sizeof(system_state.sweep_path), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            // El punto de control de la línea de comandos tiene prioridad sobre config.txt
+            snprintf(checkpoint.path, sizeof(checkpoint.path), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            snprintf(checkpoint.restore_path, sizeof(checkpoint.restore_path), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            // El registro de la línea de comandos tiene prioridad sobre config.txt
+            snprintf(replay.path, sizeof(replay.path), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            // La semilla de la línea de comandos tiene prioridad sobre config.txt
+            system_state.seed = strtoull(argv[++i], NULL, 0);
+            system_state.seed_set = 1;
+        } else {
+            config_path = argv[i];
+        }
+    }
+    
+    system_state.start_time = time(NULL);
+    
+    // Arrancar el hilo de log; al salir (también por exit) se vacía lo pendiente
+    start_logger();
+    atexit(stop_logger);
+    
+    if (compile_output) {
+        return scenario_load(scenario.path) == 0 && scenario_write_binary(compile_output) == 0 ? 0 : EXIT_FAILURE;
+    }
+    
+    // Una misión repetida trae su semilla, su config.txt y su escenario
+    if (replay_path && replay_load(replay_path) != 0) {
+        return EXIT_FAILURE;
+    }
+    
+    // Cargar configuración y, si hay, el escenario
+    load_configuration(config_path);
+    if (scenario.path[0] && (scenario_load(scenario.path) != 0 || scenario_apply() != 0)) {
+        return EXIT_FAILURE;
+    }
+    if (force_virtual || replay.mode == REPLAY_PLAY) {
+        system_state.virtual_time = 1;
+    }
+    if (replay.path[0] && (checkpoint.restore_path[0] || system_state.batch_runs > 0 || system_state.sweep_path[0])) {
+        log_error("Error: el registro de misión no se combina con restore, el lote ni el barrido");
+        return EXIT_FAILURE;
+    }
+    
+    // La flota de un punto de control manda sobre config.txt (el lote necesita saber sus
+    // objetivos antes de crear las corridas); sin --seed sigue con la semilla guardada
+    if (checkpoint.restore_path[0]) {
+        if (system_state.sweep_path[0]) {
+            log_error("Error: el barrido no puede partir de un punto de control");
+            return EXIT_FAILURE;
+        }
+        if (checkpoint_load_configuration(checkpoint.restore_path) != 0) {
+            return EXIT_FAILURE;
+        }
+        system_state.seed_set = 1;
+    }
+    
+    // Sin semilla explícita se toma una nueva y se informa para poder repetir la corrida
+    if (!system_state.seed_set) {
+        system_state.seed = ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid();
+    }
+    
+    // Elegir el kernel de cinemática según la CPU
+    select_kinematics_kernel();
+    
+    if (replay.path[0] && replay.mode == REPLAY_OFF && replay_open_record(config_path) != 0) {
+        return EXIT_FAILURE;
+    }
+    
+    if (system_state.sweep_path[0]) {
+        return run_sweep();
+    }
+    if (system_state.batch_runs > 0) {
+        return run_batch();
+    }
+    
+    log_message("Semilla de la corrida: %llu (repetir con --seed %llu)",
+               (unsigned long long)system_state.seed, (unsigned long long)system_state.seed);
+    
+    run_mission();
     
     log_message("=== DRONE WARS 2 FINALIZADO ===");
     
-    return 0;
+    // Una repetición distinta de la corrida registrada termina con error
+    return replay.mode == REPLAY_PLAY && (replay.divergent_ticks > 0 || !replay.end_matched) ? EXIT_FAILURE : 0;
 }
+#endif
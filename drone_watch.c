@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "drone_shm.h"
+
+// Observador de Drone Wars 2: se conecta a la región compartida de una misión en curso,
+// sigue la telemetría (los mismos registros que la traza binaria) sin copiarla del
+// proceso de la simulación, lee fotos consistentes del mundo y puede mandar comandos a
+// los drones o al centro.
+
+#define POLL_MS 10 // Espera entre pasadas cuando no hay registros nuevos
+#define WAIT_MS 100 // Espera entre intentos de abrir la región con --wait
+#define DOORBELL_BATCH 64 // Comandos encolados entre dos toques del timbre en una ráfaga
+
+// Opciones de la línea de comandos (-1 = sin filtro)
+typedef struct {
+    const char* name;
+    unsigned kind_mask;
+    long drone;
+    long swarm;
+    int status;
+    int snapshot;
+    int wait;
+    int retask_drone;
+    int retask_target;
+    int send_type;
+    int send_target;
+    int send_arg;
+    long burst; // Veces que se encola el comando de --send
+} WatchOptions;
+
+// Registro leído de un anillo, con su anillo para ordenar de forma estable
+typedef struct {
+    TraceRecord record;
+    uint32_t ring;
+} WatchRecord;
+
+// Función para mostrar el uso del observador
+void print_usage(const char* program) {
+    fprintf(stderr,
+            "Uso: %s [opciones]\n"
+            "  --name=/nombre   región compartida (por defecto %s)\n"
+            "  --kind=a,b,...   tipos a mostrar (spawn, state, event, comm_lost, comm_restored,\n"
+            "                   comm_timeout, shot_down, transfer)\n"
+            "  --drone=N        solo el drone N\n"
+            "  --swarm=N        solo registros del enjambre N\n"
+            "  --status         muestra la cabecera y el avance de cada anillo y sale\n"
+            "  --snapshot       muestra la última foto del mundo (con --drone=N, ese drone) y sale\n"
+            "  --wait           espera a que la misión cree la región\n"
+            "  --retask=D:T     manda al drone D al objetivo T y sale\n"
+            "  --send=C[:A...]  encola el comando C al centro y sale: attack, retask:S:T\n"
+            "                   (enjambre S al objetivo T), report_ok:T, report_fail:T o\n"
+            "                   defense:D:0|1 (apaga o enciende la defensa D)\n"
+            "  --burst=N        encola N veces el comando de --send (prueba de carga)\n",
+            program, SHM_DEFAULT_NAME);
+}
+
+// Función para interpretar el nombre de un comando
+int parse_command(const char* name) {
+    size_t count = sizeof(shm_command_names) / sizeof(shm_command_names[0]);
+    for (size_t c = 0; c < count; c++) {
+        size_t length = strlen(shm_command_names[c]);
+        if (strncmp(name, shm_command_names[c], length) == 0 && (name[length] == '\0' || name[length] == ':')) {
+            return (int)c;
+        }
+    }
+    fprintf(stderr, "Comando desconocido: %s\n", name);
+    exit(EXIT_FAILURE);
+}
+
+// Función para leer el reloj monotónico en nanosegundos (el mismo que usa la simulación)
+uint64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Función para dormir unos milisegundos
+void sleep_ms(long ms) {
+    struct timespec delay = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&delay, NULL);
+}
+
+// Función para abrir y mapear la región (solo lectura salvo que haya que mandar comandos)
+char* attach_region(const WatchOptions* options, int writable, size_t* size) {
+    int fd;
+    while ((fd = shm_open(options->name, writable ? O_RDWR : O_RDONLY, 0)) == -1) {
+        if (!options->wait) {
+            perror(options->name);
+            return NULL;
+        }
+        sleep_ms(WAIT_MS);
+    }
+
+    // La simulación dimensiona la región después de crearla
+    struct stat info;
+    while (fstat(fd, &info) == 0 && (size_t)info.st_size < sizeof(ShmHeader)) {
+        sleep_ms(WAIT_MS);
+    }
+    *size = (size_t)info.st_size;
+    char* base = mmap(NULL, *size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+
+    // La firma se escribe al final: esperar a que la cabecera esté completa
+    ShmHeader* header = (ShmHeader*)base;
+    while (memcmp((const char*)header->magic, SHM_MAGIC, sizeof(header->magic)) != 0) {
+        if (!options->wait) {
+            fprintf(stderr, "%s: no es una región de Drone Wars 2\n", options->name);
+            munmap(base, *size);
+            return NULL;
+        }
+        sleep_ms(WAIT_MS);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (header->version != SHM_VERSION || header->header_size != sizeof(ShmHeader)) {
+        fprintf(stderr, "%s: versión %u con cabecera de %u bytes no soportada\n",
+                options->name, header->version, header->header_size);
+        munmap(base, *size);
+        return NULL;
+    }
+    return base;
+}
+
+// Función para abrir la FIFO del centro (comandos de texto y timbre de la cola)
+int open_center() {
+    int fd = open(SHM_CENTER_FIFO, O_WRONLY | O_NONBLOCK);
+    if (fd == -1) {
+        perror(SHM_CENTER_FIFO);
+    }
+    return fd;
+}
+
+// Función para tocar el timbre: con la FIFO llena sobra, el intérprete ya tiene qué leer
+void ring_center(int fd) {
+    if (write(fd, "\n", 1) == -1 && errno != EAGAIN) {
+        perror(SHM_CENTER_FIFO);
+    }
+}
+
+// Función para redirigir un drone: los slots los escribe solo el intérprete de la
+// simulación, así que el pedido va como texto por la FIFO del centro
+int post_retask(int drone_id, int target_id) {
+    char line[64];
+    int length = snprintf(line, sizeof(line), "retask_drone %d %d\n", drone_id, target_id);
+    int fd = open_center();
+    if (fd == -1) {
+        return -1;
+    }
+    int written = write(fd, line, length);
+    close(fd);
+    if (written != length) {
+        perror(SHM_CENTER_FIFO);
+        return -1;
+    }
+    printf("Drone %d: retask al objetivo %d pedido al centro\n", drone_id, target_id);
+    return 0;
+}
+
+// Función para encolar un comando al centro. Con la cola llena toca el timbre y espera a
+// que el intérprete la vacíe (mientras la misión siga en curso).
+int post_center(char* base, int center_fd, int type, int target_id, int arg) {
+    ShmHeader* header = (ShmHeader*)base;
+    ShmCommandQueue* queue = (ShmCommandQueue*)(base + header->queue_offset);
+    uint64_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    ShmCommandCell* cell;
+
+    while (1) {
+        cell = &queue->cells[position & (header->queue_capacity - 1)];
+        uint64_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        if (sequence == position) {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            if (!atomic_load_explicit(&header->running, memory_order_acquire)) {
+                fprintf(stderr, "Cola de comandos del centro llena y la misión terminó\n");
+                return -1;
+            }
+            ring_center(center_fd);
+            sleep_ms(1);
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        } else {
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    cell->type = (uint32_t)type;
+    cell->target_id = target_id;
+    cell->arg = arg;
+    cell->sent_ns = monotonic_ns();
+    snprintf(cell->data, sizeof(cell->data), "drone_watch");
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+    return 0;
+}
+
+// Función para encolar un comando (o una ráfaga del mismo) tocando el timbre del centro
+// cada DOORBELL_BATCH comandos y al final
+int send_center(char* base, const WatchOptions* options) {
+    int center_fd = open_center();
+    if (center_fd == -1) {
+        return -1;
+    }
+    uint64_t start = monotonic_ns();
+    for (long i = 0; i < options->burst; i++) {
+        if (post_center(base, center_fd, options->send_type, options->send_target, options->send_arg) != 0) {
+            close(center_fd);
+            return -1;
+        }
+        if ((i + 1) % DOORBELL_BATCH == 0 || i + 1 == options->burst) {
+            ring_center(center_fd);
+        }
+    }
+    close(center_fd);
+    printf("Centro: %ld x %s (objetivo %d, enjambre %d) encolados en %.3f ms\n",
+           options->burst, shm_command_names[options->send_type], options->send_target, options->send_arg,
+           (monotonic_ns() - start) / 1e6);
+    return 0;
+}
+
+// Función para mostrar la cabecera y el avance de los anillos
+void print_status(const char* base) {
+    const ShmHeader* header = (const ShmHeader*)base;
+    uint32_t used = atomic_load_explicit(&((ShmHeader*)base)->rings_used, memory_order_relaxed);
+    const ShmCommandQueue* queue = (const ShmCommandQueue*)(base + header->queue_offset);
+
+    printf("Misión pid %d, semilla %llu, tick %llu (%s)\n", header->pid,
+           (unsigned long long)header->seed, (unsigned long long)atomic_load(&((ShmHeader*)base)->tick),
+           atomic_load(&((ShmHeader*)base)->running) ? "en curso" : "terminada");
+    printf("Slots de comando: %u; cola del centro: %llu encolados, %llu consumidos de %u\n",
+           header->drone_capacity,
+           (unsigned long long)atomic_load(&((ShmCommandQueue*)queue)->head),
+           (unsigned long long)atomic_load(&((ShmCommandQueue*)queue)->tail), header->queue_capacity);
+    printf("Fotos del mundo: %llu publicadas, %.1f KB cada una\n",
+           (unsigned long long)atomic_load(&((ShmHeader*)base)->snapshots_published),
+           header->snapshot_size / 1024.0);
+    printf("Anillos de telemetría: %u de %u en uso, %u registros cada uno\n",
+           used < header->ring_count ? used : header->ring_count, header->ring_count, header->ring_records);
+    for (uint32_t r = 0; r < used && r < header->ring_count; r++) {
+        ShmTelemetryRing* ring = (ShmTelemetryRing*)(base + header->rings_offset + r * header->ring_size);
+        printf("  anillo %-3u %llu registros publicados\n", r, (unsigned long long)atomic_load(&ring->head));
+    }
+}
+
+// Función para mostrar la última foto del mundo: drones por estado y, con --drone, la
+// posición y el estado de ese drone, todo del mismo tick
+int print_snapshot(char* base, const WatchOptions* options) {
+    ShmHeader* header = (ShmHeader*)base;
+    uint32_t capacity = header->drone_capacity;
+    int32_t* x = malloc(sizeof(int32_t) * capacity);
+    int32_t* y = malloc(sizeof(int32_t) * capacity);
+    int32_t* state = malloc(sizeof(int32_t) * capacity);
+    ShmSnapshot snapshot;
+
+    uint64_t start = monotonic_ns();
+    int retries = shm_snapshot_read(base + header->snapshots_offset, header->snapshot_size,
+                                    &header->snapshots_published, &snapshot, x, y, state, capacity);
+    uint64_t elapsed = monotonic_ns() - start;
+    if (retries < 0) {
+        fprintf(stderr, "%s: la misión todavía no publicó ninguna foto\n", options->name);
+        free(x);
+        free(y);
+        free(state);
+        return -1;
+    }
+
+    printf("Foto del tick %llu (fase %u): %u drones, copiada en %.1f µs (%d reintentos)\n",
+           (unsigned long long)snapshot.tick, snapshot.phase, snapshot.drone_count, elapsed / 1e3, retries);
+    for (int s = 0; s < SHM_SNAPSHOT_STATES; s++) {
+        if (snapshot.state_counts[s] > 0) {
+            printf("  %-20s %u\n", trace_state_names[s], snapshot.state_counts[s]);
+        }
+    }
+    if (options->drone >= 0) {
+        if ((uint32_t)options->drone < snapshot.drone_count) {
+            printf("Drone %ld: (%d, %d) %s\n", options->drone, x[options->drone], y[options->drone],
+                   (uint32_t)state[options->drone] < SHM_SNAPSHOT_STATES ? trace_state_names[state[options->drone]] : "?");
+        } else {
+            printf("Drone %ld: no existe en el tick %llu\n", options->drone, (unsigned long long)snapshot.tick);
+        }
+    }
+    free(x);
+    free(y);
+    free(state);
+    return 0;
+}
+
+// Orden de los registros de una pasada: por tick, y dentro del tick por anillo
+int compare_records(const void* a, const void* b) {
+    const WatchRecord* x = a;
+    const WatchRecord* y = b;
+    if (x->record.tick != y->record.tick) return x->record.tick < y->record.tick ? -1 : 1;
+    return x->ring < y->ring ? -1 : (x->ring > y->ring);
+}
+
+// Función para seguir la telemetría hasta que termine la misión
+void follow_telemetry(const char* base, const WatchOptions* options) {
+    ShmHeader* header = (ShmHeader*)base;
+    uint32_t records = header->ring_records;
+    uint64_t cursor[SHM_RING_COUNT] = {0};
+    int started[SHM_RING_COUNT] = {0};
+    WatchRecord* batch = malloc(sizeof(WatchRecord) * (size_t)records * header->ring_count);
+    unsigned long long shown = 0, lost = 0;
+
+    printf("tick,segundos,tipo,drone,enjambre,valor,aux\n");
+    while (1) {
+        int running = atomic_load_explicit(&header->running, memory_order_acquire);
+        uint32_t used = atomic_load_explicit(&header->rings_used, memory_order_relaxed);
+        size_t count = 0;
+
+        for (uint32_t r = 0; r < used && r < header->ring_count && r < SHM_RING_COUNT; r++) {
+            ShmTelemetryRing* ring = (ShmTelemetryRing*)(base + header->rings_offset + r * header->ring_size);
+            uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            if (!started[r]) {
+                cursor[r] = head > records ? head - records : 0; // Lo más viejo que queda
+                started[r] = 1;
+            }
+            if (head - cursor[r] > records) {
+                lost += head - cursor[r] - records;
+                cursor[r] = head - records;
+            }
+
+            // Leer en el lugar y validar después: lo que el escritor pisó mientras tanto se descarta
+            size_t first = count;
+            for (uint64_t p = cursor[r]; p < head; p++) {
+                batch[count].record = ring->records[p & (records - 1)];
+                batch[count].ring = r;
+                count++;
+            }
+            atomic_thread_fence(memory_order_acquire);
+            uint64_t after = atomic_load_explicit(&ring->head, memory_order_relaxed);
+            for (uint64_t p = cursor[r]; p < head && after - p >= records; p++) {
+                batch[first + (p - cursor[r])].record.kind = TRACE_KIND_COUNT; // Pisado
+                lost++;
+            }
+            cursor[r] = head;
+        }
+
+        qsort(batch, count, sizeof(WatchRecord), compare_records);
+        for (size_t i = 0; i < count; i++) {
+            const TraceRecord* record = &batch[i].record;
+            if (record->kind >= TRACE_KIND_COUNT || !(options->kind_mask & (1u << record->kind))) continue;
+            if (options->drone >= 0 && record->drone_id != (uint32_t)options->drone) continue;
+            if (options->swarm >= 0 && record->swarm_id != (uint32_t)options->swarm) continue;
+
+            shown++;
+            printf("%u,%.1f,%s,%u,%u,%u,%u\n", record->tick, record->tick * header->tick_ms / 1000.0,
+                   trace_kind_names[record->kind], record->drone_id, record->swarm_id, record->value, record->aux);
+        }
+        fflush(stdout);
+
+        if (!running) {
+            break; // Esta pasada ya leyó todo lo publicado antes del final
+        }
+        if (count == 0) {
+            sleep_ms(POLL_MS);
+        }
+    }
+
+    fprintf(stderr, "Misión terminada en el tick %llu: %llu registros mostrados, %llu perdidos\n",
+            (unsigned long long)atomic_load(&header->tick), shown, lost);
+    free(batch);
+}
+
+int main(int argc, char* argv[]) {
+    WatchOptions options = {SHM_DEFAULT_NAME, (1u << TRACE_KIND_COUNT) - 1, -1, -1, 0, 0, 0, -1, -1, -1, -1, -1, 1};
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--name=", 7) == 0) {
+            options.name = argv[i] + 7;
+        } else if (strncmp(argv[i], "--kind=", 7) == 0) {
+            options.kind_mask = parse_kinds(argv[i] + 7);
+        } else if (strncmp(argv[i], "--drone=", 8) == 0) {
+            options.drone = atol(argv[i] + 8);
+        } else if (strncmp(argv[i], "--swarm=", 8) == 0) {
+            options.swarm = atol(argv[i] + 8);
+        } else if (strcmp(argv[i], "--status") == 0) {
+            options.status = 1;
+        } else if (strcmp(argv[i], "--snapshot") == 0) {
+            options.snapshot = 1;
+        } else if (strcmp(argv[i], "--wait") == 0) {
+            options.wait = 1;
+        } else if (strncmp(argv[i], "--retask=", 9) == 0) {
+            if (sscanf(argv[i] + 9, "%d:%d", &options.retask_drone, &options.retask_target) != 2) {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strncmp(argv[i], "--send=", 7) == 0) {
+            options.send_type = parse_command(argv[i] + 7);
+            const char* first = strchr(argv[i] + 7, ':');
+            const char* second = first ? strchr(first + 1, ':') : NULL;
+            if (second && strncmp(argv[i] + 7, "defense", 7) == 0) {
+                options.send_target = atoi(first + 1); // defense:D:0|1
+                options.send_arg = atoi(second + 1);
+            } else if (second) {
+                options.send_arg = atoi(first + 1); // retask:S:T
+                options.send_target = atoi(second + 1);
+            } else {
+                options.send_target = first ? atoi(first + 1) : -1;
+            }
+        } else if (strncmp(argv[i], "--burst=", 8) == 0) {
+            options.burst = atol(argv[i] + 8);
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options.retask_drone >= 0) {
+        return post_retask(options.retask_drone, options.retask_target) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int writable = options.send_type >= 0;
+    size_t size;
+    char* base = attach_region(&options, writable, &size);
+    if (!base) {
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    if (writable) {
+        if (send_center(base, &options) != 0) {
+            status = EXIT_FAILURE;
+        }
+    } else if (options.status) {
+        print_status(base);
+    } else if (options.snapshot) {
+        if (print_snapshot(base, &options) != 0) {
+            status = EXIT_FAILURE;
+        }
+    } else {
+        follow_telemetry(base, &options);
+    }
+
+    munmap(base, size);
+    return status;
+}